@@ -0,0 +1,139 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include <core/Arena.h>
+
+using namespace core;
+
+Arena::Arena(size_t blockSize_)
+  : blockSize(blockSize_), active(0), current(0), usedTotal(0), peak(0)
+{
+}
+
+Arena::~Arena()
+{
+  for (const Block& block : blocks)
+    free(block.data);
+}
+
+void* Arena::allocate(size_t size, size_t align)
+{
+  uintptr_t base, pos;
+
+  assert((align & (align - 1)) == 0);
+
+  if (size == 0)
+    size = 1;
+
+  while (true) {
+    if (active < blocks.size()) {
+      base = (uintptr_t)blocks[active].data;
+      pos = (base + current + align - 1) & ~(uintptr_t)(align - 1);
+      if (pos + size <= base + blocks[active].size) {
+        current = pos + size - base;
+        return (void*)pos;
+      }
+
+      // Doesn't fit, so move on to the next block
+      usedTotal += current;
+      current = 0;
+      active++;
+      if (active < blocks.size())
+        continue;
+    }
+
+    grow(size + align);
+  }
+}
+
+void Arena::release(void* ptr, size_t size)
+{
+  uintptr_t base;
+
+  if (active >= blocks.size())
+    return;
+
+  base = (uintptr_t)blocks[active].data;
+  if ((uintptr_t)ptr + size == base + current)
+    current = (uintptr_t)ptr - base;
+}
+
+void Arena::reset()
+{
+  size_t total;
+
+  total = used();
+  if (total > peak)
+    peak = total;
+
+  // Needed more than one block? Then merge them so the next round
+  // can be served from a single block.
+  if (blocks.size() > 1) {
+    size_t size;
+
+    size = blockSize;
+    while (size < peak)
+      size *= 2;
+
+    for (const Block& block : blocks)
+      free(block.data);
+    blocks.clear();
+
+    grow(size);
+  }
+
+  active = 0;
+  current = 0;
+  usedTotal = 0;
+}
+
+size_t Arena::capacity() const
+{
+  size_t total;
+
+  total = 0;
+  for (const Block& block : blocks)
+    total += block.size;
+
+  return total;
+}
+
+void Arena::grow(size_t size)
+{
+  Block block;
+
+  block.size = blockSize;
+  while (block.size < size)
+    block.size *= 2;
+
+  block.data = (unsigned char*)malloc(block.size);
+  if (block.data == nullptr)
+    throw std::bad_alloc();
+
+  blocks.push_back(block);
+}
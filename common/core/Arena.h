@@ -0,0 +1,121 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef __CORE_ARENA_H__
+#define __CORE_ARENA_H__
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace core {
+
+  /* Arena
+
+     Simple bump allocator for short lived temporaries. Memory is
+     handed out linearly from a set of blocks and is only given back
+     in bulk when reset() is called, making allocations nearly free
+     and avoiding heap churn on hot paths.
+
+     After a reset() the arena keeps enough memory to satisfy the
+     previous round without having to grow again, so a steady
+     workload settles on zero heap allocations.
+  */
+
+  class Arena {
+  public:
+    Arena(size_t blockSize=65536);
+    ~Arena();
+
+    // allocate()
+    //   Returns a block of memory of the given size that stays valid
+    //   until the next reset(). Never returns a null pointer.
+    void* allocate(size_t size, size_t align=sizeof(void*) * 2);
+
+    // release()
+    //   Gives back the most recent allocation, if that is the block
+    //   given. Any other block is left until the next reset().
+    void release(void* ptr, size_t size);
+
+    // reset()
+    //   Invalidates every allocation made so far.
+    void reset();
+
+    // Statistics for the current round
+    size_t used() const { return usedTotal + current; }
+    size_t capacity() const;
+
+  private:
+    void grow(size_t size);
+
+  private:
+    struct Block {
+      unsigned char* data;
+      size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t active;
+    size_t current;
+    size_t usedTotal;
+    size_t peak;
+  };
+
+  /* ArenaAllocator
+
+     Standard allocator that puts a container's storage in an Arena.
+     Deallocation is a no-op except for the most recent block, which
+     means that a temporary container gives its memory back to the
+     arena when it goes out of scope.
+  */
+
+  template<class T>
+  class ArenaAllocator {
+  public:
+    typedef T value_type;
+
+    ArenaAllocator(Arena* arena_) : arena(arena_) {}
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+      return (T*)arena->allocate(n * sizeof(T), alignof(T));
+    }
+    void deallocate(T* p, size_t n) {
+      arena->release(p, n * sizeof(T));
+    }
+
+    template<class U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+      return arena == other.arena;
+    }
+    template<class U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+      return arena != other.arena;
+    }
+
+  private:
+    template<class U> friend class ArenaAllocator;
+
+    Arena* arena;
+  };
+
+}
+
+#endif
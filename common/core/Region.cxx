@@ -21,6 +21,7 @@
 #include <config.h>
 #endif
 
+#include <core/Arena.h>
 #include <core/LogWriter.h>
 #include <core/Region.h>
 
@@ -44,6 +45,20 @@ Region::Region(const Rect& r)
   pixman_region_init_rect(rgn, r.tl.x, r.tl.y, r.width(), r.height());
 }
 
+Region::Region(const std::vector<Rect>& rects)
+{
+  std::vector<pixman_box16_t> boxes;
+
+  boxes.reserve(rects.size());
+  for (const Rect& r : rects)
+    boxes.push_back({(int16_t)r.tl.x, (int16_t)r.tl.y,
+                     (int16_t)r.br.x, (int16_t)r.br.y});
+
+  // pixman sorts and merges everything in a single pass
+  rgn = new struct pixman_region16;
+  pixman_region_init_rects(rgn, boxes.data(), boxes.size());
+}
+
 Region::Region(const Region& r)
 {
   rgn = new struct pixman_region16;
@@ -96,6 +111,34 @@ void Region::assign_subtract(const Region& r)
   pixman_region_subtract(rgn, rgn, r.rgn);
 }
 
+void Region::assign_intersect(const Rect& r)
+{
+  pixman_region16_t tmp;
+
+  // A single rectangle region needs no extra storage
+  pixman_region_init_rect(&tmp, r.tl.x, r.tl.y, r.width(), r.height());
+  pixman_region_intersect(rgn, rgn, &tmp);
+  pixman_region_fini(&tmp);
+}
+
+void Region::assign_union(const Rect& r)
+{
+  pixman_region16_t tmp;
+
+  pixman_region_init_rect(&tmp, r.tl.x, r.tl.y, r.width(), r.height());
+  pixman_region_union(rgn, rgn, &tmp);
+  pixman_region_fini(&tmp);
+}
+
+void Region::assign_subtract(const Rect& r)
+{
+  pixman_region16_t tmp;
+
+  pixman_region_init_rect(&tmp, r.tl.x, r.tl.y, r.width(), r.height());
+  pixman_region_subtract(rgn, rgn, &tmp);
+  pixman_region_fini(&tmp);
+}
+
 Region Region::intersect(const Region& r) const
 {
   Region ret;
@@ -132,7 +175,8 @@ int Region::numRects() const
   return pixman_region_n_rects(rgn);
 }
 
-bool Region::get_rects(std::vector<Rect>* rects,
+template<class Allocator>
+bool Region::get_rects(std::vector<Rect, Allocator>* rects,
                        bool left2right, bool topdown) const
 {
   int nRects;
@@ -175,6 +219,11 @@ bool Region::get_rects(std::vector<Rect>* rects,
   return !rects->empty();
 }
 
+template bool Region::get_rects(std::vector<Rect, std::allocator<Rect>>*,
+                                bool, bool) const;
+template bool Region::get_rects(std::vector<Rect, ArenaAllocator<Rect>>*,
+                                bool, bool) const;
+
 Rect Region::get_bounding_rect() const
 {
   const pixman_box16_t* extents;
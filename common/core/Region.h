@@ -39,6 +39,9 @@ namespace core {
     Region();
     // Create a rectangular region
     Region(const Rect& r);
+    // Create a region covering many (possibly overlapping) rectangles,
+    // which is much faster than adding them one at a time
+    Region(const std::vector<Rect>& rects);
 
     Region(const Region& r);
     Region &operator=(const Region& src);
@@ -55,6 +58,11 @@ namespace core {
     void assign_union(const Region& r);
     void assign_subtract(const Region& r);
 
+    // Same as above, but without creating a temporary Region
+    void assign_intersect(const Rect& r);
+    void assign_union(const Rect& r);
+    void assign_subtract(const Rect& r);
+
     // the following three operations return a new region:
 
     Region intersect(const Region& r) const
@@ -69,8 +77,10 @@ namespace core {
     int numRects() const;
     bool is_empty() const { return numRects() == 0; }
 
-    bool get_rects(std::vector<Rect>* rects, bool left2right=true,
-                   bool topdown=true) const;
+    // Available for std::allocator and ArenaAllocator
+    template<class Allocator>
+    bool get_rects(std::vector<Rect, Allocator>* rects,
+                   bool left2right=true, bool topdown=true) const;
     Rect get_bounding_rect() const;
 
     void debug_print(const char *prefix) const;
@@ -27,6 +27,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <core/string.h>
 
 namespace core {
@@ -155,109 +159,229 @@ namespace core {
     return out;
   }
 
-  std::string convertLF(const char* src, size_t bytes)
-  {
-    size_t sz;
-    std::string out;
+  // How convertText() should treat line endings
+  enum LineEnding { keepLineEndings, lfLineEndings, crlfLineEndings };
 
-    const char* in;
-    size_t in_len;
-
-    // Compute output size
-    sz = 0;
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      if (*in != '\r') {
-        sz++;
-        in++;
-        in_len--;
-        continue;
+  // Returns how many bytes at the start of src can be copied as is,
+  // i.e. everything up to the first byte that needs to be looked at
+  // more closely
+  static inline size_t plainLength(const char* src, size_t bytes,
+                                   bool stopAtHigh, bool stopAtCR,
+                                   bool stopAtLF)
+  {
+    size_t len;
+
+    len = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cr = _mm_set1_epi8(stopAtCR ? '\r' : '\0');
+    const __m128i lf = _mm_set1_epi8(stopAtLF ? '\n' : '\0');
+
+    while ((bytes - len) >= 16) {
+      __m128i data, special;
+      int mask;
+
+      data = _mm_loadu_si128((const __m128i*)(src + len));
+
+      special = _mm_cmpeq_epi8(data, zero);
+      special = _mm_or_si128(special, _mm_cmpeq_epi8(data, cr));
+      special = _mm_or_si128(special, _mm_cmpeq_epi8(data, lf));
+
+      // Anything non-ASCII already has the top bit set
+      if (stopAtHigh)
+        special = _mm_or_si128(special, data);
+
+      mask = _mm_movemask_epi8(special);
+      if (mask != 0) {
+#ifdef __GNUC__
+        return len + __builtin_ctz(mask);
+#else
+        while (!(mask & 1)) {
+          mask >>= 1;
+          len++;
+        }
+        return len;
+#endif
       }
 
-      if ((in_len < 2) || (*(in+1) != '\n'))
-        sz++;
-
-      in++;
-      in_len--;
+      len += 16;
     }
+#endif
 
-    // Reserve space
-    out.reserve(sz);
+    while (len < bytes) {
+      unsigned char c;
 
-    // And convert
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      if (*in != '\r') {
-        out += *in++;
-        in_len--;
-        continue;
-      }
+      c = src[len];
 
-      if ((in_len < 2) || (*(in+1) != '\n'))
-        out += '\n';
+      if (c == '\0')
+        break;
+      if (stopAtHigh && (c & 0x80))
+        break;
+      if (stopAtCR && (c == '\r'))
+        break;
+      if (stopAtLF && (c == '\n'))
+        break;
 
-      in++;
-      in_len--;
+      len++;
     }
 
-    return out;
+    return len;
   }
 
-  std::string convertCRLF(const char* src, size_t bytes)
+  // Converts encoding and line endings in a single pass. Anything
+  // that can be kept as is gets copied in as long runs as possible, and
+  // plain ASCII is skipped over in bulk. If both encodings are Latin-1
+  // then the data is treated as opaque bytes and only the line endings
+  // are changed. Invalid UTF-8 is copied as is, or replaced with '?'
+  // for Latin-1, and reported by returning false.
+  static bool convertText(const char* src, size_t bytes,
+                          bool srcUTF8, bool dstUTF8, LineEnding eol,
+                          std::string* dst)
   {
-    std::string out;
-    size_t sz;
+    bool stopAtHigh, stopAtCR, stopAtLF;
+    const char* run;
+    bool valid;
 
-    const char* in;
-    size_t in_len;
+    stopAtHigh = srcUTF8 || dstUTF8;
+    stopAtCR = eol != keepLineEndings;
+    stopAtLF = eol == crlfLineEndings;
 
-    // Compute output size
-    sz = 0;
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      sz++;
+    valid = true;
+
+    if (bytes == (size_t)-1)
+      bytes = strlen(src);
+
+    dst->clear();
+    dst->reserve(bytes);
+
+    run = src;
+
+    while (bytes > 0) {
+      size_t len;
+      unsigned char c;
+      unsigned ucs;
+
+      len = plainLength(src, bytes, stopAtHigh, stopAtCR, stopAtLF);
+      src += len;
+      bytes -= len;
 
-      if (*in == '\r') {
-        if ((in_len < 2) || (*(in+1) != '\n'))
-          sz++;
-      } else if (*in == '\n') {
-        if ((in == src) || (*(in-1) != '\r'))
-          sz++;
+      if (bytes == 0)
+        break;
+
+      c = *src;
+
+      if (c == '\0')
+        break;
+
+      if ((c == '\r') || (c == '\n')) {
+        dst->append(run, src - run);
+
+        if (c == '\r') {
+          if ((bytes >= 2) && (src[1] == '\n')) {
+            // Already CRLF, or the LF will be copied with the next run
+            if (eol == crlfLineEndings) {
+              dst->append("\r\n", 2);
+              src++;
+              bytes--;
+            }
+          } else {
+            if (eol == crlfLineEndings)
+              dst->append("\r\n", 2);
+            else
+              dst->push_back('\n');
+          }
+        } else {
+          // Any CRLF pairs have already been dealt with above
+          dst->append("\r\n", 2);
+        }
+
+        src++;
+        bytes--;
+        run = src;
+        continue;
       }
 
-      in++;
-      in_len--;
-    }
+      if (!srcUTF8) {
+        char buf[2];
 
-    // Reserve space
-    out.reserve(sz);
+        dst->append(run, src - run);
 
-    // And convert
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      if (*in == '\n') {
-        if ((in == src) || (*(in-1) != '\r'))
-          out += '\r';
+        buf[0] = 0xc0 | (c >> 6);
+        buf[1] = 0x80 | (c & 0x3f);
+        dst->append(buf, 2);
+
+        src++;
+        bytes--;
+        run = src;
+        continue;
       }
 
-      out += *in;
+      len = utf8ToUCS4(src, bytes, &ucs);
+      if (ucs == 0xfffd) {
+        valid = false;
+
+        // Truncated sequences are reported as longer than what is
+        // left, and the byte that broke the sequence is included. We
+        // need to look at that byte if it is ASCII, though.
+        if (len > bytes)
+          len = bytes;
+        if ((len > 1) && ((src[len-1] & 0x80) == 0))
+          len--;
+      }
 
-      if (*in == '\r') {
-        if ((in_len < 2) || (*(in+1) != '\n'))
-          out += '\n';
+      if (!dstUTF8) {
+        dst->append(run, src - run);
+        if (ucs > 0xff)
+          dst->push_back('?');
+        else
+          dst->push_back(ucs);
+        run = src + len;
       }
 
-      in++;
-      in_len--;
+      src += len;
+      bytes -= len;
     }
 
+    dst->append(run, src - run);
+
+    return valid;
+  }
+
+  std::string convertLF(const char* src, size_t bytes)
+  {
+    std::string out;
+    convertText(src, bytes, false, false, lfLineEndings, &out);
+    return out;
+  }
+
+  std::string convertCRLF(const char* src, size_t bytes)
+  {
+    std::string out;
+    convertText(src, bytes, false, false, crlfLineEndings, &out);
     return out;
   }
 
+  bool utf8ToLF(const char* src, size_t bytes, std::string* dst)
+  {
+    return convertText(src, bytes, true, true, lfLineEndings, dst);
+  }
+
+  bool utf8ToCRLF(const char* src, size_t bytes, std::string* dst)
+  {
+    return convertText(src, bytes, true, true, crlfLineEndings, dst);
+  }
+
+  void latin1ToUTF8LF(const char* src, size_t bytes, std::string* dst)
+  {
+    convertText(src, bytes, false, true, lfLineEndings, dst);
+  }
+
+  bool utf8ToLatin1(const char* src, size_t bytes, std::string* dst)
+  {
+    return convertText(src, bytes, true, false, keepLineEndings, dst);
+  }
+
   size_t ucs4ToUTF8(unsigned src, char dst[5]) {
     if (src < 0x80) {
       *dst++ = src;
@@ -403,80 +527,13 @@ namespace core {
 
   std::string latin1ToUTF8(const char* src, size_t bytes) {
     std::string out;
-    size_t sz;
-
-    const char* in;
-    size_t in_len;
-
-    // Compute output size
-    sz = 0;
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      char buf[5];
-      sz += ucs4ToUTF8(*(const unsigned char*)in, buf);
-      in++;
-      in_len--;
-    }
-
-    // Reserve space
-    out.reserve(sz);
-
-    // And convert
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      char buf[5];
-      ucs4ToUTF8(*(const unsigned char*)in, buf);
-      out += buf;
-      in++;
-      in_len--;
-    }
-
+    convertText(src, bytes, false, true, keepLineEndings, &out);
     return out;
   }
 
   std::string utf8ToLatin1(const char* src, size_t bytes) {
     std::string out;
-    size_t sz;
-
-    const char* in;
-    size_t in_len;
-
-    // Compute output size
-    sz = 0;
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      size_t len;
-      unsigned ucs;
-
-      len = utf8ToUCS4(in, in_len, &ucs);
-      in += len;
-      in_len -= len;
-      sz++;
-    }
-
-    // Reserve space
-    out.reserve(sz);
-
-    // And convert
-    in = src;
-    in_len = bytes;
-    while ((in_len > 0) && (*in != '\0')) {
-      size_t len;
-      unsigned ucs;
-
-      len = utf8ToUCS4(in, in_len, &ucs);
-      in += len;
-      in_len -= len;
-
-      if (ucs > 0xff)
-        out += '?';
-      else
-        out += (unsigned char)ucs;
-    }
-
+    convertText(src, bytes, true, false, keepLineEndings, &out);
     return out;
   }
 
@@ -620,10 +677,20 @@ namespace core {
 
   bool isValidUTF8(const char* str, size_t bytes)
   {
-    while ((bytes > 0) && (*str != '\0')) {
+    if (bytes == (size_t)-1)
+      bytes = strlen(str);
+
+    while (bytes > 0) {
       size_t len;
       unsigned ucs;
 
+      len = plainLength(str, bytes, true, false, false);
+      str += len;
+      bytes -= len;
+
+      if ((bytes == 0) || (*str == '\0'))
+        break;
+
       len = utf8ToUCS4(str, bytes, &ucs);
       str += len;
       bytes -= len;
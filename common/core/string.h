@@ -51,6 +51,16 @@ namespace core {
   std::string convertLF(const char* src, size_t bytes = (size_t)-1);
   std::string convertCRLF(const char* src, size_t bytes = (size_t)-1);
 
+  // Clipboard conversions that validate, change encoding and fix line
+  // endings in a single pass. The result is written to an existing
+  // string so that its memory can be reused. The ones taking UTF-8
+  // return false if it isn't valid.
+
+  bool utf8ToLF(const char* src, size_t bytes, std::string* dst);
+  bool utf8ToCRLF(const char* src, size_t bytes, std::string* dst);
+  void latin1ToUTF8LF(const char* src, size_t bytes, std::string* dst);
+  bool utf8ToLatin1(const char* src, size_t bytes, std::string* dst);
+
   // Convertions between various Unicode formats
 
   size_t ucs4ToUTF8(unsigned src, char dst[5]);
@@ -32,7 +32,8 @@ static const size_t DEFAULT_BUF_SIZE = 16384;
 static const size_t MAX_BUF_SIZE = 32 * 1024 * 1024;
 
 BufferedOutStream::BufferedOutStream(bool emulateCork_)
-  : bufSize(DEFAULT_BUF_SIZE), offset(0), emulateCork(emulateCork_)
+  : bufSize(DEFAULT_BUF_SIZE), offset(0), emulateCork(emulateCork_),
+    callback(nullptr), reportedBufferedData(false)
 {
   ptr = start = sentUpTo = new uint8_t[bufSize];
   end = start + bufSize;
@@ -74,6 +75,12 @@ void BufferedOutStream::flush()
   if (sentUpTo == ptr)
     ptr = sentUpTo = start;
 
+  if ((callback != nullptr) &&
+      (hasBufferedData() != reportedBufferedData)) {
+    reportedBufferedData = hasBufferedData();
+    callback->bufferedDataChanged(this);
+  }
+
   // Time to shrink an excessive buffer?
   gettimeofday(&now, nullptr);
   if ((sentUpTo == ptr) && (bufSize > DEFAULT_BUF_SIZE) &&
@@ -103,6 +110,17 @@ bool BufferedOutStream::hasBufferedData()
   return sentUpTo != ptr;
 }
 
+size_t BufferedOutStream::bufferUsage()
+{
+  return ptr - sentUpTo;
+}
+
+void BufferedOutStream::setCallback(Callback* cb)
+{
+  callback = cb;
+  reportedBufferedData = hasBufferedData();
+}
+
 void BufferedOutStream::overrun(size_t needed)
 {
   bool oldCorked;
@@ -32,6 +32,17 @@ namespace rdr {
 
   class BufferedOutStream : public OutStream {
 
+  public:
+    // Callback is notified when hasBufferedData() changes after a
+    // flush, so that an event loop only needs to update its interest
+    // in the stream when there is an actual change
+
+    class Callback {
+    public:
+      virtual ~Callback() {}
+      virtual void bufferedDataChanged(BufferedOutStream* stream) = 0;
+    };
+
   public:
     virtual ~BufferedOutStream();
 
@@ -42,6 +53,15 @@ namespace rdr {
 
     bool hasBufferedData();
 
+    // bufferUsage() returns the number of bytes yet to be flushed
+
+    size_t bufferUsage();
+
+    // setCallback() sets the object to notify of changes in
+    // hasBufferedData(), or nullptr to stop notifications
+
+    void setCallback(Callback* cb);
+
   private:
     // flushBuffer() requests that the stream be flushed. Returns true if it is
     // able to progress the output (which might still not mean any bytes
@@ -61,6 +81,9 @@ namespace rdr {
 
     bool emulateCork;
 
+    Callback* callback;
+    bool reportedBufferedData;
+
   protected:
     uint8_t* sentUpTo;
 
@@ -57,7 +57,7 @@ FdOutStream::FdOutStream(int fd_)
 #else
   : BufferedOutStream(true),
 #endif
-  fd(fd_)
+  fd(fd_), sendLowWater(0)
 {
   gettimeofday(&lastWrite, nullptr);
 }
@@ -81,9 +81,33 @@ void FdOutStream::cork(bool enable)
 #endif
 }
 
+bool FdOutStream::setSendLowWater(size_t bytes)
+{
+#ifdef TCP_NOTSENT_LOWAT
+  int value = bytes;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                 (char *)&value, sizeof(value)) < 0)
+    return false;
+
+  sendLowWater = bytes;
+
+  return true;
+#else
+  (void)bytes;
+  return false;
+#endif
+}
+
 bool FdOutStream::flushBuffer()
 {
-  size_t n = writeFd(sentUpTo, ptr - sentUpTo);
+  size_t length = ptr - sentUpTo;
+
+  // The kernel only reports the socket as writable once it is below
+  // the low water mark, so don't hand it much more than that at once
+  if ((sendLowWater != 0) && (length > sendLowWater))
+    length = sendLowWater;
+
+  size_t n = writeFd(sentUpTo, length);
   if (n == 0)
     return false;
 
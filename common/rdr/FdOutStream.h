@@ -43,10 +43,16 @@ namespace rdr {
 
     void cork(bool enable) override;
 
+    // Limits how much unsent data the kernel may hold on to. Anything
+    // beyond that stays buffered here until the connection has caught
+    // up, so that it can still be replaced by fresher data.
+    bool setSendLowWater(size_t bytes);
+
   private:
     bool flushBuffer() override;
     size_t writeFd(const uint8_t* data, size_t length);
     int fd;
+    size_t sendLowWater;
     struct timeval lastWrite;
   };
 
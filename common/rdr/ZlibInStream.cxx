@@ -96,15 +96,22 @@ bool ZlibInStream::fillBuffer()
   zs->next_out = (uint8_t*)end;
   zs->avail_out = availSpace();
 
-  if (!underlying->hasData(1))
-    return false;
-  size_t length = underlying->avail();
-  if (length > bytesIn)
-    length = bytesIn;
+  // zlib might still have output pending even if all input has been
+  // consumed, so only touch the underlying stream if there is more
+  size_t length = 0;
+  if (bytesIn > 0) {
+    if (!underlying->hasData(1))
+      return false;
+    length = underlying->avail();
+    if (length > bytesIn)
+      length = bytesIn;
+  }
   zs->next_in = (uint8_t*)underlying->getptr(length);
   zs->avail_in = length;
 
   int rc = inflate(zs, Z_SYNC_FLUSH);
+  if ((rc == Z_BUF_ERROR) && (length == 0))
+    return false;
   if (rc < 0) {
     throw std::runtime_error("ZlibInStream: inflate failed");
   }
@@ -21,6 +21,7 @@
 #include <config.h>
 #endif
 
+#include <assert.h>
 #include <stdio.h>
 
 #include <core/LogWriter.h>
@@ -36,7 +37,8 @@ static core::LogWriter vlog("ZlibOutStream");
 using namespace rdr;
 
 ZlibOutStream::ZlibOutStream(OutStream* os, int compressLevel)
-  : underlying(os), compressionLevel(compressLevel), newLevel(compressLevel)
+  : underlying(os), compressionLevel(compressLevel), newLevel(compressLevel),
+    checkpointed(false), savedLevel(compressLevel), saved(nullptr)
 {
   zs = new z_stream;
   zs->zalloc    = nullptr;
@@ -56,6 +58,7 @@ ZlibOutStream::~ZlibOutStream()
     flush();
   } catch (std::exception&) {
   }
+  commit();
   deflateEnd(zs);
   delete zs;
 }
@@ -89,8 +92,58 @@ void ZlibOutStream::cork(bool enable)
     underlying->cork(enable);
 }
 
+void ZlibOutStream::checkpoint()
+{
+  assert(ptr == sentUpTo);
+
+  commit();
+
+  checkpointed = true;
+  savedLevel = compressionLevel;
+}
+
+void ZlibOutStream::commit()
+{
+  checkpointed = false;
+
+  if (saved != nullptr) {
+    deflateEnd(saved);
+    delete saved;
+    saved = nullptr;
+  }
+}
+
+void ZlibOutStream::rollback()
+{
+  assert(checkpointed);
+
+  // Anything not yet compressed can simply be forgotten
+  ptr = sentUpTo;
+
+  if (saved != nullptr) {
+    deflateEnd(zs);
+    delete zs;
+    zs = saved;
+    saved = nullptr;
+  }
+
+  compressionLevel = savedLevel;
+  checkpointed = false;
+}
+
 bool ZlibOutStream::flushBuffer()
 {
+  // The state is only copied once it is about to change, as it is
+  // fairly large and most checkpoints never see any data
+  if (checkpointed && (saved == nullptr)) {
+    saved = new z_stream;
+    if (deflateCopy(saved, zs) != Z_OK) {
+      delete saved;
+      saved = nullptr;
+      throw std::runtime_error("ZlibOutStream: deflateCopy failed");
+    }
+  }
+
   checkCompressionLevel();
 
   zs->next_in = sentUpTo;
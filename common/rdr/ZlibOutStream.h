@@ -43,6 +43,14 @@ namespace rdr {
     void flush() override;
     void cork(bool enable) override;
 
+    // checkpoint() remembers the current compression state so that
+    // rollback() can return to it, forgetting everything written in
+    // between. commit() drops the remembered state again. Everything
+    // must have been flushed when calling checkpoint().
+    void checkpoint();
+    void commit();
+    void rollback();
+
   private:
     bool flushBuffer() override;
     void deflate(int flush);
@@ -52,6 +60,10 @@ namespace rdr {
     int compressionLevel;
     int newLevel;
     z_stream_s* zs;
+
+    bool checkpointed;
+    int savedLevel;
+    z_stream_s* saved;
   };
 
 } // end of namespace rdr
@@ -37,12 +37,14 @@
 #include <rfb/CMsgReader.h>
 #include <rfb/CMsgWriter.h>
 #include <rfb/CSecurity.h>
+#include <rfb/ClientParams.h>
 #include <rfb/Cursor.h>
 #include <rfb/Decoder.h>
 #include <rfb/KeysymStr.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/Security.h>
 #include <rfb/SecurityClient.h>
+#include <rfb/SharedPixelBuffer.h>
 #include <rfb/CConnection.h>
 
 #define XK_MISCELLANY
@@ -64,11 +66,13 @@ CConnection::CConnection()
   : csecurity(nullptr),
     supportsLocalCursor(false), supportsCursorPosition(false),
     supportsDesktopResize(false), supportsLEDState(false),
+    supportsSharedMemory(false),
     is(nullptr), os(nullptr), reader_(nullptr), writer_(nullptr),
     shared(false),
     state_(RFBSTATE_UNINITIALISED),
     pendingPFChange(false), preferredEncoding(encodingTight),
     compressLevel(2), qualityLevel(-1),
+    fineQualityLevel(-1), subsampling(subsampleUndefined),
     formatChange(false), encodingChange(false),
     firstUpdate(true), pendingUpdate(false), continuousUpdates(false),
     forceNonincremental(true),
@@ -467,6 +471,32 @@ void CConnection::setCursorPos(const core::Point& /*pos*/)
 {
 }
 
+void CConnection::setSharedFramebuffer(int width, int height,
+                                       const PixelFormat& pf,
+                                       unsigned pid, int fd,
+                                       uint32_t serial)
+{
+  SharedPixelBuffer* fb;
+
+  try {
+    fb = new SharedPixelBuffer(pf, width, height, pid, fd);
+  } catch (std::exception& e) {
+    vlog.error("Unable to use shared framebuffer: %s", e.what());
+
+    // Whatever the server put in it is lost, so we need it again
+    // using a normal encoding
+    decoder.setSharedFramebuffer(nullptr, 0);
+    supportsSharedMemory = false;
+    encodingChange = true;
+    refreshFramebuffer();
+    return;
+  }
+
+  vlog.debug("Using shared framebuffer from process %u", pid);
+
+  decoder.setSharedFramebuffer(fb, serial);
+}
+
 void CConnection::setName(const char* name)
 {
   server.setName(name);
@@ -704,11 +734,12 @@ void CConnection::handleClipboardProvide(uint32_t flags,
   }
 
   // FIXME: This conversion magic should be in CMsgReader
-  if (!core::isValidUTF8((const char*)data[0], lengths[0])) {
+  if (!core::utf8ToLF((const char*)data[0], lengths[0],
+                      &clipboardBuffer)) {
     vlog.error("Invalid UTF-8 sequence in clipboard - ignoring");
     return;
   }
-  serverClipboard = core::convertLF((const char*)data[0], lengths[0]);
+  serverClipboard.swap(clipboardBuffer);
   hasRemoteClipboard = true;
 
   // FIXME: Should probably verify that this data was actually requested
@@ -775,9 +806,9 @@ void CConnection::sendClipboardData(const char* data)
 {
   if (server.clipboardFlags() & rfb::clipboardProvide) {
     // FIXME: This conversion magic should be in CMsgWriter
-    std::string filtered(core::convertCRLF(data));
-    size_t sizes[1] = { filtered.size() + 1 };
-    const uint8_t* datas[1] = { (const uint8_t*)filtered.c_str() };
+    core::utf8ToCRLF(data, strlen(data), &clipboardBuffer);
+    size_t sizes[1] = { clipboardBuffer.size() + 1 };
+    const uint8_t* datas[1] = { (const uint8_t*)clipboardBuffer.c_str() };
 
     if (unsolicitedClipboardAttempt) {
       unsolicitedClipboardAttempt = false;
@@ -930,6 +961,31 @@ int CConnection::getQualityLevel()
   return qualityLevel;
 }
 
+void CConnection::setFineQualityLevel(int quality, int subsampling_)
+{
+  if ((fineQualityLevel == quality) && (subsampling == subsampling_))
+    return;
+
+  fineQualityLevel = quality;
+  subsampling = subsampling_;
+  encodingChange = true;
+}
+
+int CConnection::getFineQualityLevel()
+{
+  return fineQualityLevel;
+}
+
+int CConnection::getSubsampling()
+{
+  return subsampling;
+}
+
+unsigned long long CConnection::getDecodeTime()
+{
+  return decoder.getDecodeTime();
+}
+
 void CConnection::setPF(const PixelFormat& pf)
 {
   if (server.pf() == pf && !formatChange)
@@ -1003,6 +1059,7 @@ void CConnection::updateEncodings()
     encodings.push_back(pseudoEncodingVMwareCursor);
     encodings.push_back(pseudoEncodingCursor);
     encodings.push_back(pseudoEncodingXCursor);
+    encodings.push_back(pseudoEncodingCursorCache);
   }
   if (supportsCursorPosition) {
     encodings.push_back(pseudoEncodingVMwareCursorPosition);
@@ -1010,11 +1067,15 @@ void CConnection::updateEncodings()
   if (supportsDesktopResize) {
     encodings.push_back(pseudoEncodingDesktopSize);
     encodings.push_back(pseudoEncodingExtendedDesktopSize);
+    // setFramebuffer() keeps whatever still fits
+    encodings.push_back(pseudoEncodingPreserveOnResize);
   }
   if (supportsLEDState) {
     encodings.push_back(pseudoEncodingLEDState);
     encodings.push_back(pseudoEncodingVMwareLEDState);
   }
+  if (supportsSharedMemory && SharedPixelBuffer::isSupported())
+    encodings.push_back(pseudoEncodingSharedMemory);
 
   encodings.push_back(pseudoEncodingDesktopName);
   encodings.push_back(pseudoEncodingLastRect);
@@ -1045,6 +1106,29 @@ void CConnection::updateEncodings()
   if (!noJpeg) {
     if (qualityLevel >= 0 && qualityLevel <= 9)
       encodings.push_back(pseudoEncodingQualityLevel0 + qualityLevel);
+    if (fineQualityLevel >= 0 && fineQualityLevel <= 100)
+      encodings.push_back(pseudoEncodingFineQualityLevel0 +
+                          fineQualityLevel);
+    switch (subsampling) {
+    case subsampleNone:
+      encodings.push_back(pseudoEncodingSubsamp1X);
+      break;
+    case subsampleGray:
+      encodings.push_back(pseudoEncodingSubsampGray);
+      break;
+    case subsample2X:
+      encodings.push_back(pseudoEncodingSubsamp2X);
+      break;
+    case subsample4X:
+      encodings.push_back(pseudoEncodingSubsamp4X);
+      break;
+    case subsample8X:
+      encodings.push_back(pseudoEncodingSubsamp8X);
+      break;
+    case subsample16X:
+      encodings.push_back(pseudoEncodingSubsamp16X);
+      break;
+    }
   }
 
   writer()->writeSetEncodings(encodings);
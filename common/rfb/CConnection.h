@@ -153,6 +153,16 @@ namespace rfb {
     int getCompressLevel();
     void setQualityLevel(int level);
     int getQualityLevel();
+    // setFineQualityLevel() adds a precise JPEG quality (0-100) and
+    // chroma subsampling to the encoding hints. Servers that don't
+    // understand them will use the normal quality level instead. Use
+    // -1 and subsampleUndefined to leave them out.
+    void setFineQualityLevel(int quality, int subsampling);
+    int getFineQualityLevel();
+    int getSubsampling();
+    // getDecodeTime() returns the total time in microseconds spent
+    // decoding rects so far
+    unsigned long long getDecodeTime();
     // setPF() controls the pixel format requested from the server.
     // server.pf() will automatically be adjusted once the new format
     // is active.
@@ -212,6 +222,10 @@ namespace rfb {
     void setCursor(int width, int height, const core::Point& hotspot,
                    const uint8_t* data) override;
     void setCursorPos(const core::Point& pos) override;
+    void setSharedFramebuffer(int width, int height,
+                              const PixelFormat& pf,
+                              unsigned pid, int fd,
+                              uint32_t serial) override;
 
     void setName(const char* name) override;
 
@@ -301,6 +315,8 @@ namespace rfb {
     bool supportsCursorPosition;
     bool supportsDesktopResize;
     bool supportsLEDState;
+    // Only meaningful if the server is on the same host
+    bool supportsSharedMemory;
 
   private:
     bool processVersionMsg();
@@ -331,6 +347,8 @@ namespace rfb {
     int preferredEncoding;
     int compressLevel;
     int qualityLevel;
+    int fineQualityLevel;
+    int subsampling;
 
     bool formatChange;
     rfb::PixelFormat nextPF;
@@ -346,6 +364,9 @@ namespace rfb {
     DecodeManager decoder;
 
     std::string serverClipboard;
+    // Scratch space for clipboard conversions, kept around so that its
+    // memory can be reused
+    std::string clipboardBuffer;
     bool hasRemoteClipboard;
     bool hasLocalClipboard;
     bool unsolicitedClipboardAttempt;
@@ -51,6 +51,10 @@ namespace rfb {
                            core::Point& hotspot,
                            const uint8_t* data) = 0;
     virtual void setCursorPos(const core::Point& pos) = 0;
+    virtual void setSharedFramebuffer(int width, int height,
+                                      const PixelFormat& pf,
+                                      unsigned pid, int fd,
+                                      uint32_t serial) = 0;
     virtual void setName(const char* name) = 0;
     virtual void fence(uint32_t flags, unsigned len,
                        const uint8_t data[]) = 0;
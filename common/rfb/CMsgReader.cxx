@@ -34,9 +34,11 @@
 
 #include <rfb/msgTypes.h>
 #include <rfb/clipboardTypes.h>
+#include <rfb/cursorCacheTypes.h>
 #include <rfb/Exception.h>
 #include <rfb/CMsgHandler.h>
 #include <rfb/CMsgReader.h>
+#include <rfb/Cursor.h>
 #include <rfb/PixelBuffer.h>
 #include <rfb/ScreenSet.h>
 #include <rfb/encodings.h>
@@ -52,12 +54,16 @@ using namespace rfb;
 
 CMsgReader::CMsgReader(CMsgHandler* handler_, rdr::InStream* is_)
   : imageBufIdealSize(0), handler(handler_), is(is_),
-    state(MSGSTATE_IDLE), cursorEncoding(-1)
+    state(MSGSTATE_IDLE), cursorEncoding(-1), cursorCacheSlot(-1)
 {
+  for (Cursor*& cursor : cursorCache)
+    cursor = nullptr;
 }
 
 CMsgReader::~CMsgReader()
 {
+  for (Cursor* cursor : cursorCache)
+    delete cursor;
 }
 
 bool CMsgReader::readServerInit()
@@ -183,6 +189,12 @@ bool CMsgReader::readMsg()
     case pseudoEncodingVMwareCursor:
       ret = readSetVMwareCursor(dataRect.width(), dataRect.height(), dataRect.tl);
       break;
+    case pseudoEncodingCursorCache:
+      ret = readCursorCache(dataRect.tl.x, dataRect.tl.y);
+      break;
+    case pseudoEncodingSharedMemory:
+      ret = readSharedFramebuffer(dataRect.width(), dataRect.height());
+      break;
     case pseudoEncodingVMwareCursorPosition:
       handler->setCursorPos(dataRect.tl);
       ret = true;
@@ -223,6 +235,8 @@ bool CMsgReader::readMsg()
       nUpdateRectsLeft--;
       if (nUpdateRectsLeft == 0) {
         state = MSGSTATE_IDLE;
+        // A store only applies to a cursor in the same update
+        cursorCacheSlot = -1;
         handler->framebufferUpdateEnd();
       }
     }
@@ -295,8 +309,8 @@ bool CMsgReader::readServerCutText()
   std::vector<char> ca(len);
   is->readBytes((uint8_t*)ca.data(), len);
 
-  std::string utf8(core::latin1ToUTF8(ca.data(), ca.size()));
-  std::string filtered(core::convertLF(utf8.data(), utf8.size()));
+  std::string filtered;
+  core::latin1ToUTF8LF(ca.data(), ca.size(), &filtered);
 
   handler->serverCutText(filtered.c_str());
 
@@ -553,7 +567,7 @@ bool CMsgReader::readSetXCursor(int width, int height,
     }
   }
 
-  handler->setCursor(width, height, hotspot, rgba.data());
+  setCursor(width, height, hotspot, rgba.data());
 
   return true;
 }
@@ -600,7 +614,7 @@ bool CMsgReader::readSetCursor(int width, int height,
     }
   }
 
-  handler->setCursor(width, height, hotspot, rgba.data());
+  setCursor(width, height, hotspot, rgba.data());
 
   return true;
 }
@@ -619,6 +633,7 @@ bool CMsgReader::readSetCursorWithAlpha(int width, int height,
 
   uint8_t* buf;
   int stride;
+  std::vector<uint8_t> rgba;
 
   // We can't use restore points as the decoder likely wants to as well, so
   // we need to keep track of the read encoding
@@ -643,26 +658,34 @@ bool CMsgReader::readSetCursorWithAlpha(int width, int height,
   // On-wire data has pre-multiplied alpha, but we store it
   // non-pre-multiplied
   buf = pb.getBufferRW(pb.getRect(), &stride);
-  assert(stride == width);
 
-  for (int i = 0;i < pb.area();i++) {
-    uint8_t alpha;
+  for (int y = 0;y < height;y++) {
+    uint8_t* pixel;
+
+    pixel = buf + y * stride * 4;
+
+    for (int x = 0;x < width;x++) {
+      uint8_t alpha;
 
-    alpha = buf[3];
-    if (alpha == 0)
-      alpha = 1; // Avoid division by zero
+      alpha = pixel[3];
+      if (alpha == 0)
+        alpha = 1; // Avoid division by zero
 
-    buf[0] = (unsigned)buf[0] * 255/alpha;
-    buf[1] = (unsigned)buf[1] * 255/alpha;
-    buf[2] = (unsigned)buf[2] * 255/alpha;
+      pixel[0] = (unsigned)pixel[0] * 255/alpha;
+      pixel[1] = (unsigned)pixel[1] * 255/alpha;
+      pixel[2] = (unsigned)pixel[2] * 255/alpha;
 
-    buf += 4;
+      pixel += 4;
+    }
   }
 
   pb.commitBufferRW(pb.getRect());
 
-  handler->setCursor(width, height, hotspot,
-                     pb.getBuffer(pb.getRect(), &stride));
+  // Rows in the buffer may be padded, but the cursor wants them packed
+  rgba.resize(pb.area() * 4);
+  pb.getImage(rgba.data(), pb.getRect());
+
+  setCursor(width, height, hotspot, rgba.data());
 
   return true;
 }
@@ -752,7 +775,7 @@ bool CMsgReader::readSetVMwareCursor(int width, int height,
       }
     }
 
-    handler->setCursor(width, height, hotspot, data.data());
+    setCursor(width, height, hotspot, data.data());
   } else if (type == 1) {
     std::vector<uint8_t> data(width*height*4);
 
@@ -763,7 +786,7 @@ bool CMsgReader::readSetVMwareCursor(int width, int height,
     // FIXME: Is alpha premultiplied?
     is->readBytes(data.data(), data.size());
 
-    handler->setCursor(width, height, hotspot, data.data());
+    setCursor(width, height, hotspot, data.data());
   } else {
     throw protocol_error("Unknown cursor type");
   }
@@ -771,6 +794,63 @@ bool CMsgReader::readSetVMwareCursor(int width, int height,
   return true;
 }
 
+bool CMsgReader::readCursorCache(int slot, int op)
+{
+  const Cursor* cursor;
+
+  if (slot >= cursorCacheSlots)
+    throw protocol_error("Invalid cursor cache slot");
+
+  switch (op) {
+  case cursorCacheStore:
+    cursorCacheSlot = slot;
+    break;
+  case cursorCacheUse:
+    cursor = cursorCache[slot];
+    if (cursor == nullptr)
+      throw protocol_error("Empty cursor cache slot");
+    handler->setCursor(cursor->width(), cursor->height(),
+                       cursor->hotspot(), cursor->getBuffer());
+    break;
+  default:
+    throw protocol_error("Invalid cursor cache operation");
+  }
+
+  return true;
+}
+
+bool CMsgReader::readSharedFramebuffer(int width, int height)
+{
+  uint32_t pid, fd, serial;
+  PixelFormat pf;
+
+  if (!is->hasData(4 + 4 + 4 + 16))
+    return false;
+
+  pid = is->readU32();
+  fd = is->readU32();
+  serial = is->readU32();
+  pf.read(is);
+
+  handler->setSharedFramebuffer(width, height, pf, pid, fd, serial);
+
+  return true;
+}
+
+void CMsgReader::setCursor(int width, int height,
+                           const core::Point& hotspot,
+                           const uint8_t* data)
+{
+  if (cursorCacheSlot != -1) {
+    delete cursorCache[cursorCacheSlot];
+    cursorCache[cursorCacheSlot] = new Cursor(width, height,
+                                              hotspot, data);
+    cursorCacheSlot = -1;
+  }
+
+  handler->setCursor(width, height, hotspot, data);
+}
+
 bool CMsgReader::readSetDesktopName(int x, int y, int w, int h)
 {
   uint32_t len;
@@ -28,11 +28,14 @@
 
 #include <core/Rect.h>
 
+#include <rfb/cursorCacheTypes.h>
+
 namespace rdr { class InStream; }
 
 namespace rfb {
 
   class CMsgHandler;
+  class Cursor;
 
   class CMsgReader {
   public:
@@ -68,11 +71,16 @@ namespace rfb {
                                 const core::Point& hotspot);
     bool readSetVMwareCursor(int width, int height,
                              const core::Point& hotspot);
+    bool readCursorCache(int slot, int op);
+    bool readSharedFramebuffer(int width, int height);
     bool readSetDesktopName(int x, int y, int w, int h);
     bool readExtendedDesktopSize(int x, int y, int w, int h);
     bool readLEDState();
     bool readVMwareLEDState();
 
+    void setCursor(int width, int height, const core::Point& hotspot,
+                   const uint8_t* data);
+
   private:
     CMsgHandler* handler;
     rdr::InStream* is;
@@ -93,6 +101,9 @@ namespace rfb {
 
     int cursorEncoding;
 
+    int cursorCacheSlot;
+    Cursor* cursorCache[cursorCacheSlots];
+
     static const int maxCursorSize = 256;
   };
 
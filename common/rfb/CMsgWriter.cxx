@@ -227,12 +227,12 @@ void CMsgWriter::writeClientCutText(const char* str)
   if (strchr(str, '\r') != nullptr)
     throw std::invalid_argument("Invalid carriage return in clipboard data");
 
-  std::string latin1(core::utf8ToLatin1(str));
+  core::utf8ToLatin1(str, (size_t)-1, &cutText);
 
   startMsg(msgTypeClientCutText);
   os->pad(3);
-  os->writeU32(latin1.size());
-  os->writeBytes((const uint8_t*)latin1.data(), latin1.size());
+  os->writeU32(cutText.size());
+  os->writeBytes((const uint8_t*)cutText.data(), cutText.size());
   endMsg();
 }
 
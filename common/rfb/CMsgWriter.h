@@ -24,6 +24,7 @@
 #define __RFB_CMSGWRITER_H__
 
 #include <list>
+#include <string>
 
 #include <stdint.h>
 
@@ -75,6 +76,9 @@ namespace rfb {
 
     ServerParams* server;
     rdr::OutStream* os;
+
+    // Kept around so that its memory can be reused
+    std::string cutText;
   };
 }
 #endif
@@ -34,6 +34,9 @@
 #include <unistd.h>
 #endif
 
+#include <map>
+#include <vector>
+
 #include <core/LogWriter.h>
 #include <core/string.h>
 #include <core/xdgdirs.h>
@@ -58,6 +61,13 @@ core::StringParameter CSecurityTLS::X509CRL("X509CRL", "X509 CRL file",
 
 static core::LogWriter vlog("TLS");
 
+// Session data from earlier connections, for each server. Only kept
+// in memory, as it contains the keys needed to resume the session.
+static std::map<std::string, std::vector<uint8_t>> sessionCache;
+
+static unsigned handshakes = 0;
+static unsigned resumedHandshakes = 0;
+
 static const char* configdirfn(const char* fn)
 {
   static char full_path[PATH_MAX];
@@ -74,7 +84,7 @@ static const char* configdirfn(const char* fn)
 CSecurityTLS::CSecurityTLS(CConnection* cc_, bool _anon)
   : CSecurity(cc_), session(nullptr),
     anon_cred(nullptr), cert_cred(nullptr),
-    anon(_anon), tlssock(nullptr),
+    anon(_anon), verified(false), tlssock(nullptr),
     rawis(nullptr), rawos(nullptr)
 {
   int err = gnutls_global_init();
@@ -146,6 +156,7 @@ bool CSecurityTLS::processMsg()
       throw rdr::tls_error("gnutls_set_default_priority()", ret);
 
     setParam();
+    resumeSession();
 
     tlssock = new rdr::TLSSocket(is, os, session);
 
@@ -164,7 +175,22 @@ bool CSecurityTLS::processMsg()
   vlog.debug("TLS handshake completed with %s",
              gnutls_session_get_desc(session));
 
-  checkSession();
+  handshakes++;
+
+  // The server was verified when the session was first set up, and
+  // only verified sessions are saved
+  if (gnutls_session_is_resumed(session)) {
+    resumedHandshakes++;
+  } else {
+    checkSession();
+  }
+
+  vlog.info("%s TLS session (%u of %u resumed)",
+            gnutls_session_is_resumed(session) ? "Resumed" : "New",
+            resumedHandshakes, handshakes);
+
+  verified = true;
+  saveSession();
 
   cc->setStreams(&tlssock->inStream(), &tlssock->outStream());
 
@@ -275,6 +301,79 @@ void CSecurityTLS::setParam()
   }
 }
 
+std::string CSecurityTLS::getSessionKey()
+{
+  return std::string(anon ? "anon:" : "x509:") + client->getServerName();
+}
+
+void CSecurityTLS::resumeSession()
+{
+  std::map<std::string, std::vector<uint8_t>>::iterator iter;
+  int ret;
+
+  gnutls_session_set_ptr(session, this);
+  gnutls_handshake_set_hook_function(session,
+                                     GNUTLS_HANDSHAKE_NEW_SESSION_TICKET,
+                                     GNUTLS_HOOK_POST,
+                                     handleNewSessionTicket);
+
+  iter = sessionCache.find(getSessionKey());
+  if (iter == sessionCache.end())
+    return;
+
+  ret = gnutls_session_set_data(session, iter->second.data(),
+                                iter->second.size());
+
+  // Tickets are not meant to be reused, and we will be given a new
+  // one if this works
+  sessionCache.erase(iter);
+
+  if (ret != GNUTLS_E_SUCCESS)
+    vlog.debug("Could not resume TLS session: %s", gnutls_strerror(ret));
+}
+
+void CSecurityTLS::saveSession()
+{
+  gnutls_datum_t data;
+  int ret;
+
+  // Don't remember servers we haven't accepted
+  if (!verified)
+    return;
+
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+  // With TLS 1.3, sessions can only be resumed once the server has
+  // sent a ticket, which happens after the handshake
+  if ((gnutls_protocol_get_version(session) == GNUTLS_TLS1_3) &&
+      !(gnutls_session_get_flags(session) & GNUTLS_SFLAGS_SESSION_TICKET))
+    return;
+#endif
+
+  ret = gnutls_session_get_data2(session, &data);
+  if (ret != GNUTLS_E_SUCCESS) {
+    vlog.debug("Could not save TLS session: %s", gnutls_strerror(ret));
+    return;
+  }
+
+  sessionCache[getSessionKey()].assign(data.data, data.data + data.size);
+
+  gnutls_free(data.data);
+}
+
+int CSecurityTLS::handleNewSessionTicket(gnutls_session_t session,
+                                         unsigned int /*htype*/,
+                                         unsigned int /*when*/,
+                                         unsigned int /*incoming*/,
+                                         const gnutls_datum_t* /*msg*/)
+{
+  CSecurityTLS* self;
+
+  self = (CSecurityTLS*)gnutls_session_get_ptr(session);
+  self->saveSession();
+
+  return 0;
+}
+
 void CSecurityTLS::checkSession()
 {
   const unsigned allowed_errors = GNUTLS_CERT_INVALID |
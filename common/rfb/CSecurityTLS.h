@@ -27,6 +27,8 @@
 #error "This header should not be compiled without HAVE_GNUTLS defined"
 #endif
 
+#include <string>
+
 #include <rfb/CSecurity.h>
 #include <rfb/Security.h>
 
@@ -57,11 +59,23 @@ namespace rfb {
     void checkSession();
     CConnection *client;
 
+    // Sessions are remembered per server so that reconnects can
+    // resume them instead of doing a full handshake
+    std::string getSessionKey();
+    void resumeSession();
+    void saveSession();
+    static int handleNewSessionTicket(gnutls_session_t session,
+                                      unsigned int htype,
+                                      unsigned int when,
+                                      unsigned int incoming,
+                                      const gnutls_datum_t* msg);
+
   private:
     gnutls_session_t session;
     gnutls_anon_client_credentials_t anon_cred;
     gnutls_certificate_credentials_t cert_cred;
     bool anon;
+    bool verified;
 
     rdr::TLSSocket* tlssock;
 
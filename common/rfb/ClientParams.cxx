@@ -257,3 +257,10 @@ bool ClientParams::supportsExtendedMouseButtons() const
     return true;
   return false;
 }
+
+bool ClientParams::supportsPreserveOnResize() const
+{
+  if (supportsEncoding(pseudoEncodingPreserveOnResize))
+    return true;
+  return false;
+}
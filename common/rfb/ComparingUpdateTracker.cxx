@@ -70,6 +70,7 @@ bool ComparingUpdateTracker::compare()
     }
 
     firstCompare = false;
+    exposed.clear();
 
     return false;
   }
@@ -78,12 +79,34 @@ bool ComparingUpdateTracker::compare()
   for (i = rects.begin(); i != rects.end(); i++)
     oldFb.copyRect(*i, copy_delta);
 
-  changed.get_rects(&rects);
+  if (!exposed.is_empty()) {
+    core::Region src;
+
+    // Anything copied from an area we know nothing about is just as
+    // unknown after the copy
+    src = exposed;
+    src.translate(copy_delta);
+    exposed.assign_union(src.intersect(copied));
+  }
+
+  // Areas we have nothing to compare with always count as changed
+  core::Region newChanged = changed.intersect(exposed);
 
-  core::Region newChanged;
+  changed.subtract(exposed).get_rects(&rects);
   for (i = rects.begin(); i != rects.end(); i++)
     compareRect(*i, &newChanged);
 
+  if (!exposed.is_empty()) {
+    exposed.get_rects(&rects);
+    for (i = rects.begin(); i != rects.end(); i++) {
+      int srcStride;
+      const uint8_t* srcData = fb->getBuffer(*i, &srcStride);
+      oldFb.imageRect(*i, srcData, srcStride);
+    }
+
+    exposed.clear();
+  }
+
   changed.get_rects(&rects);
   for (i = rects.begin(); i != rects.end(); i++)
     totalPixels += i->area();
@@ -112,6 +135,46 @@ void ComparingUpdateTracker::disable()
   firstCompare = true;
 }
 
+void ComparingUpdateTracker::setBuffer(PixelBuffer* buffer)
+{
+  core::Rect overlap;
+
+  fb = buffer;
+
+  clear();
+  changed.assign_union(fb->getRect());
+
+  if (oldFb.getPF() != fb->getPF()) {
+    oldFb.setPF(fb->getPF());
+    firstCompare = true;
+  }
+
+  // Nothing saved, so nothing to keep
+  if (firstCompare)
+    return;
+
+  overlap = oldFb.getRect().intersect(fb->getRect());
+
+  if (oldFb.getRect() != fb->getRect()) {
+    // setSize() doesn't preserve anything, so we need to save the
+    // area we want to keep
+    ManagedPixelBuffer saved(oldFb.getPF(),
+                             overlap.width(), overlap.height());
+    const uint8_t* data;
+    int stride;
+
+    data = oldFb.getBuffer(overlap, &stride);
+    saved.imageRect(saved.getRect(), data, stride);
+
+    oldFb.setSize(fb->width(), fb->height());
+
+    data = saved.getBuffer(saved.getRect(), &stride);
+    oldFb.imageRect(overlap, data, stride);
+  }
+
+  exposed = core::Region(fb->getRect()).subtract(overlap);
+}
+
 void ComparingUpdateTracker::compareRect(const core::Rect& r,
                                          core::Region* newChanged)
 {
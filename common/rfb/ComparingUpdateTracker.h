@@ -42,6 +42,13 @@ namespace rfb {
     virtual void enable();
     virtual void disable();
 
+    // setBuffer() switches to a new framebuffer, possibly of a
+    // different size. The entire new framebuffer is marked as changed,
+    // but the previous contents that still fit are kept so that
+    // compare() can filter out anything that didn't actually change.
+
+    void setBuffer(PixelBuffer* buffer);
+
     void logStats();
 
   private:
@@ -51,6 +58,9 @@ namespace rfb {
     bool firstCompare;
     bool enabled;
 
+    // Areas of oldFb that we have no previous contents for
+    core::Region exposed;
+
     unsigned long long totalPixels, missedPixels;
   };
 
@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include <core/LogWriter.h>
 #include <core/Region.h>
@@ -31,6 +32,7 @@
 #include <rfb/DecodeManager.h>
 #include <rfb/Decoder.h>
 #include <rfb/Exception.h>
+#include <rfb/SharedMemoryDecoder.h>
 
 #include <rdr/MemOutStream.h>
 
@@ -39,13 +41,12 @@ using namespace rfb;
 static core::LogWriter vlog("DecodeManager");
 
 DecodeManager::DecodeManager(CConnection *conn_) :
-  conn(conn_), partialEntry(nullptr), threadException(nullptr)
+  conn(conn_), sharedDecoder(nullptr), decodeTime(0),
+  partialEntry(nullptr), threadException(nullptr)
 {
   size_t cpuCount;
 
-  memset(decoders, 0, sizeof(decoders));
-
-  memset(stats, 0, sizeof(stats));
+  memset(&sharedStats, 0, sizeof(sharedStats));
 
   cpuCount = std::thread::hardware_concurrency();
   if (cpuCount == 0) {
@@ -85,8 +86,9 @@ DecodeManager::~DecodeManager()
     freeBuffers.pop_back();
   }
 
-  for (Decoder* decoder : decoders)
-    delete decoder;
+  for (const auto& decoder : decoders)
+    delete decoder.second;
+  delete sharedDecoder;
 
   delete partialEntry;
 }
@@ -95,6 +97,7 @@ bool DecodeManager::decodeRect(const core::Rect& r, int encoding,
                                ModifiablePixelBuffer* pb)
 {
   int equiv;
+  DecoderStats* stat;
 
   assert(pb != nullptr);
 
@@ -102,20 +105,26 @@ bool DecodeManager::decodeRect(const core::Rect& r, int encoding,
     Decoder *decoder;
     rdr::MemOutStream *bufferStream;
 
-    if (!Decoder::supported(encoding)) {
-      vlog.error("Unknown encoding %d", encoding);
-      throw protocol_error("Unknown encoding");
-    }
-
-    if (!decoders[encoding]) {
-      decoders[encoding] = Decoder::createDecoder(encoding);
-      if (!decoders[encoding]) {
+    if (encoding == encodingSharedMemory) {
+      if (!sharedDecoder)
+        sharedDecoder = new SharedMemoryDecoder();
+      decoder = sharedDecoder;
+    } else {
+      if (!Decoder::supported(encoding)) {
         vlog.error("Unknown encoding %d", encoding);
         throw protocol_error("Unknown encoding");
       }
-    }
 
-    decoder = decoders[encoding];
+      if (!decoders[encoding]) {
+        decoders[encoding] = Decoder::createDecoder(encoding);
+        if (!decoders[encoding]) {
+          vlog.error("Unknown encoding %d", encoding);
+          throw protocol_error("Unknown encoding");
+        }
+      }
+
+      decoder = decoders[encoding];
+    }
 
     // Wait for an available memory buffer
     std::unique_lock<std::mutex> lock(queueMutex);
@@ -162,11 +171,16 @@ bool DecodeManager::decodeRect(const core::Rect& r, int encoding,
     partialEntry->bufferStream->length(), conn->server,
     &partialEntry->affectedRegion);
 
-  stats[encoding].rects++;
-  stats[encoding].bytes += 12 + conn->getInStream()->pos() - beforePos;
-  stats[encoding].pixels += r.area();
+  if (encoding == encodingSharedMemory)
+    stat = &sharedStats;
+  else
+    stat = &stats[encoding];
+
+  stat->rects++;
+  stat->bytes += 12 + conn->getInStream()->pos() - beforePos;
+  stat->pixels += r.area();
   equiv = 12 + r.area() * (conn->server.pf().bpp/8);
-  stats[encoding].equivalent += equiv;
+  stat->equivalent += equiv;
 
   // Then try to put it on the queue
 
@@ -200,10 +214,26 @@ void DecodeManager::flush()
   throwThreadException();
 }
 
-void DecodeManager::logStats()
+unsigned long long DecodeManager::getDecodeTime()
+{
+  const std::lock_guard<std::mutex> lock(queueMutex);
+
+  return decodeTime;
+}
+
+void DecodeManager::setSharedFramebuffer(SharedPixelBuffer* fb,
+                                         uint32_t serial)
 {
-  size_t i;
+  // The workers might still be reading from the old buffer
+  flush();
+
+  if (!sharedDecoder)
+    sharedDecoder = new SharedMemoryDecoder();
+  sharedDecoder->setBuffer(fb, serial);
+}
 
+void DecodeManager::logStats()
+{
   unsigned rects;
   unsigned long long pixels, bytes, equivalent;
 
@@ -212,24 +242,41 @@ void DecodeManager::logStats()
   rects = 0;
   pixels = bytes = equivalent = 0;
 
-  for (i = 0;i < (sizeof(stats)/sizeof(stats[0]));i++) {
+  for (const auto& iter : stats) {
+    const DecoderStats& stat = iter.second;
+
     // Did this class do anything at all?
-    if (stats[i].rects == 0)
+    if (stat.rects == 0)
       continue;
 
-    rects += stats[i].rects;
-    pixels += stats[i].pixels;
-    bytes += stats[i].bytes;
-    equivalent += stats[i].equivalent;
+    rects += stat.rects;
+    pixels += stat.pixels;
+    bytes += stat.bytes;
+    equivalent += stat.equivalent;
 
-    ratio = (double)stats[i].equivalent / stats[i].bytes;
+    ratio = (double)stat.equivalent / stat.bytes;
 
-    vlog.info("    %s: %s, %s", encodingName(i),
-              core::siPrefix(stats[i].rects, "rects").c_str(),
-              core::siPrefix(stats[i].pixels, "pixels").c_str());
+    vlog.info("    %s: %s, %s", encodingName(iter.first),
+              core::siPrefix(stat.rects, "rects").c_str(),
+              core::siPrefix(stat.pixels, "pixels").c_str());
     vlog.info("    %*s  %s (1:%g ratio)",
-              (int)strlen(encodingName(i)), "",
-              core::iecPrefix(stats[i].bytes, "B").c_str(), ratio);
+              (int)strlen(encodingName(iter.first)), "",
+              core::iecPrefix(stat.bytes, "B").c_str(), ratio);
+  }
+
+  if (sharedStats.rects != 0) {
+    rects += sharedStats.rects;
+    pixels += sharedStats.pixels;
+    bytes += sharedStats.bytes;
+    equivalent += sharedStats.equivalent;
+
+    ratio = (double)sharedStats.equivalent / sharedStats.bytes;
+
+    vlog.info("    Shared memory: %s, %s",
+              core::siPrefix(sharedStats.rects, "rects").c_str(),
+              core::siPrefix(sharedStats.pixels, "pixels").c_str());
+    vlog.info("                   %s (1:%g ratio)",
+              core::iecPrefix(sharedStats.bytes, "B").c_str(), ratio);
   }
 
   ratio = (double)equivalent / bytes;
@@ -307,6 +354,7 @@ void DecodeManager::DecodeThread::worker()
 
   while (!stopRequested) {
     DecodeManager::QueueEntry *entry;
+    struct timeval start, end;
 
     // Look for an available entry in the work queue
     entry = findEntry();
@@ -321,6 +369,8 @@ void DecodeManager::DecodeThread::worker()
 
     lock.unlock();
 
+    gettimeofday(&start, nullptr);
+
     // Do the actual decoding
     try {
       entry->decoder->decodeRect(entry->rect, entry->bufferStream->data(),
@@ -332,8 +382,13 @@ void DecodeManager::DecodeThread::worker()
       assert(false);
     }
 
+    gettimeofday(&end, nullptr);
+
     lock.lock();
 
+    manager->decodeTime += (end.tv_sec - start.tv_sec) * 1000000 +
+                           (end.tv_usec - start.tv_usec);
+
     // Remove the entry from the queue and give back the memory buffer
     manager->freeBuffers.push_back(entry->bufferStream);
     manager->workQueue.remove(entry);
@@ -22,6 +22,7 @@
 #include <condition_variable>
 #include <exception>
 #include <list>
+#include <map>
 #include <mutex>
 #include <thread>
 
@@ -42,6 +43,8 @@ namespace rfb {
   class CConnection;
   class Decoder;
   class ModifiablePixelBuffer;
+  class SharedMemoryDecoder;
+  class SharedPixelBuffer;
 
   class DecodeManager {
   public:
@@ -53,6 +56,14 @@ namespace rfb {
 
     void flush();
 
+    // getDecodeTime() returns the total time in microseconds the
+    // decoder threads have spent decoding rects
+    unsigned long long getDecodeTime();
+
+    // setSharedFramebuffer() switches to a new framebuffer shared with
+    // the server, or none at all. Ownership of the buffer is taken.
+    void setSharedFramebuffer(SharedPixelBuffer* fb, uint32_t serial);
+
   private:
     void logStats();
 
@@ -61,7 +72,9 @@ namespace rfb {
 
   private:
     CConnection *conn;
-    Decoder *decoders[encodingMax+1];
+    // Not all encodings fit in 0-encodingMax
+    std::map<int, Decoder*> decoders;
+    SharedMemoryDecoder *sharedDecoder;
 
     struct DecoderStats {
       unsigned rects;
@@ -70,7 +83,9 @@ namespace rfb {
       unsigned long long equivalent;
     };
 
-    DecoderStats stats[encodingMax+1];
+    std::map<int, DecoderStats> stats;
+    DecoderStats sharedStats;
+    unsigned long long decodeTime;
     size_t beforePos;
 
     struct QueueEntry {
@@ -34,6 +34,7 @@
 #include <rfb/JPEGDecoder.h>
 #include <rfb/ZRLEDecoder.h>
 #include <rfb/TightDecoder.h>
+#include <rfb/FastLosslessDecoder.h>
 #ifdef HAVE_H264
 #include <rfb/H264Decoder.h>
 #endif
@@ -78,6 +79,7 @@ bool Decoder::supported(int encoding)
   case encodingJPEG:
   case encodingZRLE:
   case encodingTight:
+  case encodingFastLossless:
 #ifdef HAVE_H264
   case encodingH264:
 #endif
@@ -104,6 +106,8 @@ Decoder* Decoder::createDecoder(int encoding)
     return new ZRLEDecoder();
   case encodingTight:
     return new TightDecoder();
+  case encodingFastLossless:
+    return new FastLosslessDecoder();
 #ifdef HAVE_H264
   case encodingH264:
     return new H264Decoder();
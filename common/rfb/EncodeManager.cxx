@@ -23,7 +23,9 @@
 #include <config.h>
 #endif
 
+#include <assert.h>
 #include <stdlib.h>
+#include <sys/time.h>
 
 #include <core/LogWriter.h>
 #include <core/string.h>
@@ -34,6 +36,7 @@
 #include <rfb/Palette.h>
 #include <rfb/SConnection.h>
 #include <rfb/SMsgWriter.h>
+#include <rfb/SharedPixelBuffer.h>
 #include <rfb/UpdateTracker.h>
 #include <rfb/encodings.h>
 
@@ -44,6 +47,7 @@
 #include <rfb/ZRLEEncoder.h>
 #include <rfb/TightEncoder.h>
 #include <rfb/TightJPEGEncoder.h>
+#include <rfb/FastLosslessEncoder.h>
 
 using namespace rfb;
 
@@ -63,6 +67,10 @@ static const int SolidBlockMinArea = 2048;
 // How long we consider a region recently changed (in ms)
 static const int RecentChangeTimeout = 50;
 
+// Running share (out of 256) of prepared updates that had to be thrown
+// away because the area changed again. We stop preparing above this.
+static const unsigned PreEncodeWasteLimit = 128;
+
 namespace rfb {
 
 enum EncoderClass {
@@ -73,6 +81,7 @@ enum EncoderClass {
   encoderTightJPEG,
   encoderZRLE,
   encoderJPEG,
+  encoderFastLossless,
   encoderClassMax,
 };
 
@@ -110,6 +119,8 @@ static const char *encoderClassName(EncoderClass klass)
     return "ZRLE";
   case encoderJPEG:
     return "JPEG";
+  case encoderFastLossless:
+    return "FastLossless";
   case encoderClassMax:
     break;
   }
@@ -140,7 +151,13 @@ static const char *encoderTypeName(EncoderType type)
 }
 
 EncodeManager::EncodeManager(SConnection* conn_)
-  : conn(conn_), recentChangeTimer(this)
+  : conn(conn_), recentChangeTimer(this), qualityLimit(-1),
+    focusDrop(0),
+    allowSharedMemory(false),
+    sharedPb(nullptr), sharedSerial(0), sharedAnnounce(false),
+    preEncodeTime(0), preEncodeWaste(0),
+    preEncodedUpdates(0), discardedPreEncodes(0),
+    reencodedPixels(0), preEncodeSaved(0)
 {
   StatsVector::iterator iter;
 
@@ -154,9 +171,11 @@ EncodeManager::EncodeManager(SConnection* conn_)
   encoders[encoderTightJPEG] = new TightJPEGEncoder(conn);
   encoders[encoderZRLE] = new ZRLEEncoder(conn);
   encoders[encoderJPEG] = new JPEGEncoder(conn);
+  encoders[encoderFastLossless] = new FastLosslessEncoder(conn);
 
   updates = 0;
   memset(&copyStats, 0, sizeof(copyStats));
+  memset(&sharedStats, 0, sizeof(sharedStats));
   stats.resize(encoderClassMax);
   for (iter = stats.begin();iter != stats.end();++iter) {
     StatsVector::value_type::iterator iter2;
@@ -172,6 +191,8 @@ EncodeManager::~EncodeManager()
 
   for (Encoder* encoder : encoders)
     delete encoder;
+
+  delete sharedPb;
 }
 
 void EncodeManager::logStats()
@@ -206,6 +227,24 @@ void EncodeManager::logStats()
               core::iecPrefix(copyStats.bytes, "B").c_str(), ratio);
   }
 
+  if (sharedStats.rects != 0) {
+    vlog.info("  %s:", "Shared memory");
+
+    rects += sharedStats.rects;
+    pixels += sharedStats.pixels;
+    bytes += sharedStats.bytes;
+    equivalent += sharedStats.equivalent;
+
+    ratio = (double)sharedStats.equivalent / sharedStats.bytes;
+
+    vlog.info("    %s: %s, %s", "Rects",
+              core::siPrefix(sharedStats.rects, "rects").c_str(),
+              core::siPrefix(sharedStats.pixels, "pixels").c_str());
+    vlog.info("    %*s  %s (1:%g ratio)",
+              (int)strlen("Rects"), "",
+              core::iecPrefix(sharedStats.bytes, "B").c_str(), ratio);
+  }
+
   for (i = 0;i < stats.size();i++) {
     // Did this class do anything at all?
     for (j = 0;j < stats[i].size();j++) {
@@ -244,6 +283,14 @@ void EncodeManager::logStats()
             core::siPrefix(pixels, "pixels").c_str());
   vlog.info("         %s (1:%g ratio)",
             core::iecPrefix(bytes, "B").c_str(), ratio);
+
+  if ((preEncodedUpdates != 0) || (discardedPreEncodes != 0)) {
+    vlog.info("  Pre-encoded: %u of %u updates, %u discarded",
+              preEncodedUpdates, updates, discardedPreEncodes);
+    vlog.info("               %s changed again, %g ms saved",
+              core::siPrefix(reencodedPixels, "pixels").c_str(),
+              preEncodeSaved / 1000.0);
+  }
 }
 
 bool EncodeManager::supported(int encoding)
@@ -255,12 +302,29 @@ bool EncodeManager::supported(int encoding)
   case encodingJPEG:
   case encodingZRLE:
   case encodingTight:
+  case encodingFastLossless:
     return true;
   default:
     return false;
   }
 }
 
+void EncodeManager::enableSharedMemory()
+{
+  allowSharedMemory = SharedPixelBuffer::isSupported();
+}
+
+void EncodeManager::setQualityLimit(int level)
+{
+  qualityLimit = level;
+}
+
+void EncodeManager::setFocus(const core::Region& area, int peripheryDrop)
+{
+  focusRegion = area;
+  focusDrop = peripheryDrop;
+}
+
 bool EncodeManager::needsLosslessRefresh(const core::Region& req)
 {
   return !lossyRegion.intersect(req).is_empty();
@@ -311,6 +375,157 @@ void EncodeManager::writeLosslessRefresh(const core::Region& req,
            {}, {}, pb, renderedCursor);
 }
 
+core::Region EncodeManager::preEncode(const core::Region& changed_,
+                                      const PixelBuffer* pb)
+{
+  core::Region changed, periphery, prepared;
+  struct timeval start, now;
+
+  // The viewer reads shared memory directly, so there is nothing to
+  // prepare, and without LastRect we would have to know the number
+  // of rects in advance
+  if (allowSharedMemory)
+    return {};
+  if (!conn->client.supportsEncoding(pseudoEncodingLastRect))
+    return {};
+
+  // Don't bother if most of what we prepare changes again before the
+  // client gets it
+  if (preEncodeWaste > PreEncodeWasteLimit)
+    return {};
+
+  changed = changed_.subtract(preEncodedRegion);
+  if (changed.is_empty())
+    return {};
+
+  gettimeofday(&start, nullptr);
+
+  if (preEncodedRegion.is_empty()) {
+    for (Encoder* encoder : encoders)
+      encoder->checkpoint();
+
+    savedLossyRegion = lossyRegion;
+    savedPendingRefreshRegion = pendingRefreshRegion;
+    savedStats = stats;
+  }
+
+  prepared = changed;
+
+  conn->redirectOutput(&preEncoded);
+
+  try {
+    prepareEncoders(true);
+
+    splitPeriphery(true, &changed, &periphery);
+
+    writeSolidRects(&changed, pb);
+    writeSolidRects(&periphery, pb);
+
+    writeRects(changed, pb);
+
+    if (!periphery.is_empty()) {
+      setEncoderQuality(true, focusDrop);
+      writeRects(periphery, pb);
+    }
+  } catch (...) {
+    // Don't leave partial rects or half updated encoder state behind
+    conn->redirectOutput(nullptr);
+    updateArena.reset();
+    preEncodedRegion.assign_union(prepared);
+    discardPreEncoded();
+    throw;
+  }
+
+  conn->redirectOutput(nullptr);
+
+  updateArena.reset();
+
+  preEncodedRegion.assign_union(prepared);
+
+  gettimeofday(&now, nullptr);
+  preEncodeTime += (now.tv_sec - start.tv_sec) * 1000000ULL +
+                   (now.tv_usec - start.tv_usec);
+
+  return prepared;
+}
+
+core::Region EncodeManager::discardPreEncoded()
+{
+  core::Region discarded;
+
+  if (preEncodedRegion.is_empty())
+    return {};
+
+  for (Encoder* encoder : encoders)
+    encoder->rollback();
+
+  lossyRegion = savedLossyRegion;
+  pendingRefreshRegion = savedPendingRefreshRegion;
+  stats = savedStats;
+
+  preEncoded.clear();
+  preEncodeTime = 0;
+
+  discarded = preEncodedRegion;
+  preEncodedRegion.clear();
+
+  discardedPreEncodes++;
+
+  return discarded;
+}
+
+core::Region EncodeManager::invalidatePreEncoded(const core::Region& changed,
+                                                 const core::Region& req)
+{
+  core::Region stale;
+
+  if (preEncodedRegion.is_empty())
+    return {};
+
+  stale = preEncodedRegion.intersect(changed);
+  if (stale.is_empty() && preEncodedRegion.subtract(req).is_empty())
+    return {};
+
+  if (!stale.is_empty()) {
+    RectVector rects(&updateArena);
+
+    stale.get_rects(&rects);
+    for (const core::Rect& rect : rects)
+      reencodedPixels += rect.area();
+
+    preEncodeWaste += (256 - preEncodeWaste) / 8;
+  }
+
+  updateArena.reset();
+
+  return discardPreEncoded();
+}
+
+void EncodeManager::writePreEncoded()
+{
+  // Only possible with LastRect, as we cannot count these in advance
+  assert(conn->client.supportsEncoding(pseudoEncodingLastRect));
+
+  conn->getOutStream()->writeBytes(preEncoded.data(),
+                                   preEncoded.length());
+  preEncoded.clear();
+
+  for (Encoder* encoder : encoders)
+    encoder->commit();
+
+  preEncodedUpdates++;
+  preEncodeSaved += preEncodeTime;
+  preEncodeTime = 0;
+
+  preEncodeWaste -= preEncodeWaste / 8;
+
+  recentlyChangedRegion.assign_union(preEncodedRegion);
+  if (!recentChangeTimer.isStarted())
+    recentChangeTimer.start(RecentChangeTimeout);
+
+  preEncodedRegion.clear();
+}
+
 void EncodeManager::handleTimeout(core::Timer* t)
 {
   if (t == &recentChangeTimer) {
@@ -333,10 +548,19 @@ void EncodeManager::doUpdate(bool allowLossy, const
                              const RenderedCursor* renderedCursor)
 {
     int nRects;
-    core::Region changed, cursorRegion;
+    core::Region changed, cursorRegion, periphery;
 
     updates++;
 
+    if (prepareSharedFramebuffer(pb)) {
+      // Copies are done in the shared buffer as well, as the viewer
+      // might have picked up newer data than we think it has
+      writeSharedUpdate(changed_.union_(copied), pb, renderedCursor);
+      // Only safe once the rect lists in there are gone
+      updateArena.reset();
+      return;
+    }
+
     prepareEncoders(allowLossy);
 
     changed = changed_;
@@ -353,6 +577,13 @@ void EncodeManager::doUpdate(bool allowLossy, const
       changed.assign_subtract(renderedCursor->getEffectiveRect());
     }
 
+    /*
+     * Anything away from where the user is looking can be sent at a
+     * lower quality, so split that out as well. The cursor is always
+     * in focus.
+     */
+    splitPeriphery(allowLossy, &changed, &periphery);
+
     if (conn->client.supportsEncoding(pseudoEncodingLastRect))
       nRects = 0xFFFF;
     else {
@@ -360,11 +591,20 @@ void EncodeManager::doUpdate(bool allowLossy, const
       if (conn->client.supportsEncoding(encodingCopyRect))
         nRects += copied.numRects();
       nRects += computeNumRects(changed);
+      nRects += computeNumRects(periphery);
       nRects += computeNumRects(cursorRegion);
     }
 
     conn->writer()->writeFramebufferUpdateStart(nRects);
 
+    // Prepared rects go first, so that copies see the new content.
+    // Otherwise slowly forget about earlier waste, so that we try
+    // again once things calm down.
+    if (!preEncodedRegion.is_empty())
+      writePreEncoded();
+    else
+      preEncodeWaste -= (preEncodeWaste + 31) / 32;
+
     if (conn->client.supportsEncoding(encodingCopyRect))
       writeCopyRects(copied, copyDelta);
 
@@ -372,13 +612,34 @@ void EncodeManager::doUpdate(bool allowLossy, const
      * We start by searching for solid rects, which are then removed
      * from the changed region.
      */
-    if (conn->client.supportsEncoding(pseudoEncodingLastRect))
+    if (conn->client.supportsEncoding(pseudoEncodingLastRect)) {
       writeSolidRects(&changed, pb);
+      writeSolidRects(&periphery, pb);
+    }
 
     writeRects(changed, pb);
     writeRects(cursorRegion, renderedCursor);
 
+    if (!periphery.is_empty()) {
+      setEncoderQuality(allowLossy, focusDrop);
+      writeRects(periphery, pb);
+    }
+
     conn->writer()->writeFramebufferUpdateEnd();
+
+    updateArena.reset();
+}
+
+void EncodeManager::splitPeriphery(bool allowLossy, core::Region* changed,
+                                   core::Region* periphery)
+{
+  if (!allowLossy || (focusDrop <= 0) || focusRegion.is_empty())
+    return;
+  if (!(encoders[activeEncoders[encoderFullColour]]->flags & EncoderLossy))
+    return;
+
+  *periphery = changed->subtract(focusRegion);
+  changed->assign_intersect(focusRegion);
 }
 
 void EncodeManager::prepareEncoders(bool allowLossy)
@@ -423,6 +684,13 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   case encodingJPEG:
     fullColour = encoderJPEG;
     break;
+  case encodingFastLossless:
+    // Meant for fast links, so spend as little time as possible on
+    // everything that isn't a solid fill
+    fullColour = encoderFastLossless;
+    bitmapRLE = indexedRLE = encoderFastLossless;
+    bitmap = indexed = encoderFastLossless;
+    break;
   }
 
   // JPEG is the only encoder that can reduce things to grayscale
@@ -513,14 +781,38 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   activeEncoders[encoderIndexedRLE] = indexedRLE;
   activeEncoders[encoderFullColour] = fullColour;
 
+  for (iter = activeEncoders.begin(); iter != activeEncoders.end(); ++iter)
+    encoders[*iter]->setCompressLevel(conn->client.compressLevel);
+
+  setEncoderQuality(allowLossy, 0);
+}
+
+void EncodeManager::setEncoderQuality(bool allowLossy, int drop)
+{
+  std::vector<int>::iterator iter;
+  int level;
+
+  level = conn->client.qualityLevel;
+  if ((qualityLimit != -1) && (level > qualityLimit))
+    level = qualityLimit;
+
+  // The fine settings can't be scaled in any meaningful way, so the
+  // reduced quality has to be expressed as a coarse level
+  if ((level != -1) && (drop > 0)) {
+    level -= drop;
+    if (level < 0)
+      level = 0;
+  }
+
   for (iter = activeEncoders.begin(); iter != activeEncoders.end(); ++iter) {
     Encoder *encoder;
 
     encoder = encoders[*iter];
 
-    encoder->setCompressLevel(conn->client.compressLevel);
-
-    if (allowLossy) {
+    if (allowLossy && (level != conn->client.qualityLevel)) {
+      encoder->setQualityLevel(level);
+      encoder->setFineQualityLevel(-1, subsampleUndefined);
+    } else if (allowLossy) {
       encoder->setQualityLevel(conn->client.qualityLevel);
       encoder->setFineQualityLevel(conn->client.fineQualityLevel,
                                    conn->client.subsampling);
@@ -534,6 +826,119 @@ void EncodeManager::prepareEncoders(bool allowLossy)
   }
 }
 
+bool EncodeManager::prepareSharedFramebuffer(const PixelBuffer* pb)
+{
+  if (!allowSharedMemory ||
+      !conn->client.supportsEncoding(pseudoEncodingSharedMemory) ||
+      !conn->client.pf().trueColour) {
+    delete sharedPb;
+    sharedPb = nullptr;
+    return false;
+  }
+
+  if ((sharedPb != nullptr) &&
+      (sharedPb->getRect() == pb->getRect()) &&
+      (sharedPb->getPF() == conn->client.pf()))
+    return true;
+
+  delete sharedPb;
+  sharedPb = nullptr;
+
+  try {
+    sharedPb = new SharedPixelBuffer(conn->client.pf(),
+                                     pb->width(), pb->height());
+  } catch (std::exception& e) {
+    vlog.error("Unable to create shared framebuffer: %s", e.what());
+    allowSharedMemory = false;
+    return false;
+  }
+
+  sharedSerial++;
+  sharedAnnounce = true;
+
+  return true;
+}
+
+void EncodeManager::writeSharedUpdate(const core::Region& changed,
+                                      const PixelBuffer* pb,
+                                      const RenderedCursor* renderedCursor)
+{
+  RectVector rects(&updateArena);
+  RectVector::const_iterator rect;
+  rdr::OutStream* os;
+  int nRects;
+
+  // The viewer gets everything straight from memory, so all we need
+  // to do is to fill in the shared buffer and tell it where to look
+  changed.get_rects(&rects);
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    const uint8_t* data;
+    int stride;
+
+    data = pb->getBuffer(*rect, &stride);
+    sharedPb->imageRect(pb->getPF(), *rect, data, stride);
+  }
+
+  if (renderedCursor != nullptr) {
+    RectVector cursorRects(&updateArena);
+
+    changed.intersect(renderedCursor->getEffectiveRect())
+      .get_rects(&cursorRects);
+    for (rect = cursorRects.begin(); rect != cursorRects.end(); ++rect) {
+      const uint8_t* data;
+      int stride;
+
+      data = renderedCursor->getBuffer(*rect, &stride);
+      sharedPb->imageRect(renderedCursor->getPF(), *rect, data, stride);
+    }
+  }
+
+  if (conn->client.supportsEncoding(pseudoEncodingLastRect))
+    nRects = 0xFFFF;
+  else {
+    nRects = rects.size();
+    if (sharedAnnounce)
+      nRects++;
+  }
+
+  conn->writer()->writeFramebufferUpdateStart(nRects);
+
+  os = conn->getOutStream();
+
+  if (sharedAnnounce) {
+    conn->writer()->startRect(sharedPb->getRect(),
+                              pseudoEncodingSharedMemory);
+    os->writeU32(sharedPb->getPid());
+    os->writeU32(sharedPb->getFd());
+    os->writeU32(sharedSerial);
+    sharedPb->getPF().write(os);
+    conn->writer()->endRect();
+
+    sharedAnnounce = false;
+  }
+
+  beforeLength = os->length();
+
+  for (rect = rects.begin(); rect != rects.end(); ++rect) {
+    conn->writer()->startRect(*rect, encodingSharedMemory);
+    os->writeU32(sharedSerial);
+    conn->writer()->endRect();
+
+    sharedStats.rects++;
+    sharedStats.pixels += rect->area();
+    sharedStats.equivalent += 12 + rect->area() *
+                              (conn->client.pf().bpp/8);
+  }
+
+  sharedStats.bytes += os->length() - beforeLength;
+
+  // Everything is sent losslessly
+  lossyRegion.assign_subtract(changed);
+  pendingRefreshRegion.assign_subtract(changed);
+
+  conn->writer()->writeFramebufferUpdateEnd();
+}
+
 core::Region EncodeManager::getLosslessRefresh(const core::Region& req,
                                                size_t maxUpdateSize)
 {
@@ -590,8 +995,8 @@ core::Region EncodeManager::getLosslessRefresh(const core::Region& req,
 int EncodeManager::computeNumRects(const core::Region& changed)
 {
   int numRects;
-  std::vector<core::Rect> rects;
-  std::vector<core::Rect>::const_iterator rect;
+  RectVector rects(&updateArena);
+  RectVector::const_iterator rect;
 
   numRects = 0;
   changed.get_rects(&rects);
@@ -669,8 +1074,8 @@ void EncodeManager::endRect()
 void EncodeManager::writeCopyRects(const core::Region& copied,
                                    const core::Point& delta)
 {
-  std::vector<core::Rect> rects;
-  std::vector<core::Rect>::const_iterator rect;
+  RectVector rects(&updateArena);
+  RectVector::const_iterator rect;
 
   core::Region lossyCopy;
 
@@ -704,8 +1109,8 @@ void EncodeManager::writeCopyRects(const core::Region& copied,
 void EncodeManager::writeSolidRects(core::Region* changed,
                                     const PixelBuffer* pb)
 {
-  std::vector<core::Rect> rects;
-  std::vector<core::Rect>::const_iterator rect;
+  RectVector rects(&updateArena);
+  RectVector::const_iterator rect;
 
   changed->get_rects(&rects);
   for (rect = rects.begin(); rect != rects.end(); ++rect)
@@ -820,8 +1225,8 @@ void EncodeManager::findSolidRect(const core::Rect& rect,
 void EncodeManager::writeRects(const core::Region& changed,
                                const PixelBuffer* pb)
 {
-  std::vector<core::Rect> rects;
-  std::vector<core::Rect>::const_iterator rect;
+  RectVector rects(&updateArena);
+  RectVector::const_iterator rect;
 
   changed.get_rects(&rects);
   for (rect = rects.begin(); rect != rects.end(); ++rect) {
@@ -24,9 +24,12 @@
 
 #include <stdint.h>
 
+#include <core/Arena.h>
 #include <core/Region.h>
 #include <core/Timer.h>
 
+#include <rdr/MemOutStream.h>
+
 #include <rfb/PixelBuffer.h>
 
 namespace rfb {
@@ -36,6 +39,7 @@ namespace rfb {
   class UpdateInfo;
   class PixelBuffer;
   class RenderedCursor;
+  class SharedPixelBuffer;
 
   struct RectInfo;
 
@@ -49,6 +53,20 @@ namespace rfb {
     // Hack to let ConnParams calculate the client's preferred encoding
     static bool supported(int encoding);
 
+    // enableSharedMemory() allows sending updates through memory
+    // shared with the client, which must be on the same host
+    void enableSharedMemory();
+
+    // setQualityLimit() caps the JPEG quality below what the client
+    // asked for, in order to make updates cheaper. -1 removes the cap.
+    void setQualityLimit(int level);
+
+    // setFocus() marks the area the user is most likely looking at.
+    // Lossy rects outside of it are sent peripheryDrop quality levels
+    // lower, and are left for the lossless refresh to fix up later. An
+    // empty region sends everything at the same quality.
+    void setFocus(const core::Region& area, int peripheryDrop);
+
     bool needsLosslessRefresh(const core::Region& req);
     int getNextLosslessRefresh(const core::Region& req);
 
@@ -64,6 +82,20 @@ namespace rfb {
                               const RenderedCursor* renderedCursor,
                               size_t maxUpdateSize);
 
+    // preEncode() encodes changes before the client has asked for
+    // them, so that the next update can go out without delay. Areas
+    // that have already been prepared are skipped. Returns the region
+    // that was prepared, which will be sent first in the next update
+    // unless discardPreEncoded() is called. That returns the region
+    // that has to be sent again. invalidatePreEncoded() does the same,
+    // but only if some of it has changed again or is outside req.
+    core::Region preEncode(const core::Region& changed,
+                           const PixelBuffer* pb);
+    core::Region discardPreEncoded();
+    core::Region invalidatePreEncoded(const core::Region& changed,
+                                      const core::Region& req);
+    bool hasPreEncoded() const { return !preEncodedRegion.is_empty(); }
+
   protected:
     void handleTimeout(core::Timer* t) override;
 
@@ -73,6 +105,16 @@ namespace rfb {
                   const PixelBuffer* pb,
                   const RenderedCursor* renderedCursor);
     void prepareEncoders(bool allowLossy);
+    void setEncoderQuality(bool allowLossy, int drop);
+    void splitPeriphery(bool allowLossy, core::Region* changed,
+                        core::Region* periphery);
+
+    void writePreEncoded();
+
+    bool prepareSharedFramebuffer(const PixelBuffer* pb);
+    void writeSharedUpdate(const core::Region& changed,
+                           const PixelBuffer* pb,
+                           const RenderedCursor* renderedCursor);
 
     core::Region getLosslessRefresh(const core::Region& req,
                                     size_t maxUpdateSize);
@@ -140,6 +182,7 @@ namespace rfb {
 
     unsigned updates;
     EncoderStats copyStats;
+    EncoderStats sharedStats;
     StatsVector stats;
     int activeType;
     int beforeLength;
@@ -158,6 +201,41 @@ namespace rfb {
 
     OffsetPixelBuffer offsetPixelBuffer;
     ManagedPixelBuffer convertedPixelBuffer;
+
+    // Scratch memory for the update currently being written. Emptied
+    // once the update has been sent. Only the rect lists need it. The
+    // Palettes are fixed size, and convertedPixelBuffer and the
+    // encoders' MemOutStreams are kept between updates and only grow,
+    // so they stop allocating once they reach their working size.
+    core::Arena updateArena;
+    typedef std::vector<core::Rect,
+                        core::ArenaAllocator<core::Rect> > RectVector;
+
+    int qualityLimit;
+
+    core::Region focusRegion;
+    int focusDrop;
+
+    bool allowSharedMemory;
+    SharedPixelBuffer* sharedPb;
+    uint32_t sharedSerial;
+    bool sharedAnnounce;
+
+    // Rects encoded ahead of the client's request, and what we need
+    // to go back to if they are never sent
+    rdr::MemOutStream preEncoded;
+    core::Region preEncodedRegion;
+    unsigned long long preEncodeTime;
+    unsigned preEncodeWaste;
+
+    core::Region savedLossyRegion;
+    core::Region savedPendingRefreshRegion;
+    StatsVector savedStats;
+
+    unsigned preEncodedUpdates;
+    unsigned discardedPreEncodes;
+    unsigned long long reencodedPixels;
+    unsigned long long preEncodeSaved;
   };
 
 }
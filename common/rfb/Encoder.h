@@ -84,6 +84,14 @@ namespace rfb {
                                 const PixelFormat& pf,
                                 const uint8_t* colour)=0;
 
+    // checkpoint() is called before writing rects that might never
+    // reach the client. Encoders that keep state between rects that
+    // the client mirrors must then be able to return to that state
+    // on rollback(). commit() means the rects were sent after all.
+    virtual void checkpoint() {};
+    virtual void commit() {};
+    virtual void rollback() {};
+
   protected:
     // Helper method for redirecting a single colour palette to the
     // short cut method.
@@ -0,0 +1,43 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+//
+// FastLossless encodes each row as the difference to a gradient
+// prediction (left + up - up-left, modulo 256) of every byte. The
+// residual bytes are zigzag mapped and then bit packed in blocks of
+// fastLosslessBlockSize bytes.
+//
+// Each block starts with a header byte. 1-8 gives the number of bits
+// used per byte, followed by that many 16 bit little endian bit planes
+// starting with the least significant one. A header with
+// fastLosslessZeroRun set covers 1-128 blocks (the lower bits plus one)
+// where every residual is zero. Rows are padded with zero residuals
+// to a multiple of the block size, and runs never span rows.
+//
+// 32 bpp formats with 8 bits per colour are sent as three bytes per
+// pixel, in RGB order, just like Tight does.
+//
+
+#ifndef __RFB_FASTLOSSLESSCONSTANTS_H__
+#define __RFB_FASTLOSSLESSCONSTANTS_H__
+namespace rfb {
+  const unsigned int fastLosslessBlockSize = 16;
+  const unsigned int fastLosslessZeroRun = 0x80;
+  const unsigned int fastLosslessMaxRun = 128;
+}
+#endif
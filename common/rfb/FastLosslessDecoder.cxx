@@ -0,0 +1,254 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <vector>
+
+#include <core/string.h>
+
+#include <rdr/InStream.h>
+#include <rdr/OutStream.h>
+
+#include <rfb/Exception.h>
+#include <rfb/FastLosslessConstants.h>
+#include <rfb/FastLosslessDecoder.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/ServerParams.h>
+
+using namespace rfb;
+
+// Room in front of each row so the first pixel has a (zero) left
+// neighbour
+static const int RowPadding = 16;
+
+FastLosslessDecoder::FastLosslessDecoder() : Decoder(DecoderPlain)
+{
+}
+
+FastLosslessDecoder::~FastLosslessDecoder()
+{
+}
+
+bool FastLosslessDecoder::readRect(const core::Rect& r, rdr::InStream* is,
+                                   const ServerParams& server,
+                                   rdr::OutStream* os)
+{
+  uint32_t len;
+  size_t bpp, paddedLen, maxLen;
+
+  if (!is->hasData(4))
+    return false;
+
+  is->setRestorePoint();
+
+  len = is->readU32();
+
+  if ((server.pf().bpp == 32) && server.pf().is888())
+    bpp = 3;
+  else
+    bpp = server.pf().bpp/8;
+
+  paddedLen = (r.width() * bpp + fastLosslessBlockSize - 1) &
+              ~(fastLosslessBlockSize - 1);
+  maxLen = r.height() * (paddedLen / fastLosslessBlockSize) *
+           (1 + fastLosslessBlockSize);
+  if (len > maxLen)
+    throw protocol_error(core::format(
+      "FastLosslessDecoder: Too much data (%u bytes)", (unsigned)len));
+
+  if (!is->hasDataOrRestore(len))
+    return false;
+
+  is->clearRestorePoint();
+
+  os->copyBytes(is, len);
+
+  return true;
+}
+
+void FastLosslessDecoder::decodeRect(const core::Rect& r,
+                                     const uint8_t* buffer,
+                                     size_t buflen,
+                                     const ServerParams& server,
+                                     ModifiablePixelBuffer* pb)
+{
+  const PixelFormat& pf = server.pf();
+  bool packed;
+  int bpp, rowLen, paddedLen, pixelSize;
+  const uint8_t* end;
+
+  std::vector<uint8_t> rows[2];
+  std::vector<uint8_t> residual;
+  std::vector<uint8_t> pixels;
+  int currentRow;
+
+  packed = (pf.bpp == 32) && pf.is888();
+  bpp = packed ? 3 : pf.bpp/8;
+  pixelSize = pf.bpp/8;
+
+  rowLen = r.width() * bpp;
+  paddedLen = (rowLen + fastLosslessBlockSize - 1) &
+              ~(fastLosslessBlockSize - 1);
+
+  rows[0].assign(RowPadding + paddedLen, 0);
+  rows[1].assign(RowPadding + paddedLen, 0);
+  residual.resize(paddedLen);
+  pixels.resize(r.area() * pixelSize);
+  currentRow = 0;
+
+  end = buffer + buflen;
+
+  for (int y = 0; y < r.height(); y++) {
+    uint8_t* thisRow;
+    uint8_t* dst;
+
+    buffer = unpackRow(buffer, end, paddedLen, residual.data());
+
+    thisRow = rows[currentRow].data() + RowPadding;
+    reconstructRow(residual.data(),
+                   rows[currentRow ^ 1].data() + RowPadding,
+                   rowLen, bpp, thisRow);
+
+    dst = &pixels[y * r.width() * pixelSize];
+    if (packed)
+      pf.bufferFromRGB(dst, thisRow, r.width());
+    else
+      memcpy(dst, thisRow, rowLen);
+
+    currentRow ^= 1;
+  }
+
+  if (buffer != end)
+    throw protocol_error("FastLosslessDecoder: Unexpected trailing data");
+
+  pb->imageRect(pf, r, pixels.data());
+}
+
+const uint8_t* FastLosslessDecoder::unpackRow(const uint8_t* in,
+                                              const uint8_t* end,
+                                              int len, uint8_t* residual)
+{
+  int i;
+
+  i = 0;
+  while (i < len) {
+    unsigned header, bits;
+
+    if (in >= end)
+      throw protocol_error("FastLosslessDecoder: Not enough data");
+
+    header = *in++;
+
+    if (header & fastLosslessZeroRun) {
+      int count;
+
+      count = ((header & ~fastLosslessZeroRun) + 1) *
+              fastLosslessBlockSize;
+      if (count > len - i)
+        throw protocol_error("FastLosslessDecoder: Run past end of row");
+
+      memset(residual + i, 0, count);
+      i += count;
+      continue;
+    }
+
+    bits = header;
+    if ((bits < 1) || (bits > 8))
+      throw protocol_error(core::format(
+        "FastLosslessDecoder: Invalid block header 0x%02x", header));
+    if ((size_t)(end - in) < bits * 2)
+      throw protocol_error("FastLosslessDecoder: Not enough data");
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i select = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1,
+                                        -128, 64, 32, 16, 8, 4, 2, 1);
+    __m128i z, bit;
+
+    z = zero;
+    bit = one;
+    for (unsigned j = 0; j < bits; j++) {
+      __m128i plane;
+
+      // Spread the low mask byte over the first eight bytes, and the
+      // high over the last eight, then test one bit in each
+      plane = _mm_cvtsi32_si128(in[0] | (in[1] << 8));
+      plane = _mm_unpacklo_epi8(plane, plane);
+      plane = _mm_unpacklo_epi16(plane, plane);
+      plane = _mm_unpacklo_epi32(plane, plane);
+      plane = _mm_cmpeq_epi8(_mm_and_si128(plane, select), select);
+
+      z = _mm_or_si128(z, _mm_and_si128(plane, bit));
+
+      bit = _mm_add_epi8(bit, bit);
+      in += 2;
+    }
+
+    // Undo the zigzag mapping
+    z = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(z, 1),
+                                    _mm_set1_epi8(0x7f)),
+                      _mm_cmpeq_epi8(_mm_and_si128(z, one), one));
+
+    _mm_storeu_si128((__m128i*)(residual + i), z);
+#else
+    uint8_t z[fastLosslessBlockSize];
+
+    memset(z, 0, sizeof(z));
+
+    for (unsigned j = 0; j < bits; j++) {
+      unsigned plane;
+
+      plane = in[0] | (in[1] << 8);
+      for (unsigned b = 0; b < fastLosslessBlockSize; b++)
+        z[b] |= ((plane >> b) & 1) << j;
+
+      in += 2;
+    }
+
+    for (unsigned b = 0; b < fastLosslessBlockSize; b++)
+      residual[i + b] = (z[b] >> 1) ^ ((z[b] & 1) ? 0xff : 0x00);
+#endif
+
+    i += fastLosslessBlockSize;
+  }
+
+  return in;
+}
+
+void FastLosslessDecoder::reconstructRow(const uint8_t* residual,
+                                         const uint8_t* prevRow,
+                                         int len, int bpp,
+                                         uint8_t* thisRow)
+{
+  // Each pixel depends on the one to the left, so this has to be done
+  // serially
+  for (int i = 0; i < len; i++) {
+    thisRow[i] = residual[i] + thisRow[i - bpp] +
+                 prevRow[i] - prevRow[i - bpp];
+  }
+}
@@ -0,0 +1,282 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <rdr/OutStream.h>
+#include <rfb/encodings.h>
+#include <rfb/FastLosslessConstants.h>
+#include <rfb/FastLosslessEncoder.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+
+using namespace rfb;
+
+// Room in front of each row so the first pixel has a (zero) left
+// neighbour
+static const int RowPadding = 16;
+
+FastLosslessEncoder::FastLosslessEncoder(SConnection* conn_) :
+  Encoder(conn_, encodingFastLossless, EncoderPlain),
+  currentRow(0), rowLen(0), outputPos(nullptr)
+{
+}
+
+FastLosslessEncoder::~FastLosslessEncoder()
+{
+}
+
+bool FastLosslessEncoder::isSupported()
+{
+  return conn->client.supportsEncoding(encodingFastLossless);
+}
+
+void FastLosslessEncoder::writeRect(const PixelBuffer* pb,
+                                    const Palette& /*palette*/)
+{
+  const uint8_t* buffer;
+  int stride, bpp, paddedLen;
+
+  bpp = prepareBuffers(pb->width(), pb->height(), pb->getPF());
+  paddedLen = residual.size();
+
+  buffer = pb->getBuffer(pb->getRect(), &stride);
+  stride *= pb->getPF().bpp/8;
+
+  for (int y = 0; y < pb->height(); y++) {
+    loadRow(buffer, pb->width(), pb->getPF());
+
+    filterRow(rows[currentRow].data() + RowPadding,
+              rows[currentRow ^ 1].data() + RowPadding,
+              rowLen, bpp, residual.data());
+    outputPos = packRow(residual.data(), paddedLen, outputPos);
+
+    currentRow ^= 1;
+    buffer += stride;
+  }
+
+  writeData();
+}
+
+void FastLosslessEncoder::writeSolidRect(int width, int height,
+                                         const PixelFormat& pf,
+                                         const uint8_t* colour)
+{
+  std::vector<uint8_t> line;
+  int bpp, paddedLen;
+
+  bpp = prepareBuffers(width, height, pf);
+  paddedLen = residual.size();
+
+  line.resize(width * pf.bpp/8);
+  for (int x = 0; x < width; x++)
+    memcpy(&line[x * pf.bpp/8], colour, pf.bpp/8);
+
+  // Everything but the first pixel will match the prediction, so
+  // this collapses to almost nothing
+  for (int y = 0; y < height; y++) {
+    loadRow(line.data(), width, pf);
+
+    filterRow(rows[currentRow].data() + RowPadding,
+              rows[currentRow ^ 1].data() + RowPadding,
+              rowLen, bpp, residual.data());
+    outputPos = packRow(residual.data(), paddedLen, outputPos);
+
+    currentRow ^= 1;
+  }
+
+  writeData();
+}
+
+int FastLosslessEncoder::prepareBuffers(int width, int height,
+                                        const PixelFormat& pf)
+{
+  int bpp, paddedLen;
+  size_t maxLen;
+
+  if ((pf.bpp == 32) && pf.is888())
+    bpp = 3;
+  else
+    bpp = pf.bpp/8;
+
+  rowLen = width * bpp;
+  paddedLen = (rowLen + fastLosslessBlockSize - 1) &
+              ~(fastLosslessBlockSize - 1);
+
+  // The area outside the actual pixels must read as zero
+  rows[0].assign(RowPadding + paddedLen, 0);
+  rows[1].assign(RowPadding + paddedLen, 0);
+  residual.assign(paddedLen, 0);
+  currentRow = 0;
+
+  // Worst case is a header and every bit plane for every block
+  maxLen = (size_t)height * (paddedLen / fastLosslessBlockSize) *
+           (1 + fastLosslessBlockSize);
+  if (output.size() < maxLen)
+    output.resize(maxLen);
+  outputPos = output.data();
+
+  return bpp;
+}
+
+void FastLosslessEncoder::loadRow(const uint8_t* src, int width,
+                                  const PixelFormat& pf)
+{
+  uint8_t* dst;
+
+  dst = rows[currentRow].data() + RowPadding;
+
+  if ((pf.bpp == 32) && pf.is888())
+    pf.rgbFromBuffer(dst, src, width);
+  else
+    memcpy(dst, src, rowLen);
+}
+
+void FastLosslessEncoder::writeData()
+{
+  rdr::OutStream* os;
+  size_t length;
+
+  length = outputPos - output.data();
+  assert(length <= output.size());
+
+  os = conn->getOutStream();
+  os->writeU32(length);
+  os->writeBytes(output.data(), length);
+}
+
+void FastLosslessEncoder::filterRow(const uint8_t* thisRow,
+                                    const uint8_t* prevRow,
+                                    int len, int bpp, uint8_t* out)
+{
+  int i;
+
+  // The rows have zeroes in front, so the first pixel just uses the
+  // pixel above as its prediction, and the first row the pixel to
+  // the left
+
+  i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= len; i += 16) {
+    __m128i up, left, upLeft, pix, est;
+
+    up = _mm_loadu_si128((const __m128i*)(prevRow + i));
+    left = _mm_loadu_si128((const __m128i*)(thisRow + i - bpp));
+    upLeft = _mm_loadu_si128((const __m128i*)(prevRow + i - bpp));
+    pix = _mm_loadu_si128((const __m128i*)(thisRow + i));
+
+    est = _mm_sub_epi8(_mm_add_epi8(up, left), upLeft);
+
+    _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(pix, est));
+  }
+#endif
+
+  for (; i < len; i++)
+    out[i] = thisRow[i] - thisRow[i - bpp] - prevRow[i] + prevRow[i - bpp];
+}
+
+uint8_t* FastLosslessEncoder::packRow(const uint8_t* residual_, int len,
+                                      uint8_t* out)
+{
+  uint8_t* run;
+
+  assert((len % fastLosslessBlockSize) == 0);
+
+  run = nullptr;
+
+  for (int i = 0; i < len; i += fastLosslessBlockSize) {
+    unsigned planes[8];
+    int bits;
+
+#ifdef __SSE2__
+    __m128i zero, r, z;
+
+    zero = _mm_setzero_si128();
+    r = _mm_loadu_si128((const __m128i*)(residual_ + i));
+
+    // Zigzag mapping, so small negative values also get few bits
+    z = _mm_xor_si128(_mm_add_epi8(r, r), _mm_cmpgt_epi8(zero, r));
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(z, zero)) == 0xffff) {
+      bits = 0;
+    } else {
+      // Shifting each byte left moves the next bit plane in to the
+      // top bit, which is what movemask picks up
+      for (int j = 7; j >= 0; j--) {
+        planes[j] = _mm_movemask_epi8(z);
+        z = _mm_add_epi8(z, z);
+      }
+
+      bits = 8;
+      while (planes[bits - 1] == 0)
+        bits--;
+    }
+#else
+    unsigned all;
+
+    memset(planes, 0, sizeof(planes));
+    all = 0;
+
+    for (unsigned b = 0; b < fastLosslessBlockSize; b++) {
+      uint8_t r, z;
+
+      r = residual_[i + b];
+      z = (r << 1) ^ ((r & 0x80) ? 0xff : 0x00);
+      all |= z;
+
+      for (int j = 0; j < 8; j++)
+        planes[j] |= ((z >> j) & 1) << b;
+    }
+
+    bits = 0;
+    while (all >> bits)
+      bits++;
+#endif
+
+    if (bits == 0) {
+      if ((run != nullptr) &&
+          ((*run & ~fastLosslessZeroRun) < (fastLosslessMaxRun - 1))) {
+        (*run)++;
+      } else {
+        run = out;
+        *out++ = fastLosslessZeroRun;
+      }
+      continue;
+    }
+
+    run = nullptr;
+
+    *out++ = bits;
+    for (int j = 0; j < bits; j++) {
+      *out++ = planes[j] & 0xff;
+      *out++ = planes[j] >> 8;
+    }
+  }
+
+  return out;
+}
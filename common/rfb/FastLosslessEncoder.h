@@ -0,0 +1,63 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef __RFB_FASTLOSSLESSENCODER_H__
+#define __RFB_FASTLOSSLESSENCODER_H__
+
+#include <vector>
+
+#include <rfb/Encoder.h>
+
+namespace rfb {
+
+  class FastLosslessEncoder : public Encoder {
+  public:
+    FastLosslessEncoder(SConnection* conn);
+    virtual ~FastLosslessEncoder();
+
+    bool isSupported() override;
+
+    void writeRect(const PixelBuffer* pb,
+                   const Palette& palette) override;
+    void writeSolidRect(int width, int height, const PixelFormat& pf,
+                        const uint8_t* colour) override;
+
+  protected:
+    // Prepares the row buffers and returns the bytes used per pixel
+    int prepareBuffers(int width, int height, const PixelFormat& pf);
+    void loadRow(const uint8_t* src, int width, const PixelFormat& pf);
+    void writeData();
+
+    static void filterRow(const uint8_t* thisRow, const uint8_t* prevRow,
+                          int len, int bpp, uint8_t* out);
+    static uint8_t* packRow(const uint8_t* residual, int len,
+                            uint8_t* out);
+
+  protected:
+    // Current and previous row, with room for the left neighbour of
+    // the first pixel in front
+    std::vector<uint8_t> rows[2];
+    int currentRow;
+    int rowLen;
+    std::vector<uint8_t> residual;
+
+    std::vector<uint8_t> output;
+    uint8_t* outputPos;
+  };
+}
+#endif
@@ -0,0 +1,272 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <new>
+
+#include <core/LogWriter.h>
+
+#include <rfb/FramebufferMemory.h>
+
+using namespace rfb;
+
+static core::LogWriter vlog("FramebufferMemory");
+
+// Everything is aligned to at least a cache line
+static const size_t cacheLineSize = 64;
+// The common huge page size on x86 and ARM
+static const size_t hugePageSize = 2 * 1024 * 1024;
+
+#ifdef __linux__
+// From <numaif.h>, so we don't need libnuma
+static const int MPOL_BIND_ = 2;
+#endif
+
+core::EnumParameter FramebufferMemory::hugePages
+("FramebufferHugePages",
+ "Use huge pages for large framebuffers (none, transparent or explicit)",
+ {"none", "transparent", "explicit"}, "none");
+core::BoolParameter FramebufferMemory::padRows
+("FramebufferPadRows",
+ "Pad each framebuffer row to a multiple of the cache line size",
+ false);
+core::IntParameter FramebufferMemory::numaNode
+("FramebufferNUMANode",
+ "Bind framebuffer memory to this NUMA node (-1 = no binding)",
+ -1, -1, 1023);
+
+FramebufferMemory::FramebufferMemory()
+  : data_(nullptr), size_(0), mapSize(0), kind(kindHeap)
+{
+}
+
+FramebufferMemory::~FramebufferMemory()
+{
+  release();
+}
+
+void FramebufferMemory::allocate(size_t size)
+{
+  uint8_t* newData;
+
+  release();
+
+  if (size == 0)
+    return;
+
+  newData = nullptr;
+
+  // Huge pages are pointless for anything smaller than a page
+  if ((size >= hugePageSize) && (hugePages == "explicit")) {
+    newData = allocateHugeTLB(size);
+    if (newData != nullptr)
+      kind = kindHugeTLB;
+  }
+
+  // A policy can only be set reliably on pages that we own and that
+  // haven't been touched yet, so NUMA binding needs a mapping of its
+  // own rather than heap memory
+  if ((newData == nullptr) && (numaNode != -1)) {
+    newData = allocateMapping(size);
+    if (newData != nullptr)
+      kind = kindMapping;
+  }
+
+  if (newData == nullptr) {
+    if ((size >= hugePageSize) && (hugePages != "none"))
+      newData = allocateHeap(size, hugePageSize);
+    else
+      newData = allocateHeap(size, cacheLineSize);
+    kind = kindHeap;
+  }
+
+#ifdef MADV_HUGEPAGE
+  if ((size >= hugePageSize) && (hugePages != "none") &&
+      (kind != kindHugeTLB)) {
+    if (madvise(newData, size, MADV_HUGEPAGE) != 0)
+      vlog.debug("Failed to enable transparent huge pages: %s",
+                 strerror(errno));
+  }
+#endif
+
+  if (numaNode != -1) {
+    if (kind != kindHeap)
+      bindNode(newData, mapSize);
+    else
+      vlog.error("Cannot bind framebuffer to NUMA node %d",
+                 (int)numaNode);
+  }
+
+  data_ = newData;
+  size_ = size;
+}
+
+void FramebufferMemory::release()
+{
+  if (data_ == nullptr)
+    return;
+
+#ifndef WIN32
+  if (kind != kindHeap)
+    munmap(data_, mapSize);
+  else
+    free(data_);
+#else
+  _aligned_free(data_);
+#endif
+
+  data_ = nullptr;
+  size_ = 0;
+  mapSize = 0;
+  kind = kindHeap;
+}
+
+int FramebufferMemory::getStride(int width, int bpp)
+{
+  int bytesPerPixel, rowBytes;
+
+  if (!padRows || (bpp < 8))
+    return width;
+
+  bytesPerPixel = bpp / 8;
+  rowBytes = width * bytesPerPixel;
+  rowBytes = (rowBytes + cacheLineSize - 1) & ~(cacheLineSize - 1);
+
+  // Odd pixel sizes might not divide evenly in to a cache line
+  if ((rowBytes % bytesPerPixel) != 0)
+    return width;
+
+  return rowBytes / bytesPerPixel;
+}
+
+uint8_t* FramebufferMemory::allocateHeap(size_t size, size_t alignment)
+{
+  void* ptr;
+
+#ifdef WIN32
+  ptr = _aligned_malloc(size, alignment);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+#else
+  if (posix_memalign(&ptr, alignment, size) != 0)
+    throw std::bad_alloc();
+#endif
+
+  return (uint8_t*)ptr;
+}
+
+uint8_t* FramebufferMemory::allocateMapping(size_t size)
+{
+#ifndef WIN32
+  void* ptr;
+  size_t pageSize;
+
+  pageSize = sysconf(_SC_PAGESIZE);
+  mapSize = (size + pageSize - 1) & ~(pageSize - 1);
+
+  ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    vlog.error("Failed to map framebuffer memory: %s", strerror(errno));
+    mapSize = 0;
+    return nullptr;
+  }
+
+  return (uint8_t*)ptr;
+#else
+  (void)size;
+  return nullptr;
+#endif
+}
+
+uint8_t* FramebufferMemory::allocateHugeTLB(size_t size)
+{
+#if defined(__linux__) && defined(MAP_HUGETLB)
+  void* ptr;
+
+  mapSize = (size + hugePageSize - 1) & ~(hugePageSize - 1);
+
+  ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr == MAP_FAILED) {
+    // Most likely no huge pages have been reserved, so there is no
+    // point in complaining about it more than once
+    static bool warned = false;
+    if (!warned) {
+      vlog.error("Failed to allocate huge pages, falling back to "
+                 "transparent huge pages: %s", strerror(errno));
+      warned = true;
+    }
+    mapSize = 0;
+    return nullptr;
+  }
+
+  return (uint8_t*)ptr;
+#else
+  (void)size;
+  return nullptr;
+#endif
+}
+
+void FramebufferMemory::bindNode(uint8_t* data, size_t size)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+  unsigned long mask[1024 / (sizeof(unsigned long) * 8)];
+  size_t bits;
+
+  bits = sizeof(unsigned long) * 8;
+
+  memset(mask, 0, sizeof(mask));
+  mask[numaNode / bits] |= 1UL << (numaNode % bits);
+
+  // The mapping is fresh, so there is nothing to move and the pages
+  // will be placed on the node as they are first touched. The kernel
+  // wants one more than the number of bits in the mask.
+  if (syscall(SYS_mbind, data, size, MPOL_BIND_, mask,
+              sizeof(mask) * 8 + 1, 0) != 0) {
+    vlog.error("Failed to bind framebuffer to NUMA node %d: %s",
+               (int)numaNode, strerror(errno));
+  }
+#else
+  (void)data;
+  (void)size;
+  static bool warned = false;
+  if (!warned) {
+    vlog.error("NUMA binding is not supported on this platform");
+    warned = true;
+  }
+#endif
+}
@@ -0,0 +1,74 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+//
+// FramebufferMemory - backing memory for large pixel buffers
+//
+
+#ifndef __RFB_FRAMEBUFFERMEMORY_H__
+#define __RFB_FRAMEBUFFERMEMORY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <core/Configuration.h>
+
+namespace rfb {
+
+  // Memory is always aligned to a cache line. Depending on the
+  // settings it can also be backed by huge pages, to avoid TLB misses
+  // when scanning large buffers, and be bound to a specific NUMA node.
+
+  class FramebufferMemory {
+  public:
+    FramebufferMemory();
+    ~FramebufferMemory();
+
+    // allocate() replaces the current memory with a block of at least
+    // size bytes. The contents are undefined.
+    void allocate(size_t size);
+    void release();
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // getStride() returns the number of pixels to use for each row of
+    // a buffer that is width pixels wide
+    static int getStride(int width, int bpp);
+
+    static core::EnumParameter hugePages;
+    static core::BoolParameter padRows;
+    static core::IntParameter numaNode;
+
+  private:
+    enum Kind { kindHeap, kindMapping, kindHugeTLB };
+
+    uint8_t* allocateHeap(size_t size, size_t alignment);
+    uint8_t* allocateMapping(size_t size);
+    uint8_t* allocateHugeTLB(size_t size);
+    void bindNode(uint8_t* data, size_t size);
+
+  private:
+    uint8_t* data_;
+    size_t size_;
+    size_t mapSize;
+    Kind kind;
+  };
+
+}
+
+#endif
@@ -19,6 +19,8 @@
 #ifndef __RFB_HEXTILEDECODER_H__
 #define __RFB_HEXTILEDECODER_H__
 
+#include <core/Rect.h>
+
 #include <rfb/Decoder.h>
 
 namespace rfb {
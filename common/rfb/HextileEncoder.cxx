@@ -24,6 +24,10 @@
 
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <core/Configuration.h>
 
 #include <rdr/OutStream.h>
@@ -45,6 +49,120 @@ core::BoolParameter improvedHextile("ImprovedHextile",
                                     "CPU time",
                                     true);
 
+//
+// Tile analysis helpers. Tiles are at most 16 pixels wide, so a row of
+// a tile can be described by a 16 bit mask.
+//
+
+static inline int countTrailingZeros(unsigned v)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(v);
+#else
+  int n = 0;
+  while (!(v & 1)) {
+    v >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static inline int countBits(unsigned v)
+{
+#ifdef __GNUC__
+  return __builtin_popcount(v);
+#else
+  int n = 0;
+  while (v) {
+    v &= v - 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+//
+// Returns a mask of the pixels in a tile row that have the given
+// colour. The SSE2 version always reads 16 pixels, so the tile must be
+// stored in a buffer of 256 pixels.
+//
+
+template<class T>
+static inline unsigned rowMask(const T* row, int w, T colour)
+{
+#ifdef __SSE2__
+  __m128i c, a, b;
+
+  if (sizeof(T) == 1) {
+    c = _mm_set1_epi8((char)colour);
+    a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)row), c);
+  } else if (sizeof(T) == 2) {
+    c = _mm_set1_epi16((short)colour);
+    a = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)row), c);
+    b = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(row + 8)), c);
+    a = _mm_packs_epi16(a, b);
+  } else {
+    c = _mm_set1_epi32((int)colour);
+    a = _mm_packs_epi32(
+      _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)row), c),
+      _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(row + 4)), c));
+    b = _mm_packs_epi32(
+      _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(row + 8)), c),
+      _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(row + 12)), c));
+    a = _mm_packs_epi16(a, b);
+  }
+
+  return _mm_movemask_epi8(a) & ((1 << w) - 1);
+#else
+  unsigned mask = 0;
+  for (int x = 0; x < w; x++) {
+    if (row[x] == colour)
+      mask |= 1 << x;
+  }
+  return mask;
+#endif
+}
+
+//
+// Finds the first two colours of a tile and counts their pixels, in a
+// single pass over the rows. The rows of the first colour are stored
+// in mask0. Returns 1 for solid tiles, 2 if the tile has exactly two
+// colours and 3 if it has more. The scan stops as soon as a third
+// colour is seen, so the masks and counts are then incomplete.
+//
+
+template<class T>
+static int scanTile(const T* data, int w, int h, T* colour0, T* colour1,
+                    uint16_t* mask0, int* count0, int* count1)
+{
+  const unsigned full = (1 << w) - 1;
+
+  *colour0 = data[0];
+  *count0 = *count1 = 0;
+
+  for (int y = 0; y < h; y++) {
+    const T* row = data + y * w;
+    unsigned mask, mask1;
+
+    mask = rowMask(row, w, *colour0);
+    mask0[y] = mask;
+    *count0 += countBits(mask);
+    if (mask == full)
+      continue;
+
+    if (*count1 == 0)
+      *colour1 = row[countTrailingZeros(~mask)];
+
+    mask1 = rowMask(row, w, *colour1);
+    *count1 += countBits(mask1);
+    if ((mask | mask1) != full)
+      return 3;
+  }
+
+  return *count1 == 0 ? 1 : 2;
+}
+
 HextileEncoder::HextileEncoder(SConnection* conn_) :
   Encoder(conn_, encodingHextile, EncoderPlain)
 {
@@ -260,33 +378,20 @@ int HextileEncoder::hextileEncodeTile(T* data, int w, int h,
 template<class T>
 int HextileEncoder::testTileType(T* data, int w, int h, T* bg, T* fg)
 {
-  T pix1 = *data;
-  T* end = data + w * h;
-
-  T* ptr = data + 1;
-  while (ptr < end && *ptr == pix1)
-    ptr++;
+  T pix1, pix2;
+  uint16_t mask[16];
+  int count1, count2;
 
-  if (ptr == end) {
+  int numColours = scanTile(data, w, h, &pix1, &pix2, mask,
+                            &count1, &count2);
+  if (numColours == 1) {
     *bg = pix1;
     return 0;                   // solid-color tile
   }
 
-  int count1 = ptr - data;
-  int count2 = 1;
-  T pix2 = *ptr++;
   int tileType = hextileAnySubrects;
-
-  for (; ptr < end; ptr++) {
-    if (*ptr == pix1) {
-      count1++;
-    } else if (*ptr == pix2) {
-      count2++;
-    } else {
-      tileType |= hextileSubrectsColoured;
-      break;
-    }
-  }
+  if (numColours > 2)
+    tileType |= hextileSubrectsColoured;
 
   if (count1 >= count2) {
     *bg = pix1; *fg = pix2;
@@ -308,7 +413,8 @@ class HextileTile {
   HextileTile ();
 
   //
-  // Initialize existing object instance with new tile data.
+  // Initialize existing object instance with new tile data. The tile
+  // must be stored in a buffer with room for 256 pixels.
   //
   void newTile(const T *src, int w, int h);
 
@@ -351,6 +457,13 @@ class HextileTile {
   //
   void analyze();
 
+  //
+  // Find the subrects of tiles with exactly two colours, or with more
+  // than that.
+  //
+  void analyzeMono();
+  void analyzeColoured();
+
   const T *m_tile;
   int m_width;
   int m_height;
@@ -366,7 +479,9 @@ class HextileTile {
 
  private:
 
-  bool m_processed[16][16];
+  // Rows of pixels that have the first colour of the tile
+  uint16_t m_mask[16];
+
   Palette m_pal;
 };
 
@@ -393,62 +508,138 @@ void HextileTile<T>::analyze()
 {
   assert(m_tile && m_width && m_height);
 
-  const T *ptr = m_tile;
-  const T *end = &m_tile[m_width * m_height];
-  T color = *ptr++;
-  while (ptr != end && *ptr == color)
-    ptr++;
+  // Busy tiles usually show three colours right away, in which case
+  // there is no point in scanning for two colour tiles
+  if ((m_width > 2) && (m_tile[1] != m_tile[0]) &&
+      (m_tile[2] != m_tile[0]) && (m_tile[2] != m_tile[1])) {
+    analyzeColoured();
+    return;
+  }
+
+  int count0, count1;
+  int numColours = scanTile(m_tile, m_width, m_height, &m_background,
+                            &m_foreground, m_mask, &count0, &count1);
 
   // Handle solid tile
-  if (ptr == end) {
-    m_background = m_tile[0];
+  if (numColours == 1) {
     m_flags = 0;
     m_size = 0;
     return;
   }
 
-  // Compute number of complete rows of the same color, at the top
-  int y = (ptr - m_tile) / m_width;
+  if (numColours == 2)
+    analyzeMono();
+  else
+    analyzeColoured();
+}
 
+template<class T>
+void HextileTile<T>::analyzeMono()
+{
+  const int w = m_width;
+  const int h = m_height;
+  const unsigned full = (1 << w) - 1;
+
+  uint16_t pending[16];
+  int numRects[2] = { 0, 0 };
+
+  // The tile is fully described by the mask of the first colour, so
+  // the pixels never have to be looked at again
   T *colorsPtr = m_colors;
   uint8_t *coordsPtr = m_coords;
-  m_pal.clear();
-  m_numSubrects = 0;
-
-  // Have we found the first subrect already?
-  if (y > 0) {
-    *colorsPtr++ = color;
-    *coordsPtr++ = 0;
-    *coordsPtr++ = (uint8_t)(((m_width - 1) << 4) | ((y - 1) & 0x0F));
-    m_pal.insert(color, 1);
-    m_numSubrects++;
-  }
 
-  memset(m_processed, 0, 16 * 16 * sizeof(bool));
+  for (int y = 0; y < h; y++)
+    pending[y] = full;
 
-  int x, sx, sy, sw, sh, max_x;
+  for (int y = 0; y < h; y++) {
+    while (pending[y] != 0) {
+      int x, c, sw, sh;
+      unsigned mask, bits;
 
-  for (; y < m_height; y++) {
-    for (x = 0; x < m_width; x++) {
-      // Skip pixels that were processed earlier
-      if (m_processed[y][x]) {
-        continue;
-      }
-      // Determine dimensions of the horizontal subrect
-      color = m_tile[y * m_width + x];
-      for (sx = x + 1; sx < m_width; sx++) {
-        if (m_tile[y * m_width + sx] != color)
+      x = countTrailingZeros(pending[y]);
+      c = (m_mask[y] >> x) & 1 ? 0 : 1;
+      mask = c == 0 ? m_mask[y] : m_mask[y] ^ full;
+
+      // Determine dimensions of the horizontal subrect, and then
+      // extend it downwards as long as the whole span matches
+      sw = countTrailingZeros(~(mask >> x));
+      bits = ((1 << sw) - 1) << x;
+
+      for (sh = 1; y + sh < h; sh++) {
+        mask = c == 0 ? m_mask[y + sh] : m_mask[y + sh] ^ full;
+        if ((mask & bits) != bits)
           break;
       }
-      sw = sx - x;
-      max_x = sx;
-      for (sy = y + 1; sy < m_height; sy++) {
-        for (sx = x; sx < max_x; sx++) {
-          if (m_tile[sy * m_width + sx] != color)
-            goto done;
-        }
+
+      *colorsPtr++ = c == 0 ? m_background : m_foreground;
+      *coordsPtr++ = (uint8_t)((x << 4) | (y & 0x0F));
+      *coordsPtr++ = (uint8_t)(((sw - 1) << 4) | ((sh - 1) & 0x0F));
+      numRects[c]++;
+
+      for (int sy = y; sy < y + sh; sy++)
+        pending[sy] &= ~bits;
+    }
+  }
+
+  m_numSubrects = numRects[0] + numRects[1];
+
+  // The colour with the most subrects becomes the background, so that
+  // they don't have to be sent
+  if (numRects[1] > numRects[0])
+    std::swap(m_background, m_foreground);
+
+  m_flags = hextileAnySubrects;
+  m_size = 1 + 2 * std::min(numRects[0], numRects[1]);
+}
+
+template<class T>
+void HextileTile<T>::analyzeColoured()
+{
+  const T *tile = m_tile;
+  const int w = m_width;
+  const int h = m_height;
+
+  uint16_t pending[16];
+  int numSubrects;
+
+  T *colorsPtr = m_colors;
+  uint8_t *coordsPtr = m_coords;
+  m_pal.clear();
+  numSubrects = 0;
+
+  for (int y = 0; y < h; y++)
+    pending[y] = (1 << w) - 1;
+
+  for (int y = 0; y < h; y++) {
+    const T *row = &tile[y * w];
+    unsigned todo = pending[y];
+
+    // Skip pixels that were processed earlier
+    while (todo != 0) {
+      int x, sy, sw, sh;
+      unsigned bits;
+      T color;
+
+      x = countTrailingZeros(todo);
+      color = row[x];
+
+      // Determine dimensions of the horizontal subrect. Busy tiles
+      // mostly have very short ones, so only compare a whole row at
+      // once if there is more than a single pixel.
+      if ((x + 1 < w) && (row[x + 1] == color))
+        sw = countTrailingZeros(~(rowMask(row, w, color) >> x));
+      else
+        sw = 1;
+      bits = ((1 << sw) - 1) << x;
+
+      for (sy = y + 1; sy < h; sy++) {
+        if (tile[sy * w + x] != color)
+          break;
+        if (sw == 1)
+          continue;
+        if ((rowMask(&tile[sy * w], w, color) & bits) != bits)
+          break;
       }
-    done:
       sh = sy - y;
 
       // Save properties of this subrect
@@ -464,36 +655,25 @@ void HextileTile<T>::analyze()
         return;
       }
 
-      m_numSubrects++;
-
-      // Mark pixels of this subrect as processed, below this row
-      for (sy = y + 1; sy < y + sh; sy++) {
-        for (sx = x; sx < x + sw; sx++)
-          m_processed[sy][sx] = true;
-      }
+      numSubrects++;
 
-      // Skip processed pixels of this row
-      x += (sw - 1);
+      // Mark pixels of this subrect as processed
+      todo &= ~bits;
+      for (sy = y + 1; sy < y + sh; sy++)
+        pending[sy] &= ~bits;
     }
   }
 
-  // Save number of colors in this tile (should be no less than 2)
+  m_numSubrects = numSubrects;
+
+  // Save number of colors in this tile (should be more than 2)
   int numColors = m_pal.size();
-  assert(numColors >= 2);
+  assert(numColors > 2);
+  (void)numColors;
 
   m_background = (T)m_pal.getColour(0);
-  m_flags = hextileAnySubrects;
-  int numSubrects = m_numSubrects - m_pal.getCount(0);
-
-  if (numColors == 2) {
-    // Monochrome tile
-    m_foreground = (T)m_pal.getColour(1);
-    m_size = 1 + 2 * numSubrects;
-  } else {
-    // Colored tile
-    m_flags |= hextileSubrectsColoured;
-    m_size = 1 + (2 + sizeof(T)) * numSubrects;
-  }
+  m_flags = hextileAnySubrects | hextileSubrectsColoured;
+  m_size = 1 + (2 + sizeof(T)) * (numSubrects - m_pal.getCount(0));
 }
 
 template<class T>
@@ -62,6 +62,26 @@ int JPEGEncoder::getQualityLevel()
   return jc.getQualityLevel();
 }
 
+void JPEGEncoder::checkpoint()
+{
+  // The client remembers the last tables we sent
+  savedHuffmanTables = lastHuffmanTables;
+  savedQuantTables = lastQuantTables;
+}
+
+void JPEGEncoder::commit()
+{
+  savedHuffmanTables.clear();
+  savedQuantTables.clear();
+}
+
+void JPEGEncoder::rollback()
+{
+  lastHuffmanTables.swap(savedHuffmanTables);
+  lastQuantTables.swap(savedQuantTables);
+  commit();
+}
+
 void JPEGEncoder::writeRect(const PixelBuffer* pb,
                             const Palette& /*palette*/)
 {
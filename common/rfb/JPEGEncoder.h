@@ -44,11 +44,18 @@ namespace rfb {
     void writeSolidRect(int width, int height, const PixelFormat& pf,
                         const uint8_t* colour) override;
 
+    void checkpoint() override;
+    void commit() override;
+    void rollback() override;
+
   protected:
     JpegCompressor jc;
 
     std::vector<uint8_t> lastHuffmanTables;
     std::vector<uint8_t> lastQuantTables;
+
+    std::vector<uint8_t> savedHuffmanTables;
+    std::vector<uint8_t> savedQuantTables;
   };
 }
 #endif
@@ -220,8 +220,6 @@ void JpegCompressor::compress(const uint8_t *buf, volatile int stride,
   int h = r.height();
   int pixelsize;
   uint8_t * volatile srcBuf = nullptr;
-  volatile bool srcBufIsTemp = false;
-  JSAMPROW * volatile rowPointer = nullptr;
 
   if (qualityLevel >= 0 && qualityLevel <= 9) {
     quality = conf[qualityLevel].quality;
@@ -240,8 +238,6 @@ void JpegCompressor::compress(const uint8_t *buf, volatile int stride,
   if(setjmp(err->jmpBuffer)) {
     // this will execute if libjpeg has an error
     jpeg_abort_compress(cinfo);
-    if (srcBufIsTemp && srcBuf) delete[] srcBuf;
-    if (rowPointer) delete[] rowPointer;
     throw std::runtime_error(err->lastError);
   }
 
@@ -272,8 +268,8 @@ void JpegCompressor::compress(const uint8_t *buf, volatile int stride,
     stride = w;
 
   if (cinfo->in_color_space == JCS_RGB) {
-    srcBuf = new uint8_t[w * h * pixelsize];
-    srcBufIsTemp = true;
+    convertBuffer.resize(w * h * pixelsize);
+    srcBuf = convertBuffer.data();
     pf.rgbFromBuffer(srcBuf, (const uint8_t *)buf, w, stride, h);
     stride = w;
   }
@@ -310,19 +306,16 @@ void JpegCompressor::compress(const uint8_t *buf, volatile int stride,
     cinfo->comp_info[0].v_samp_factor = 1;
   }
 
-  rowPointer = new JSAMPROW[h];
+  rowPointers.resize(h);
   for (int dy = 0; dy < h; dy++)
-    rowPointer[dy] = (JSAMPROW)(&srcBuf[dy * stride * pixelsize]);
+    rowPointers[dy] = &srcBuf[dy * stride * pixelsize];
 
   jpeg_start_compress(cinfo, TRUE);
   while (cinfo->next_scanline < cinfo->image_height)
-    jpeg_write_scanlines(cinfo, &rowPointer[cinfo->next_scanline],
+    jpeg_write_scanlines(cinfo, &rowPointers[cinfo->next_scanline],
       cinfo->image_height - cinfo->next_scanline);
 
   jpeg_finish_compress(cinfo);
-
-  if (srcBufIsTemp) delete[] srcBuf;
-  delete[] rowPointer;
 }
 
 void JpegCompressor::writeBytes(const uint8_t* /*data*/, int /*length*/)
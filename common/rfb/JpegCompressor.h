@@ -25,6 +25,8 @@
 #ifndef __RFB_JPEGCOMPRESSOR_H__
 #define __RFB_JPEGCOMPRESSOR_H__
 
+#include <vector>
+
 #include <core/Rect.h>
 
 #include <rdr/MemOutStream.h>
@@ -67,6 +69,9 @@ namespace rfb {
     struct JPEG_ERROR_MGR *err;
     struct JPEG_DEST_MGR *dest;
 
+    // Kept between calls to avoid allocating for every rect
+    std::vector<uint8_t> convertBuffer;
+    std::vector<uint8_t*> rowPointers;
   };
 
 } // end of namespace rfb
@@ -401,20 +401,17 @@ void FullFramePixelBuffer::setSize(int /*w*/, int /*h*/)
 // Automatically allocates enough space for the specified format & area
 
 ManagedPixelBuffer::ManagedPixelBuffer()
-  : data_(nullptr), datasize(0)
 {
 }
 
 ManagedPixelBuffer::ManagedPixelBuffer(const PixelFormat& pf, int w, int h)
-  : FullFramePixelBuffer(pf, 0, 0, nullptr, 0), data_(nullptr), datasize(0)
+  : FullFramePixelBuffer(pf, 0, 0, nullptr, 0)
 {
   setSize(w, h);
 }
 
 ManagedPixelBuffer::~ManagedPixelBuffer()
 {
-  if (data_)
-    delete [] data_;
 }
 
 void ManagedPixelBuffer::setPF(const PixelFormat &pf)
@@ -425,20 +422,14 @@ void ManagedPixelBuffer::setPF(const PixelFormat &pf)
 
 void ManagedPixelBuffer::setSize(int w, int h)
 {
-  unsigned long new_datasize = w * h * (format.bpp/8);
-
-  new_datasize = w * h * (format.bpp/8);
-  if (datasize < new_datasize) {
-    if (data_) {
-      delete [] data_;
-      data_ = nullptr;
-      datasize = 0;
-    }
-    if (new_datasize) {
-      data_ = new uint8_t[new_datasize];
-      datasize = new_datasize;
-    }
-  }
+  int new_stride;
+  size_t new_datasize;
+
+  new_stride = FramebufferMemory::getStride(w, format.bpp);
+
+  new_datasize = (size_t)new_stride * h * (format.bpp/8);
+  if (memory.size() < new_datasize)
+    memory.allocate(new_datasize);
 
-  setBuffer(w, h, data_, w);
+  setBuffer(w, h, memory.data(), new_stride);
 }
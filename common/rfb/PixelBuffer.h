@@ -27,6 +27,7 @@
 
 #include <core/Rect.h>
 
+#include <rfb/FramebufferMemory.h>
 #include <rfb/PixelFormat.h>
 
 namespace core { class Region; }
@@ -188,8 +189,7 @@ namespace rfb {
     void setSize(int w, int h) override;
 
   private:
-    uint8_t* data_; // Mirrors FullFramePixelBuffer::data
-    unsigned long datasize;
+    FramebufferMemory memory;
   };
 
 };
@@ -0,0 +1,240 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+/*
+ * This code picks JPEG quality, chroma subsampling and compression
+ * level for a client based on what it can actually keep up with.
+ *
+ * The main signal is the load, i.e. how much of the time is spent
+ * receiving and decoding updates. A client that is busy all the time
+ * is limited by either the network or the decoder, so the settings
+ * are made cheaper. Which setting is changed depends on how much of
+ * that time is spent decoding. A client that is mostly idle can afford
+ * better quality.
+ *
+ * The decode cost per pixel guards the improvements. A low load might
+ * only mean that little is changing on the screen, and if every pixel
+ * is already expensive to decode then better quality would make the
+ * next big update stall the client.
+ *
+ * Changes for the worse are made right away to keep the session
+ * responsive, but changes for the better require the load to stay low
+ * for a while and are made in smaller steps. The gap between the two
+ * load thresholds also keeps things from flipping back and forth.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <rfb/ClientParams.h>
+#include <rfb/QualityControl.h>
+
+using namespace rfb;
+
+// Load (in percent) above which settings are made cheaper, and below
+// which they are made better
+static const unsigned HighLoad = 80;
+static const unsigned LowLoad = 40;
+
+// Decode share (in percent) above which the decoder is considered the
+// bottleneck, and below which it can afford more detail
+static const unsigned HighDecodeShare = 50;
+static const unsigned LowDecodeShare = 25;
+
+// Decode cost (in nanoseconds per pixel) above which quality and
+// subsampling are not improved, as a full HD update would then take
+// over 40 ms to decode
+static const unsigned HighDecodeCost = 20;
+
+// Evaluations with a low load needed before improving anything
+static const unsigned ImproveRounds = 2;
+
+static const int MinQuality = 20;
+static const int MaxQuality = 95;
+static const int QualityStepDown = 10;
+static const int QualityStepUp = 5;
+
+static const int MaxSubsampling = subsample4X;
+static const int MaxCompressLevel = 6;
+
+// Round trip time (in ms) below which bandwidth is considered cheap
+// enough to save the server some effort with a lower compression level
+static const int LanRTT = 5;
+
+// Matches the JPEG qualities of the coarse quality levels
+static const int levelQuality[10] = { 15, 29, 41, 42, 62, 77, 79, 86, 92, 100 };
+
+QualityControl::QualityControl()
+{
+  reset(20000000);
+}
+
+QualityControl::~QualityControl()
+{
+}
+
+void QualityControl::reset(unsigned long long bps)
+{
+  // Same starting point as the coarse quality levels 8 and 6
+  if (bps > 16000000)
+    quality = 92;
+  else
+    quality = 79;
+  subsampling = subsampleNone;
+  compressLevel = 2;
+
+  reason = "";
+  improveRounds = 0;
+
+  updates = 0;
+  busyTime = 0;
+  decodeTime = 0;
+  pixels = 0;
+
+  load = 0;
+  decodeShare = 0;
+  decodeCost = 0;
+  frameRate = 0;
+  rtt = -1;
+}
+
+void QualityControl::updateDone(unsigned elapsed, size_t pixels_,
+                                unsigned decodeTime_)
+{
+  updates++;
+  busyTime += elapsed;
+  decodeTime += decodeTime_;
+  pixels += pixels_;
+}
+
+void QualityControl::gotRTT(unsigned rtt_)
+{
+  // Smooth out the noise a bit
+  if (rtt == -1)
+    rtt = rtt_;
+  else
+    rtt = (rtt * 3 + (int)rtt_) / 4;
+}
+
+bool QualityControl::adjust(unsigned period)
+{
+  bool changed;
+
+  if (period == 0)
+    return false;
+
+  // Nothing to judge the settings by?
+  if (updates == 0) {
+    improveRounds = 0;
+    return false;
+  }
+
+  load = busyTime / 10 / period;
+  if (load > 100)
+    load = 100;
+  decodeShare = busyTime ? decodeTime * 100 / busyTime : 0;
+  if (decodeShare > 100)
+    decodeShare = 100;
+  decodeCost = pixels ? decodeTime * 1000 / pixels : 0;
+  frameRate = updates * 1000 / period;
+
+  updates = 0;
+  busyTime = 0;
+  decodeTime = 0;
+  pixels = 0;
+
+  changed = false;
+
+  if (load >= HighLoad) {
+    improveRounds = 0;
+
+    if (decodeShare >= HighDecodeShare) {
+      // Less chroma data is cheaper to decode and costs little in
+      // perceived quality
+      if (subsampling < MaxSubsampling) {
+        // Gray is not a step between none and 2X
+        if (subsampling == subsampleNone)
+          subsampling = subsample2X;
+        else
+          subsampling++;
+        changed = true;
+      } else if (quality > MinQuality) {
+        quality -= QualityStepDown;
+        changed = true;
+      }
+      reason = "decoding is too slow";
+    } else {
+      if (quality > MinQuality) {
+        quality -= QualityStepDown;
+        changed = true;
+      } else if (compressLevel < MaxCompressLevel) {
+        compressLevel++;
+        changed = true;
+      }
+      reason = "throughput is too low";
+    }
+
+    if (quality < MinQuality)
+      quality = MinQuality;
+  } else if (load <= LowLoad) {
+    int minCompressLevel;
+
+    improveRounds++;
+    if (improveRounds < ImproveRounds)
+      return false;
+    improveRounds = 0;
+
+    minCompressLevel = ((rtt != -1) && (rtt < LanRTT)) ? 1 : 2;
+
+    if (compressLevel > minCompressLevel) {
+      compressLevel--;
+      changed = true;
+    } else if (decodeCost > HighDecodeCost) {
+      // Both of the below make decoding more expensive
+    } else if ((subsampling > subsampleNone) &&
+               (decodeShare < LowDecodeShare)) {
+      subsampling--;
+      if (subsampling == subsampleGray)
+        subsampling = subsampleNone;
+      changed = true;
+    } else if (quality < MaxQuality) {
+      quality += QualityStepUp;
+      if (quality > MaxQuality)
+        quality = MaxQuality;
+      changed = true;
+    }
+    reason = "there is spare capacity";
+  } else {
+    improveRounds = 0;
+  }
+
+  return changed;
+}
+
+int QualityControl::getQualityLevel() const
+{
+  int level;
+
+  for (level = 9; level > 0; level--) {
+    if (levelQuality[level] <= quality)
+      break;
+  }
+
+  return level;
+}
@@ -0,0 +1,93 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef __RFB_QUALITYCONTROL_H__
+#define __RFB_QUALITYCONTROL_H__
+
+#include <stddef.h>
+
+namespace rfb {
+  class QualityControl {
+  public:
+    QualityControl();
+    ~QualityControl();
+
+    // reset() picks starting settings based on a bandwidth estimate
+    // in bits per second and forgets all measurements.
+    void reset(unsigned long long bps);
+
+    // updateDone() registers a finished framebuffer update. elapsed is
+    // the time in microseconds from the start of the update until it
+    // was decoded, pixels the area it covered and decodeTime the time
+    // in microseconds the decoder threads spent on it.
+    void updateDone(unsigned elapsed, size_t pixels, unsigned decodeTime);
+
+    // gotRTT() registers a round trip time measurement in
+    // milliseconds.
+    void gotRTT(unsigned rtt);
+
+    // adjust() evaluates what has been registered over the last
+    // period milliseconds and returns true if the settings changed.
+    // getReason() then describes why.
+    bool adjust(unsigned period);
+    const char* getReason() const { return reason; }
+
+    // The current settings, as a fine JPEG quality (0-100), a
+    // subsampling level (subsample* from ClientParams.h) and a
+    // compression level (0-9). getQualityLevel() gives the closest
+    // coarse quality level for servers without fine quality support.
+    int getQuality() const { return quality; }
+    int getSubsampling() const { return subsampling; }
+    int getCompressLevel() const { return compressLevel; }
+    int getQualityLevel() const;
+
+    // The measurements behind the last evaluation. Load is how much of
+    // the time was spent receiving and decoding updates, and decode
+    // share how much of that was decoding, both in percent. Decode
+    // cost is in nanoseconds per pixel, frame rate in updates per
+    // second and the round trip time in milliseconds, or -1 if
+    // unknown.
+    unsigned getLoad() const { return load; }
+    unsigned getDecodeShare() const { return decodeShare; }
+    unsigned getDecodeCost() const { return decodeCost; }
+    unsigned getFrameRate() const { return frameRate; }
+    int getRTT() const { return rtt; }
+
+  private:
+    int quality;
+    int subsampling;
+    int compressLevel;
+
+    const char* reason;
+    unsigned improveRounds;
+
+    // Accumulated since the last evaluation
+    unsigned updates;
+    unsigned long long busyTime;
+    unsigned long long decodeTime;
+    unsigned long long pixels;
+
+    unsigned load;
+    unsigned decodeShare;
+    unsigned decodeCost;
+    unsigned frameRate;
+    int rtt;
+  };
+}
+
+#endif
@@ -21,6 +21,7 @@
 #include <config.h>
 #endif
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -50,7 +51,7 @@ static core::LogWriter vlog("SConnection");
 
 SConnection::SConnection(AccessRights accessRights_)
   : readyForSetColourMapEntries(false), is(nullptr), os(nullptr),
-    reader_(nullptr), writer_(nullptr), ssecurity(nullptr),
+    realOs(nullptr), reader_(nullptr), writer_(nullptr), ssecurity(nullptr),
     authFailureTimer(this, &SConnection::handleAuthFailureTimeout),
     state_(RFBSTATE_UNINITIALISED), preferredEncoding(encodingRaw),
     accessRights(accessRights_), hasRemoteClipboard(false),
@@ -76,6 +77,22 @@ void SConnection::setStreams(rdr::InStream* is_, rdr::OutStream* os_)
   os = os_;
 }
 
+void SConnection::redirectOutput(rdr::OutStream* target)
+{
+  if (target != nullptr) {
+    assert(realOs == nullptr);
+    realOs = os;
+    os = target;
+  } else {
+    assert(realOs != nullptr);
+    os = realOs;
+    realOs = nullptr;
+  }
+
+  if (writer_ != nullptr)
+    writer_->setOutStream(os);
+}
+
 void SConnection::initialiseProtocol()
 {
   char str[13];
@@ -507,11 +524,12 @@ void SConnection::handleClipboardProvide(uint32_t flags,
   }
 
   // FIXME: This conversion magic should be in SMsgReader
-  if (!core::isValidUTF8((const char*)data[0], lengths[0])) {
+  if (!core::utf8ToLF((const char*)data[0], lengths[0],
+                      &clipboardBuffer)) {
     vlog.error("Invalid UTF-8 sequence in clipboard - ignoring");
     return;
   }
-  clientClipboard = core::convertLF((const char*)data[0], lengths[0]);
+  clientClipboard.swap(clipboardBuffer);
   hasRemoteClipboard = true;
 
   if (!accessCheck(AccessCutText))
@@ -701,9 +719,9 @@ void SConnection::sendClipboardData(const char* data)
   if (client.supportsEncoding(pseudoEncodingExtendedClipboard) &&
       (client.clipboardFlags() & rfb::clipboardProvide)) {
     // FIXME: This conversion magic should be in SMsgWriter
-    std::string filtered(core::convertCRLF(data));
-    size_t sizes[1] = { filtered.size() + 1 };
-    const uint8_t* datas[1] = { (const uint8_t*)filtered.c_str() };
+    core::utf8ToCRLF(data, strlen(data), &clipboardBuffer);
+    size_t sizes[1] = { clipboardBuffer.size() + 1 };
+    const uint8_t* datas[1] = { (const uint8_t*)clipboardBuffer.c_str() };
 
     if (unsolicitedClipboardAttempt) {
       unsolicitedClipboardAttempt = false;
@@ -59,6 +59,11 @@ namespace rfb {
     // (i.e. SConnection will not delete them).
     void setStreams(rdr::InStream* is, rdr::OutStream* os);
 
+    // redirectOutput() temporarily sends everything written for this
+    // connection to the given stream instead. Calling it again with
+    // nullptr goes back to the real output stream.
+    void redirectOutput(rdr::OutStream* target);
+
     // initialiseProtocol() should be called once the streams and security
     // types are set.  Subsequently, processMsg() should be called whenever
     // there is data to read on the InStream.
@@ -275,6 +280,7 @@ namespace rfb {
 
     rdr::InStream* is;
     rdr::OutStream* os;
+    rdr::OutStream* realOs;
 
     SMsgReader* reader_;
     SMsgWriter* writer_;
@@ -290,6 +296,9 @@ namespace rfb {
     AccessRights accessRights;
 
     std::string clientClipboard;
+    // Scratch space for clipboard conversions, kept around so that its
+    // memory can be reused
+    std::string clipboardBuffer;
     bool hasRemoteClipboard;
     bool hasLocalClipboard;
     bool unsolicitedClipboardAttempt;
@@ -344,8 +344,8 @@ bool SMsgReader::readClientCutText()
   std::vector<char> ca(len);
   is->readBytes((uint8_t*)ca.data(), len);
 
-  std::string utf8(core::latin1ToUTF8(ca.data(), ca.size()));
-  std::string filtered(core::convertLF(utf8.data(), utf8.size()));
+  std::string filtered;
+  core::latin1ToUTF8LF(ca.data(), ca.size(), &filtered);
 
   handler->clientCutText(filtered.c_str());
 
@@ -23,6 +23,7 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 
 #include <core/LogWriter.h>
 #include <core/string.h>
@@ -34,6 +35,7 @@
 #include <rfb/msgTypes.h>
 #include <rfb/fenceTypes.h>
 #include <rfb/clipboardTypes.h>
+#include <rfb/cursorCacheTypes.h>
 #include <rfb/ClientParams.h>
 #include <rfb/Cursor.h>
 #include <rfb/UpdateTracker.h>
@@ -47,17 +49,48 @@ using namespace rfb;
 
 static core::LogWriter vlog("SMsgWriter");
 
+static uint32_t cursorHash(const Cursor& cursor)
+{
+  uint32_t hash;
+  const uint8_t* data;
+  size_t len;
+
+  // FNV-1a over everything that makes up the shape
+  hash = 2166136261u;
+  hash = (hash ^ cursor.width()) * 16777619u;
+  hash = (hash ^ cursor.height()) * 16777619u;
+  hash = (hash ^ cursor.hotspot().x) * 16777619u;
+  hash = (hash ^ cursor.hotspot().y) * 16777619u;
+
+  data = cursor.getBuffer();
+  len = cursor.width() * cursor.height() * 4;
+  while (len--)
+    hash = (hash ^ *data++) * 16777619u;
+
+  return hash;
+}
+
 SMsgWriter::SMsgWriter(ClientParams* client_, rdr::OutStream* os_)
   : client(client_), os(os_),
     nRectsInUpdate(0), nRectsInHeader(0),
     needSetDesktopName(false), needCursor(false),
     needCursorPos(false), needLEDState(false),
-    needQEMUKeyEvent(false), needExtMouseButtonsEvent(false)
-{
+    needQEMUKeyEvent(false), needExtMouseButtonsEvent(false),
+    cursorCacheClock(0), pendingCursorHash(0)
+{
+  for (CursorSlot& slot : cursorSlots) {
+    slot.cursor = nullptr;
+    slot.hash = 0;
+    slot.lastUsed = 0;
+    slot.known = false;
+    slot.encoding = -1;
+  }
 }
 
 SMsgWriter::~SMsgWriter()
 {
+  for (CursorSlot& slot : cursorSlots)
+    delete slot.cursor;
 }
 
 void SMsgWriter::writeServerInit(uint16_t width, uint16_t height,
@@ -99,12 +132,12 @@ void SMsgWriter::writeServerCutText(const char* str)
   if (strchr(str, '\r') != nullptr)
     throw std::invalid_argument("Invalid carriage return in clipboard data");
 
-  std::string latin1(core::utf8ToLatin1(str));
+  core::utf8ToLatin1(str, (size_t)-1, &cutText);
 
   startMsg(msgTypeServerCutText);
   os->pad(3);
-  os->writeU32(latin1.size());
-  os->writeBytes((const uint8_t*)latin1.data(), latin1.size());
+  os->writeU32(cutText.size());
+  os->writeBytes((const uint8_t*)cutText.data(), cutText.size());
   endMsg();
 }
 
@@ -277,6 +310,7 @@ void SMsgWriter::writeCursor()
     throw std::logic_error("Client does not support local cursor");
 
   needCursor = true;
+  pendingCursorHash = cursorHash(client->cursor());
 }
 
 void SMsgWriter::writeCursorPos()
@@ -368,8 +402,15 @@ void SMsgWriter::writeFramebufferUpdateStart(int nRects)
   if (nRects != 0xFFFF) {
     if (needSetDesktopName)
       nRects++;
-    if (needCursor)
+    if (needCursor) {
       nRects++;
+      // The cursor needs to be stored before it can be referenced
+      if (client->supportsEncoding(pseudoEncodingCursorCache)) {
+        int slot = findCursor(client->cursor(), pendingCursorHash);
+        if ((slot == -1) || !cursorSlots[slot].known)
+          nRects++;
+      }
+    }
     if (needCursorPos)
       nRects++;
     if (needLEDState)
@@ -447,47 +488,7 @@ void SMsgWriter::endMsg()
 void SMsgWriter::writePseudoRects()
 {
   if (needCursor) {
-    const Cursor& cursor = client->cursor();
-
-    if (client->supportsEncoding(pseudoEncodingCursorWithAlpha)) {
-      writeSetCursorWithAlphaRect(cursor.width(), cursor.height(),
-                                  cursor.hotspot().x, cursor.hotspot().y,
-                                  cursor.getBuffer());
-    } else if (client->supportsEncoding(pseudoEncodingVMwareCursor)) {
-      writeSetVMwareCursorRect(cursor.width(), cursor.height(),
-                               cursor.hotspot().x, cursor.hotspot().y,
-                               cursor.getBuffer());
-    } else if (client->supportsEncoding(pseudoEncodingCursor)) {
-      size_t data_len = cursor.width()*cursor.height() *
-                        (client->pf().bpp/8);
-      std::vector<uint8_t> data(data_len);
-      std::vector<uint8_t> mask(cursor.getMask());
-
-      const uint8_t* in;
-      uint8_t* out;
-
-      in = cursor.getBuffer();
-      out = data.data();
-      for (int i = 0;i < cursor.width()*cursor.height();i++) {
-        client->pf().bufferFromRGB(out, in, 1);
-        in += 4;
-        out += client->pf().bpp/8;
-      }
-
-      writeSetCursorRect(cursor.width(), cursor.height(),
-                         cursor.hotspot().x, cursor.hotspot().y,
-                         data.data(), mask.data());
-    } else if (client->supportsEncoding(pseudoEncodingXCursor)) {
-      std::vector<uint8_t> bitmap(cursor.getBitmap());
-      std::vector<uint8_t> mask(cursor.getMask());
-
-      writeSetXCursorRect(cursor.width(), cursor.height(),
-                          cursor.hotspot().x, cursor.hotspot().y,
-                          bitmap.data(), mask.data());
-    } else {
-      throw std::logic_error("Client does not support local cursor");
-    }
-
+    writeCursorRects();
     needCursor = false;
   }
 
@@ -608,100 +609,202 @@ void SMsgWriter::writeSetDesktopNameRect(const char *name)
   os->writeBytes((const uint8_t*)name, strlen(name));
 }
 
-void SMsgWriter::writeSetCursorRect(int width, int height,
-                                    int hotspotX, int hotspotY,
-                                    const uint8_t* data,
-                                    const uint8_t* mask)
+void SMsgWriter::writeCursorRects()
 {
-  if (!client->supportsEncoding(pseudoEncodingCursor))
-    throw std::logic_error("Client does not support local cursors");
+  const Cursor& cursor = client->cursor();
+  bool useCache;
+  int encoding;
+  int index;
+  CursorSlot* slot;
+
+  useCache = client->supportsEncoding(pseudoEncodingCursorCache);
+  encoding = cursorEncoding();
+
+  index = findCursor(cursor, pendingCursorHash);
+  if (index != -1) {
+    slot = &cursorSlots[index];
+    slot->lastUsed = ++cursorCacheClock;
+
+    if (useCache && slot->known) {
+      writeCursorCacheRect(index, cursorCacheUse);
+      return;
+    }
+  } else {
+    // Replace whatever was used the longest time ago
+    index = 0;
+    for (int i = 1; i < cursorCacheSlots; i++) {
+      if (cursorSlots[i].lastUsed < cursorSlots[index].lastUsed)
+        index = i;
+    }
+
+    slot = &cursorSlots[index];
+
+    delete slot->cursor;
+    slot->cursor = new Cursor(cursor);
+    slot->hash = pendingCursorHash;
+    slot->lastUsed = ++cursorCacheClock;
+    slot->known = false;
+    slot->encoding = -1;
+  }
+
+  if ((slot->encoding != encoding) || (slot->pf != client->pf())) {
+    rdr::MemOutStream mos;
+
+    switch (encoding) {
+    case pseudoEncodingCursorWithAlpha:
+      encodeCursorWithAlpha(&mos, cursor);
+      break;
+    case pseudoEncodingVMwareCursor:
+      encodeVMwareCursor(&mos, cursor);
+      break;
+    case pseudoEncodingCursor:
+      encodeCursor(&mos, cursor);
+      break;
+    case pseudoEncodingXCursor:
+      encodeXCursor(&mos, cursor);
+      break;
+    }
+
+    slot->data.assign(mos.data(), mos.data() + mos.length());
+    slot->encoding = encoding;
+    slot->pf = client->pf();
+  }
+
+  if (useCache) {
+    writeCursorCacheRect(index, cursorCacheStore);
+    slot->known = true;
+  }
+
   if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
-    throw std::logic_error("SMsgWriter::writeSetCursorRect: nRects out of sync");
+    throw std::logic_error("SMsgWriter::writeCursorRects: nRects out of sync");
 
-  os->writeS16(hotspotX);
-  os->writeS16(hotspotY);
-  os->writeU16(width);
-  os->writeU16(height);
-  os->writeU32(pseudoEncodingCursor);
-  os->writeBytes(data, width * height * (client->pf().bpp/8));
-  os->writeBytes(mask, (width+7)/8 * height);
+  os->writeS16(cursor.hotspot().x);
+  os->writeS16(cursor.hotspot().y);
+  os->writeU16(cursor.width());
+  os->writeU16(cursor.height());
+  os->writeU32(encoding);
+  os->writeBytes(slot->data.data(), slot->data.size());
 }
 
-void SMsgWriter::writeSetXCursorRect(int width, int height,
-                                     int hotspotX, int hotspotY,
-                                     const uint8_t* data,
-                                     const uint8_t* mask)
+void SMsgWriter::writeCursorCacheRect(int slot, uint16_t op)
 {
-  if (!client->supportsEncoding(pseudoEncodingXCursor))
-    throw std::logic_error("Client does not support local cursors");
+  if (!client->supportsEncoding(pseudoEncodingCursorCache))
+    throw std::logic_error("Client does not support cursor cache");
   if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
-    throw std::logic_error("SMsgWriter::writeSetXCursorRect: nRects out of sync");
+    throw std::logic_error("SMsgWriter::writeCursorCacheRect: nRects out of sync");
 
-  os->writeS16(hotspotX);
-  os->writeS16(hotspotY);
-  os->writeU16(width);
-  os->writeU16(height);
-  os->writeU32(pseudoEncodingXCursor);
-  if (width * height > 0) {
-    os->writeU8(255);
-    os->writeU8(255);
-    os->writeU8(255);
-    os->writeU8(0);
-    os->writeU8(0);
-    os->writeU8(0);
-    os->writeBytes(data, (width+7)/8 * height);
-    os->writeBytes(mask, (width+7)/8 * height);
+  os->writeU16(slot);
+  os->writeU16(op);
+  os->writeU16(0);
+  os->writeU16(0);
+  os->writeU32(pseudoEncodingCursorCache);
+}
+
+int SMsgWriter::cursorEncoding()
+{
+  if (client->supportsEncoding(pseudoEncodingCursorWithAlpha))
+    return pseudoEncodingCursorWithAlpha;
+  if (client->supportsEncoding(pseudoEncodingVMwareCursor))
+    return pseudoEncodingVMwareCursor;
+  if (client->supportsEncoding(pseudoEncodingCursor))
+    return pseudoEncodingCursor;
+  if (client->supportsEncoding(pseudoEncodingXCursor))
+    return pseudoEncodingXCursor;
+
+  throw std::logic_error("Client does not support local cursor");
+}
+
+int SMsgWriter::findCursor(const Cursor& cursor, uint32_t hash)
+{
+  for (int i = 0; i < cursorCacheSlots; i++) {
+    const Cursor* other;
+
+    other = cursorSlots[i].cursor;
+    if (other == nullptr)
+      continue;
+    if (cursorSlots[i].hash != hash)
+      continue;
+
+    if ((other->width() != cursor.width()) ||
+        (other->height() != cursor.height()) ||
+        (other->hotspot() != cursor.hotspot()))
+      continue;
+    if (memcmp(other->getBuffer(), cursor.getBuffer(),
+               cursor.width() * cursor.height() * 4) != 0)
+      continue;
+
+    return i;
   }
+
+  return -1;
 }
 
-void SMsgWriter::writeSetCursorWithAlphaRect(int width, int height,
-                                             int hotspotX, int hotspotY,
-                                             const uint8_t* data)
+void SMsgWriter::encodeCursor(rdr::OutStream* out, const Cursor& cursor)
 {
-  if (!client->supportsEncoding(pseudoEncodingCursorWithAlpha))
-    throw std::logic_error("Client does not support local cursors");
-  if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
-    throw std::logic_error("SMsgWriter::writeSetCursorWithAlphaRect: nRects out of sync");
+  size_t data_len = cursor.width()*cursor.height() *
+                    (client->pf().bpp/8);
+  std::vector<uint8_t> data(data_len);
+  std::vector<uint8_t> mask(cursor.getMask());
 
-  os->writeS16(hotspotX);
-  os->writeS16(hotspotY);
-  os->writeU16(width);
-  os->writeU16(height);
-  os->writeU32(pseudoEncodingCursorWithAlpha);
+  const uint8_t* in;
+  uint8_t* pixel;
+
+  in = cursor.getBuffer();
+  pixel = data.data();
+  for (int i = 0;i < cursor.width()*cursor.height();i++) {
+    client->pf().bufferFromRGB(pixel, in, 1);
+    in += 4;
+    pixel += client->pf().bpp/8;
+  }
+
+  out->writeBytes(data.data(), data.size());
+  out->writeBytes(mask.data(), mask.size());
+}
+
+void SMsgWriter::encodeXCursor(rdr::OutStream* out, const Cursor& cursor)
+{
+  if (cursor.width() * cursor.height() > 0) {
+    std::vector<uint8_t> bitmap(cursor.getBitmap());
+    std::vector<uint8_t> mask(cursor.getMask());
+
+    out->writeU8(255);
+    out->writeU8(255);
+    out->writeU8(255);
+    out->writeU8(0);
+    out->writeU8(0);
+    out->writeU8(0);
+    out->writeBytes(bitmap.data(), bitmap.size());
+    out->writeBytes(mask.data(), mask.size());
+  }
+}
+
+void SMsgWriter::encodeCursorWithAlpha(rdr::OutStream* out,
+                                       const Cursor& cursor)
+{
+  const uint8_t* data;
 
   // FIXME: Use an encoder with compression?
-  os->writeU32(encodingRaw);
+  out->writeU32(encodingRaw);
 
   // Alpha needs to be pre-multiplied
-  for (int i = 0;i < width*height;i++) {
-    os->writeU8((unsigned)data[0] * data[3] / 255);
-    os->writeU8((unsigned)data[1] * data[3] / 255);
-    os->writeU8((unsigned)data[2] * data[3] / 255);
-    os->writeU8(data[3]);
+  data = cursor.getBuffer();
+  for (int i = 0;i < cursor.width()*cursor.height();i++) {
+    out->writeU8((unsigned)data[0] * data[3] / 255);
+    out->writeU8((unsigned)data[1] * data[3] / 255);
+    out->writeU8((unsigned)data[2] * data[3] / 255);
+    out->writeU8(data[3]);
     data += 4;
   }
 }
 
-void SMsgWriter::writeSetVMwareCursorRect(int width, int height,
-                                          int hotspotX, int hotspotY,
-                                          const uint8_t* data)
+void SMsgWriter::encodeVMwareCursor(rdr::OutStream* out,
+                                    const Cursor& cursor)
 {
-  if (!client->supportsEncoding(pseudoEncodingVMwareCursor))
-    throw std::logic_error("Client does not support local cursors");
-  if (++nRectsInUpdate > nRectsInHeader && nRectsInHeader)
-    throw std::logic_error("SMsgWriter::writeSetVMwareCursorRect: nRects out of sync");
-
-  os->writeS16(hotspotX);
-  os->writeS16(hotspotY);
-  os->writeU16(width);
-  os->writeU16(height);
-  os->writeU32(pseudoEncodingVMwareCursor);
-
-  os->writeU8(1); // Alpha cursor
-  os->pad(1);
+  out->writeU8(1); // Alpha cursor
+  out->pad(1);
 
   // FIXME: Should alpha be premultiplied?
-  os->writeBytes(data, width*height*4);
+  out->writeBytes(cursor.getBuffer(), cursor.width()*cursor.height()*4);
 }
 
 void SMsgWriter::writeSetVMwareCursorPositionRect(int hotspotX, int hotspotY)
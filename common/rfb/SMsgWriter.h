@@ -25,6 +25,13 @@
 
 #include <stdint.h>
 
+#include <list>
+#include <string>
+#include <vector>
+
+#include <rfb/PixelFormat.h>
+#include <rfb/cursorCacheTypes.h>
+
 namespace core { struct Rect; }
 
 namespace rdr { class OutStream; }
@@ -32,7 +39,7 @@ namespace rdr { class OutStream; }
 namespace rfb {
 
   class ClientParams;
-  class PixelFormat;
+  class Cursor;
   struct ScreenSet;
 
   class SMsgWriter {
@@ -40,6 +47,9 @@ namespace rfb {
     SMsgWriter(ClientParams* client, rdr::OutStream* os);
     virtual ~SMsgWriter();
 
+    // setOutStream() changes the stream messages are written to
+    void setOutStream(rdr::OutStream* os_) { os = os_; }
+
     // writeServerInit() must only be called at the appropriate time in the
     // protocol initialisation.
     void writeServerInit(uint16_t width, uint16_t height,
@@ -135,18 +145,16 @@ namespace rfb {
                                       int fb_width, int fb_height,
                                       const ScreenSet& layout);
     void writeSetDesktopNameRect(const char *name);
-    void writeSetCursorRect(int width, int height,
-                            int hotspotX, int hotspotY,
-                            const uint8_t* data, const uint8_t* mask);
-    void writeSetXCursorRect(int width, int height,
-                             int hotspotX, int hotspotY,
-                             const uint8_t* data, const uint8_t* mask);
-    void writeSetCursorWithAlphaRect(int width, int height,
-                                     int hotspotX, int hotspotY,
-                                     const uint8_t* data);
-    void writeSetVMwareCursorRect(int width, int height,
-                                  int hotspotX, int hotspotY,
-                                  const uint8_t* data);
+    void writeCursorRects();
+    void writeCursorCacheRect(int slot, uint16_t op);
+
+    int cursorEncoding();
+    int findCursor(const Cursor& cursor, uint32_t hash);
+
+    void encodeCursor(rdr::OutStream* out, const Cursor& cursor);
+    void encodeXCursor(rdr::OutStream* out, const Cursor& cursor);
+    void encodeCursorWithAlpha(rdr::OutStream* out, const Cursor& cursor);
+    void encodeVMwareCursor(rdr::OutStream* out, const Cursor& cursor);
     void writeSetVMwareCursorPositionRect(int hotspotX, int hotspotY);
     void writeLEDStateRect(uint8_t state);
     void writeQEMUKeyEventRect();
@@ -170,6 +178,28 @@ namespace rfb {
     } ExtendedDesktopSizeMsg;
 
     std::list<ExtendedDesktopSizeMsg> extendedDesktopSizeMsgs;
+
+    // Kept around so that its memory can be reused
+    std::string cutText;
+
+    // Recently sent cursors, along with their encoded form so that
+    // switching back and forth between a few shapes is cheap even for
+    // clients that cannot reference them by slot
+    struct CursorSlot {
+      Cursor* cursor;
+      uint32_t hash;
+      unsigned lastUsed;
+      bool known; // Client has it stored in this slot
+      int encoding;
+      PixelFormat pf;
+      std::vector<uint8_t> data;
+    };
+
+    CursorSlot cursorSlots[cursorCacheSlots];
+    unsigned cursorCacheClock;
+
+    // Hash of client->cursor(), computed once when it changes
+    uint32_t pendingCursorHash;
   };
 }
 #endif
@@ -29,6 +29,7 @@
 #endif
 
 #include <stdlib.h>
+#include <time.h>
 
 #include <core/LogWriter.h>
 
@@ -69,6 +70,17 @@ core::StringParameter SSecurityTLS::X509_KeyFile
 
 static core::LogWriter vlog("TLS");
 
+// Session tickets let clients that reconnect skip the key exchange and
+// certificate checks. The key is shared by all connections to this
+// server, and replaced now and then to limit how long a stolen key
+// would be useful.
+static const time_t TicketKeyLifetime = 24 * 60 * 60;
+static gnutls_datum_t ticketKey = { nullptr, 0 };
+static time_t ticketKeyCreated;
+
+static unsigned handshakes = 0;
+static unsigned resumedHandshakes = 0;
+
 SSecurityTLS::SSecurityTLS(SConnection* sc_, bool _anon)
   : SSecurity(sc_), session(nullptr), anon_cred(nullptr),
     cert_cred(nullptr), anon(_anon), tlssock(nullptr),
@@ -178,6 +190,14 @@ bool SSecurityTLS::processMsg()
   vlog.debug("TLS handshake completed with %s",
              gnutls_session_get_desc(session));
 
+  handshakes++;
+  if (gnutls_session_is_resumed(session))
+    resumedHandshakes++;
+
+  vlog.info("%s TLS session (%u of %u resumed)",
+            gnutls_session_is_resumed(session) ? "Resumed" : "New",
+            resumedHandshakes, handshakes);
+
   sc->setStreams(&tlssock->inStream(), &tlssock->outStream());
 
   return true;
@@ -283,4 +303,40 @@ void SSecurityTLS::setParams()
 
   }
 
+  enableSessionTickets();
+}
+
+void SSecurityTLS::enableSessionTickets()
+{
+  time_t now;
+  int ret;
+
+  now = time(nullptr);
+
+  if ((ticketKey.data != nullptr) &&
+      ((now - ticketKeyCreated) >= TicketKeyLifetime)) {
+    vlog.debug("Replacing session ticket key");
+    // Each session has its own copy of the key
+    gnutls_memset(ticketKey.data, 0, ticketKey.size);
+    gnutls_free(ticketKey.data);
+    ticketKey.data = nullptr;
+    ticketKey.size = 0;
+  }
+
+  if (ticketKey.data == nullptr) {
+    ret = gnutls_session_ticket_key_generate(&ticketKey);
+    if (ret != GNUTLS_E_SUCCESS) {
+      vlog.error("Failed to generate session ticket key: %s",
+                 gnutls_strerror(ret));
+      return;
+    }
+
+    ticketKeyCreated = now;
+  }
+
+  // Resumption is an optimisation, so carry on without it if needed
+  ret = gnutls_session_ticket_enable_server(session, &ticketKey);
+  if (ret != GNUTLS_E_SUCCESS)
+    vlog.error("Failed to enable session tickets: %s",
+               gnutls_strerror(ret));
 }
@@ -61,6 +61,7 @@ namespace rfb {
   protected:
     void shutdown();
     void setParams();
+    void enableSessionTickets();
 
   private:
     gnutls_session_t session;
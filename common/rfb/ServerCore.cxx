@@ -54,11 +54,42 @@ core::IntParameter rfb::Server::frameRate
 ("FrameRate",
  "The maximum number of updates per second sent to each client",
  60, 0, INT_MAX);
+core::IntParameter rfb::Server::maxOutputMemory
+("MaxOutputMemory",
+ "The maximum amount of memory, in KiB, that may be used for output "
+ "that hasn't yet been sent to the clients (0 = unlimited)",
+ 262144, 0, INT_MAX);
+core::IntParameter rfb::Server::sendLowWater
+("SendLowWater",
+ "The maximum amount of data, in KiB, that may be queued up in the "
+ "operating system for each client before updates are held back "
+ "(0 = operating system default)",
+ 128, 0, INT_MAX / 1024);
+core::IntParameter rfb::Server::focusRadius
+("FocusRadius",
+ "The distance, in pixels, around the pointer and the most recent "
+ "typing that is sent at full JPEG quality (0 = everywhere)",
+ 0, 0, 4096);
+core::IntParameter rfb::Server::focusQualityDrop
+("FocusQualityDrop",
+ "How many JPEG quality levels lower to send areas outside of "
+ "FocusRadius",
+ 3, 0, 9);
+core::EnumParameter rfb::Server::presentPacing
+("PresentPacing",
+ "What paces the frame counter applications synchronise their drawing "
+ "to (timer, slowest, fastest or active client)",
+ {"timer", "slowest", "fastest", "active"}, "timer");
 core::BoolParameter rfb::Server::protocol3_3
 ("Protocol3.3",
  "Always use protocol version 3.3 for backwards compatibility with "
  "badly-behaved clients",
  false);
+core::BoolParameter rfb::Server::preEncode
+("PreEncode",
+ "Encode changes for clients without continuous updates before they "
+ "ask for them",
+ true);
 core::BoolParameter rfb::Server::alwaysShared
 ("AlwaysShared",
  "Always treat incoming connections as shared, regardless of the client-"
@@ -37,7 +37,13 @@ namespace rfb {
     static core::IntParameter maxIdleTime;
     static core::IntParameter compareFB;
     static core::IntParameter frameRate;
+    static core::IntParameter maxOutputMemory;
+    static core::IntParameter sendLowWater;
+    static core::IntParameter focusRadius;
+    static core::IntParameter focusQualityDrop;
+    static core::EnumParameter presentPacing;
     static core::BoolParameter protocol3_3;
+    static core::BoolParameter preEncode;
     static core::BoolParameter alwaysShared;
     static core::BoolParameter neverShared;
     static core::BoolParameter disconnectClients;
@@ -0,0 +1,82 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <rdr/InStream.h>
+#include <rdr/MemInStream.h>
+#include <rdr/OutStream.h>
+
+#include <rfb/Exception.h>
+#include <rfb/SharedMemoryDecoder.h>
+#include <rfb/SharedPixelBuffer.h>
+
+using namespace rfb;
+
+SharedMemoryDecoder::SharedMemoryDecoder()
+  : Decoder(DecoderPlain), fb(nullptr), serial(0)
+{
+}
+
+SharedMemoryDecoder::~SharedMemoryDecoder()
+{
+  delete fb;
+}
+
+void SharedMemoryDecoder::setBuffer(SharedPixelBuffer* fb_,
+                                    uint32_t serial_)
+{
+  delete fb;
+  fb = fb_;
+  serial = serial_;
+}
+
+bool SharedMemoryDecoder::readRect(const core::Rect& /*r*/,
+                                   rdr::InStream* is,
+                                   const ServerParams& /*server*/,
+                                   rdr::OutStream* os)
+{
+  if (!is->hasData(4))
+    return false;
+  os->copyBytes(is, 4);
+  return true;
+}
+
+void SharedMemoryDecoder::decodeRect(const core::Rect& r,
+                                     const uint8_t* buffer,
+                                     size_t buflen,
+                                     const ServerParams& /*server*/,
+                                     ModifiablePixelBuffer* pb)
+{
+  rdr::MemInStream is(buffer, buflen);
+  const uint8_t* data;
+  int stride;
+
+  // Meant for a buffer we failed to attach to, and the server has
+  // been asked to send everything again
+  if ((fb == nullptr) || (is.readU32() != serial))
+    return;
+
+  if (!r.enclosed_by(fb->getRect()))
+    throw protocol_error("Shared framebuffer rect out of bounds");
+
+  data = fb->getBuffer(r, &stride);
+  pb->imageRect(fb->getPF(), r, data, stride);
+}
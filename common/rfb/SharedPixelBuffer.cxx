@@ -0,0 +1,152 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdexcept>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <core/Exception.h>
+#include <core/string.h>
+
+#include <rfb/SharedPixelBuffer.h>
+
+using namespace rfb;
+
+SharedPixelBuffer::SharedPixelBuffer(const PixelFormat& pf,
+                                     int width, int height)
+  : FullFramePixelBuffer(pf, 0, 0, nullptr, 0),
+    pid(0), fd(-1), map(nullptr), mapSize(0)
+{
+#ifdef __linux__
+  mapSize = (size_t)width * height * (pf.bpp/8);
+  if (mapSize == 0)
+    mapSize = 1;
+
+  fd = memfd_create("vnc-framebuffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1)
+    throw core::posix_error("memfd_create", errno);
+
+  if (ftruncate(fd, mapSize) == -1) {
+    int err = errno;
+    close(fd);
+    throw core::posix_error("ftruncate", err);
+  }
+
+  // Whoever maps this must be able to trust the size
+  fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+  map = (uint8_t*)mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    int err = errno;
+    close(fd);
+    throw core::posix_error("mmap", err);
+  }
+
+  pid = getpid();
+
+  setBuffer(width, height, map, width);
+#else
+  (void)width;
+  (void)height;
+  throw std::logic_error("Shared framebuffers are not supported");
+#endif
+}
+
+SharedPixelBuffer::SharedPixelBuffer(const PixelFormat& pf,
+                                     int width, int height,
+                                     unsigned pid_, int fd_)
+  : FullFramePixelBuffer(pf, 0, 0, nullptr, 0),
+    pid(pid_), fd(-1), map(nullptr), mapSize(0)
+{
+#ifdef __linux__
+  std::string path;
+  struct stat st;
+  int mapFd;
+
+  mapSize = (size_t)width * height * (pf.bpp/8);
+  if (mapSize == 0)
+    mapSize = 1;
+
+  // Opening it through procfs makes the kernel check that we are
+  // allowed to peek at the other process
+  path = core::format("/proc/%u/fd/%d", pid_, fd_);
+  mapFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (mapFd == -1)
+    throw core::posix_error(core::format("Failed to open %s",
+                                         path.c_str()), errno);
+
+  if (fstat(mapFd, &st) == -1) {
+    int err = errno;
+    close(mapFd);
+    throw core::posix_error("fstat", err);
+  }
+
+  if ((size_t)st.st_size < mapSize) {
+    close(mapFd);
+    throw std::runtime_error("Shared framebuffer is too small");
+  }
+
+  if ((fcntl(mapFd, F_GET_SEALS) & F_SEAL_SHRINK) == 0) {
+    close(mapFd);
+    throw std::runtime_error("Shared framebuffer can be truncated");
+  }
+
+  map = (uint8_t*)mmap(nullptr, mapSize, PROT_READ, MAP_SHARED,
+                       mapFd, 0);
+  close(mapFd);
+  if (map == MAP_FAILED)
+    throw core::posix_error("mmap", errno);
+
+  setBuffer(width, height, map, width);
+#else
+  (void)width;
+  (void)height;
+  (void)fd_;
+  throw std::logic_error("Shared framebuffers are not supported");
+#endif
+}
+
+SharedPixelBuffer::~SharedPixelBuffer()
+{
+#ifdef __linux__
+  munmap(map, mapSize);
+  // Only set if we created the buffer
+  if (fd != -1)
+    close(fd);
+#endif
+}
+
+bool SharedPixelBuffer::isSupported()
+{
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
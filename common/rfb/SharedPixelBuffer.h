@@ -0,0 +1,56 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+//
+// SharedPixelBuffer - a framebuffer in memory that can be mapped by
+// another process on the same host
+//
+
+#ifndef __RFB_SHAREDPIXELBUFFER_H__
+#define __RFB_SHAREDPIXELBUFFER_H__
+
+#include <rfb/PixelBuffer.h>
+
+namespace rfb {
+
+  class SharedPixelBuffer : public FullFramePixelBuffer {
+  public:
+    // Creates a new buffer that other processes can attach to
+    SharedPixelBuffer(const PixelFormat& pf, int width, int height);
+    // Attaches to a buffer created by the given process. The contents
+    // are read only and must not be modified.
+    SharedPixelBuffer(const PixelFormat& pf, int width, int height,
+                      unsigned pid, int fd);
+    virtual ~SharedPixelBuffer();
+
+    // Identifies the buffer for another process (only valid for
+    // buffers created by this process)
+    unsigned getPid() const { return pid; }
+    int getFd() const { return fd; }
+
+    static bool isSupported();
+
+  private:
+    unsigned pid;
+    int fd;
+    uint8_t* map;
+    size_t mapSize;
+  };
+
+}
+
+#endif
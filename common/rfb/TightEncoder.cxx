@@ -23,6 +23,16 @@
 #endif
 
 #include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <utility>
+
+#include <core/Configuration.h>
 
 #include <rdr/OutStream.h>
 #include <rfb/PixelBuffer.h>
@@ -36,6 +46,17 @@ using namespace rfb;
 
 static const int TIGHT_MAX_WIDTH = 2048;
 
+// Rects smaller than this are not worth sampling for the gradient
+// filter, and the number of rows we look at when we do sample
+static const int GradientMinArea = 1024;
+static const int GradientSampleRows = 8;
+
+core::BoolParameter tightGradient("TightGradient",
+                                  "Use the gradient filter for smooth "
+                                  "full colour areas when sending "
+                                  "lossless Tight data",
+                                  true);
+
 struct TightConf {
   int idxZlibLevel, monoZlibLevel, rawZlibLevel;
 };
@@ -106,6 +127,24 @@ void TightEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
   }
 }
 
+void TightEncoder::checkpoint()
+{
+  for (rdr::ZlibOutStream& zos : zlibStreams)
+    zos.checkpoint();
+}
+
+void TightEncoder::commit()
+{
+  for (rdr::ZlibOutStream& zos : zlibStreams)
+    zos.commit();
+}
+
+void TightEncoder::rollback()
+{
+  for (rdr::ZlibOutStream& zos : zlibStreams)
+    zos.rollback();
+}
+
 void TightEncoder::writeSolidRect(int width, int /*height*/,
                                   const PixelFormat& pf,
                                   const uint8_t* colour)
@@ -164,6 +203,77 @@ void TightEncoder::writeIndexedRect(const PixelBuffer* pb, const Palette& palett
   }
 }
 
+// Computes the residuals of the Tight gradient filter for a single
+// row of RGB888 data. The decoder has to do this serially, but here
+// we already know every pixel so each byte can be predicted on its own.
+static void filterGradientRow(const uint8_t* prevRow,
+                              const uint8_t* thisRow,
+                              uint8_t* out, int width)
+{
+  int i, len;
+
+  len = width * 3;
+
+  // The first pixel is predicted only from the one above it
+  for (i = 0; i < 3; i++)
+    out[i] = thisRow[i] - prevRow[i];
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i up, left, upLeft, pix, lo, hi, est;
+
+    up = _mm_loadu_si128((const __m128i*)(prevRow + i));
+    left = _mm_loadu_si128((const __m128i*)(thisRow + i - 3));
+    upLeft = _mm_loadu_si128((const __m128i*)(prevRow + i - 3));
+    pix = _mm_loadu_si128((const __m128i*)(thisRow + i));
+
+    lo = _mm_add_epi16(_mm_unpacklo_epi8(up, zero),
+                       _mm_unpacklo_epi8(left, zero));
+    lo = _mm_sub_epi16(lo, _mm_unpacklo_epi8(upLeft, zero));
+    hi = _mm_add_epi16(_mm_unpackhi_epi8(up, zero),
+                       _mm_unpackhi_epi8(left, zero));
+    hi = _mm_sub_epi16(hi, _mm_unpackhi_epi8(upLeft, zero));
+
+    // Saturated packing clamps the estimate to 0-255 for us
+    est = _mm_packus_epi16(lo, hi);
+
+    _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi8(pix, est));
+  }
+#endif
+
+  for (; i < len; i++) {
+    int est;
+
+    est = prevRow[i] + thisRow[i - 3] - prevRow[i - 3];
+    if (est > 255)
+      est = 255;
+    else if (est < 0)
+      est = 0;
+
+    out[i] = thisRow[i] - est;
+  }
+}
+
+static double estimateEntropy(const unsigned* histogram, unsigned total)
+{
+  double bits;
+
+  bits = 0.0;
+  for (int i = 0; i < 256; i++) {
+    double p;
+
+    if (histogram[i] == 0)
+      continue;
+
+    p = (double)histogram[i] / total;
+    bits -= histogram[i] * log2(p);
+  }
+
+  return bits;
+}
+
 void TightEncoder::writeFullColourRect(const PixelBuffer* pb)
 {
   const int streamId = 0;
@@ -175,6 +285,11 @@ void TightEncoder::writeFullColourRect(const PixelBuffer* pb)
   const uint8_t* buffer;
   int stride, h;
 
+  if (isSmoothRect(pb)) {
+    writeGradientRect(pb);
+    return;
+  }
+
   os = conn->getOutStream();
 
   os->writeU8(streamId << 4);
@@ -200,6 +315,123 @@ void TightEncoder::writeFullColourRect(const PixelBuffer* pb)
   flushZlibOutStream(zos);
 }
 
+void TightEncoder::writeGradientRect(const PixelBuffer* pb)
+{
+  const int streamId = 3;
+
+  rdr::OutStream* os;
+  rdr::OutStream* zos;
+
+  const uint8_t* buffer;
+  int stride, width, height;
+
+  uint8_t rows[2][TIGHT_MAX_WIDTH*3];
+  uint8_t residuals[TIGHT_MAX_WIDTH*3];
+  uint8_t *prevRow, *thisRow;
+
+  assert(pb->getPF().bpp == 32);
+  assert(pb->getPF().is888());
+
+  os = conn->getOutStream();
+
+  os->writeU8((streamId | tightExplicitFilter) << 4);
+  os->writeU8(tightFilterGradient);
+
+  width = pb->width();
+  height = pb->height();
+
+  // Set up compression
+  zos = getZlibOutStream(streamId, rawZlibLevel, width * height * 3);
+
+  // Encode the data
+  buffer = pb->getBuffer(pb->getRect(), &stride);
+
+  prevRow = rows[0];
+  thisRow = rows[1];
+
+  // The row above the first one is considered to be all black
+  memset(prevRow, 0, width * 3);
+
+  while (height--) {
+    pb->getPF().rgbFromBuffer(thisRow, buffer, width);
+    filterGradientRow(prevRow, thisRow, residuals, width);
+    zos->writeBytes(residuals, width * 3);
+
+    std::swap(prevRow, thisRow);
+    buffer += stride * 4;
+  }
+
+  // Finish the zlib stream
+  flushZlibOutStream(zos);
+}
+
+bool TightEncoder::isSmoothRect(const PixelBuffer* pb)
+{
+  const uint8_t* buffer;
+  int stride, width, height;
+
+  uint8_t prevRow[TIGHT_MAX_WIDTH*3];
+  uint8_t thisRow[TIGHT_MAX_WIDTH*3];
+  uint8_t residuals[TIGHT_MAX_WIDTH*3];
+
+  unsigned copyHist[256], gradientHist[256];
+  unsigned total;
+  int rows, step;
+
+  if (!tightGradient)
+    return false;
+
+  // The decoders only get the gradient filter right for 24-bit data
+  if ((pb->getPF().bpp != 32) || !pb->getPF().is888())
+    return false;
+
+  // Not much point in spending effort if zlib won't either
+  if (rawZlibLevel == 0)
+    return false;
+
+  width = pb->width();
+  height = pb->height();
+
+  if ((height < 2) || (pb->getRect().area() < GradientMinArea))
+    return false;
+
+  // Compare the order-0 entropy of the unfiltered and filtered bytes
+  // for a few evenly spaced rows. This is a crude estimate of what
+  // zlib can do with each, but it is cheap and good at telling photos
+  // and gradients apart from flat synthetic content.
+  memset(copyHist, 0, sizeof(copyHist));
+  memset(gradientHist, 0, sizeof(gradientHist));
+
+  rows = GradientSampleRows;
+  if (rows > height - 1)
+    rows = height - 1;
+  step = (height - 1) / rows;
+
+  buffer = pb->getBuffer(pb->getRect(), &stride);
+
+  for (int i = 0; i < rows; i++) {
+    const uint8_t* row;
+
+    row = buffer + (1 + i * step) * stride * 4;
+
+    pb->getPF().rgbFromBuffer(prevRow, row - stride * 4, width);
+    pb->getPF().rgbFromBuffer(thisRow, row, width);
+    filterGradientRow(prevRow, thisRow, residuals, width);
+
+    for (int j = 0; j < width * 3; j++) {
+      copyHist[thisRow[j]]++;
+      gradientHist[residuals[j]]++;
+    }
+  }
+
+  total = rows * width * 3;
+
+  // Require a decent margin as zlib is also good at finding the
+  // repetitions that synthetic content has, something we don't see
+  return estimateEntropy(gradientHist, total) <
+         estimateEntropy(copyHist, total) * 0.875;
+}
+
 void TightEncoder::writePixels(const uint8_t* buffer, const PixelFormat& pf,
                                unsigned int count, rdr::OutStream* os)
 {
@@ -40,10 +40,17 @@ namespace rfb {
     void writeSolidRect(int width, int height, const PixelFormat& pf,
                         const uint8_t* colour) override;
 
+    void checkpoint() override;
+    void commit() override;
+    void rollback() override;
+
   protected:
     void writeMonoRect(const PixelBuffer* pb, const Palette& palette);
     void writeIndexedRect(const PixelBuffer* pb, const Palette& palette);
     void writeFullColourRect(const PixelBuffer* pb);
+    void writeGradientRect(const PixelBuffer* pb);
+
+    bool isSmoothRect(const PixelBuffer* pb);
 
     void writePixels(const uint8_t* buffer, const PixelFormat& pf,
                      unsigned int count, rdr::OutStream* os);
@@ -32,6 +32,9 @@
 #include <rdr/FdOutStream.h>
 
 #include <network/TcpSocket.h>
+#ifndef WIN32
+#include <network/UnixSocket.h>
+#endif
 
 #include <rfb/ComparingUpdateTracker.h>
 #include <rfb/Encoder.h>
@@ -58,6 +61,8 @@ using namespace rfb;
 static const unsigned LOGIN_GRACE_TIME = 120;
 // Number of seconds allowed to flush a closing socket
 static const unsigned CLOSE_GRACE_TIME = 5;
+// JPEG quality cap for each level of memory pressure
+static const int PRESSURE_QUALITY[] = { -1, 5, 2 };
 
 static core::LogWriter vlog("VNCSConnST");
 
@@ -69,16 +74,38 @@ VNCSConnectionST::VNCSConnectionST(VNCServerST* server_, network::Socket *s,
     sock(s), socketTimer(this), reverseConnection(reverse),
     inProcessMessages(false),
     pendingSyncFence(false), syncFence(false), fenceFlags(0),
-    fenceDataLen(0), fenceData(nullptr), congestionTimer(this),
-    losslessTimer(this), server(server_),
+    fenceDataLen(0), fenceData(nullptr), pendingDamageFence(false),
+    congestionTimer(this),
+    losslessTimer(this), outputUsage(0), outputPeak(0),
+    memoryPressure(0), pressureUpdates(0), skippedUpdates(0),
+    postponedRefreshes(0), maxOutputUsage(0), server(server_),
     updateRenderedCursor(false), removeRenderedCursor(false),
     continuousUpdates(false), encodeManager(this), idleTimer(this),
-    pointerEventTime(0), clientHasCursor(false)
+    pointerEventTime(0), clientHasCursor(false), keyFocusPending(false)
 {
   socketTimer.start(core::secsToMillis(LOGIN_GRACE_TIME));
 
+  gettimeofday(&lastDataUpdate, nullptr);
+  lastInputTime.tv_sec = 0;
+  lastInputTime.tv_usec = 0;
+
   setStreams(&sock->inStream(), &sock->outStream());
   peerEndpoint = sock->getPeerEndpoint();
+
+#ifndef WIN32
+  // Only a viewer on this host can map our memory
+  if (dynamic_cast<network::UnixSocket*>(sock) != nullptr)
+    encodeManager.enableSharedMemory();
+#endif
+
+  // Keep any backlog here, where it holds back new updates, rather
+  // than in the kernel where it just adds latency
+  if ((rfb::Server::sendLowWater != 0) &&
+      (dynamic_cast<network::TcpSocket*>(sock) != nullptr)) {
+    if (!sock->outStream().setSendLowWater(rfb::Server::sendLowWater * 1024))
+      vlog.debug("Unable to limit unsent data for %s",
+                 peerEndpoint.c_str());
+  }
 }
 
 
@@ -89,6 +116,10 @@ VNCSConnectionST::~VNCSConnectionST()
     vlog.info("Closing %s: %s", peerEndpoint.c_str(),
               closeReason.c_str());
 
+  logStats();
+
+  server->adjustOutputUsage(outputUsage, 0);
+
   // Release any keys the client still had pressed
   while (!pressedKeys.empty()) {
     uint32_t keysym, keycode;
@@ -200,6 +231,7 @@ void VNCSConnectionST::processSocketReadEvent()
 
     // Flush out everything in case we go idle after this.
     getOutStream()->cork(false);
+    updateOutputUsage();
 
     inProcessMessages = false;
 
@@ -219,6 +251,7 @@ void VNCSConnectionST::processSocketWriteEvent()
   if (state() == RFBSTATE_CLOSING) return;
   try {
     sock->outStream().flush();
+    updateOutputUsage();
     // Flushing the socket might release an update that was previously
     // delayed because of congestion.
     if (!sock->outStream().hasBufferedData())
@@ -231,27 +264,23 @@ void VNCSConnectionST::processSocketWriteEvent()
 void VNCSConnectionST::pixelBufferChange()
 {
   try {
+    core::Rect oldRect;
+
     if (state() != RFBSTATE_NORMAL)
       return;
+
+    discardPreEncoded();
+    lastRequested.clear();
+    lastChanged.clear();
+
+    oldRect.setXYWH(0, 0, client.width(), client.height());
+
     if (client.width() && client.height() &&
         (server->getPixelBuffer()->width() != client.width() ||
          server->getPixelBuffer()->height() != client.height()))
     {
-      // We need to clip the next update to the new size, but also add any
-      // extra bits if it's bigger.  If we wanted to do this exactly, something
-      // like the code below would do it, but at the moment we just update the
-      // entire new size.  However, we do need to clip the damagedCursorRegion
-      // because that might be added to updates in writeFramebufferUpdate().
-
-      //updates.intersect(server->pb->getRect());
-      //
-      //if (server->pb->width() > client.width())
-      //  updates.add_changed({client.width(), 0, server->pb->width(),
-      //                       server->pb->height()});
-      //if (server->pb->height() > client.height())
-      //  updates.add_changed({0, client.height(), client.width(),
-      //                       server->pb->height()});
-
+      // We need to clip the damagedCursorRegion because that might be
+      // added to updates in writeFramebufferUpdate().
       damagedCursorRegion.assign_intersect(server->getPixelBuffer()->getRect());
 
       client.setDimensions(server->getPixelBuffer()->width(),
@@ -268,10 +297,25 @@ void VNCSConnectionST::pixelBufferChange()
       // Drop any lossy tracking that is now outside the framebuffer
       encodeManager.pruneLosslessRefresh(server->getPixelBuffer()->getRect());
     }
-    // Just update the whole screen at the moment because we're too lazy to
-    // work out what's actually changed.
-    updates.clear();
-    updates.add_changed(server->getPixelBuffer()->getRect());
+
+    if (client.supportsPreserveOnResize()) {
+      SimpleUpdateTracker clipped;
+      ClippingUpdateTracker clipper(&clipped,
+                                    server->getPixelBuffer()->getRect());
+
+      // The client keeps what still fits, and the server core will
+      // tell us what actually changed there. So we only need to clip
+      // what we have queued and send the newly exposed areas.
+      updates.copyTo(&clipper);
+      updates.clear();
+      clipped.copyTo(&updates);
+
+      updates.add_changed(core::Region(server->getPixelBuffer()->getRect())
+                          .subtract(oldRect));
+    } else {
+      updates.clear();
+      updates.add_changed(server->getPixelBuffer()->getRect());
+    }
     writeFramebufferUpdate();
   } catch(std::exception& e) {
     close(e.what());
@@ -437,6 +481,31 @@ bool VNCSConnectionST::needRenderedCursor()
   return false;
 }
 
+bool VNCSConnectionST::isUpToDate()
+{
+  UpdateInfo ui;
+
+  if (state() != RFBSTATE_NORMAL)
+    return false;
+
+  // Data still on its way?
+  if (sock->outStream().hasBufferedData())
+    return false;
+  if (client.supportsFence() && congestion.isCongested())
+    return false;
+
+  if (encodeManager.hasPreEncoded())
+    return false;
+
+  // Areas outside what the client is tracking don't matter
+  if (continuousUpdates)
+    updates.getUpdateInfo(&ui, cuRegion);
+  else
+    updates.getUpdateInfo(&ui, server->getPixelBuffer()->getRect());
+
+  return ui.is_empty();
+}
+
 void VNCSConnectionST::desktopReady()
 {
   if (state() != RFBSTATE_CLIENT_READY)
@@ -505,6 +574,7 @@ void VNCSConnectionST::clientReady(bool shared)
 
 void VNCSConnectionST::setPixelFormat(const PixelFormat& pf)
 {
+  discardPreEncoded();
   SConnection::setPixelFormat(pf);
   char buffer[256];
   pf.print(buffer, 256);
@@ -513,6 +583,14 @@ void VNCSConnectionST::setPixelFormat(const PixelFormat& pf)
   encodeManager.forceRefresh(server->getPixelBuffer()->getRect());
 }
 
+void VNCSConnectionST::setEncodings(int nEncodings,
+                                    const int32_t* encodings)
+{
+  // The client might not understand what we have prepared anymore
+  discardPreEncoded();
+  SConnection::setEncodings(nEncodings, encodings);
+}
+
 void VNCSConnectionST::pointerEvent(const core::Point& pos,
                                     uint16_t buttonMask)
 {
@@ -520,6 +598,12 @@ void VNCSConnectionST::pointerEvent(const core::Point& pos,
     idleTimer.start(core::secsToMillis(rfb::Server::idleTimeout));
   pointerEventTime = time(nullptr);
   if (!accessCheck(AccessPtrEvents)) return;
+  gettimeofday(&lastInputTime, nullptr);
+  // The user has moved on from whatever they were typing in
+  if ((pos != pointerEventPos) || (buttonMask != 0)) {
+    keyFocusPending = false;
+    keyFocus.clear();
+  }
   pointerEventPos = pos;
   server->pointerEvent(this, pointerEventPos, buttonMask);
 }
@@ -556,10 +640,13 @@ void VNCSConnectionST::keyEvent(uint32_t keysym, uint32_t keycode, bool down) {
   //        confusing debug logging without it
   if (!rfb::Server::acceptKeyEvents) return;
 
-  if (down)
+  gettimeofday(&lastInputTime, nullptr);
+
+  if (down) {
     vlog.debug("Key pressed: 0x%04x / XK_%s (0x%04x)",
                keycode, KeySymName(keysym), keysym);
-  else
+    keyFocusPending = true;
+  } else
     vlog.debug("Key released: 0x%04x / XK_%s (0x%04x)",
                keycode, KeySymName(keysym), keysym);
 
@@ -722,6 +809,30 @@ void VNCSConnectionST::fence(uint32_t flags, unsigned len, const uint8_t data[])
   uint8_t type;
 
   if (flags & fenceFlagRequest) {
+    if (flags & fenceFlagSyncDamage) {
+      UpdateInfo ui;
+
+      // Only one at a time, so tell the client it missed the old one
+      if (pendingDamageFence)
+        writer()->writeFence(0, damageFenceData.size(),
+                             damageFenceData.data());
+
+      pendingDamageFence = true;
+      damageFenceData.assign(data, data + len);
+
+      // The input before this has been passed on, but won't normally
+      // have had any effect yet. So whatever is already changing is
+      // something else, e.g. an animation.
+      damageFenceIgnore = lastChanged;
+      if (server->getPixelBuffer() != nullptr) {
+        updates.getUpdateInfo(&ui, server->getPixelBuffer()->getRect());
+        damageFenceIgnore.assign_union(ui.changed);
+        damageFenceIgnore.assign_union(ui.copied);
+      }
+
+      return;
+    }
+
     if (flags & fenceFlagSyncNext) {
       pendingSyncFence = true;
 
@@ -900,6 +1011,7 @@ bool VNCSConnectionST::isCongested()
 
   // Stuff still waiting in the send buffer?
   sock->outStream().flush();
+  updateOutputUsage();
   congestion.debugTrace("congestion-trace.csv", sock->getFd());
   if (sock->outStream().hasBufferedData())
     return true;
@@ -918,6 +1030,113 @@ bool VNCSConnectionST::isCongested()
   return true;
 }
 
+void VNCSConnectionST::updateOutputUsage()
+{
+  size_t usage;
+
+  usage = sock->outStream().bufferUsage();
+  server->adjustOutputUsage(outputUsage, usage);
+  outputUsage = usage;
+
+  if (usage > outputPeak)
+    outputPeak = usage;
+  if (usage > maxOutputUsage)
+    maxOutputUsage = usage;
+}
+
+void VNCSConnectionST::updateMemoryPressure()
+{
+  size_t share;
+  int level;
+
+  share = server->getOutputShare();
+
+  // Back off as soon as the updates start piling up beyond our share
+  // of the budget, but don't relax until we've properly recovered
+  level = memoryPressure;
+  if (share == 0)
+    level = 0;
+  else if (outputPeak > share)
+    level = server->isOutputOverBudget() ? 2 : 1;
+  else if (outputPeak < share / 2)
+    level = 0;
+  else if ((level > 1) && !server->isOutputOverBudget())
+    level = 1;
+
+  outputPeak = outputUsage;
+
+  if (level == memoryPressure)
+    return;
+
+  vlog.debug("Memory pressure level %d for %s", level,
+             peerEndpoint.c_str());
+
+  memoryPressure = level;
+  encodeManager.setQualityLimit(PRESSURE_QUALITY[level]);
+
+  // Long lived connections might never close, so give a summary
+  // every time we've recovered
+  if (level == 0)
+    logStats();
+}
+
+void VNCSConnectionST::logStats()
+{
+  if ((pressureUpdates != 0) || (skippedUpdates != 0) ||
+      (postponedRefreshes != 0)) {
+    vlog.info("Memory pressure for %s:", peerEndpoint.c_str());
+    vlog.info("  Coarser updates: %u", pressureUpdates);
+    vlog.info("  Skipped updates: %u", skippedUpdates);
+    vlog.info("  Postponed refreshes: %u", postponedRefreshes);
+    vlog.info("  Peak pending output: %s",
+              core::iecPrefix(maxOutputUsage, "B").c_str());
+  }
+
+  pressureUpdates = skippedUpdates = postponedRefreshes = 0;
+  maxOutputUsage = outputUsage;
+}
+
+void VNCSConnectionST::updateFocus(const UpdateInfo& ui)
+{
+  core::Region focus;
+  core::Point pos;
+  int radius;
+
+  radius = rfb::Server::focusRadius;
+  if (radius == 0) {
+    encodeManager.setFocus({}, 0);
+    return;
+  }
+
+  // Whatever changes first after a key press is most likely the text
+  // being typed, unless it's too big to be just that
+  if (keyFocusPending && !ui.changed.is_empty()) {
+    core::Rect changed;
+
+    changed = ui.changed.get_bounding_rect();
+    if ((changed.width() <= radius * 2) &&
+        (changed.height() <= radius * 2))
+      keyFocus = changed;
+
+    keyFocusPending = false;
+  }
+
+  pos = server->getCursorPos();
+  focus.assign_union({pos.x - radius, pos.y - radius,
+                      pos.x + radius, pos.y + radius});
+
+  if (!keyFocus.is_empty()) {
+    pos.x = (keyFocus.tl.x + keyFocus.br.x) / 2;
+    pos.y = (keyFocus.tl.y + keyFocus.br.y) / 2;
+    focus.assign_union({pos.x - radius, pos.y - radius,
+                        pos.x + radius, pos.y + radius});
+  }
+
+  focus.assign_intersect(server->getPixelBuffer()->getRect());
+
+  encodeManager.setFocus(focus, rfb::Server::focusQualityDrop);
+}
+
 
 void VNCSConnectionST::writeFramebufferUpdate()
 {
@@ -937,14 +1156,20 @@ void VNCSConnectionST::writeFramebufferUpdate()
 
   if (state() != RFBSTATE_NORMAL)
     return;
-  if (requested.is_empty() && !continuousUpdates)
+  if (requested.is_empty() && !continuousUpdates) {
+    // Nothing to send yet, but we can get a head start on it
+    preEncodeUpdate();
     return;
+  }
 
   // Check that we actually have some space on the link and retry in a
   // bit if things are congested.
   if (isCongested())
     return;
 
+  // Clients that have been hogging memory get coarser updates
+  updateMemoryPressure();
+
   // Updates often consists of many small writes, and in continuous
   // mode, we will also have small fence messages around the update. We
   // need to aggregate these in order to not clog up TCP's congestion
@@ -958,9 +1183,15 @@ void VNCSConnectionST::writeFramebufferUpdate()
   // Then real data (if possible)
   writeDataUpdate();
 
+  // Everything is still queued up at this point, so this is when the
+  // most memory is used
+  updateOutputUsage();
+
   getOutStream()->cork(false);
 
   congestion.updatePosition(sock->outStream().length());
+
+  updateOutputUsage();
 }
 
 void VNCSConnectionST::writeNoDataUpdate()
@@ -976,7 +1207,7 @@ void VNCSConnectionST::writeNoDataUpdate()
 
 void VNCSConnectionST::writeDataUpdate()
 {
-  core::Region req;
+  core::Region req, discarded;
   UpdateInfo ui;
   bool needNewUpdateInfo;
   const RenderedCursor *cursor;
@@ -996,6 +1227,15 @@ void VNCSConnectionST::writeDataUpdate()
   updates.getUpdateInfo(&ui, req);
   needNewUpdateInfo = false;
 
+  // Prepared rects can only be sent as they are, so they are no good
+  // if they have changed again or cover more than was asked for
+  discarded = encodeManager.invalidatePreEncoded(ui.changed.union_(ui.copied),
+                                                 req);
+  if (!discarded.is_empty()) {
+    requeuePreEncoded(discarded);
+    needNewUpdateInfo = true;
+  }
+
   // If the previous position of the rendered cursor overlaps the source of the
   // copy, then when the copy happens the corresponding rectangle in the
   // destination will be wrong, so add it to the changed region.
@@ -1066,23 +1306,58 @@ void VNCSConnectionST::writeDataUpdate()
   }
 
   // If we don't have a normal update, then try a lossless refresh
-  if (ui.is_empty() && !writer()->needFakeUpdate()) {
+  if (ui.is_empty() && !writer()->needFakeUpdate() &&
+      !encodeManager.hasPreEncoded()) {
     writeLosslessRefresh();
     return;
   }
 
+  // Under severe memory pressure we only send every other frame. The
+  // changes in between are simply aggregated in to the next update.
+  if ((memoryPressure > 1) && (rfb::Server::frameRate > 0)) {
+    unsigned interval, elapsed;
+
+    interval = 2000 / rfb::Server::frameRate;
+    elapsed = core::msSince(&lastDataUpdate);
+    if (elapsed < interval) {
+      skippedUpdates++;
+      congestionTimer.start(interval - elapsed);
+      return;
+    }
+  }
+
+  if (memoryPressure > 0)
+    pressureUpdates++;
+
+  gettimeofday(&lastDataUpdate, nullptr);
+
   // We have something to send, so let's get to it
 
   writeRTTPing();
 
+  updateFocus(ui);
   encodeManager.writeUpdate(ui, server->getPixelBuffer(), cursor);
 
+  lastChanged = ui.changed.union_(ui.copied);
+
+  // Something new has changed since the client's input, so this is
+  // most likely the update it was waiting for
+  if (pendingDamageFence &&
+      !lastChanged.subtract(damageFenceIgnore).is_empty()) {
+    writer()->writeFence(fenceFlagSyncDamage, damageFenceData.size(),
+                         damageFenceData.data());
+    pendingDamageFence = false;
+  }
+
   writeRTTPing();
 
   // The request might be for just part of the screen, so we cannot
   // just clear the entire update tracker.
   updates.subtract(req);
 
+  // Clients tend to ask for the same thing next time
+  lastRequested = req;
+
   requested.clear();
 }
 
@@ -1119,6 +1394,15 @@ void VNCSConnectionST::writeLosslessRefresh()
   if (!encodeManager.needsLosslessRefresh(req))
     return;
 
+  // Refreshing is a luxury we can't afford when memory is tight
+  if (memoryPressure > 0) {
+    if (!losslessTimer.isStarted()) {
+      postponedRefreshes++;
+      losslessTimer.start(1000);
+    }
+    return;
+  }
+
   // Right away? Or later?
   nextRefresh = encodeManager.getNextLosslessRefresh(req);
   if (nextRefresh > 0) {
@@ -1161,6 +1445,70 @@ void VNCSConnectionST::writeLosslessRefresh()
 }
 
 
+void VNCSConnectionST::preEncodeUpdate()
+{
+  UpdateInfo ui;
+  core::Region prepared, discarded;
+
+  if (!rfb::Server::preEncode)
+    return;
+
+  // Only plain framebuffer changes are safe to prepare. Anything that
+  // involves the cursor, queued server updates, or messages that have
+  // to go before the data is left for the real update.
+  if (needRenderedCursor() || removeRenderedCursor || updateRenderedCursor)
+    return;
+  if (!server->getPendingRegion().is_empty())
+    return;
+  if (writer()->needNoDataUpdate())
+    return;
+
+  // Prepared data is memory the client hasn't asked for yet
+  if (memoryPressure > 0)
+    return;
+
+  // Only prepare what the client is likely to ask for, and start over
+  // if something we prepared earlier has changed again
+  updates.getUpdateInfo(&ui, lastRequested);
+  discarded = encodeManager.invalidatePreEncoded(ui.changed.union_(ui.copied),
+                                                 lastRequested);
+  if (!discarded.is_empty()) {
+    requeuePreEncoded(discarded);
+    updates.getUpdateInfo(&ui, lastRequested);
+  }
+
+  if (ui.changed.is_empty() || !ui.copied.is_empty())
+    return;
+
+  prepared = encodeManager.preEncode(ui.changed, server->getPixelBuffer());
+
+  updates.subtract(prepared);
+}
+
+void VNCSConnectionST::discardPreEncoded()
+{
+  requeuePreEncoded(encodeManager.discardPreEncoded());
+}
+
+void VNCSConnectionST::requeuePreEncoded(core::Region discarded)
+{
+  core::Region copiedFrom;
+  UpdateInfo ui;
+
+  if (discarded.is_empty())
+    return;
+
+  // Anything copied out of those areas since is just as stale
+  updates.getUpdateInfo(&ui, server->getPixelBuffer()->getRect());
+  if (!ui.copied.is_empty()) {
+    copiedFrom = discarded;
+    copiedFrom.translate(ui.copy_delta);
+    discarded.assign_union(copiedFrom.intersect(ui.copied));
+  }
+
+  updates.add_changed(discarded);
+}
+
 void VNCSConnectionST::screenLayoutChange(uint16_t reason)
 {
   if (state() != RFBSTATE_NORMAL)
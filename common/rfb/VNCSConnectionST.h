@@ -28,6 +28,9 @@
 #define __RFB_VNCSCONNECTIONST_H__
 
 #include <map>
+#include <vector>
+
+#include <sys/time.h>
 
 #include <core/Timer.h>
 
@@ -51,6 +54,7 @@ namespace rfb {
     void close(const char* reason) override;
 
     using SConnection::authenticated;
+    using SConnection::state;
 
     // Methods called from VNCServerST.  None of these methods ever knowingly
     // throw an exception.
@@ -108,6 +112,19 @@ namespace rfb {
     // or because the current cursor position has not been set by this client.
     bool needRenderedCursor();
 
+    // isUpToDate() returns true if the client has been sent everything
+    // that has changed so far and is able to take more, i.e. it would
+    // make use of another frame.
+    bool isUpToDate();
+
+    // getLastInputTime() returns when the client last sent a key or
+    // pointer event.
+    const struct timeval* getLastInputTime() { return &lastInputTime; }
+
+    // logStats() logs how often this client has had to be held back
+    // because of memory pressure since the last call, if at all.
+    void logStats();
+
     network::Socket* getSock() { return sock; }
 
     // Change tracking
@@ -127,6 +144,8 @@ namespace rfb {
     void queryConnection(const char* userName) override;
     void clientReady(bool shared) override;
     void setPixelFormat(const PixelFormat& pf) override;
+    void setEncodings(int nEncodings,
+                      const int32_t* encodings) override;
     void pointerEvent(const core::Point& pos,
                       uint16_t buttonMask) override;
     void keyEvent(uint32_t keysym, uint32_t keycode,
@@ -158,6 +177,11 @@ namespace rfb {
     void writeRTTPing();
     bool isCongested();
 
+    // Memory pressure
+    void updateOutputUsage();
+    void updateMemoryPressure();
+    void updateFocus(const UpdateInfo& ui);
+
     // writeFramebufferUpdate() attempts to write a framebuffer update to the
     // client.
 
@@ -166,6 +190,14 @@ namespace rfb {
     void writeDataUpdate();
     void writeLosslessRefresh();
 
+    // preEncodeUpdate() prepares pending changes for clients that have
+    // not yet asked for them. discardPreEncoded() throws that away if
+    // the client's settings change before it can be sent, and
+    // requeuePreEncoded() puts such a region back in the tracker.
+    void preEncodeUpdate();
+    void discardPreEncoded();
+    void requeuePreEncoded(core::Region discarded);
+
     void screenLayoutChange(uint16_t reason);
     void setCursor();
     void setCursorPos();
@@ -186,13 +218,26 @@ namespace rfb {
     unsigned fenceDataLen;
     uint8_t *fenceData;
 
+    bool pendingDamageFence;
+    std::vector<uint8_t> damageFenceData;
+    core::Region damageFenceIgnore;
+    core::Region lastChanged;
+
     Congestion congestion;
     core::Timer congestionTimer;
     core::Timer losslessTimer;
 
+    size_t outputUsage, outputPeak;
+    int memoryPressure;
+    struct timeval lastDataUpdate;
+
+    unsigned pressureUpdates, skippedUpdates, postponedRefreshes;
+    size_t maxOutputUsage;
+
     VNCServerST* server;
     SimpleUpdateTracker updates;
     core::Region requested;
+    core::Region lastRequested;
     bool updateRenderedCursor, removeRenderedCursor;
     core::Region damagedCursorRegion;
     bool continuousUpdates;
@@ -204,9 +249,13 @@ namespace rfb {
     core::Timer idleTimer;
 
     time_t pointerEventTime;
+    struct timeval lastInputTime;
     core::Point pointerEventPos;
     bool clientHasCursor;
 
+    bool keyFocusPending;
+    core::Rect keyFocus;
+
     std::string closeReason;
   };
 }
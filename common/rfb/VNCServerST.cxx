@@ -56,6 +56,7 @@
 #include <stdlib.h>
 
 #include <core/LogWriter.h>
+#include <core/string.h>
 #include <core/time.h>
 
 #include <rdr/FdOutStream.h>
@@ -93,7 +94,8 @@ VNCServerST::VNCServerST(const char* name_, SDesktop* desktop_)
     renderedCursorInvalid(false),
     keyRemapper(&KeyRemapper::defInstance),
     idleTimer(this), disconnectTimer(this), connectTimer(this),
-    msc(0), queuedMsc(0), frameTimer(this)
+    msc(0), queuedMsc(0), frameTimer(this), heldFrames(0),
+    outputUsage(0), outputOverBudget(false)
 {
   slog.debug("Creating single-threaded server %s", name.c_str());
 
@@ -203,6 +205,8 @@ void VNCServerST::removeSocket(network::Socket* sock) {
 
       if (comparer)
         comparer->logStats();
+      for (VNCSConnectionST* client : clients)
+        client->logStats();
 
       // Adjust the exit timers
       if (authClientCount() == 0) {
@@ -279,12 +283,15 @@ void VNCServerST::setPixelBuffer(PixelBuffer* pb_, const ScreenSet& layout)
 {
   if (comparer)
     comparer->logStats();
+  for (VNCSConnectionST* client : clients)
+    client->logStats();
 
   pb = pb_;
-  delete comparer;
-  comparer = nullptr;
 
   if (!pb) {
+    delete comparer;
+    comparer = nullptr;
+
     screenLayout = ScreenSet();
 
     if (desktopStarted)
@@ -298,9 +305,13 @@ void VNCServerST::setPixelBuffer(PixelBuffer* pb_, const ScreenSet& layout)
 
   screenLayout = layout;
 
-  // Assume the framebuffer contents wasn't saved and reset everything
-  // that tracks its contents
-  comparer = new ComparingUpdateTracker(pb);
+  // We can't assume the framebuffer contents was saved, but the
+  // comparer still has what it saw before, so it can work out what
+  // actually changed
+  if (comparer)
+    comparer->setBuffer(pb);
+  else
+    comparer = new ComparingUpdateTracker(pb);
   renderedCursorInvalid = true;
   add_changed(pb->getRect());
 
@@ -721,6 +732,18 @@ void VNCServerST::handleTimeout(core::Timer* t)
         ((comparer != nullptr) && !comparer->is_empty()))
       writeUpdate();
 
+    // Hold back applications that are waiting for the next frame if
+    // the clients can't keep up, as anything drawn now would never be
+    // seen. Still let them make some progress, in case a client has
+    // stopped asking for updates altogether.
+    if (!clientsReadyForFrame() &&
+        (heldFrames < rfb::Server::frameRate)) {
+      heldFrames++;
+      return;
+    }
+
+    heldFrames = 0;
+
     msc++;
     desktop->frameTick(msc);
   } else if (t == &idleTimer) {
@@ -836,6 +859,49 @@ inline bool VNCServerST::needRenderedCursor()
   return false;
 }
 
+// clientsReadyForFrame() checks if the clients selected by
+// PresentPacing have caught up with what has been drawn so far
+
+bool VNCServerST::clientsReadyForFrame()
+{
+  std::list<VNCSConnectionST*>::iterator ci;
+  VNCSConnectionST* active;
+  bool any, all;
+
+  if (rfb::Server::presentPacing == "timer")
+    return true;
+
+  active = nullptr;
+  any = false;
+  all = true;
+
+  for (ci = clients.begin(); ci != clients.end(); ci++) {
+    if ((*ci)->state() != SConnection::RFBSTATE_NORMAL)
+      continue;
+
+    if ((*ci)->isUpToDate())
+      any = true;
+    else
+      all = false;
+
+    if ((active == nullptr) ||
+        core::isBefore(active->getLastInputTime(),
+                       (*ci)->getLastInputTime()))
+      active = *ci;
+  }
+
+  // Nobody to wait for
+  if (active == nullptr)
+    return true;
+
+  if (rfb::Server::presentPacing == "slowest")
+    return all;
+  if (rfb::Server::presentPacing == "fastest")
+    return any;
+
+  return active->isUpToDate();
+}
+
 void VNCServerST::startFrameClock()
 {
   if (frameTimer.isStarted())
@@ -960,6 +1026,44 @@ const RenderedCursor* VNCServerST::getRenderedCursor()
   return &renderedCursor;
 }
 
+void VNCServerST::adjustOutputUsage(size_t oldUsage, size_t newUsage)
+{
+  outputUsage -= oldUsage;
+  outputUsage += newUsage;
+
+  // Only log the transitions, or we would flood the log
+  if (isOutputOverBudget() != outputOverBudget) {
+    outputOverBudget = !outputOverBudget;
+    if (outputOverBudget)
+      slog.status("Pending output exceeds budget: %s",
+                  core::iecPrefix(outputUsage, "B").c_str());
+    else
+      slog.status("Pending output back within budget");
+  }
+}
+
+size_t VNCServerST::getOutputShare()
+{
+  int count;
+
+  if (rfb::Server::maxOutputMemory == 0)
+    return 0;
+
+  count = authClientCount();
+  if (count < 1)
+    count = 1;
+
+  return (size_t)rfb::Server::maxOutputMemory * 1024 / count;
+}
+
+bool VNCServerST::isOutputOverBudget()
+{
+  if (rfb::Server::maxOutputMemory == 0)
+    return false;
+
+  return outputUsage > (size_t)rfb::Server::maxOutputMemory * 1024;
+}
+
 bool VNCServerST::getComparerState()
 {
   if (rfb::Server::compareFB == 0)
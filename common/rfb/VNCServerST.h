@@ -156,6 +156,18 @@ namespace rfb {
     // side rendered cursor buffer
     const RenderedCursor* getRenderedCursor();
 
+    // adjustOutputUsage() is called by the clients whenever the amount
+    // of data they have waiting to be sent changes
+    void adjustOutputUsage(size_t oldUsage, size_t newUsage);
+
+    // getOutputShare() returns how much pending output each client is
+    // allowed before it has to start backing off, or 0 if unlimited
+    size_t getOutputShare();
+
+    // isOutputOverBudget() checks if the clients combined have more
+    // pending output than MaxOutputMemory allows
+    bool isOutputOverBudget();
+
   protected:
 
     // Timer callbacks
@@ -172,6 +184,7 @@ namespace rfb {
     int authClientCount();
 
     bool needRenderedCursor();
+    bool clientsReadyForFrame();
     void startFrameClock();
     void stopFrameClock();
     void writeUpdate();
@@ -213,6 +226,10 @@ namespace rfb {
 
     uint64_t msc, queuedMsc;
     core::Timer frameTimer;
+    int heldFrames;
+
+    size_t outputUsage;
+    bool outputOverBudget;
   };
 
 };
@@ -53,23 +53,23 @@ static inline uint32_t readOpaque24B(rdr::InStream* is)
 }
 
 template<class T>
-static inline T readPixel(rdr::ZlibInStream* zis)
+static inline T readPixel(rdr::InStream* is)
 {
   if (sizeof(T) == 1)
-    return zis->readOpaque8();
+    return is->readOpaque8();
   if (sizeof(T) == 2)
-    return zis->readOpaque16();
+    return is->readOpaque16();
   if (sizeof(T) == 4)
-    return zis->readOpaque32();
+    return is->readOpaque32();
 }
 
-static inline void zlibHasData(rdr::ZlibInStream* zis, size_t length)
+static inline void zrleHasData(rdr::InStream* is, size_t length)
 {
-  if (!zis->hasData(length))
+  if (is->avail() < length)
     throw protocol_error("ZRLE decode error");
 }
 
-ZRLEDecoder::ZRLEDecoder() : Decoder(DecoderOrdered)
+ZRLEDecoder::ZRLEDecoder() : Decoder(DecoderPlain)
 {
 }
 
@@ -77,11 +77,12 @@ ZRLEDecoder::~ZRLEDecoder()
 {
 }
 
-bool ZRLEDecoder::readRect(const core::Rect& /*r*/, rdr::InStream* is,
-                           const ServerParams& /*server*/,
+bool ZRLEDecoder::readRect(const core::Rect& r, rdr::InStream* is,
+                           const ServerParams& server,
                            rdr::OutStream* os)
 {
   uint32_t len;
+  size_t maxLen, outLen;
 
   if (!is->hasData(4))
     return false;
@@ -95,8 +96,32 @@ bool ZRLEDecoder::readRect(const core::Rect& /*r*/, rdr::InStream* is,
 
   is->clearRestorePoint();
 
-  os->writeU32(len);
-  os->copyBytes(is, len);
+  // The zlib stream is shared between all rects, so it has to be
+  // inflated here in order. The tiles can then be reconstructed on
+  // any of the decoder threads.
+
+  // Worst case is a plain RLE tile with a single byte run length for
+  // every pixel, plus the largest possible palette
+  maxLen = (size_t)((r.width() + 63) / 64) * ((r.height() + 63) / 64) *
+           (1 + 127 * 4) + (size_t)r.area() * (server.pf().bpp / 8 + 1);
+
+  zis.setUnderlying(is, len);
+
+  outLen = 0;
+  while (zis.hasData(1)) {
+    size_t chunk;
+
+    chunk = zis.avail();
+    if (chunk > maxLen - outLen)
+      throw protocol_error("ZRLE decode error");
+
+    os->writeBytes(zis.getptr(chunk), chunk);
+    zis.setptr(chunk);
+    outLen += chunk;
+  }
+
+  zis.flushUnderlying();
+  zis.setUnderlying(nullptr, 0);
 
   return true;
 }
@@ -119,8 +144,6 @@ void ZRLEDecoder::zrleDecode(const core::Rect& r, rdr::InStream* is,
                              const PixelFormat& pf,
                              ModifiablePixelBuffer* pb)
 {
-  int length = is->readU32();
-  zis.setUnderlying(is, length);
   core::Rect t;
   T buf[64 * 64];
 
@@ -142,24 +165,24 @@ void ZRLEDecoder::zrleDecode(const core::Rect& r, rdr::InStream* is,
 
       t.br.x = std::min(r.br.x, t.tl.x + 64);
 
-      zlibHasData(&zis, 1);
-      int mode = zis.readU8();
+      zrleHasData(is, 1);
+      int mode = is->readU8();
       bool rle = mode & 128;
       int palSize = mode & 127;
       T palette[128];
 
       if (isLowCPixel || isHighCPixel)
-        zlibHasData(&zis, 3 * palSize);
+        zrleHasData(is, 3 * palSize);
       else
-        zlibHasData(&zis, sizeof(T) * palSize);
+        zrleHasData(is, sizeof(T) * palSize);
 
       for (int i = 0; i < palSize; i++) {
         if (isLowCPixel)
-          palette[i] = readOpaque24A(&zis);
+          palette[i] = readOpaque24A(is);
         else if (isHighCPixel)
-          palette[i] = readOpaque24B(&zis);
+          palette[i] = readOpaque24B(is);
         else
-          palette[i] = readPixel<T>(&zis);
+          palette[i] = readPixel<T>(is);
       }
 
       if (palSize == 1) {
@@ -174,19 +197,19 @@ void ZRLEDecoder::zrleDecode(const core::Rect& r, rdr::InStream* is,
           // raw
 
           if (isLowCPixel || isHighCPixel)
-            zlibHasData(&zis, 3 * t.area());
+            zrleHasData(is, 3 * t.area());
           else
-            zlibHasData(&zis, sizeof(T) * t.area());
+            zrleHasData(is, sizeof(T) * t.area());
 
           if (isLowCPixel || isHighCPixel) {
             for (T* ptr = buf; ptr < buf+t.area(); ptr++) {
               if (isLowCPixel)
-                *ptr = readOpaque24A(&zis);
+                *ptr = readOpaque24A(is);
               else
-                *ptr = readOpaque24B(&zis);
+                *ptr = readOpaque24B(is);
             }
           } else {
-            zis.readBytes((uint8_t*)buf, t.area() * sizeof(T));
+            is->readBytes((uint8_t*)buf, t.area() * sizeof(T));
           }
 
         } else {
@@ -204,8 +227,8 @@ void ZRLEDecoder::zrleDecode(const core::Rect& r, rdr::InStream* is,
 
             while (ptr < eol) {
               if (nbits == 0) {
-                zlibHasData(&zis, 1);
-                byte = zis.readU8();
+                zrleHasData(is, 1);
+                byte = is->readU8();
                 nbits = 8;
               }
               nbits -= bppp;
@@ -226,20 +249,20 @@ void ZRLEDecoder::zrleDecode(const core::Rect& r, rdr::InStream* is,
           while (ptr < end) {
             T pix;
             if (isLowCPixel || isHighCPixel)
-              zlibHasData(&zis, 3);
+              zrleHasData(is, 3);
             else
-              zlibHasData(&zis, sizeof(T));
+              zrleHasData(is, sizeof(T));
             if (isLowCPixel)
-              pix = readOpaque24A(&zis);
+              pix = readOpaque24A(is);
             else if (isHighCPixel)
-              pix = readOpaque24B(&zis);
+              pix = readOpaque24B(is);
             else
-              pix = readPixel<T>(&zis);
+              pix = readPixel<T>(is);
             int len = 1;
             int b;
             do {
-              zlibHasData(&zis, 1);
-              b = zis.readU8();
+              zrleHasData(is, 1);
+              b = is->readU8();
               len += b;
             } while (b == 255);
 
@@ -257,14 +280,14 @@ void ZRLEDecoder::zrleDecode(const core::Rect& r, rdr::InStream* is,
           T* ptr = buf;
           T* end = ptr + t.area();
           while (ptr < end) {
-            zlibHasData(&zis, 1);
-            int index = zis.readU8();
+            zrleHasData(is, 1);
+            int index = is->readU8();
             int len = 1;
             if (index & 128) {
               int b;
               do {
-                zlibHasData(&zis, 1);
-                b = zis.readU8();
+                zrleHasData(is, 1);
+                b = is->readU8();
                 len += b;
               } while (b == 255);
 
@@ -285,7 +308,4 @@ void ZRLEDecoder::zrleDecode(const core::Rect& r, rdr::InStream* is,
       pb->imageRect(pf, t, buf);
     }
   }
-
-  zis.flushUnderlying();
-  zis.setUnderlying(nullptr, 0);
 }
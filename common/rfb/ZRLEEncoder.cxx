@@ -21,6 +21,11 @@
 #include <config.h>
 #endif
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <thread>
+
 #include <core/Configuration.h>
 #include <core/LogWriter.h>
 
@@ -39,9 +44,131 @@ core::IntParameter zlibLevel("ZlibLevel",
                              "[DEPRECATED] Zlib compression level",
                              -1, -1, -1);
 
+// Rects with fewer tiles than this aren't worth splitting up
+static const int MinParallelTiles = 4;
+// A rect has at most 16 full tiles, so more threads than this rarely
+// have anything to do
+static const unsigned MaxWorkers = 4;
+
+class ZRLEEncoder::TilePool {
+public:
+  // The tile ranges of one rect, and how many are still not done
+  struct Batch {
+    ZRLEEncoder* encoder;
+    const PixelBuffer* pb;
+    unsigned pending;
+    std::exception_ptr exception;
+  };
+
+  TilePool(unsigned count);
+  ~TilePool();
+
+  unsigned size() const { return threads.size(); }
+
+  void submit(Batch* batch, TileWorker* const* workers, unsigned count);
+  void wait(Batch* batch);
+
+private:
+  void threadMain();
+
+  std::vector<std::thread*> threads;
+
+  std::mutex mutex;
+  std::condition_variable workCond;
+  std::condition_variable doneCond;
+  std::deque<std::pair<Batch*, TileWorker*>> queue;
+  bool stopRequested;
+};
+
+std::mutex ZRLEEncoder::poolMutex;
+ZRLEEncoder::TilePool* ZRLEEncoder::sharedPool = nullptr;
+unsigned ZRLEEncoder::poolUsers = 0;
+
+ZRLEEncoder::TilePool::TilePool(unsigned count)
+  : stopRequested(false)
+{
+  while (threads.size() < count)
+    threads.push_back(new std::thread(&TilePool::threadMain, this));
+}
+
+ZRLEEncoder::TilePool::~TilePool()
+{
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    stopRequested = true;
+    workCond.notify_all();
+  }
+
+  while (!threads.empty()) {
+    threads.back()->join();
+    delete threads.back();
+    threads.pop_back();
+  }
+}
+
+void ZRLEEncoder::TilePool::submit(Batch* batch,
+                                   TileWorker* const* workers,
+                                   unsigned count)
+{
+  const std::lock_guard<std::mutex> lock(mutex);
+
+  for (unsigned i = 0; i < count; i++)
+    queue.push_back({batch, workers[i]});
+  batch->pending += count;
+
+  workCond.notify_all();
+}
+
+void ZRLEEncoder::TilePool::wait(Batch* batch)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (batch->pending > 0)
+    doneCond.wait(lock);
+}
+
+void ZRLEEncoder::TilePool::threadMain()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (true) {
+    Batch* batch;
+    TileWorker* worker;
+
+    while (!stopRequested && queue.empty())
+      workCond.wait(lock);
+
+    if (stopRequested)
+      break;
+
+    batch = queue.front().first;
+    worker = queue.front().second;
+    queue.pop_front();
+
+    lock.unlock();
+
+    try {
+      batch->encoder->writeTiles(batch->pb, worker->first, worker->last,
+                                 &worker->palette, &worker->buffer);
+    } catch (...) {
+      lock.lock();
+      if (!batch->exception)
+        batch->exception = std::current_exception();
+      lock.unlock();
+    }
+
+    lock.lock();
+
+    batch->pending--;
+    if (batch->pending == 0)
+      doneCond.notify_all();
+  }
+}
+
 ZRLEEncoder::ZRLEEncoder(SConnection* conn_)
   : Encoder(conn_, encodingZRLE, EncoderPlain, 127),
-  zos(nullptr, 2), mos(129*1024)
+  zos(nullptr, 2), mos(129*1024), cpixelSize(0), cpixelOffset(0),
+  pool(nullptr)
 {
   if (zlibLevel != -1) {
     vlog.info("Warning: The ZlibLevel option is deprecated and is "
@@ -49,10 +176,26 @@ ZRLEEncoder::ZRLEEncoder(SConnection* conn_)
               "by the client instead.");
   }
   zos.setUnderlying(&mos);
+
+  maxWorkers = std::thread::hardware_concurrency();
+  if (maxWorkers > MaxWorkers)
+    maxWorkers = MaxWorkers;
+  if (maxWorkers < 1)
+    maxWorkers = 1;
+
+  // The calling thread is always the first worker
+  workers.push_back(new TileWorker());
 }
 
 ZRLEEncoder::~ZRLEEncoder()
 {
+  stopWorkers();
+
+  while (!workers.empty()) {
+    delete workers.back();
+    workers.pop_back();
+  }
+
   zos.setUnderlying(nullptr);
 }
 
@@ -68,10 +211,11 @@ void ZRLEEncoder::setCompressLevel(int level)
 
 void ZRLEEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
 {
-  int x, y;
-  core::Rect tile;
+  int tiles;
+  unsigned count;
 
-  rdr::OutStream* os;
+  TilePool::Batch batch;
+  std::exception_ptr e;
 
   // A bit of a special case
   if (palette.size() == 1) {
@@ -79,27 +223,70 @@ void ZRLEEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
     return;
   }
 
-  for (y = 0;y < pb->height();y += 64) {
-    tile.tl.y = y;
-    tile.br.y = y + 64;
-    if (tile.br.y > pb->height())
-      tile.br.y = pb->height();
+  setPixelFormat(pb->getPF());
 
-    for (x = 0;x < pb->width();x += 64) {
-      tile.tl.x = x;
-      tile.br.x = x + 64;
-      if (tile.br.x > pb->width())
-        tile.br.x = pb->width();
-
-      if (palette.size() == 0)
-        writeRawTile(tile, pb);
-      else if (palette.size() <= 16)
-        writePaletteTile(tile, pb, palette);
-      else
-        writePaletteRLETile(tile, pb, palette);
-    }
+  tiles = ((pb->width() + 63) / 64) * ((pb->height() + 63) / 64);
+
+  // The palette for the whole rect is ignored, as each tile can have
+  // its own palette and do much better than that. Without any help,
+  // the tiles can go straight in to the zlib stream.
+  if ((tiles < MinParallelTiles) || (maxWorkers <= 1)) {
+    writeTiles(pb, 0, tiles, &workers[0]->palette, &zos);
+    writeData();
+    return;
   }
 
+  if (pool == nullptr)
+    startWorkers();
+
+  count = workers.size();
+
+  for (unsigned i = 0; i < count; i++) {
+    workers[i]->first = tiles * i / count;
+    workers[i]->last = tiles * (i + 1) / count;
+  }
+
+  batch.encoder = this;
+  batch.pb = pb;
+  batch.pending = 0;
+
+  pool->submit(&batch, workers.data() + 1, count - 1);
+
+  try {
+    writeTiles(pb, workers[0]->first, workers[0]->last,
+               &workers[0]->palette, &workers[0]->buffer);
+  } catch (...) {
+    e = std::current_exception();
+  }
+
+  // The other threads might still be using the buffer, even if we
+  // failed
+  pool->wait(&batch);
+
+  if (!e)
+    e = batch.exception;
+
+  if (e) {
+    for (unsigned i = 0; i < count; i++)
+      workers[i]->buffer.clear();
+
+    std::rethrow_exception(e);
+  }
+
+  // Only the compression has to be done in order
+  for (unsigned i = 0; i < count; i++) {
+    zos.writeBytes(workers[i]->buffer.data(),
+                   workers[i]->buffer.length());
+    workers[i]->buffer.clear();
+  }
+
+  writeData();
+}
+
+void ZRLEEncoder::writeData()
+{
+  rdr::OutStream* os;
+
   zos.flush();
 
   os = conn->getOutStream();
@@ -110,107 +297,144 @@ void ZRLEEncoder::writeRect(const PixelBuffer* pb, const Palette& palette)
   mos.clear();
 }
 
+void ZRLEEncoder::checkpoint()
+{
+  zos.checkpoint();
+}
+
+void ZRLEEncoder::commit()
+{
+  zos.commit();
+}
+
+void ZRLEEncoder::rollback()
+{
+  zos.rollback();
+}
+
 void ZRLEEncoder::writeSolidRect(int width, int height,
                                  const PixelFormat& pf,
                                  const uint8_t* colour)
 {
   int tiles;
 
-  rdr::OutStream* os;
+  setPixelFormat(pf);
 
   tiles = ((width + 63)/64) * ((height + 63)/64);
 
   while (tiles--) {
     zos.writeU8(1);
-    writePixels(colour, pf, 1);
+    writePixels(colour, pf, 1, &zos);
   }
 
-  zos.flush();
+  writeData();
+}
 
-  os = conn->getOutStream();
+void ZRLEEncoder::setPixelFormat(const PixelFormat& pf)
+{
+  Pixel maxPixel;
+  uint8_t pixBuf[4];
 
-  os->writeU32(mos.length());
-  os->writeBytes(mos.data(), mos.length());
+  cpixelSize = pf.bpp/8;
+  cpixelOffset = 0;
 
-  mos.clear();
+  // 32 bpp pixels that only use three of the bytes are sent as just
+  // those three bytes
+  maxPixel = pf.pixelFromRGB((uint16_t)-1, (uint16_t)-1, (uint16_t)-1);
+  pf.bufferFromPixel(pixBuf, maxPixel);
+
+  if ((pf.bpp != 32) || ((pixBuf[0] != 0) && (pixBuf[3] != 0)))
+    return;
+
+  cpixelSize = 3;
+  if (pixBuf[0] == 0)
+    cpixelOffset = 1;
 }
 
-void ZRLEEncoder::writePaletteTile(const core::Rect& tile,
-                                   const PixelBuffer* pb,
-                                   const Palette& palette)
+void ZRLEEncoder::startWorkers()
 {
-  const uint8_t* buffer;
-  int stride;
+  const std::lock_guard<std::mutex> lock(poolMutex);
 
-  buffer = pb->getBuffer(tile, &stride);
+  // One set of threads for everyone, so that the number of threads
+  // doesn't grow with the number of clients
+  if (sharedPool == nullptr)
+    sharedPool = new TilePool(maxWorkers - 1);
+  poolUsers++;
 
-  switch (pb->getPF().bpp) {
-  case 32:
-    writePaletteTile(tile.width(), tile.height(),
-                     (uint32_t*)buffer, stride,
-                     pb->getPF(), palette);
-    break;
-  case 16:
-    writePaletteTile(tile.width(), tile.height(),
-                     (uint16_t*)buffer, stride,
-                     pb->getPF(), palette);
-    break;
-  default:
-    writePaletteTile(tile.width(), tile.height(),
-                     (uint8_t*)buffer, stride,
-                     pb->getPF(), palette);
+  pool = sharedPool;
+
+  while (workers.size() < pool->size() + 1)
+    workers.push_back(new TileWorker());
+}
+
+void ZRLEEncoder::stopWorkers()
+{
+  const std::lock_guard<std::mutex> lock(poolMutex);
+
+  if (pool == nullptr)
+    return;
+
+  pool = nullptr;
+
+  poolUsers--;
+  if (poolUsers == 0) {
+    delete sharedPool;
+    sharedPool = nullptr;
   }
 }
 
-void ZRLEEncoder::writePaletteRLETile(const core::Rect& tile,
-                                      const PixelBuffer* pb,
-                                      const Palette& palette)
+void ZRLEEncoder::writeTiles(const PixelBuffer* pb, int first, int last,
+                             Palette* palette, rdr::OutStream* os)
 {
-  const uint8_t* buffer;
-  int stride;
+  int tilesPerRow;
+  core::Rect tile;
 
-  buffer = pb->getBuffer(tile, &stride);
+  tilesPerRow = (pb->width() + 63) / 64;
 
-  switch (pb->getPF().bpp) {
-  case 32:
-    writePaletteRLETile(tile.width(), tile.height(),
-                        (uint32_t*)buffer, stride,
-                        pb->getPF(), palette);
-    break;
-  case 16:
-    writePaletteRLETile(tile.width(), tile.height(),
-                        (uint16_t*)buffer, stride,
-                        pb->getPF(), palette);
-    break;
-  default:
-    writePaletteRLETile(tile.width(), tile.height(),
-                        (uint8_t*)buffer, stride,
-                        pb->getPF(), palette);
+  for (int i = first; i < last; i++) {
+    tile.tl.x = (i % tilesPerRow) * 64;
+    tile.tl.y = (i / tilesPerRow) * 64;
+    tile.br.x = tile.tl.x + 64;
+    if (tile.br.x > pb->width())
+      tile.br.x = pb->width();
+    tile.br.y = tile.tl.y + 64;
+    if (tile.br.y > pb->height())
+      tile.br.y = pb->height();
+
+    writeTile(tile, pb, palette, os);
   }
 }
 
-void ZRLEEncoder::writeRawTile(const core::Rect& tile,
-                               const PixelBuffer* pb)
+void ZRLEEncoder::writeTile(const core::Rect& tile,
+                            const PixelBuffer* pb,
+                            Palette* palette, rdr::OutStream* os)
 {
   const uint8_t* buffer;
   int stride;
 
-  int w, h, stride_bytes;
-
   buffer = pb->getBuffer(tile, &stride);
 
-  zos.writeU8(0); // Empty palette (i.e. raw pixels)
-
-  w = tile.width();
-  h = tile.height();
-  stride_bytes = stride * pb->getPF().bpp/8;
-  while (h--) {
-    writePixels(buffer, pb->getPF(), w);
-    buffer += stride_bytes;
+  switch (pb->getPF().bpp) {
+  case 32:
+    writeTile(tile.width(), tile.height(),
+              (const uint32_t*)buffer, stride, pb->getPF(),
+              palette, os);
+    break;
+  case 16:
+    writeTile(tile.width(), tile.height(),
+              (const uint16_t*)buffer, stride, pb->getPF(),
+              palette, os);
+    break;
+  default:
+    writeTile(tile.width(), tile.height(),
+              (const uint8_t*)buffer, stride, pb->getPF(),
+              palette, os);
   }
 }
 
-void ZRLEEncoder::writePalette(const PixelFormat& pf, const Palette& palette)
+void ZRLEEncoder::writePalette(const PixelFormat& pf,
+                               const Palette& palette,
+                               rdr::OutStream* os)
 {
   uint8_t buffer[256*4];
   int i;
@@ -232,37 +456,162 @@ void ZRLEEncoder::writePalette(const PixelFormat& pf, const Palette& palette)
       *buf++ = palette.getColour(i);
   }
 
-  writePixels(buffer, pf, palette.size());
+  writePixels(buffer, pf, palette.size(), os);
 }
 
 void ZRLEEncoder::writePixels(const uint8_t* buffer, const PixelFormat& pf,
-                              unsigned int count)
+                              unsigned int count, rdr::OutStream* os)
 {
-  Pixel maxPixel;
-  uint8_t pixBuf[4];
-
-  maxPixel = pf.pixelFromRGB((uint16_t)-1, (uint16_t)-1, (uint16_t)-1);
-  pf.bufferFromPixel(pixBuf, maxPixel);
-
-  if ((pf.bpp != 32) || ((pixBuf[0] != 0) && (pixBuf[3] != 0))) {
-    zos.writeBytes(buffer, count * (pf.bpp/8));
+  if (cpixelSize == pf.bpp/8) {
+    os->writeBytes(buffer, count * cpixelSize);
     return;
   }
 
-  if (pixBuf[0] == 0)
-    buffer++;
+  buffer += cpixelOffset;
 
   while (count--) {
-    zos.writeBytes(buffer, 3);
+    os->writeBytes(buffer, 3);
     buffer += 4;
   }
 }
 
+static inline void writeRunLength(int runLength, rdr::OutStream* os)
+{
+  while (runLength > 255) {
+    os->writeU8(255);
+    runLength -= 255;
+  }
+  os->writeU8(runLength - 1);
+}
+
+template<class T>
+void ZRLEEncoder::writeTile(int width, int height,
+                            const T* buffer, int stride,
+                            const PixelFormat& pf, Palette* palette,
+                            rdr::OutStream* os)
+{
+  const int bitsPerPackedPixel[] = {
+    0, 1, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4
+  };
+
+  const T* ptr;
+  int pad;
+
+  T colour;
+  int runLength;
+
+  bool usePalette;
+  size_t rleBytes, paletteRLEBytes;
+
+  size_t bestBytes;
+  enum { Raw, RLE, PaletteRLE, Packed } best;
+
+  // Figure out the colours and runs of the tile, which gives the
+  // exact size of every subencoding
+
+  palette->clear();
+  usePalette = true;
+  rleBytes = paletteRLEBytes = 0;
+
+  pad = stride - width;
+
+  ptr = buffer;
+  colour = *ptr;
+  runLength = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      if (*ptr != colour) {
+        if (usePalette && (!palette->insert(colour, runLength) ||
+                           (palette->size() > 127)))
+          usePalette = false;
+
+        rleBytes += cpixelSize + 1 + (runLength - 1) / 255;
+        if (runLength == 1)
+          paletteRLEBytes += 1;
+        else
+          paletteRLEBytes += 2 + (runLength - 1) / 255;
+
+        colour = *ptr;
+        runLength = 0;
+      }
+      runLength++;
+      ptr++;
+    }
+    ptr += pad;
+  }
+
+  if (usePalette && (!palette->insert(colour, runLength) ||
+                     (palette->size() > 127)))
+    usePalette = false;
+
+  rleBytes += cpixelSize + 1 + (runLength - 1) / 255;
+  if (runLength == 1)
+    paletteRLEBytes += 1;
+  else
+    paletteRLEBytes += 2 + (runLength - 1) / 255;
+
+  if (usePalette && (palette->size() == 1)) {
+    os->writeU8(1);
+    writePixels((const uint8_t*)&colour, pf, 1, os);
+    return;
+  }
+
+  best = Raw;
+  bestBytes = (size_t)width * height * cpixelSize;
+
+  if (rleBytes < bestBytes) {
+    best = RLE;
+    bestBytes = rleBytes;
+  }
+
+  if (usePalette) {
+    size_t paletteBytes;
+
+    paletteBytes = palette->size() * cpixelSize;
+
+    if (paletteBytes + paletteRLEBytes < bestBytes) {
+      best = PaletteRLE;
+      bestBytes = paletteBytes + paletteRLEBytes;
+    }
+
+    if (palette->size() <= 16) {
+      int bppp;
+      size_t packedBytes;
+
+      bppp = bitsPerPackedPixel[palette->size()-1];
+      packedBytes = (size_t)height * ((width * bppp + 7) / 8);
+
+      if (paletteBytes + packedBytes <= bestBytes) {
+        best = Packed;
+        bestBytes = paletteBytes + packedBytes;
+      }
+    }
+  }
+
+  switch (best) {
+  case Raw:
+    writeRawTile(width, height, buffer, stride, pf, os);
+    break;
+  case RLE:
+    writeRLETile(width, height, buffer, stride, pf, os);
+    break;
+  case PaletteRLE:
+    writePaletteRLETile(width, height, buffer, stride, pf,
+                        *palette, os);
+    break;
+  case Packed:
+    writePaletteTile(width, height, buffer, stride, pf,
+                     *palette, os);
+    break;
+  }
+}
+
 template<class T>
 void ZRLEEncoder::writePaletteTile(int width, int height,
                                    const T* buffer, int stride,
                                    const PixelFormat& pf,
-                                   const Palette& palette)
+                                   const Palette& palette,
+                                   rdr::OutStream* os)
 {
   const int bitsPerPackedPixel[] = {
     0, 1, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4
@@ -274,8 +623,8 @@ void ZRLEEncoder::writePaletteTile(int width, int height,
   assert(palette.size() > 1);
   assert(palette.size() <= 16);
 
-  zos.writeU8(palette.size());
-  writePalette(pf, palette);
+  os->writeU8(palette.size());
+  writePalette(pf, palette, os);
 
   bppp = bitsPerPackedPixel[palette.size()-1];
   pad = stride - width;
@@ -293,13 +642,13 @@ void ZRLEEncoder::writePaletteTile(int width, int height,
       byte = (byte << bppp) | index;
       nbits += bppp;
       if (nbits >= 8) {
-        zos.writeU8(byte);
+        os->writeU8(byte);
         nbits = 0;
       }
     }
     if (nbits > 0) {
       byte <<= 8 - nbits;
-      zos.writeU8(byte);
+      os->writeU8(byte);
     }
 
     buffer += pad;
@@ -310,7 +659,8 @@ template<class T>
 void ZRLEEncoder::writePaletteRLETile(int width, int height,
                                       const T* buffer, int stride,
                                       const PixelFormat& pf,
-                                      const Palette& palette)
+                                      const Palette& palette,
+                                      rdr::OutStream* os)
 {
   int pad;
 
@@ -320,8 +670,8 @@ void ZRLEEncoder::writePaletteRLETile(int width, int height,
   assert(palette.size() > 1);
   assert(palette.size() <= 127);
 
-  zos.writeU8(palette.size() | 0x80);
-  writePalette(pf, palette);
+  os->writeU8(palette.size() | 0x80);
+  writePalette(pf, palette, os);
 
   pad = stride - width;
 
@@ -333,15 +683,10 @@ void ZRLEEncoder::writePaletteRLETile(int width, int height,
     while (w--) {
       if (prevColour != *buffer) {
         if (runLength == 1)
-          zos.writeU8(palette.lookup(prevColour));
+          os->writeU8(palette.lookup(prevColour));
         else {
-          zos.writeU8(palette.lookup(prevColour) | 0x80);
-
-          while (runLength > 255) {
-            zos.writeU8(255);
-            runLength -= 255;
-          }
-          zos.writeU8(runLength - 1);
+          os->writeU8(palette.lookup(prevColour) | 0x80);
+          writeRunLength(runLength, os);
         }
 
         prevColour = *buffer;
@@ -354,14 +699,61 @@ void ZRLEEncoder::writePaletteRLETile(int width, int height,
     buffer += pad;
   }
   if (runLength == 1)
-    zos.writeU8(palette.lookup(prevColour));
+    os->writeU8(palette.lookup(prevColour));
   else {
-    zos.writeU8(palette.lookup(prevColour) | 0x80);
+    os->writeU8(palette.lookup(prevColour) | 0x80);
+    writeRunLength(runLength, os);
+  }
+}
+
+template<class T>
+void ZRLEEncoder::writeRLETile(int width, int height,
+                               const T* buffer, int stride,
+                               const PixelFormat& pf,
+                               rdr::OutStream* os)
+{
+  int pad;
+
+  T prevColour;
+  int runLength;
+
+  os->writeU8(128);
+
+  pad = stride - width;
+
+  prevColour = *buffer;
+  runLength = 0;
+
+  while (height--) {
+    int w = width;
+    while (w--) {
+      if (prevColour != *buffer) {
+        writePixels((const uint8_t*)&prevColour, pf, 1, os);
+        writeRunLength(runLength, os);
 
-    while (runLength > 255) {
-      zos.writeU8(255);
-      runLength -= 255;
+        prevColour = *buffer;
+        runLength = 0;
+      }
+
+      runLength++;
+      buffer++;
     }
-    zos.writeU8(runLength - 1);
+    buffer += pad;
+  }
+  writePixels((const uint8_t*)&prevColour, pf, 1, os);
+  writeRunLength(runLength, os);
+}
+
+template<class T>
+void ZRLEEncoder::writeRawTile(int width, int height,
+                               const T* buffer, int stride,
+                               const PixelFormat& pf,
+                               rdr::OutStream* os)
+{
+  os->writeU8(0); // Empty palette (i.e. raw pixels)
+
+  while (height--) {
+    writePixels((const uint8_t*)buffer, pf, width, os);
+    buffer += stride;
   }
 }
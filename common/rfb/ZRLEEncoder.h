@@ -19,9 +19,13 @@
 #ifndef __RFB_ZRLEENCODER_H__
 #define __RFB_ZRLEENCODER_H__
 
+#include <mutex>
+#include <vector>
+
 #include <rdr/MemOutStream.h>
 #include <rdr/ZlibOutStream.h>
 #include <rfb/Encoder.h>
+#include <rfb/Palette.h>
 
 namespace rfb {
 
@@ -39,34 +43,86 @@ namespace rfb {
     void writeSolidRect(int width, int height, const PixelFormat& pf,
                         const uint8_t* colour) override;
 
+    void checkpoint() override;
+    void commit() override;
+    void rollback() override;
+
   protected:
-    void writePaletteTile(const core::Rect& tile,
-                          const PixelBuffer* pb,
-                          const Palette& palette);
-    void writePaletteRLETile(const core::Rect& tile,
-                             const PixelBuffer* pb,
-                             const Palette& palette);
-    void writeRawTile(const core::Rect& tile, const PixelBuffer* pb);
+    struct TileWorker;
+    class TilePool;
+
+    void setPixelFormat(const PixelFormat& pf);
+
+    void startWorkers();
+    void stopWorkers();
 
-    void writePalette(const PixelFormat& pf, const Palette& palette);
+    void writeData();
+
+    void writeTiles(const PixelBuffer* pb, int first, int last,
+                    Palette* palette, rdr::OutStream* os);
+    void writeTile(const core::Rect& tile, const PixelBuffer* pb,
+                   Palette* palette, rdr::OutStream* os);
+
+    void writePalette(const PixelFormat& pf, const Palette& palette,
+                      rdr::OutStream* os);
 
     void writePixels(const uint8_t* buffer, const PixelFormat& pf,
-                     unsigned int count);
+                     unsigned int count, rdr::OutStream* os);
 
   protected:
     // Templated, optimised methods
     template<class T>
+    void writeTile(int width, int height, const T* buffer, int stride,
+                   const PixelFormat& pf, Palette* palette,
+                   rdr::OutStream* os);
+    template<class T>
     void writePaletteTile(int width, int height,
                           const T* buffer, int stride,
-                          const PixelFormat& pf, const Palette& palette);
+                          const PixelFormat& pf, const Palette& palette,
+                          rdr::OutStream* os);
     template<class T>
     void writePaletteRLETile(int width, int height,
                              const T* buffer, int stride,
-                             const PixelFormat& pf, const Palette& palette);
+                             const PixelFormat& pf, const Palette& palette,
+                             rdr::OutStream* os);
+    template<class T>
+    void writeRLETile(int width, int height,
+                      const T* buffer, int stride,
+                      const PixelFormat& pf, rdr::OutStream* os);
+    template<class T>
+    void writeRawTile(int width, int height,
+                      const T* buffer, int stride,
+                      const PixelFormat& pf, rdr::OutStream* os);
 
   protected:
     rdr::ZlibOutStream zos;
     rdr::MemOutStream mos;
+
+    // Bytes per pixel on the wire, as 32 bpp pixels are sent as three
+    // bytes if possible
+    int cpixelSize;
+    // Which byte to start from when sending three byte pixels
+    int cpixelOffset;
+
+    // The tiles of a rect are split in to consecutive ranges that are
+    // encoded in parallel, leaving just the compression to be done in
+    // order. The first range is done by the calling thread, and the
+    // rest by threads that all encoders share.
+    struct TileWorker {
+      TileWorker() : first(0), last(0) {}
+
+      int first, last;
+      rdr::MemOutStream buffer;
+      Palette palette;
+    };
+
+    std::vector<TileWorker*> workers;
+    unsigned maxWorkers;
+    TilePool* pool;
+
+    static std::mutex poolMutex;
+    static TilePool* sharedPool;
+    static unsigned poolUsers;
   };
 }
 #endif
@@ -0,0 +1,34 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+#ifndef __RFB_CURSORCACHETYPES_H__
+#define __RFB_CURSORCACHETYPES_H__
+
+#include <stdint.h>
+
+namespace rfb {
+  // A pseudoEncodingCursorCache rect has the slot in x and the
+  // operation in y. "Store" applies to the next cursor rect in the
+  // same update, "use" replaces the cursor with a stored one.
+
+  const int cursorCacheSlots = 16;
+
+  const uint16_t cursorCacheStore = 0;
+  const uint16_t cursorCacheUse   = 1;
+}
+
+#endif
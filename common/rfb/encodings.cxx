@@ -34,6 +34,7 @@ int rfb::encodingNum(const char* name)
   if (strcasecmp(name, "Tight") == 0)    return encodingTight;
   if (strcasecmp(name, "JPEG") == 0)     return encodingJPEG;
   if (strcasecmp(name, "H.264") == 0)    return encodingH264;
+  if (strcasecmp(name, "FastLossless") == 0) return encodingFastLossless;
   return -1;
 }
 
@@ -49,6 +50,7 @@ const char* rfb::encodingName(int num)
   case encodingTight:    return "Tight";
   case encodingJPEG:     return "JPEG";
   case encodingH264:     return "H.264";
+  case encodingFastLossless: return "FastLossless";
   default:               return "[unknown encoding]";
   }
 }
@@ -70,6 +70,13 @@ namespace rfb {
   // UltraVNC-specific
   const int pseudoEncodingExtendedClipboard = 0xC0A1E5CE;
 
+  // TigerVNC-specific (experimental, not yet registered)
+  const int pseudoEncodingPreserveOnResize = 0x54494700;
+  const int pseudoEncodingCursorCache = 0x54494701;
+  const int pseudoEncodingSharedMemory = 0x54494702;
+  const int encodingSharedMemory = 0x54494703;
+  const int encodingFastLossless = 0x54494704;
+
   int encodingNum(const char* name);
   const char* encodingName(int num);
 }
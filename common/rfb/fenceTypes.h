@@ -24,12 +24,18 @@ namespace rfb {
   const uint32_t fenceFlagBlockBefore = 1<<0;
   const uint32_t fenceFlagBlockAfter  = 1<<1;
   const uint32_t fenceFlagSyncNext    = 1<<2;
+  // Respond after the first framebuffer update with changes that
+  // appeared after the fence request, i.e. that were most likely
+  // caused by the input preceding it. Servers that don't know about
+  // this clear it in the response, as for any unknown flag.
+  const uint32_t fenceFlagSyncDamage  = 1<<3;
 
   const uint32_t fenceFlagRequest     = 1<<31;
 
   const uint32_t fenceFlagsSupported  = (fenceFlagBlockBefore |
                                          fenceFlagBlockAfter |
                                          fenceFlagSyncNext |
+                                         fenceFlagSyncDamage |
                                          fenceFlagRequest);
 }
 
@@ -0,0 +1,154 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+/*
+ * This program measures how fast the server can take in the damage
+ * from many small drawing operations, e.g. a terminal printing text.
+ * It compares passing on every rectangle on its own with first
+ * merging them together, the way Xvnc does it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <core/Region.h>
+
+#include <rfb/UpdateTracker.h>
+
+#include "util.h"
+
+static const int width = 1920;
+static const int height = 1080;
+
+static const int glyphWidth = 8;
+static const int glyphHeight = 16;
+
+// How many glyphs are drawn between each update being sent
+static const int batches[] = { 100, 1000, 5000 };
+
+static const int frames = 100;
+
+static std::vector<core::Rect> makeGlyphs(int count)
+{
+  std::vector<core::Rect> glyphs;
+  int x, y;
+
+  // Lines of text at random places on the screen
+  x = y = 0;
+  for (int i = 0; i < count; i++) {
+    if ((i % 80) == 0) {
+      x = (rand() % (width / glyphWidth / 2)) * glyphWidth;
+      y = (rand() % (height / glyphHeight)) * glyphHeight;
+    }
+
+    glyphs.push_back({x, y, x + glyphWidth, y + glyphHeight});
+
+    x += glyphWidth;
+    if (x >= width)
+      x = 0;
+  }
+
+  return glyphs;
+}
+
+// Other changes that are waiting to be sent
+static core::Region makeBackground()
+{
+  core::Region background;
+
+  for (const core::Rect& r : makeGlyphs(200))
+    background.assign_union(r.translate({width / 2, 0}));
+
+  return background;
+}
+
+static double testPerRect(const std::vector<core::Rect>& glyphs)
+{
+  rfb::SimpleUpdateTracker tracker;
+  core::Region background;
+
+  background = makeBackground();
+
+  startCpuCounter();
+
+  for (int i = 0; i < frames; i++) {
+    tracker.add_changed(background);
+    for (const core::Rect& r : glyphs)
+      tracker.add_changed(r);
+    tracker.clear();
+  }
+
+  endCpuCounter();
+
+  return getCpuCounter();
+}
+
+static double testBatched(const std::vector<core::Rect>& glyphs)
+{
+  rfb::SimpleUpdateTracker tracker;
+  core::Region background;
+
+  background = makeBackground();
+
+  startCpuCounter();
+
+  for (int i = 0; i < frames; i++) {
+    tracker.add_changed(background);
+    tracker.add_changed(core::Region(glyphs));
+    tracker.clear();
+  }
+
+  endCpuCounter();
+
+  return getCpuCounter();
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+  printf("# Damage Accumulation Performance Test\n");
+  printf("#\n");
+  printf("# Screen: %dx%d pixels\n", width, height);
+  printf("# Glyph size: %dx%d pixels\n", glyphWidth, glyphHeight);
+  printf("#\n");
+  printf("# Note: Results are thousand rects/sec\n");
+  printf("#\n");
+
+  printf("Rects per update,Per rect,Batched\n");
+
+  for (int count : batches) {
+    std::vector<core::Rect> glyphs;
+    double perRect, batched;
+
+    glyphs = makeGlyphs(count);
+
+    perRect = testPerRect(glyphs);
+    batched = testBatched(glyphs);
+
+    printf("%d,%g,%g\n", count,
+           (double)count * frames / 1000.0 / perRect,
+           (double)count * frames / 1000.0 / batched);
+  }
+
+  return 0;
+}
@@ -37,6 +37,10 @@
 #include <math.h>
 #include <sys/time.h>
 
+#include <atomic>
+#include <new>
+#include <vector>
+
 #include <core/Configuration.h>
 
 #include <rdr/OutStream.h>
@@ -51,6 +55,7 @@
 #include <rfb/EncodeManager.h>
 #include <rfb/SConnection.h>
 #include <rfb/SMsgWriter.h>
+#include <rfb/encodings.h>
 
 #include "util.h"
 
@@ -64,15 +69,51 @@ static core::BoolParameter translate("translate",
                                      "Translate 8-bit and 16-bit datasets into 24-bit",
                                      true);
 
+static core::StringParameter preferred("encoding",
+                                      "Preferred encoding", "Tight");
+static core::BoolParameter lossless("lossless",
+                                    "Don't allow lossy encodings (e.g. JPEG)",
+                                    false);
+
+// Heap allocations made whilst encoding, including by the encoders'
+// worker threads
+static std::atomic<bool> countAllocations(false);
+static std::atomic<unsigned long long> allocations(0);
+
+void* operator new(size_t size)
+{
+  void* ptr;
+
+  if (countAllocations.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+  ptr = malloc(size ? size : 1);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
 // The frame buffer (and output) is always this format
 static const rfb::PixelFormat fbPF(32, 24, false, true, 255, 255, 255, 0, 8, 16);
 
-// Encodings to use
+// Encodings to use, after the preferred one
 static const int32_t encodings[] = {
-  rfb::encodingTight, rfb::encodingCopyRect, rfb::encodingRRE,
-  rfb::encodingHextile, rfb::encodingZRLE, rfb::pseudoEncodingLastRect,
-  rfb::pseudoEncodingQualityLevel0 + 8,
-  rfb::pseudoEncodingCompressLevel0 + 2};
+  rfb::encodingCopyRect, rfb::encodingRRE,
+  rfb::encodingHextile, rfb::encodingZRLE, rfb::encodingTight,
+  rfb::pseudoEncodingLastRect,
+  rfb::pseudoEncodingCompressLevel0 + 2,
+  rfb::pseudoEncodingQualityLevel0 + 8};
 
 class DummyOutStream : public rdr::OutStream {
 public:
@@ -110,6 +151,8 @@ public:
 public:
   double decodeTime;
   double encodeTime;
+  unsigned updateCount;
+  unsigned long long allocationCount;
 
 protected:
   rdr::FileInStream *in;
@@ -178,6 +221,8 @@ CConn::CConn(const char *filename)
 {
   decodeTime = 0.0;
   encodeTime = 0.0;
+  updateCount = 0;
+  allocationCount = 0;
 
   in = new rdr::FileInStream(filename);
   out = new DummyOutStream;
@@ -196,7 +241,14 @@ CConn::CConn(const char *filename)
 
   sc = new SConn();
   sc->client.setPF((bool)translate ? fbPF : pf);
-  ((rfb::SMsgHandler*)sc)->setEncodings(sizeof(encodings) / sizeof(*encodings), encodings);
+  std::vector<int32_t> encs;
+  encs.push_back(rfb::encodingNum(preferred));
+  encs.insert(encs.end(), encodings,
+              encodings + sizeof(encodings) / sizeof(*encodings));
+  // The quality level is last so it can easily be left out
+  if (lossless)
+    encs.pop_back();
+  ((rfb::SMsgHandler*)sc)->setEncodings(encs.size(), encs.data());
 }
 
 CConn::~CConn()
@@ -243,11 +295,18 @@ void CConn::framebufferUpdateEnd()
 
   updates.getUpdateInfo(&ui, clip);
 
+  allocations = 0;
+  countAllocations = true;
+
   startCpuCounter();
   sc->writeUpdate(ui, pb);
   endCpuCounter();
 
+  countAllocations = false;
+
   encodeTime += getCpuCounter();
+  updateCount++;
+  allocationCount += allocations;
 }
 
 bool CConn::dataRect(const core::Rect& r, int encoding)
@@ -360,6 +419,9 @@ struct stats
   double ratio;
   unsigned long long bytes;
   unsigned long long rawEquivalent;
+
+  unsigned updates;
+  unsigned long long allocations;
 };
 
 static struct stats runTest(const char *fn)
@@ -390,6 +452,8 @@ static struct stats runTest(const char *fn)
 
   s.decodeTime = cc->decodeTime;
   s.encodeTime = cc->encodeTime;
+  s.updates = cc->updateCount;
+  s.allocations = cc->allocationCount;
   s.realTime = (double)stop.tv_sec - start.tv_sec;
   s.realTime += ((double)stop.tv_usec - start.tv_usec)/1000000.0;
   cc->getStats(s.ratio, s.bytes, s.rawEquivalent);
@@ -487,6 +551,12 @@ int main(int argc, char **argv)
     usage(argv[0]);
   }
 
+  if (rfb::encodingNum(preferred) == -1) {
+    fprintf(stderr, "Unknown encoding '%s'!\n\n",
+            preferred.getValueStr().c_str());
+    usage(argv[0]);
+  }
+
   if (width == 0 || height == 0) {
     fprintf(stderr, "Frame buffer size not specified!\n\n");
     usage(argv[0]);
@@ -547,6 +617,8 @@ int main(int argc, char **argv)
   printf("Encoded bytes: %llu\n", runs[0].bytes);
   printf("Raw equivalent bytes: %llu\n", runs[0].rawEquivalent);
   printf("Ratio: %g\n", runs[0].ratio);
+  printf("Allocations per update: %g\n",
+         (double)runs[0].allocations / runs[0].updates);
 
   return 0;
 }
@@ -68,7 +68,10 @@ protected:
 
 class OverlayTestWindow: public PartialTestWindow {
 public:
-  OverlayTestWindow();
+  // If direct is set, then the overlay is kept away from the updates
+  // and those are copied straight to the window, like DesktopWindow
+  // does when nothing is composited on top of them
+  OverlayTestWindow(bool direct=false);
 
   void start(int width, int height) override;
   void stop() override;
@@ -76,6 +79,7 @@ public:
   void draw() override;
 
 protected:
+  bool direct;
   Surface* overlay;
   Surface* offscreen;
 };
@@ -207,8 +211,8 @@ void PartialTestWindow::changefb()
   fb->fillRect(r, &pixel);
 }
 
-OverlayTestWindow::OverlayTestWindow() :
-  overlay(nullptr), offscreen(nullptr)
+OverlayTestWindow::OverlayTestWindow(bool direct_) :
+  direct(direct_), overlay(nullptr), offscreen(nullptr)
 {
 }
 
@@ -216,7 +220,11 @@ void OverlayTestWindow::start(int width, int height)
 {
   PartialTestWindow::start(width, height);
 
-  overlay = new Surface(400, 200);
+  // Same size as the statistics graph when kept out of the way
+  if (direct)
+    overlay = new Surface(200, 100);
+  else
+    overlay = new Surface(400, 200);
   overlay->clear(0xff, 0x80, 0x00, 0xcc);
 
   // X11 needs an off screen buffer for compositing to avoid flicker,
@@ -256,6 +264,26 @@ void OverlayTestWindow::draw()
   if (!overlay)
     return;
 
+  ow = overlay->width();
+  oh = overlay->height();
+  if (direct) {
+    ox = w() - ow - 30;
+    oy = h() - oh - 30;
+  } else {
+    ox = (w() - ow) / 2;
+    oy = h() / 4 - oh / 2;
+  }
+
+  if (direct && ((X >= ox + ow) || (Y >= oy + oh) ||
+                 (X + W <= ox) || (Y + H <= oy))) {
+    fb->draw(X, Y, X, Y, W, H);
+
+    pixels += W*H;
+    frames++;
+
+    return;
+  }
+
   // Simplify the clip region to a simple rectangle in order to
   // properly draw all the layers even if they only partially overlap
   fl_push_no_clip();
@@ -269,10 +297,6 @@ void OverlayTestWindow::draw()
   pixels += W*H;
   frames++;
 
-  ox = (w() - overlay->width()) / 2;
-  oy = h() / 4 - overlay->height() / 2;
-  ow = overlay->width();
-  oh = overlay->height();
   fl_clip_box(ox, oy, ow, oh, X, Y, W, H);
   if ((W != 0) && (H != 0)) {
     if (offscreen)
@@ -373,6 +397,8 @@ static void dotest(TestWindow* win)
                           core::siPrefix(1.0 / rate, "pixels/s").c_str());
   fprintf(stderr, "Maximum FPS: %g fps @ 1920x1080\n",
           1.0 / (delay + rate * 1920 * 1080));
+  fprintf(stderr, "Maximum FPS: %g fps @ 3840x2160\n",
+          1.0 / (delay + rate * 3840 * 2160));
 }
 
 int main(int /*argc*/, char** /*argv*/)
@@ -397,5 +423,11 @@ int main(int /*argc*/, char** /*argv*/)
   delete win;
   fprintf(stderr, "\n");
 
+  fprintf(stderr, "Partial window update with overlay elsewhere:\n\n");
+  win = new OverlayTestWindow(true);
+  dotest(win);
+  delete win;
+  fprintf(stderr, "\n");
+
   return 0;
 }
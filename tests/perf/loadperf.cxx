@@ -0,0 +1,1128 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+/*
+ * This program runs a complete server (VNCServerST) against a number
+ * of simulated viewers (CConnection), all within a single process and
+ * without any display. The desktop is synthetic and produces a
+ * scripted mix of damage at a fixed rate. Each frame is tagged with a
+ * serial number in the top left corner of the screen, which allows the
+ * viewers to measure how long it took for each frame to reach them.
+ *
+ * Every viewer can be given its own encoding, quality level, pixel
+ * format, bandwidth and round trip time. The links between the server
+ * and the viewers are emulated by pumping the data through a queue
+ * that delays and rate limits it.
+ *
+ * The test is run once for every number of clients specified, so the
+ * output shows how the server scales as the number of clients grows.
+ * Note that the viewers run in the same process, so the wall clock
+ * results are only meaningful as long as the machine has spare cores.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <numeric>
+#include <vector>
+
+#include <core/Configuration.h>
+#include <core/Timer.h>
+
+#include <network/UnixSocket.h>
+
+#include <rdr/FdInStream.h>
+#include <rdr/FdOutStream.h>
+
+#include <rfb/CConnection.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/PixelFormat.h>
+#include <rfb/SDesktop.h>
+#include <rfb/SecurityClient.h>
+#include <rfb/SecurityServer.h>
+#include <rfb/VNCServerST.h>
+#include <rfb/encodings.h>
+
+static core::IntListParameter clients("clients",
+                                      "Number of clients to run the "
+                                      "test with",
+                                      {1, 2, 4, 8}, 1, 1000);
+static core::IntParameter duration("duration",
+                                   "Number of seconds to measure for "
+                                   "each number of clients", 10, 1);
+static core::IntParameter width("width", "Frame buffer width", 1920, 64);
+static core::IntParameter height("height", "Frame buffer height",
+                                 1080, 64);
+static core::IntParameter rate("rate",
+                               "Number of frames per second the "
+                               "desktop produces", 30, 1, 1000);
+static core::EnumParameter pattern("pattern",
+                                   "Type of screen content (video, "
+                                   "scroll, typing or mixed)",
+                                   {"video", "scroll", "typing",
+                                    "mixed"}, "mixed");
+
+static core::StringListParameter encodings("encodings",
+                                           "Preferred encodings to "
+                                           "cycle through for the "
+                                           "clients",
+                                           {"Tight", "ZRLE",
+                                            "Hextile"});
+static core::IntListParameter quality("quality",
+                                      "JPEG quality levels to cycle "
+                                      "through for the clients "
+                                      "(-1 for lossless)",
+                                      {-1, 8, 2}, -1, 9);
+static core::StringListParameter formats("formats",
+                                         "Pixel formats to cycle "
+                                         "through for the clients",
+                                         {"rgb888", "rgb565",
+                                          "rgb332"});
+static core::IntListParameter bandwidth("bandwidth",
+                                        "Link speeds to cycle through "
+                                        "for the clients, in kbit/s "
+                                        "(0 for unlimited)",
+                                        {0}, 0);
+static core::IntListParameter latency("latency",
+                                      "Round trip times to cycle "
+                                      "through for the clients, in "
+                                      "milliseconds",
+                                      {0}, 0, 10000);
+
+static core::BoolParameter verbose("verbose",
+                                   "Show the results for every "
+                                   "individual client",
+                                   true);
+
+// The frame buffer on both sides is always this format
+static const rfb::PixelFormat fbPF(32, 24, false, true,
+                                   255, 255, 255, 16, 8, 0);
+
+// Frame serial numbers are drawn as a row of black and white blocks
+static const int markerBits = 24;
+static const int markerSize = 16;
+
+// How much data the emulated bottleneck will queue up before it
+// pushes back on the sender
+static const double queueTime = 0.050;
+
+// Time allowed for everything to settle before measuring starts
+static const double warmupTime = 1.0;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static double threadCpu()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static int nextTimeout(double current, double deadline)
+{
+  if (deadline <= current)
+    return 0;
+  // Round up so we don't spin waiting for the last fraction
+  return (int)((deadline - current) * 1000.0) + 1;
+}
+
+static bool measuring;
+static double serverCpu;
+
+class Desktop : public rfb::SDesktop {
+public:
+  Desktop(int width, int height);
+
+  void init(rfb::VNCServer* vs) override;
+  void start() override;
+  void stop() override;
+  void queryConnection(network::Socket* sock,
+                       const char* userName) override;
+  void terminate() override;
+
+  void render();
+
+  double frameTime(unsigned frame) const;
+
+private:
+  void drawMarker();
+  void drawVideo();
+  void drawScroll();
+  void drawTyping();
+
+  void drawGlyph(int x, int y, int glyph);
+
+private:
+  rfb::VNCServer* server;
+  rfb::ManagedPixelBuffer pb;
+  bool started;
+
+  core::Rect video, scroll, typing;
+  core::Point cursor;
+
+  std::vector<double> frameTimes;
+
+  uint8_t glyphs[64][16];
+};
+
+Desktop::Desktop(int w, int h)
+  : server(nullptr), pb(fbPF, w, h), started(false)
+{
+  core::Rect content(0, markerSize, w, h);
+
+  if (pattern == "video") {
+    video = content;
+  } else if (pattern == "scroll") {
+    scroll = content;
+  } else if (pattern == "typing") {
+    typing = content;
+  } else {
+    int mx = w / 2;
+    int my = markerSize + (h - markerSize) / 2;
+    video = core::Rect(0, markerSize, mx, my);
+    typing = core::Rect(0, my, mx, h);
+    scroll = core::Rect(mx, markerSize, w, h);
+  }
+
+  cursor = typing.tl;
+
+  // A small set of fixed glyphs gives a realistic amount of
+  // repetition for the encoders to find
+  srand(1);
+  for (int i = 0; i < 64; i++) {
+    for (int y = 0; y < 16; y++) {
+      if ((y < 3) || (y > 12))
+        glyphs[i][y] = 0;
+      else
+        glyphs[i][y] = (rand() & 0x7e);
+    }
+  }
+
+  uint32_t white = 0xffffff;
+  pb.fillRect(pb.getRect(), &white);
+}
+
+void Desktop::init(rfb::VNCServer* vs)
+{
+  server = vs;
+}
+
+void Desktop::start()
+{
+  server->setPixelBuffer(&pb);
+  started = true;
+}
+
+void Desktop::stop()
+{
+  server->setPixelBuffer(nullptr);
+  started = false;
+}
+
+void Desktop::queryConnection(network::Socket* sock,
+                              const char* /*userName*/)
+{
+  server->approveConnection(sock, true, nullptr);
+}
+
+void Desktop::terminate()
+{
+}
+
+void Desktop::render()
+{
+  frameTimes.push_back(now());
+
+  drawMarker();
+  drawVideo();
+  drawScroll();
+  drawTyping();
+}
+
+double Desktop::frameTime(unsigned frame) const
+{
+  if (frame >= frameTimes.size())
+    return 0;
+  return frameTimes[frame];
+}
+
+void Desktop::drawMarker()
+{
+  uint32_t black = 0x000000;
+  uint32_t white = 0xffffff;
+  unsigned frame;
+  core::Rect r;
+
+  frame = frameTimes.size() - 1;
+
+  for (int i = 0; i < markerBits; i++) {
+    r.setXYWH(i * markerSize, 0, markerSize, markerSize);
+    pb.fillRect(r, (frame & (1 << i)) ? &white : &black);
+  }
+
+  if (started)
+    server->add_changed(core::Rect(0, 0, markerBits * markerSize,
+                                   markerSize));
+}
+
+void Desktop::drawVideo()
+{
+  uint8_t* buffer;
+  int stride;
+  unsigned t;
+
+  if (video.is_empty())
+    return;
+
+  t = frameTimes.size();
+
+  // Something that changes everywhere and that the lossless encoders
+  // find hard, but that is still cheap to produce
+  buffer = pb.getBufferRW(video, &stride);
+  for (int y = 0; y < video.height(); y++) {
+    uint8_t* pixel = buffer + y * stride * 4;
+    for (int x = 0; x < video.width(); x++) {
+      unsigned v = ((x + t * 3) ^ (y + t * 2));
+      pixel[0] = v * 7;
+      pixel[1] = v * 3 + t;
+      pixel[2] = (x + y + t * 5) >> 1;
+      pixel[3] = 0;
+      pixel += 4;
+    }
+  }
+  pb.commitBufferRW(video);
+
+  if (started)
+    server->add_changed(video);
+}
+
+void Desktop::drawScroll()
+{
+  uint32_t white = 0xffffff;
+  core::Rect line;
+
+  if (scroll.is_empty())
+    return;
+
+  // One new line of text at the bottom per frame
+  if (scroll.height() > markerSize) {
+    core::Rect dest(scroll.tl.x, scroll.tl.y,
+                    scroll.br.x, scroll.br.y - markerSize);
+    pb.copyRect(dest, {0, -markerSize});
+    if (started)
+      server->add_copied(dest, {0, -markerSize});
+  }
+
+  line = core::Rect(scroll.tl.x, scroll.br.y - markerSize,
+                    scroll.br.x, scroll.br.y);
+  pb.fillRect(line, &white);
+  for (int x = line.tl.x; x + 8 <= line.br.x; x += 8) {
+    if ((rand() % 6) == 0)
+      continue;
+    drawGlyph(x, line.tl.y, rand() % 64);
+  }
+
+  if (started)
+    server->add_changed(line);
+}
+
+void Desktop::drawTyping()
+{
+  uint32_t white = 0xffffff;
+
+  if (typing.is_empty())
+    return;
+
+  // A couple of characters per frame, like someone typing quickly
+  for (int i = 0; i < 2; i++) {
+    if (cursor.x + 8 > typing.br.x) {
+      cursor.x = typing.tl.x;
+      cursor.y += 16;
+    }
+    if (cursor.y + 16 > typing.br.y) {
+      cursor = typing.tl;
+      pb.fillRect(typing, &white);
+      if (started)
+        server->add_changed(typing);
+    }
+
+    drawGlyph(cursor.x, cursor.y, rand() % 64);
+    if (started)
+      server->add_changed(core::Rect(cursor.x, cursor.y,
+                                     cursor.x + 8, cursor.y + 16));
+
+    cursor.x += 8;
+  }
+}
+
+void Desktop::drawGlyph(int x, int y, int glyph)
+{
+  core::Rect r(x, y, x + 8, y + 16);
+  uint8_t* buffer;
+  int stride;
+
+  buffer = pb.getBufferRW(r, &stride);
+  for (int gy = 0; gy < 16; gy++) {
+    uint8_t* pixel = buffer + gy * stride * 4;
+    for (int gx = 0; gx < 8; gx++) {
+      uint8_t v = (glyphs[glyph][gy] & (0x80 >> gx)) ? 0x00 : 0xff;
+      pixel[0] = pixel[1] = pixel[2] = v;
+      pixel[3] = 0;
+      pixel += 4;
+    }
+  }
+  pb.commitBufferRW(r);
+}
+
+struct Packet {
+  double due;
+  std::vector<uint8_t> data;
+  size_t offset;
+};
+
+// Link emulates the network between the server and a client. It
+// needs two socket pairs with the link in the middle pumping data
+// between them.
+class Link {
+public:
+  Link(int bandwidth, int latency);
+  ~Link();
+
+  int serverFd() { return fds[0]; }
+  int clientFd() { return pumping() ? fds[2] : fds[1]; }
+
+  bool pumping() { return (bandwidth != 0) || (latency != 0); }
+
+  void prepare(std::vector<struct pollfd>* pfds, double* deadline);
+  void process(const struct pollfd* pfds);
+
+private:
+  bool canReceiveDown(double current);
+
+  void receive(int fd, std::deque<Packet>* queue, bool shaped);
+  void send(int fd, std::deque<Packet>* queue, bool* blocked);
+
+private:
+  int bandwidth, latency;
+  int fds[4];
+
+  std::deque<Packet> down, up;
+  bool downBlocked, upBlocked;
+
+  // When the emulated bottleneck is done with everything queued
+  double linkFree;
+};
+
+Link::Link(int bandwidth_, int latency_)
+  : bandwidth(bandwidth_), latency(latency_),
+    downBlocked(false), upBlocked(false), linkFree(0)
+{
+  int bufSize;
+
+  for (int& fd : fds)
+    fd = -1;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[0]) != 0) {
+    perror("socketpair");
+    exit(1);
+  }
+
+  if (!pumping())
+    return;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[2]) != 0) {
+    perror("socketpair");
+    exit(1);
+  }
+
+  // Keep the kernel buffers small so that the link has control over
+  // the timing rather than the socket
+  bufSize = 32768;
+  for (int fd : fds)
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+
+  fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+  fcntl(fds[3], F_SETFL, fcntl(fds[3], F_GETFL) | O_NONBLOCK);
+}
+
+Link::~Link()
+{
+  // Only the pump ends are ours, the sockets own the others
+  if (pumping()) {
+    close(fds[1]);
+    close(fds[3]);
+  }
+}
+
+bool Link::canReceiveDown(double current)
+{
+  if (bandwidth == 0)
+    return down.size() < 256;
+  return (linkFree - current) < queueTime;
+}
+
+void Link::prepare(std::vector<struct pollfd>* pfds, double* deadline)
+{
+  double current;
+  struct pollfd pfd;
+
+  if (!pumping())
+    return;
+
+  current = now();
+
+  pfd.fd = fds[1];
+  pfd.events = POLLIN;
+  if (!canReceiveDown(current)) {
+    pfd.events = 0;
+    *deadline = std::min(*deadline, linkFree - queueTime);
+  }
+  if (upBlocked)
+    pfd.events |= POLLOUT;
+  else if (!up.empty())
+    *deadline = std::min(*deadline, up.front().due);
+  pfds->push_back(pfd);
+
+  pfd.fd = fds[3];
+  pfd.events = POLLIN;
+  if (downBlocked)
+    pfd.events |= POLLOUT;
+  else if (!down.empty())
+    *deadline = std::min(*deadline, down.front().due);
+  pfds->push_back(pfd);
+}
+
+void Link::process(const struct pollfd* pfds)
+{
+  if (!pumping())
+    return;
+
+  if (pfds[0].revents & POLLOUT)
+    upBlocked = false;
+  if (pfds[1].revents & POLLOUT)
+    downBlocked = false;
+
+  if (pfds[0].revents & POLLIN)
+    receive(fds[1], &down, true);
+  if (pfds[1].revents & POLLIN)
+    receive(fds[3], &up, false);
+
+  send(fds[3], &down, &downBlocked);
+  send(fds[1], &up, &upBlocked);
+}
+
+void Link::receive(int fd, std::deque<Packet>* queue, bool shaped)
+{
+  uint8_t buf[16384];
+  double current, departure;
+  ssize_t len;
+  Packet packet;
+
+  len = read(fd, buf, sizeof(buf));
+  if (len <= 0)
+    return;
+
+  current = now();
+
+  departure = current;
+  if (shaped && (bandwidth != 0)) {
+    departure = std::max(current, linkFree) +
+                len * 8.0 / (bandwidth * 1000.0);
+    linkFree = departure;
+  }
+
+  packet.due = departure + latency / 2000.0;
+  packet.data.assign(buf, buf + len);
+  packet.offset = 0;
+  queue->push_back(packet);
+}
+
+void Link::send(int fd, std::deque<Packet>* queue, bool* blocked)
+{
+  double current;
+
+  if (*blocked)
+    return;
+
+  current = now();
+  while (!queue->empty() && (queue->front().due <= current)) {
+    Packet* packet;
+    ssize_t len;
+
+    packet = &queue->front();
+    len = write(fd, packet->data.data() + packet->offset,
+                packet->data.size() - packet->offset);
+    if (len < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        *blocked = true;
+      return;
+    }
+
+    packet->offset += len;
+    if (packet->offset < packet->data.size()) {
+      *blocked = true;
+      return;
+    }
+
+    queue->pop_front();
+  }
+}
+
+struct ClientConfig {
+  int encoding;
+  int quality;
+  rfb::PixelFormat pf;
+  int bandwidth;
+  int latency;
+};
+
+class Client : public rfb::CConnection {
+public:
+  Client(int id, const ClientConfig& config, const Desktop* desktop);
+  ~Client();
+
+  network::Socket* getSock() { return sock; }
+
+  bool alive() { return !failed; }
+  void process();
+
+  void describe(char* buf, size_t len);
+
+  void reset();
+  void finish();
+
+  Link* getLink() { return &link; }
+
+  unsigned frames;
+  std::vector<double> latencies;
+  size_t bytes;
+
+protected:
+  void initDone() override;
+  void framebufferUpdateEnd() override;
+
+  void setColourMapEntries(int, int, uint16_t*) override {}
+  void bell() override {}
+  void getUserPasswd(bool, std::string*, std::string*) override {}
+  bool showMsgBox(rfb::MsgBoxFlags, const char*, const char*) override
+  { return true; }
+
+private:
+  unsigned readMarker();
+
+private:
+  int id;
+  ClientConfig config;
+  Link link;
+  network::Socket* sock;
+  const Desktop* desktop;
+  bool failed;
+
+  unsigned lastFrame;
+  size_t startPos;
+};
+
+Client::Client(int id_, const ClientConfig& config_,
+               const Desktop* desktop_)
+  : frames(0), bytes(0), id(id_), config(config_),
+    link(config.bandwidth, config.latency), desktop(desktop_),
+    failed(false), lastFrame(0), startPos(0)
+{
+  sock = new network::UnixSocket(link.clientFd());
+  setStreams(&sock->inStream(), &sock->outStream());
+  setShared(true);
+  initialiseProtocol();
+}
+
+Client::~Client()
+{
+  delete sock;
+}
+
+void Client::process()
+{
+  if (failed)
+    return;
+
+  try {
+    sock->outStream().flush();
+
+    getOutStream()->cork(true);
+    while (processMsg())
+      ;
+    getOutStream()->cork(false);
+  } catch (std::exception& e) {
+    fprintf(stderr, "Client %d failed: %s\n", id, e.what());
+    failed = true;
+  }
+}
+
+void Client::describe(char* buf, size_t len)
+{
+  char qualityStr[16];
+
+  if (config.quality < 0)
+    strcpy(qualityStr, "lossless");
+  else
+    snprintf(qualityStr, sizeof(qualityStr), "%d", config.quality);
+
+  snprintf(buf, len, "%-8s %-8s %-6s %7d %5d",
+           rfb::encodingName(config.encoding), qualityStr,
+           (config.pf.depth > 16) ? "24bpp" :
+           (config.pf.depth > 8) ? "16bpp" : "8bpp",
+           config.bandwidth, config.latency);
+}
+
+void Client::reset()
+{
+  frames = 0;
+  latencies.clear();
+  startPos = sock->inStream().pos();
+  bytes = 0;
+}
+
+void Client::finish()
+{
+  bytes = sock->inStream().pos() - startPos;
+}
+
+void Client::initDone()
+{
+  setFramebuffer(new rfb::ManagedPixelBuffer(fbPF, server.width(),
+                                             server.height()));
+
+  setPreferredEncoding(config.encoding);
+  setQualityLevel(config.quality);
+  setPF(config.pf);
+}
+
+void Client::framebufferUpdateEnd()
+{
+  unsigned frame;
+  double sent;
+
+  CConnection::framebufferUpdateEnd();
+
+  frame = readMarker();
+  if (frame <= lastFrame)
+    return;
+  lastFrame = frame;
+
+  if (!measuring)
+    return;
+
+  sent = desktop->frameTime(frame);
+  if (sent == 0)
+    return;
+
+  frames++;
+  latencies.push_back(now() - sent);
+}
+
+unsigned Client::readMarker()
+{
+  const uint8_t* buffer;
+  unsigned frame;
+  int stride;
+
+  buffer = getFramebuffer()->getBuffer({0, 0, markerBits * markerSize,
+                                        markerSize},
+                                       &stride);
+
+  frame = 0;
+  for (int i = 0; i < markerBits; i++) {
+    const uint8_t* pixel;
+    pixel = buffer + (markerSize / 2 * stride +
+                      i * markerSize + markerSize / 2) * 4;
+    if (pixel[1] >= 0x80)
+      frame |= 1 << i;
+  }
+
+  return frame;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+  size_t idx;
+
+  if (values.empty())
+    return 0;
+
+  std::sort(values.begin(), values.end());
+  idx = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[idx];
+}
+
+struct Result {
+  double fps, minFps;
+  double p50, p90, p99;
+  double mbits;
+  double cpu;
+};
+
+// Steps through a list so that it changes with every client, but with
+// an extra shift every time an earlier list has wrapped around
+template<class T>
+static T pickConfig(const std::vector<T>& list, size_t* idx, size_t* shift)
+{
+  *shift += *idx % list.size();
+  *idx /= list.size();
+  return list[*shift % list.size()];
+}
+
+static std::vector<ClientConfig> getConfigs(int count)
+{
+  std::vector<int> encodingList, qualityList;
+  std::vector<rfb::PixelFormat> pfList;
+  std::vector<int> bandwidthList, latencyList;
+  std::vector<ClientConfig> configs;
+
+  for (const char* name : encodings) {
+    int encoding = rfb::encodingNum(name);
+    if (encoding == -1) {
+      fprintf(stderr, "Unknown encoding '%s'\n", name);
+      exit(1);
+    }
+    encodingList.push_back(encoding);
+  }
+  for (int level : quality)
+    qualityList.push_back(level);
+  for (const char* name : formats) {
+    rfb::PixelFormat pf;
+    if (!pf.parse(name)) {
+      fprintf(stderr, "Invalid pixel format '%s'\n", name);
+      exit(1);
+    }
+    pfList.push_back(pf);
+  }
+  for (int speed : bandwidth)
+    bandwidthList.push_back(speed);
+  for (int rtt : latency)
+    latencyList.push_back(rtt);
+
+  // Every setting changes from one client to the next, so that even a
+  // few clients cover all values of each one. The shifts make sure
+  // that every combination still comes up eventually.
+  for (int i = 0; i < count; i++) {
+    ClientConfig config;
+    size_t idx, shift;
+
+    idx = i;
+    shift = 0;
+    config.encoding = pickConfig(encodingList, &idx, &shift);
+    config.quality = pickConfig(qualityList, &idx, &shift);
+    config.pf = pickConfig(pfList, &idx, &shift);
+    config.bandwidth = pickConfig(bandwidthList, &idx, &shift);
+    config.latency = pickConfig(latencyList, &idx, &shift);
+
+    configs.push_back(config);
+  }
+
+  return configs;
+}
+
+static void runServer(rfb::VNCServerST* server,
+                      std::list<network::Socket*>* sockets,
+                      const std::vector<struct pollfd>& pfds)
+{
+  double start;
+
+  start = threadCpu();
+
+  for (network::Socket* sock : *sockets) {
+    for (const struct pollfd& pfd : pfds) {
+      if (pfd.fd != sock->getFd())
+        continue;
+      if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+        server->processSocketReadEvent(sock);
+      if (pfd.revents & POLLOUT)
+        server->processSocketWriteEvent(sock);
+    }
+  }
+
+  start = threadCpu() - start;
+  if (measuring)
+    serverCpu += start;
+}
+
+static Result runTest(int count)
+{
+  Desktop desktop(width, height);
+  rfb::VNCServerST* server;
+  std::vector<Client*> clientList;
+  std::list<network::Socket*> sockets;
+
+  double nextFrame, measureStart, measureEnd;
+
+  std::vector<double> fps, allLatencies;
+  double totalBytes;
+  Result result;
+
+  server = new rfb::VNCServerST("loadperf", &desktop);
+
+  for (const ClientConfig& config : getConfigs(count)) {
+    Client* client;
+    network::Socket* sock;
+
+    client = new Client(clientList.size(), config, &desktop);
+    clientList.push_back(client);
+
+    sock = new network::UnixSocket(client->getLink()->serverFd());
+    if (!server->addSocket(sock)) {
+      fprintf(stderr, "Server refused client %d\n",
+              (int)clientList.size() - 1);
+      exit(1);
+    }
+    sockets.push_back(sock);
+  }
+
+  measuring = false;
+  serverCpu = 0;
+
+  nextFrame = now();
+  measureStart = nextFrame + warmupTime;
+  measureEnd = measureStart + duration;
+
+  while (true) {
+    std::vector<struct pollfd> pfds;
+    double current, deadline, start;
+    int timeout;
+    size_t idx;
+
+    current = now();
+
+    if (!measuring && (current >= measureStart)) {
+      for (Client* client : clientList)
+        client->reset();
+      measuring = true;
+    }
+
+    if (current >= measureEnd) {
+      for (Client* client : clientList)
+        client->finish();
+      break;
+    }
+
+    // The desktop is not part of the server cost, as a real desktop
+    // would render in some other process
+    if (current >= nextFrame) {
+      desktop.render();
+      nextFrame += 1.0 / rate;
+      // Don't try to catch up if we've fallen behind
+      if (nextFrame < current)
+        nextFrame = current + 1.0 / rate;
+    }
+
+    start = threadCpu();
+    timeout = core::Timer::checkTimeouts();
+    start = threadCpu() - start;
+    if (measuring)
+      serverCpu += start;
+
+    deadline = std::min(nextFrame, measureEnd);
+    if (timeout >= 0)
+      deadline = std::min(deadline, current + timeout / 1000.0);
+
+    for (network::Socket* sock : sockets) {
+      struct pollfd pfd;
+      pfd.fd = sock->getFd();
+      pfd.events = POLLIN;
+      if (sock->outStream().hasBufferedData())
+        pfd.events |= POLLOUT;
+      pfds.push_back(pfd);
+    }
+
+    for (Client* client : clientList) {
+      struct pollfd pfd;
+      pfd.fd = client->getSock()->getFd();
+      pfd.events = POLLIN;
+      if (client->getSock()->outStream().hasBufferedData())
+        pfd.events |= POLLOUT;
+      pfds.push_back(pfd);
+      client->getLink()->prepare(&pfds, &deadline);
+    }
+
+    if (poll(pfds.data(), pfds.size(),
+             nextTimeout(now(), deadline)) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      exit(1);
+    }
+
+    runServer(server, &sockets, pfds);
+
+    for (network::Socket* sock : sockets) {
+      if (sock->isShutdownRead()) {
+        fprintf(stderr, "Server closed a connection\n");
+        exit(1);
+      }
+    }
+
+    idx = sockets.size();
+    for (Client* client : clientList) {
+      if (pfds[idx].revents != 0)
+        client->process();
+      idx++;
+      if (client->getLink()->pumping()) {
+        client->getLink()->process(&pfds[idx]);
+        idx += 2;
+      }
+    }
+  }
+
+  totalBytes = 0;
+  for (Client* client : clientList) {
+    fps.push_back(client->frames / (double)duration);
+    allLatencies.insert(allLatencies.end(), client->latencies.begin(),
+                        client->latencies.end());
+    totalBytes += client->bytes;
+  }
+
+  if (verbose) {
+    printf("\n%d client%s:\n", count, count == 1 ? "" : "s");
+    printf("  %-4s %-8s %-8s %-6s %7s %5s %6s %7s %7s %7s %7s\n",
+           "#", "Encoding", "Quality", "Format", "kbit/s", "RTT",
+           "FPS", "p50 ms", "p90 ms", "p99 ms", "Mbit/s");
+    for (size_t i = 0; i < clientList.size(); i++) {
+      Client* client = clientList[i];
+      char desc[256];
+
+      client->describe(desc, sizeof(desc));
+      printf("  %-4d %s %6.1f %7.1f %7.1f %7.1f %7.2f%s\n",
+             (int)i, desc, fps[i],
+             percentile(client->latencies, 0.50) * 1000,
+             percentile(client->latencies, 0.90) * 1000,
+             percentile(client->latencies, 0.99) * 1000,
+             client->bytes * 8 / (double)duration / 1000000,
+             client->alive() ? "" : " (failed)");
+    }
+  }
+
+  result.fps = std::accumulate(fps.begin(), fps.end(), 0.0) / fps.size();
+  result.minFps = *std::min_element(fps.begin(), fps.end());
+  result.p50 = percentile(allLatencies, 0.50) * 1000;
+  result.p90 = percentile(allLatencies, 0.90) * 1000;
+  result.p99 = percentile(allLatencies, 0.99) * 1000;
+  result.mbits = totalBytes * 8 / (double)duration / 1000000;
+  result.cpu = serverCpu / duration * 100;
+
+  // The server must go first as it still refers to the sockets
+  delete server;
+
+  for (network::Socket* sock : sockets)
+    delete sock;
+
+  for (Client* client : clientList)
+    delete client;
+
+  return result;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr, "Syntax: %s [options]\n", argv0);
+  fprintf(stderr, "Options:\n");
+  core::Configuration::listParams(79, 14);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+
+  std::vector<Result> results;
+
+  for (i = 1; i < argc;) {
+    int ret;
+
+    ret = core::Configuration::handleParamArg(argc, argv, i);
+    if (ret > 0) {
+      i += ret;
+      continue;
+    }
+
+    if (strcmp(argv[i], "-h") == 0 ||
+        strcmp(argv[i], "--help") == 0) {
+      usage(argv[0]);
+    }
+
+    if (strcmp(argv[i], "-v") == 0 ||
+        strcmp(argv[i], "--version") == 0) {
+      fprintf(stderr, "loadperf (TigerVNC) %s\n", PACKAGE_VERSION);
+      exit(0);
+    }
+
+    fprintf(stderr, "%s: Unrecognized option '%s'\n",
+            argv[0], argv[i]);
+    fprintf(stderr, "See '%s --help' for more information.\n",
+            argv[0]);
+    exit(1);
+  }
+
+  // Both ends run in this process, so neither side can use anything
+  // that needs user interaction
+  rfb::SecurityClient::secTypes.setParam("None");
+  rfb::SecurityServer::secTypes.setParam("None");
+
+  // All clients connect at once from the same "host"
+  core::Configuration::setParam("UseBlacklist", "0");
+
+  printf("Desktop %dx%d at %d fps, %s content, %d second runs\n",
+         (int)width, (int)height, (int)rate,
+         pattern.getValueStr().c_str(),
+         (int)duration);
+
+  for (int count : clients)
+    results.push_back(runTest(count));
+
+  printf("\n");
+  printf("%-7s %6s %7s %7s %7s %7s %8s %10s\n",
+         "Clients", "FPS", "Min FPS", "p50 ms", "p90 ms", "p99 ms",
+         "Mbit/s", "Server CPU");
+
+  i = 0;
+  for (int count : clients) {
+    const Result& result = results[i++];
+    printf("%-7d %6.1f %7.1f %7.1f %7.1f %7.1f %8.2f %9.1f%%\n",
+           count, result.fps, result.minFps,
+           result.p50, result.p90, result.p99,
+           result.mbits, result.cpu);
+  }
+
+  return 0;
+}
@@ -0,0 +1,286 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+/*
+ * This program measures how much latency the data queued up in the
+ * kernel adds on a slow link, and how much SendLowWater helps.
+ *
+ * A TCP connection over loopback is drained by a reader thread that
+ * only reads as fast as the emulated link allows. The sender offers
+ * frames at a fixed rate, but skips a frame if the previous one is
+ * still buffered in FdOutStream, just like the server holds back
+ * updates. Each frame carries the time it was sent, so the reader can
+ * tell how old it was when it had been fully received.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <core/Configuration.h>
+
+#include <rdr/FdOutStream.h>
+
+static core::IntListParameter lowWater("lowwater",
+                                       "Low water marks to run the "
+                                       "test with, in KiB (0 for the "
+                                       "operating system default)",
+                                       {0, 128, 32}, 0, 65536);
+static core::IntParameter duration("duration",
+                                   "Number of seconds to measure for "
+                                   "each low water mark", 5, 1);
+static core::IntParameter bandwidth("bandwidth",
+                                    "Link speed, in kbit/s",
+                                    32000, 1);
+static core::IntParameter frameSize("framesize",
+                                    "Size of each frame, in KiB",
+                                    64, 1, 65536);
+static core::IntParameter rate("rate",
+                               "Number of frames per second the "
+                               "sender offers", 100, 1, 1000);
+
+struct Result {
+  int sent, skipped;
+  std::vector<double> latencies;
+};
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void connectLoopback(int* sender, int* receiver)
+{
+  struct sockaddr_in addr;
+  socklen_t len;
+  int listener;
+
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0)
+    throw std::runtime_error("Unable to create socket");
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  len = sizeof(addr);
+  if ((bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+      (listen(listener, 1) < 0) ||
+      (getsockname(listener, (struct sockaddr*)&addr, &len) < 0))
+    throw std::runtime_error("Unable to listen on loopback");
+
+  *sender = socket(AF_INET, SOCK_STREAM, 0);
+  if ((*sender < 0) ||
+      (connect(*sender, (struct sockaddr*)&addr, sizeof(addr)) < 0))
+    throw std::runtime_error("Unable to connect over loopback");
+
+  *receiver = accept(listener, nullptr, nullptr);
+  if (*receiver < 0)
+    throw std::runtime_error("Unable to accept connection");
+
+  close(listener);
+
+  fcntl(*sender, F_SETFL, O_NONBLOCK);
+}
+
+// Reads no faster than the link could carry the data, and notes how
+// old each frame was once all of it had arrived
+static void receive(int fd, const std::atomic<bool>* done,
+                    std::vector<double>* latencies)
+{
+  std::vector<uint8_t> frame(frameSize * 1024);
+  double start, bytesPerSec;
+  size_t received, total;
+
+  bytesPerSec = bandwidth * 1000.0 / 8.0;
+
+  start = now();
+  received = 0;
+  total = 0;
+  while (!*done) {
+    double allowed;
+    ssize_t len;
+
+    // Wait for at least a full packet's worth of tokens
+    allowed = (now() - start) * bytesPerSec - total;
+    if (allowed < 1500) {
+      usleep(1000);
+      continue;
+    }
+
+    len = recv(fd, frame.data() + received,
+               std::min((size_t)allowed, frame.size() - received),
+               MSG_DONTWAIT);
+    if (len <= 0) {
+      usleep(1000);
+      continue;
+    }
+
+    received += len;
+    total += len;
+
+    if (received == frame.size()) {
+      double sent;
+      memcpy(&sent, frame.data(), sizeof(sent));
+      latencies->push_back(now() - sent);
+      received = 0;
+    }
+  }
+}
+
+static Result runTest(int lowat)
+{
+  std::vector<uint8_t> frame(frameSize * 1024);
+  std::atomic<bool> done(false);
+  int sender, receiver;
+  double end;
+  Result result;
+
+  connectLoopback(&sender, &receiver);
+
+  std::thread reader(receive, receiver, &done, &result.latencies);
+
+  {
+    rdr::FdOutStream os(sender);
+
+    if (lowat != 0) {
+      if (!os.setSendLowWater(lowat * 1024))
+        fprintf(stderr, "Unable to set the low water mark\n");
+    }
+
+    result.sent = 0;
+    result.skipped = 0;
+
+    end = now() + duration;
+    while (now() < end) {
+      os.flush();
+
+      // Like the server, only produce a new frame once the previous
+      // one has left our buffer
+      if (os.hasBufferedData()) {
+        result.skipped++;
+      } else {
+        double t = now();
+        memcpy(frame.data(), &t, sizeof(t));
+        os.writeBytes(frame.data(), frame.size());
+        os.flush();
+        result.sent++;
+      }
+
+      usleep(1000000 / rate);
+    }
+
+    done = true;
+    reader.join();
+  }
+
+  close(sender);
+  close(receiver);
+
+  return result;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr, "Syntax: %s [options]\n", argv0);
+  fprintf(stderr, "Options:\n");
+  core::Configuration::listParams(79, 14);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  int i;
+
+  for (i = 1; i < argc;) {
+    int ret;
+
+    ret = core::Configuration::handleParamArg(argc, argv, i);
+    if (ret > 0) {
+      i += ret;
+      continue;
+    }
+
+    if (strcmp(argv[i], "-h") == 0 ||
+        strcmp(argv[i], "--help") == 0) {
+      usage(argv[0]);
+    }
+
+    fprintf(stderr, "%s: Unrecognized option '%s'\n",
+            argv[0], argv[i]);
+    fprintf(stderr, "See '%s --help' for more information.\n",
+            argv[0]);
+    exit(1);
+  }
+
+  printf("# Send Queue Latency Test\n");
+  printf("#\n");
+  printf("# Link: %d kbit/s\n", (int)bandwidth);
+  printf("# Frames: %d KiB at %d fps\n", (int)frameSize, (int)rate);
+  printf("#\n");
+  printf("# Note: Latencies are in milliseconds\n");
+  printf("#\n");
+
+  printf("Low water mark (KiB),Sent,Skipped,Received,Median,P95\n");
+
+  for (int lowat : lowWater) {
+    Result result;
+
+    try {
+      result = runTest(lowat);
+    } catch (std::exception& e) {
+      fprintf(stderr, "Failed: %s\n", e.what());
+      return 1;
+    }
+
+    std::vector<double>& latencies = result.latencies;
+
+    printf("%d,%d,%d,%d", lowat, result.sent, result.skipped,
+           (int)latencies.size());
+
+    if (latencies.empty()) {
+      printf(",,\n");
+      continue;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    printf(",%g,%g\n", latencies[latencies.size() / 2] * 1000,
+           latencies[latencies.size() * 95 / 100] * 1000);
+    fflush(stdout);
+  }
+
+  return 0;
+}
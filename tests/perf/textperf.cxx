@@ -0,0 +1,178 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+/*
+ * This program measures how fast large clipboards can be converted
+ * between what the protocol uses and what the local system uses, e.g.
+ * when copying a big log file or CSV dump.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include <core/string.h>
+
+#include "util.h"
+
+static const int runs = 3;
+
+enum Content { AsciiLF, AsciiCRLF, UnicodeLF };
+
+static const char* contentNames[] = {
+  "ASCII with LF", "ASCII with CRLF", "UTF-8 with LF"
+};
+
+static std::string makeText(Content content, size_t size)
+{
+  static const char* words[] = {
+    "connection", "update", "12345", "0.75", "ERROR", "INFO",
+    "r\xc3\xa4ksm\xc3\xb6rg\xc3\xa5s", "\xce\xba\xce\xb1\xce\xbb\xce\xb7",
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "na\xc3\xafve",
+  };
+  std::string text;
+  size_t column;
+
+  text.reserve(size + 100);
+
+  srand(content);
+
+  // Something like a log file or a CSV dump
+  column = 0;
+  while (text.size() < size) {
+    const char* word;
+
+    if (content == UnicodeLF)
+      word = words[rand() % 10];
+    else
+      word = words[rand() % 6];
+
+    text += word;
+    column += strlen(word);
+
+    if (column > 80) {
+      text += (content == AsciiCRLF) ? "\r\n" : "\n";
+      column = 0;
+    } else {
+      text += ',';
+    }
+  }
+
+  return text;
+}
+
+typedef void (*testfn) (const std::string&, std::string*);
+
+struct TestEntry {
+  const char *label;
+  testfn fn;
+};
+
+static void testProvide(const std::string& in, std::string* out)
+{
+  core::utf8ToLF(in.data(), in.size(), out);
+}
+
+static void testProvideMultiPass(const std::string& in, std::string* out)
+{
+  if (!core::isValidUTF8(in.data(), in.size()))
+    return;
+  *out = core::convertLF(in.data(), in.size());
+}
+
+static void testSend(const std::string& in, std::string* out)
+{
+  core::utf8ToCRLF(in.data(), in.size(), out);
+}
+
+static void testCutTextIn(const std::string& in, std::string* out)
+{
+  core::latin1ToUTF8LF(in.data(), in.size(), out);
+}
+
+static void testCutTextOut(const std::string& in, std::string* out)
+{
+  core::utf8ToLatin1(in.data(), in.size(), out);
+}
+
+static struct TestEntry tests[] = {
+  {"UTF-8 to LF", testProvide},
+  {"UTF-8 to LF (two passes)", testProvideMultiPass},
+  {"UTF-8 to CRLF", testSend},
+  {"Latin-1 to UTF-8 with LF", testCutTextIn},
+  {"UTF-8 to Latin-1", testCutTextOut},
+};
+
+static double doTest(testfn fn, const std::string& in)
+{
+  std::string out;
+
+  // The output buffer is reused, like for the connection's clipboard
+  startCpuCounter();
+  for (int i = 0; i < runs; i++)
+    fn(in, &out);
+  endCpuCounter();
+
+  return (double)in.size() * runs / (1024.0 * 1024.0) / getCpuCounter();
+}
+
+int main(int argc, char** argv)
+{
+  size_t size;
+
+  size = 256;
+  if (argc > 1)
+    size = atoi(argv[1]);
+  if (size == 0) {
+    fprintf(stderr, "Usage: %s [size in MiB]\n", argv[0]);
+    return 1;
+  }
+
+  printf("# Clipboard Text Conversion Performance Test\n");
+  printf("#\n");
+  printf("# Text size: %d MiB\n", (int)size);
+  printf("#\n");
+  printf("# Note: Results are MiB/sec\n");
+  printf("#\n");
+
+  printf("Content");
+  for (const TestEntry& test : tests)
+    printf(",%s", test.label);
+  printf("\n");
+
+  for (Content content : { AsciiLF, AsciiCRLF, UnicodeLF }) {
+    std::string text;
+
+    text = makeText(content, size * 1024 * 1024);
+
+    printf("%s", contentNames[content]);
+    for (const TestEntry& test : tests) {
+      printf(",%g", doTest(test.fn, text));
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+
+  return 0;
+}
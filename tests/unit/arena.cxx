@@ -0,0 +1,149 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <core/Arena.h>
+#include <core/Region.h>
+
+TEST(Arena, alignment)
+{
+  core::Arena arena(256);
+
+  arena.allocate(1, 1);
+  EXPECT_EQ((uintptr_t)arena.allocate(8, 8) % 8, 0);
+  arena.allocate(3, 1);
+  EXPECT_EQ((uintptr_t)arena.allocate(16, 64) % 64, 0);
+}
+
+TEST(Arena, grow)
+{
+  core::Arena arena(256);
+  uint8_t* a;
+  uint8_t* b;
+
+  a = (uint8_t*)arena.allocate(200);
+  b = (uint8_t*)arena.allocate(200);
+  memset(a, 0xaa, 200);
+  memset(b, 0xbb, 200);
+  EXPECT_EQ(a[199], 0xaa);
+  EXPECT_GE(arena.used(), 400);
+
+  arena.allocate(10000);
+  EXPECT_GE(arena.capacity(), 10400);
+}
+
+TEST(Arena, reset)
+{
+  core::Arena arena(256);
+  void* first;
+  size_t capacity;
+
+  first = arena.allocate(100);
+  arena.allocate(1000);
+  arena.allocate(1000);
+
+  arena.reset();
+  EXPECT_EQ(arena.used(), 0);
+
+  // Everything should now fit in a single block
+  capacity = arena.capacity();
+  EXPECT_GE(capacity, 2100);
+  arena.allocate(100);
+  arena.allocate(1000);
+  arena.allocate(1000);
+  EXPECT_EQ(arena.capacity(), capacity);
+
+  arena.reset();
+  EXPECT_NE(arena.allocate(100), first);
+}
+
+TEST(Arena, release)
+{
+  core::Arena arena;
+  void* a;
+  void* b;
+
+  a = arena.allocate(64);
+  b = arena.allocate(64);
+
+  // Only the most recent allocation can be given back
+  arena.release(a, 64);
+  EXPECT_EQ(arena.used(), 128);
+  arena.release(b, 64);
+  EXPECT_EQ(arena.used(), 64);
+  EXPECT_EQ(arena.allocate(64), b);
+}
+
+TEST(Arena, vector)
+{
+  core::Arena arena;
+  std::vector<int, core::ArenaAllocator<int> > v(&arena);
+
+  for (int i = 0; i < 1000; i++)
+    v.push_back(i);
+  for (int i = 0; i < 1000; i++)
+    EXPECT_EQ(v[i], i);
+}
+
+TEST(Arena, scope)
+{
+  core::Arena arena;
+  size_t used;
+
+  arena.allocate(16);
+  used = arena.used();
+
+  {
+    std::vector<int, core::ArenaAllocator<int> > v(&arena);
+    v.reserve(100);
+    EXPECT_GT(arena.used(), used);
+  }
+
+  EXPECT_EQ(arena.used(), used);
+}
+
+TEST(Arena, regionRects)
+{
+  core::Arena arena;
+  core::Region region;
+  std::vector<core::Rect> heapRects;
+  std::vector<core::Rect,
+              core::ArenaAllocator<core::Rect> > arenaRects(&arena);
+
+  region.assign_union({0, 0, 10, 10});
+  region.assign_union({20, 0, 30, 10});
+  region.assign_union({0, 20, 30, 30});
+  region.assign_subtract({5, 5, 25, 25});
+
+  region.get_rects(&heapRects, false, false);
+  region.get_rects(&arenaRects, false, false);
+
+  ASSERT_EQ(heapRects.size(), arenaRects.size());
+  for (size_t i = 0; i < heapRects.size(); i++)
+    EXPECT_EQ(heapRects[i], arenaRects[i]);
+}
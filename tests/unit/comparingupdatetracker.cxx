@@ -0,0 +1,142 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <rfb/ComparingUpdateTracker.h>
+
+static const rfb::PixelFormat fbPF(32, 24, false, true,
+                                   255, 255, 255, 0, 8, 16);
+
+static void fill(rfb::ManagedPixelBuffer* pb, const core::Rect& r,
+                 uint32_t colour)
+{
+  pb->fillRect(r, &colour);
+}
+
+static void pattern(rfb::ManagedPixelBuffer* pb)
+{
+  for (int y = 0; y < pb->height(); y++) {
+    for (int x = 0; x < pb->width(); x++)
+      fill(pb, {x, y, x+1, y+1}, (x * 7) ^ (y * 13));
+  }
+}
+
+static core::Region compare(rfb::ComparingUpdateTracker* cut,
+                            const core::Rect& clip)
+{
+  rfb::UpdateInfo ui;
+
+  cut->compare();
+  cut->getUpdateInfo(&ui, clip);
+  cut->clear();
+
+  return ui.changed;
+}
+
+TEST(ComparingUpdateTracker, initial)
+{
+  rfb::ManagedPixelBuffer fb(fbPF, 200, 100);
+  rfb::ComparingUpdateTracker cut(&fb);
+
+  pattern(&fb);
+
+  EXPECT_EQ(compare(&cut, fb.getRect()), core::Region(fb.getRect()));
+
+  cut.add_changed(fb.getRect());
+  EXPECT_TRUE(compare(&cut, fb.getRect()).is_empty());
+}
+
+TEST(ComparingUpdateTracker, grow)
+{
+  rfb::ManagedPixelBuffer fb(fbPF, 200, 100);
+  rfb::ManagedPixelBuffer fb2(fbPF, 300, 150);
+  rfb::ComparingUpdateTracker cut(&fb);
+
+  pattern(&fb);
+  compare(&cut, fb.getRect());
+
+  // Same contents in the overlapping area
+  pattern(&fb2);
+  cut.setBuffer(&fb2);
+
+  EXPECT_EQ(compare(&cut, fb2.getRect()),
+            core::Region(fb2.getRect()).subtract(core::Rect(0, 0, 200, 100)));
+
+  // And the new area should now be known
+  cut.add_changed(fb2.getRect());
+  EXPECT_TRUE(compare(&cut, fb2.getRect()).is_empty());
+}
+
+TEST(ComparingUpdateTracker, shrink)
+{
+  rfb::ManagedPixelBuffer fb(fbPF, 200, 100);
+  rfb::ManagedPixelBuffer fb2(fbPF, 150, 80);
+  rfb::ComparingUpdateTracker cut(&fb);
+
+  pattern(&fb);
+  compare(&cut, fb.getRect());
+
+  pattern(&fb2);
+  cut.setBuffer(&fb2);
+
+  EXPECT_TRUE(compare(&cut, fb2.getRect()).is_empty());
+}
+
+TEST(ComparingUpdateTracker, changedOverlap)
+{
+  rfb::ManagedPixelBuffer fb(fbPF, 200, 100);
+  rfb::ManagedPixelBuffer fb2(fbPF, 100, 200);
+  rfb::ComparingUpdateTracker cut(&fb);
+  core::Region changed;
+
+  pattern(&fb);
+  compare(&cut, fb.getRect());
+
+  pattern(&fb2);
+  fill(&fb2, {10, 10, 20, 20}, 0xffffff);
+  cut.setBuffer(&fb2);
+
+  changed = compare(&cut, fb2.getRect());
+
+  EXPECT_EQ(changed.intersect(core::Rect(10, 10, 20, 20)),
+            core::Region({10, 10, 20, 20}));
+  EXPECT_TRUE(changed.intersect(core::Rect(0, 30, 100, 100)).is_empty());
+  EXPECT_EQ(changed.intersect(core::Rect(0, 100, 100, 200)),
+            core::Region({0, 100, 100, 200}));
+}
+
+TEST(ComparingUpdateTracker, newFormat)
+{
+  rfb::PixelFormat pf2(32, 24, false, true, 255, 255, 255, 16, 8, 0);
+  rfb::ManagedPixelBuffer fb(fbPF, 200, 100);
+  rfb::ManagedPixelBuffer fb2(pf2, 200, 100);
+  rfb::ComparingUpdateTracker cut(&fb);
+
+  pattern(&fb);
+  compare(&cut, fb.getRect());
+
+  pattern(&fb2);
+  cut.setBuffer(&fb2);
+
+  EXPECT_EQ(compare(&cut, fb2.getRect()), core::Region(fb2.getRect()));
+}
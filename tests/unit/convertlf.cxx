@@ -68,6 +68,87 @@ TEST(ConvertLF, convertCRLF)
   EXPECT_EQ(core::convertCRLF("old\rmac\rformat"), "old\r\nmac\r\nformat");
 }
 
+// Long enough to not be handled one byte at a time
+static std::string repeat(const char* str, size_t count = 50)
+{
+  std::string out;
+  while (count--)
+    out += str;
+  return out;
+}
+
+TEST(ConvertLF, longLines)
+{
+  EXPECT_EQ(core::convertLF(repeat("a long line of text\r\n").c_str()),
+            repeat("a long line of text\n"));
+  EXPECT_EQ(core::convertLF(repeat("a long line of text\r").c_str()),
+            repeat("a long line of text\n"));
+  EXPECT_EQ(core::convertCRLF(repeat("a long line of text\n").c_str()),
+            repeat("a long line of text\r\n"));
+  EXPECT_EQ(core::convertCRLF(repeat("a long line of text\r\n").c_str()),
+            repeat("a long line of text\r\n"));
+
+  // Non-ASCII is just bytes to these
+  EXPECT_EQ(core::convertLF(repeat("r\xe4ksm\xf6rg\xe5s\r\n").c_str()),
+            repeat("r\xe4ksm\xf6rg\xe5s\n"));
+}
+
+TEST(ConvertLF, stopAtNul)
+{
+  std::string in;
+
+  in = repeat("0123456789abcdef", 2);
+  in[20] = '\0';
+
+  EXPECT_EQ(core::convertLF(in.data(), in.size()), in.substr(0, 20));
+  EXPECT_EQ(core::convertCRLF(in.data(), in.size()), in.substr(0, 20));
+}
+
+TEST(ConvertLF, utf8ToLF)
+{
+  std::string out;
+
+  EXPECT_TRUE(core::utf8ToLF("", 0, &out));
+  EXPECT_EQ(out, "");
+
+  EXPECT_TRUE(core::utf8ToLF("r\xc3\xa4ksm\xc3\xb6rg\xc3\xa5s\r\n", 15, &out));
+  EXPECT_EQ(out, "r\xc3\xa4ksm\xc3\xb6rg\xc3\xa5s\n");
+
+  EXPECT_TRUE(core::utf8ToLF(repeat("\xe6\x97\xa5\xe6\x9c\xac\r\n").c_str(),
+                             (size_t)-1, &out));
+  EXPECT_EQ(out, repeat("\xe6\x97\xa5\xe6\x9c\xac\n"));
+
+  // Invalid sequences are kept, but reported
+  EXPECT_FALSE(core::utf8ToLF("abc\xe5\xe4\xf6\r\n", 8, &out));
+  EXPECT_EQ(out, "abc\xe5\xe4\xf6\n");
+  EXPECT_FALSE(core::utf8ToLF((repeat("abc") + "\xed\xa2\x80").c_str(),
+                              (size_t)-1, &out));
+
+  // Old contents are replaced
+  EXPECT_TRUE(core::utf8ToLF("new", 3, &out));
+  EXPECT_EQ(out, "new");
+}
+
+TEST(ConvertLF, utf8ToCRLF)
+{
+  std::string out;
+
+  EXPECT_TRUE(core::utf8ToCRLF(repeat("\xc3\xa5\xc3\xa4\xc3\xb6\n").c_str(),
+                               (size_t)-1, &out));
+  EXPECT_EQ(out, repeat("\xc3\xa5\xc3\xa4\xc3\xb6\r\n"));
+
+  EXPECT_FALSE(core::utf8ToCRLF("\xf8\xa1\xa1\xa1\xa1\n", 6, &out));
+}
+
+TEST(ConvertLF, latin1ToUTF8LF)
+{
+  std::string out;
+
+  core::latin1ToUTF8LF(repeat("r\xe4ksm\xf6rg\xe5s\r\n").c_str(),
+                       (size_t)-1, &out);
+  EXPECT_EQ(out, repeat("r\xc3\xa4ksm\xc3\xb6rg\xc3\xa5s\n"));
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,304 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+
+#include <rfb/CMsgHandler.h>
+#include <rfb/CMsgReader.h>
+#include <rfb/ClientParams.h>
+#include <rfb/Cursor.h>
+#include <rfb/SMsgWriter.h>
+#include <rfb/Exception.h>
+#include <rfb/cursorCacheTypes.h>
+#include <rfb/encodings.h>
+#include <rfb/msgTypes.h>
+
+class CursorHandler : public rfb::CMsgHandler {
+public:
+  void setDesktopSize(int, int) override {}
+  void setExtendedDesktopSize(unsigned, unsigned, int, int,
+                              const rfb::ScreenSet&) override {}
+  void setCursor(int width, int height, const core::Point& hotspot,
+                 const uint8_t* data) override {
+    cursors.emplace_back(width, height, hotspot, data);
+  }
+  void setCursorPos(const core::Point&) override {}
+  void setSharedFramebuffer(int, int, const rfb::PixelFormat&,
+                            unsigned, int, uint32_t) override {}
+  void setName(const char*) override {}
+  void fence(uint32_t, unsigned, const uint8_t[]) override {}
+  void endOfContinuousUpdates() override {}
+  void supportsQEMUKeyEvent() override {}
+  void supportsExtendedMouseButtons() override {}
+  void serverInit(int, int, const rfb::PixelFormat&,
+                  const char*) override {}
+  bool readAndDecodeRect(const core::Rect& r, int encoding,
+                         rfb::ModifiablePixelBuffer* pb) override {
+    std::vector<uint8_t> data(r.area() * 4);
+
+    // Only used for alpha cursors, which are always sent raw
+    if (encoding != rfb::encodingRaw)
+      return false;
+
+    if (!in->hasData(data.size()))
+      return false;
+    in->readBytes(data.data(), data.size());
+    pb->imageRect(r, data.data());
+
+    return true;
+  }
+  void framebufferUpdateStart() override {}
+  void framebufferUpdateEnd() override {}
+  bool dataRect(const core::Rect&, int) override { return true; }
+  void setColourMapEntries(int, int, uint16_t*) override {}
+  void bell() override {}
+  void serverCutText(const char*) override {}
+  void setLEDState(unsigned int) override {}
+  void handleClipboardCaps(uint32_t, const uint32_t*) override {}
+  void handleClipboardRequest(uint32_t) override {}
+  void handleClipboardPeek() override {}
+  void handleClipboardNotify(uint32_t) override {}
+  void handleClipboardProvide(uint32_t, const size_t*,
+                              const uint8_t* const*) override {}
+
+  rdr::InStream* in;
+  std::vector<rfb::Cursor> cursors;
+};
+
+class CursorCache : public testing::Test {
+protected:
+  CursorCache() : writer(&client, &out) {}
+
+  void setEncodings(bool cache, bool alpha=false) {
+    std::vector<int32_t> encodings;
+
+    if (alpha)
+      encodings.push_back(rfb::pseudoEncodingCursorWithAlpha);
+    else
+      encodings.push_back(rfb::pseudoEncodingVMwareCursor);
+    if (cache)
+      encodings.push_back(rfb::pseudoEncodingCursorCache);
+
+    client.setEncodings(encodings.size(), encodings.data());
+  }
+
+  // Writes an update with the cursor and returns its size
+  size_t send(const rfb::Cursor& cursor) {
+    size_t start;
+
+    start = out.length();
+
+    client.setCursor(cursor);
+    writer.writeCursor();
+    writer.writeFramebufferUpdateStart(0);
+    writer.writeFramebufferUpdateEnd();
+
+    return out.length() - start;
+  }
+
+  // Writes an update with nothing but a cache operation
+  void sendCacheRect(int slot, uint16_t op) {
+    out.writeU8(rfb::msgTypeFramebufferUpdate);
+    out.pad(1);
+    out.writeU16(1);
+    out.writeU16(slot);
+    out.writeU16(op);
+    out.writeU16(0);
+    out.writeU16(0);
+    out.writeU32(rfb::pseudoEncodingCursorCache);
+  }
+
+  // Feeds everything written so far to a viewer
+  void receive() {
+    rdr::MemInStream in(out.data(), out.length());
+    rfb::CMsgReader reader(&handler, &in);
+
+    handler.in = &in;
+    while (in.avail() > 0)
+      ASSERT_TRUE(reader.readMsg());
+  }
+
+  rfb::ClientParams client;
+  rdr::MemOutStream out;
+  rfb::SMsgWriter writer;
+
+  CursorHandler handler;
+};
+
+static rfb::Cursor makeCursor(int width, int height, uint8_t seed)
+{
+  std::vector<uint8_t> data(width * height * 4);
+
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = seed + i * 3;
+
+  return rfb::Cursor(width, height, {width/2, height/2}, data.data());
+}
+
+static bool sameCursor(const rfb::Cursor& a, const rfb::Cursor& b)
+{
+  if ((a.width() != b.width()) || (a.height() != b.height()))
+    return false;
+  if (a.hotspot() != b.hotspot())
+    return false;
+  return memcmp(a.getBuffer(), b.getBuffer(),
+                a.width() * a.height() * 4) == 0;
+}
+
+TEST_F(CursorCache, reference)
+{
+  rfb::Cursor arrow(makeCursor(16, 24, 1));
+  rfb::Cursor hand(makeCursor(20, 20, 2));
+  size_t full, cached;
+
+  setEncodings(true);
+
+  full = send(arrow);
+  send(hand);
+  cached = send(arrow);
+
+  // Just the header and a single cache rect
+  EXPECT_EQ(cached, 4U + 12U);
+  EXPECT_GT(full, 16U * 24U * 4U);
+
+  receive();
+
+  ASSERT_EQ(handler.cursors.size(), 3U);
+  EXPECT_TRUE(sameCursor(handler.cursors[0], arrow));
+  EXPECT_TRUE(sameCursor(handler.cursors[1], hand));
+  EXPECT_TRUE(sameCursor(handler.cursors[2], arrow));
+}
+
+TEST_F(CursorCache, unsupported)
+{
+  rfb::Cursor arrow(makeCursor(16, 24, 1));
+  rfb::Cursor hand(makeCursor(20, 20, 2));
+  size_t first, second;
+
+  setEncodings(false);
+
+  first = send(arrow);
+  send(hand);
+  second = send(arrow);
+
+  EXPECT_EQ(first, second);
+
+  receive();
+
+  ASSERT_EQ(handler.cursors.size(), 3U);
+  EXPECT_TRUE(sameCursor(handler.cursors[2], arrow));
+}
+
+TEST_F(CursorCache, enabledLater)
+{
+  rfb::Cursor arrow(makeCursor(16, 24, 1));
+  size_t first, second;
+
+  // Sent before the viewer told us it had a cache, so it must be sent
+  // again in full
+  setEncodings(false);
+  send(arrow);
+  setEncodings(true);
+  first = send(arrow);
+  second = send(arrow);
+
+  EXPECT_GT(first, second);
+
+  receive();
+
+  ASSERT_EQ(handler.cursors.size(), 3U);
+  EXPECT_TRUE(sameCursor(handler.cursors[2], arrow));
+}
+
+TEST_F(CursorCache, eviction)
+{
+  std::vector<rfb::Cursor> cursors;
+
+  setEncodings(true);
+
+  for (int i = 0; i < rfb::cursorCacheSlots + 1; i++) {
+    cursors.push_back(makeCursor(8, 8, i));
+    send(cursors.back());
+  }
+
+  // The first one should have been pushed out, the second one not
+  EXPECT_GT(send(cursors[0]), 4U + 12U);
+  EXPECT_EQ(send(cursors[2]), 4U + 12U);
+
+  receive();
+
+  ASSERT_EQ(handler.cursors.size(), cursors.size() + 2);
+  EXPECT_TRUE(sameCursor(handler.cursors[cursors.size()], cursors[0]));
+  EXPECT_TRUE(sameCursor(handler.cursors[cursors.size()+1], cursors[2]));
+}
+
+TEST_F(CursorCache, paddedRows)
+{
+  std::vector<uint8_t> data(24 * 24 * 4);
+
+  // Pre-multiplied alpha is only lossless when fully opaque
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = (i % 4 == 3) ? 255 : i * 7;
+
+  // The viewer's scratch buffer pads these rows, which must not end up
+  // in the cursor
+  rfb::Cursor cursor(24, 24, {3, 4}, data.data());
+
+  setEncodings(false, true);
+  send(cursor);
+
+  receive();
+
+  ASSERT_EQ(handler.cursors.size(), 1U);
+  EXPECT_TRUE(sameCursor(handler.cursors[0], cursor));
+}
+
+TEST_F(CursorCache, storeEndsWithUpdate)
+{
+  rfb::Cursor arrow(makeCursor(16, 24, 1));
+
+  setEncodings(false);
+
+  // A store without a cursor in the same update must not catch the
+  // cursor in the next one
+  sendCacheRect(3, rfb::cursorCacheStore);
+  send(arrow);
+  sendCacheRect(3, rfb::cursorCacheUse);
+
+  rdr::MemInStream in(out.data(), out.length());
+  rfb::CMsgReader reader(&handler, &in);
+
+  handler.in = &in;
+  ASSERT_TRUE(reader.readMsg());
+  ASSERT_TRUE(reader.readMsg());
+  EXPECT_THROW(reader.readMsg(), rfb::protocol_error);
+
+  ASSERT_EQ(handler.cursors.size(), 1U);
+  EXPECT_TRUE(sameCursor(handler.cursors[0], arrow));
+}
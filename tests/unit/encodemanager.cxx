@@ -0,0 +1,121 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <rdr/MemOutStream.h>
+
+#include <rfb/EncodeManager.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/SMsgWriter.h>
+#include <rfb/UpdateTracker.h>
+#include <rfb/encodings.h>
+
+static const rfb::PixelFormat rgb888(32, 24, false, true,
+                                     255, 255, 255, 16, 8, 0);
+
+class DummySConnection : public rfb::SConnection {
+public:
+  DummySConnection(rdr::OutStream* out)
+    : SConnection(rfb::AccessDefault) {
+    setStreams(nullptr, out);
+    setWriter(new rfb::SMsgWriter(&client, out));
+  }
+
+  void setAccessRights(rfb::AccessRights) override {}
+  void setDesktopSize(int, int, const rfb::ScreenSet&) override {}
+  void keyEvent(uint32_t, uint32_t, bool) override {}
+  void pointerEvent(const core::Point&, uint16_t) override {}
+};
+
+// Sends a full update of something photo like and returns how big it
+// was, so that we can tell if anything got a lower quality
+static size_t encode(bool lossy, const core::Region& focus, int drop)
+{
+  rdr::MemOutStream out;
+  DummySConnection conn(&out);
+  rfb::EncodeManager manager(&conn);
+  rfb::ManagedPixelBuffer pb(rgb888, 256, 256);
+  std::vector<int32_t> encodings;
+  rfb::UpdateInfo ui;
+  uint8_t* data;
+  int stride;
+
+  data = pb.getBufferRW(pb.getRect(), &stride);
+  srand(1);
+  for (int y = 0; y < pb.height(); y++) {
+    for (int x = 0; x < pb.width(); x++) {
+      uint8_t* pixel = data + (y * stride + x) * 4;
+      pixel[0] = x + rand() % 32;
+      pixel[1] = y + rand() % 32;
+      pixel[2] = x + y + rand() % 32;
+      pixel[3] = 0;
+    }
+  }
+  pb.commitBufferRW(pb.getRect());
+
+  encodings.push_back(rfb::encodingTight);
+  if (lossy)
+    encodings.push_back(rfb::pseudoEncodingQualityLevel0 + 8);
+
+  conn.client.setPF(rgb888);
+  conn.client.setEncodings(encodings.size(), encodings.data());
+
+  manager.setFocus(focus, drop);
+
+  ui.changed = pb.getRect();
+  manager.writeUpdate(ui, &pb, nullptr);
+
+  return out.length();
+}
+
+TEST(EncodeManager, focusLowersPeriphery)
+{
+  EXPECT_LT(encode(true, core::Rect(0, 0, 64, 64), 4),
+            encode(true, {}, 0));
+}
+
+TEST(EncodeManager, focusWithoutDrop)
+{
+  EXPECT_EQ(encode(true, core::Rect(0, 0, 64, 64), 0),
+            encode(true, {}, 0));
+}
+
+TEST(EncodeManager, focusEverywhere)
+{
+  EXPECT_EQ(encode(true, core::Rect(0, 0, 256, 256), 4),
+            encode(true, {}, 0));
+  EXPECT_EQ(encode(true, core::Rect(-100, -100, 500, 500), 4),
+            encode(true, {}, 0));
+}
+
+TEST(EncodeManager, focusLossless)
+{
+  // Nothing to lower if the client hasn't asked for JPEG
+  EXPECT_EQ(encode(false, core::Rect(0, 0, 64, 64), 4),
+            encode(false, {}, 0));
+}
@@ -0,0 +1,200 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+
+#include <rfb/FastLosslessDecoder.h>
+#include <rfb/FastLosslessEncoder.h>
+#include <rfb/Palette.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/ServerParams.h>
+
+static const rfb::PixelFormat rgb888(32, 24, false, true,
+                                     255, 255, 255, 16, 8, 0);
+static const rfb::PixelFormat bgr888(32, 24, true, true,
+                                     255, 255, 255, 0, 8, 16);
+static const rfb::PixelFormat rgb565(16, 16, false, true,
+                                     31, 63, 31, 11, 5, 0);
+static const rfb::PixelFormat rgb332(8, 8, false, true,
+                                     7, 7, 3, 5, 2, 0);
+
+namespace rfb {
+
+static std::ostream& operator<<(std::ostream& os, const PixelFormat& pf)
+{
+  char b[256];
+  pf.print(b, sizeof(b));
+  return os << b;
+}
+
+}
+
+class DummySConnection : public rfb::SConnection {
+public:
+  DummySConnection(rdr::OutStream* out)
+    : SConnection(rfb::AccessDefault) { setStreams(nullptr, out); }
+
+  void setAccessRights(rfb::AccessRights) override {}
+  void setDesktopSize(int, int, const rfb::ScreenSet&) override {}
+  void keyEvent(uint32_t, uint32_t, bool) override {}
+  void pointerEvent(const core::Point&, uint16_t) override {}
+};
+
+class FastLossless : public testing::TestWithParam<rfb::PixelFormat> {
+protected:
+  // Fills via RGB so that any padding bits are consistent
+  void fill(rfb::ManagedPixelBuffer* pb, int pattern) {
+    std::vector<uint8_t> rgb(pb->width() * 3);
+    uint8_t* data;
+    int stride;
+
+    data = pb->getBufferRW(pb->getRect(), &stride);
+    stride *= pb->getPF().bpp/8;
+
+    srand(pattern);
+    for (int y = 0; y < pb->height(); y++) {
+      for (int i = 0; i < pb->width() * 3; i++) {
+        if (pattern == 0)
+          rgb[i] = i * 3 + y * 5;
+        else
+          rgb[i] = rand();
+      }
+      pb->getPF().bufferFromRGB(data + y * stride, rgb.data(),
+                                pb->width());
+    }
+
+    pb->commitBufferRW(pb->getRect());
+  }
+
+  // Runs the encoded data through the decoder like DecodeManager
+  // would
+  void decode(rdr::MemOutStream& encoded,
+              rfb::ModifiablePixelBuffer* pb) {
+    rfb::FastLosslessDecoder decoder;
+    rfb::ServerParams server;
+    rdr::MemInStream is(encoded.data(), encoded.length());
+    rdr::MemOutStream buf;
+
+    server.setPF(pb->getPF());
+
+    ASSERT_TRUE(decoder.readRect(pb->getRect(), &is, server, &buf));
+    EXPECT_EQ(is.avail(), 0U);
+    decoder.decodeRect(pb->getRect(), buf.data(), buf.length(),
+                       server, pb);
+  }
+
+  void compare(const rfb::PixelBuffer* a, const rfb::PixelBuffer* b) {
+    const uint8_t *dataA, *dataB;
+    int strideA, strideB, bpp;
+
+    bpp = a->getPF().bpp/8;
+    dataA = a->getBuffer(a->getRect(), &strideA);
+    dataB = b->getBuffer(b->getRect(), &strideB);
+
+    for (int y = 0; y < a->height(); y++) {
+      ASSERT_EQ(memcmp(dataA + y * strideA * bpp,
+                       dataB + y * strideB * bpp,
+                       a->width() * bpp), 0) << "Row " << y;
+    }
+  }
+};
+
+TEST_P(FastLossless, roundTrip)
+{
+  rdr::MemOutStream os;
+  DummySConnection conn(&os);
+  rfb::FastLosslessEncoder encoder(&conn);
+  rfb::Palette palette;
+
+  // Odd sizes so that rows don't line up with the blocks
+  for (int pattern = 0; pattern < 2; pattern++) {
+    rfb::ManagedPixelBuffer src(GetParam(), 37, 19);
+    rfb::ManagedPixelBuffer dst(GetParam(), 37, 19);
+
+    fill(&src, pattern);
+
+    os.clear();
+    encoder.writeRect(&src, palette);
+    decode(os, &dst);
+
+    compare(&src, &dst);
+  }
+}
+
+TEST_P(FastLossless, solid)
+{
+  rdr::MemOutStream os;
+  DummySConnection conn(&os);
+  rfb::FastLosslessEncoder encoder(&conn);
+  rfb::ManagedPixelBuffer src(GetParam(), 100, 50);
+  rfb::ManagedPixelBuffer dst(GetParam(), 100, 50);
+  const uint8_t rgb[3] = { 0x12, 0x34, 0x56 };
+  uint8_t colour[4];
+
+  GetParam().bufferFromRGB(colour, rgb, 1);
+
+  src.fillRect(src.getRect(), colour);
+
+  encoder.writeSolidRect(src.width(), src.height(), src.getPF(),
+                         colour);
+  decode(os, &dst);
+
+  compare(&src, &dst);
+
+  // Should be little more than one header per block
+  EXPECT_LT(os.length(), 4U + 50 * 100 * 4 / 16 + 16);
+}
+
+TEST_P(FastLossless, truncated)
+{
+  rdr::MemOutStream os;
+  DummySConnection conn(&os);
+  rfb::FastLosslessEncoder encoder(&conn);
+  rfb::FastLosslessDecoder decoder;
+  rfb::ServerParams server;
+  rfb::Palette palette;
+  rfb::ManagedPixelBuffer src(GetParam(), 20, 20);
+  rfb::ManagedPixelBuffer dst(GetParam(), 20, 20);
+
+  fill(&src, 1);
+  encoder.writeRect(&src, palette);
+
+  server.setPF(GetParam());
+
+  // Skip the length and feed the decoder too little data
+  EXPECT_THROW(decoder.decodeRect(dst.getRect(), os.data() + 4,
+                                  os.length() - 5, server, &dst),
+               std::exception);
+}
+
+INSTANTIATE_TEST_SUITE_P(, FastLossless,
+                         testing::Values(rgb888, bgr888,
+                                         rgb565, rgb332));
@@ -0,0 +1,127 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <rdr/FdOutStream.h>
+
+// A loopback connection where nothing is read on the other end, so
+// the data backs up like on a slow link
+class FdOutStream : public testing::Test {
+protected:
+  void SetUp() override {
+    struct sockaddr_in addr;
+    socklen_t len;
+    int listener;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(listener, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(listener, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    ASSERT_EQ(listen(listener, 1), 0);
+
+    len = sizeof(addr);
+    ASSERT_EQ(getsockname(listener, (struct sockaddr*)&addr, &len), 0);
+
+    sender = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(sender, 0);
+    ASSERT_EQ(connect(sender, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    fcntl(sender, F_SETFL, O_NONBLOCK);
+
+    receiver = accept(listener, nullptr, nullptr);
+    ASSERT_GE(receiver, 0);
+
+    close(listener);
+  }
+
+  void TearDown() override {
+    close(sender);
+    close(receiver);
+  }
+
+  // Writes much more than the kernel buffers can hold
+  void fill(rdr::FdOutStream* os) {
+    std::vector<uint8_t> data(1024 * 1024);
+
+    for (int i = 0; i < 16; i++)
+      os->writeBytes(data.data(), data.size());
+    os->flush();
+  }
+
+  int sender, receiver;
+};
+
+TEST_F(FdOutStream, sendLowWater)
+{
+  rdr::FdOutStream os(sender);
+
+#ifndef TCP_NOTSENT_LOWAT
+  GTEST_SKIP() << "TCP_NOTSENT_LOWAT is not supported";
+#endif
+
+  ASSERT_TRUE(os.setSendLowWater(64 * 1024));
+
+  fill(&os);
+
+  // Whatever didn't fit is kept by us
+  EXPECT_TRUE(os.hasBufferedData());
+
+#ifdef SIOCOUTQNSD
+  int unsent;
+
+  // The kernel may go over a bit, but not by more than one write
+  ASSERT_EQ(ioctl(sender, SIOCOUTQNSD, &unsent), 0);
+  EXPECT_LE(unsent, 2 * 64 * 1024);
+#endif
+}
+
+TEST(FdOutStreamUnix, sendLowWater)
+{
+  int fds[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  rdr::FdOutStream os(fds[0]);
+
+  // Only applies to TCP
+  EXPECT_FALSE(os.setSendLowWater(64 * 1024));
+
+  close(fds[0]);
+  close(fds[1]);
+}
@@ -0,0 +1,129 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include <rfb/FramebufferMemory.h>
+#include <rfb/PixelBuffer.h>
+
+class FramebufferMemory : public testing::Test {
+protected:
+  void TearDown() override {
+    rfb::FramebufferMemory::hugePages.setParam("none");
+    rfb::FramebufferMemory::padRows.setParam(false);
+    rfb::FramebufferMemory::numaNode.setParam(-1);
+  }
+};
+
+TEST_F(FramebufferMemory, stride)
+{
+  rfb::FramebufferMemory::padRows.setParam(true);
+  EXPECT_EQ(rfb::FramebufferMemory::getStride(16, 32), 16);
+  EXPECT_EQ(rfb::FramebufferMemory::getStride(17, 32), 32);
+  EXPECT_EQ(rfb::FramebufferMemory::getStride(1, 16), 32);
+  EXPECT_EQ(rfb::FramebufferMemory::getStride(65, 8), 128);
+  // 24 bits per pixel can't be padded evenly
+  EXPECT_EQ(rfb::FramebufferMemory::getStride(17, 24), 17);
+
+  rfb::FramebufferMemory::padRows.setParam(false);
+  EXPECT_EQ(rfb::FramebufferMemory::getStride(17, 32), 17);
+}
+
+TEST_F(FramebufferMemory, alignment)
+{
+  rfb::FramebufferMemory memory;
+
+  memory.allocate(1000);
+  EXPECT_EQ((uintptr_t)memory.data() % 64, 0);
+  EXPECT_GE(memory.size(), 1000);
+
+  memory.release();
+  EXPECT_EQ(memory.data(), nullptr);
+  EXPECT_EQ(memory.size(), 0);
+}
+
+TEST_F(FramebufferMemory, hugePages)
+{
+  const size_t size = 5 * 1024 * 1024;
+
+  for (const char* mode : {"transparent", "explicit"}) {
+    rfb::FramebufferMemory memory;
+
+    // Explicit huge pages will fall back if none are reserved
+    rfb::FramebufferMemory::hugePages.setParam(mode);
+    memory.allocate(size);
+    ASSERT_NE(memory.data(), nullptr) << mode;
+    EXPECT_EQ((uintptr_t)memory.data() % 64, 0) << mode;
+
+    memset(memory.data(), 0xaa, size);
+    EXPECT_EQ(memory.data()[size - 1], 0xaa) << mode;
+  }
+}
+
+TEST_F(FramebufferMemory, numaNode)
+{
+  const size_t size = 100000;
+  rfb::FramebufferMemory memory;
+
+  // Binding may fail on this system, but the memory must still work
+  rfb::FramebufferMemory::numaNode.setParam(0);
+  memory.allocate(size);
+  ASSERT_NE(memory.data(), nullptr);
+  EXPECT_EQ((uintptr_t)memory.data() % 64, 0);
+
+  memset(memory.data(), 0xaa, size);
+  EXPECT_EQ(memory.data()[size - 1], 0xaa);
+
+  memory.release();
+  EXPECT_EQ(memory.data(), nullptr);
+}
+
+TEST_F(FramebufferMemory, pixelBuffer)
+{
+  rfb::PixelFormat pf(32, 24, false, true, 255, 255, 255, 0, 8, 16);
+  int stride;
+
+  rfb::FramebufferMemory::padRows.setParam(true);
+
+  rfb::ManagedPixelBuffer pb(pf, 17, 10);
+
+  pb.getBuffer(pb.getRect(), &stride);
+  EXPECT_EQ(stride, 32);
+  for (int y = 0; y < pb.height(); y++) {
+    const uint8_t* row = pb.getBuffer({0, y, 1, y + 1}, &stride);
+    EXPECT_EQ((uintptr_t)row % 64, 0);
+  }
+
+  // Growing must keep the layout consistent
+  pb.setSize(100, 20);
+  pb.getBuffer(pb.getRect(), &stride);
+  EXPECT_EQ(stride, 112);
+
+  uint32_t colour = 0x123456;
+  pb.fillRect(pb.getRect(), &colour);
+  uint32_t pix = 0;
+  pb.getImage(&pix, {99, 19, 100, 20});
+  EXPECT_EQ(pix, colour);
+}
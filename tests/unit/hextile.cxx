@@ -0,0 +1,221 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <core/Configuration.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+
+#include <rfb/HextileDecoder.h>
+#include <rfb/HextileEncoder.h>
+#include <rfb/Palette.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/ServerParams.h>
+
+static const rfb::PixelFormat rgb888(32, 24, false, true,
+                                     255, 255, 255, 16, 8, 0);
+static const rfb::PixelFormat rgb565(16, 16, false, true,
+                                     31, 63, 31, 11, 5, 0);
+static const rfb::PixelFormat rgb332(8, 8, false, true,
+                                     7, 7, 3, 5, 2, 0);
+
+namespace rfb {
+
+static std::ostream& operator<<(std::ostream& os, const PixelFormat& pf)
+{
+  char b[256];
+  pf.print(b, sizeof(b));
+  return os << b;
+}
+
+}
+
+class DummySConnection : public rfb::SConnection {
+public:
+  DummySConnection(rdr::OutStream* out)
+    : SConnection(rfb::AccessDefault) { setStreams(nullptr, out); }
+
+  void setAccessRights(rfb::AccessRights) override {}
+  void setDesktopSize(int, int, const rfb::ScreenSet&) override {}
+  void keyEvent(uint32_t, uint32_t, bool) override {}
+  void pointerEvent(const core::Point&, uint16_t) override {}
+};
+
+enum Pattern { Text, FewColours, Noise, Solid };
+
+class Hextile
+  : public testing::TestWithParam<std::tuple<rfb::PixelFormat, bool>> {
+protected:
+  void SetUp() override {
+    core::Configuration::setParam("ImprovedHextile",
+                                  std::get<1>(GetParam()) ? "1" : "0");
+  }
+
+  void TearDown() override {
+    core::Configuration::setParam("ImprovedHextile", "1");
+  }
+
+  // Fills via RGB so that any padding bits are consistent
+  void fill(rfb::ManagedPixelBuffer* pb, Pattern pattern) {
+    static const uint8_t colours[4][3] = {
+      { 0xff, 0xff, 0xff }, { 0x00, 0x00, 0x00 },
+      { 0x00, 0x00, 0xaa }, { 0xaa, 0x00, 0x00 },
+    };
+    std::vector<uint8_t> rgb(pb->width() * 3);
+    uint8_t* data;
+    int stride;
+
+    data = pb->getBufferRW(pb->getRect(), &stride);
+    stride *= pb->getPF().bpp/8;
+
+    srand(pattern);
+    for (int y = 0; y < pb->height(); y++) {
+      for (int x = 0; x < pb->width(); x++) {
+        const uint8_t* colour;
+
+        switch (pattern) {
+        case Text:
+          colour = colours[(rand() % 3) == 0 ? 1 : 0];
+          break;
+        case FewColours:
+          colour = colours[(x / 3 + y / 5) % 4];
+          break;
+        case Solid:
+          colour = colours[2];
+          break;
+        default:
+          colour = nullptr;
+        }
+
+        for (int i = 0; i < 3; i++)
+          rgb[x * 3 + i] = colour ? colour[i] : rand();
+      }
+      pb->getPF().bufferFromRGB(data + y * stride, rgb.data(),
+                                pb->width());
+    }
+
+    pb->commitBufferRW(pb->getRect());
+  }
+
+  // Runs the encoded data through the decoder like DecodeManager
+  // would
+  void decode(rdr::MemOutStream& encoded,
+              rfb::ModifiablePixelBuffer* pb) {
+    rfb::HextileDecoder decoder;
+    rfb::ServerParams server;
+    rdr::MemInStream is(encoded.data(), encoded.length());
+    rdr::MemOutStream buf;
+
+    server.setPF(pb->getPF());
+
+    ASSERT_TRUE(decoder.readRect(pb->getRect(), &is, server, &buf));
+    EXPECT_EQ(is.avail(), 0U);
+    decoder.decodeRect(pb->getRect(), buf.data(), buf.length(),
+                       server, pb);
+  }
+
+  void compare(const rfb::PixelBuffer* a, const rfb::PixelBuffer* b) {
+    const uint8_t *dataA, *dataB;
+    int strideA, strideB, bpp;
+
+    bpp = a->getPF().bpp/8;
+    dataA = a->getBuffer(a->getRect(), &strideA);
+    dataB = b->getBuffer(b->getRect(), &strideB);
+
+    for (int y = 0; y < a->height(); y++) {
+      ASSERT_EQ(memcmp(dataA + y * strideA * bpp,
+                       dataB + y * strideB * bpp,
+                       a->width() * bpp), 0) << "Row " << y;
+    }
+  }
+
+  size_t roundTrip(Pattern pattern, int width, int height) {
+    rdr::MemOutStream os;
+    DummySConnection conn(&os);
+    rfb::HextileEncoder encoder(&conn);
+    rfb::Palette palette;
+    rfb::PixelFormat pf;
+
+    pf = std::get<0>(GetParam());
+
+    rfb::ManagedPixelBuffer src(pf, width, height);
+    rfb::ManagedPixelBuffer dst(pf, width, height);
+
+    fill(&src, pattern);
+
+    encoder.writeRect(&src, palette);
+    decode(os, &dst);
+
+    compare(&src, &dst);
+
+    return os.length();
+  }
+};
+
+TEST_P(Hextile, text)
+{
+  size_t raw;
+
+  raw = 64 * 48 * std::get<0>(GetParam()).bpp/8;
+  EXPECT_LT(roundTrip(Text, 64, 48), raw);
+}
+
+TEST_P(Hextile, fewColours)
+{
+  roundTrip(FewColours, 64, 48);
+}
+
+TEST_P(Hextile, noise)
+{
+  roundTrip(Noise, 64, 48);
+}
+
+TEST_P(Hextile, solid)
+{
+  // One tile header and background colour, then empty tiles
+  EXPECT_LE(roundTrip(Solid, 64, 48), 1U + 4 + 11);
+}
+
+TEST_P(Hextile, partialTiles)
+{
+  // Odd sizes so that the edge tiles are narrower and shorter
+  roundTrip(Text, 37, 19);
+  roundTrip(FewColours, 37, 19);
+  roundTrip(Noise, 37, 19);
+  roundTrip(Text, 1, 2);
+  roundTrip(FewColours, 2, 1);
+}
+
+INSTANTIATE_TEST_SUITE_P(, Hextile,
+                         testing::Combine(testing::Values(rgb888,
+                                                          rgb565,
+                                                          rgb332),
+                                          testing::Bool()));
@@ -0,0 +1,167 @@
+/* Copyright (C) 2026 TigerVNC Team
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <rfb/ClientParams.h>
+#include <rfb/QualityControl.h>
+
+// Registers a second of updates that kept the client busy for the
+// given percentage of the time, with the given share spent decoding
+static bool runSecond(rfb::QualityControl* qc, unsigned load,
+                      unsigned decodeShare)
+{
+  for (int i = 0; i < 10; i++) {
+    qc->updateDone(load * 1000, 100000, load * decodeShare * 10);
+  }
+  return qc->adjust(1000);
+}
+
+TEST(QualityControl, reset)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  EXPECT_EQ(qc.getQuality(), 92);
+  EXPECT_EQ(qc.getQualityLevel(), 8);
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsampleNone);
+  EXPECT_EQ(qc.getRTT(), -1);
+
+  qc.reset(1000000);
+  EXPECT_EQ(qc.getQuality(), 79);
+  EXPECT_EQ(qc.getQualityLevel(), 6);
+}
+
+TEST(QualityControl, idle)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  EXPECT_FALSE(qc.adjust(1000));
+  EXPECT_FALSE(qc.adjust(1000));
+  EXPECT_FALSE(qc.adjust(1000));
+  EXPECT_EQ(qc.getQuality(), 92);
+}
+
+TEST(QualityControl, measurements)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  runSecond(&qc, 60, 50);
+  EXPECT_EQ(qc.getLoad(), 60);
+  EXPECT_EQ(qc.getDecodeShare(), 50);
+  EXPECT_EQ(qc.getFrameRate(), 10);
+  EXPECT_EQ(qc.getDecodeCost(), 300);
+
+  qc.gotRTT(20);
+  EXPECT_EQ(qc.getRTT(), 20);
+  qc.gotRTT(40);
+  EXPECT_EQ(qc.getRTT(), 25);
+}
+
+TEST(QualityControl, network)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  EXPECT_TRUE(runSecond(&qc, 100, 10));
+  EXPECT_EQ(qc.getQuality(), 82);
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsampleNone);
+
+  while (runSecond(&qc, 100, 10));
+  EXPECT_EQ(qc.getQuality(), 20);
+  EXPECT_EQ(qc.getCompressLevel(), 6);
+  EXPECT_EQ(qc.getQualityLevel(), 0);
+}
+
+TEST(QualityControl, decoder)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  EXPECT_TRUE(runSecond(&qc, 100, 90));
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsample2X);
+  EXPECT_EQ(qc.getQuality(), 92);
+  EXPECT_TRUE(runSecond(&qc, 100, 90));
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsample4X);
+  EXPECT_TRUE(runSecond(&qc, 100, 90));
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsample4X);
+  EXPECT_EQ(qc.getQuality(), 82);
+}
+
+TEST(QualityControl, improve)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  runSecond(&qc, 100, 90);
+  runSecond(&qc, 100, 90);
+  ASSERT_EQ(qc.getSubsampling(), rfb::subsample4X);
+
+  // Needs a sustained low load
+  EXPECT_FALSE(runSecond(&qc, 10, 10));
+  EXPECT_TRUE(runSecond(&qc, 10, 10));
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsample2X);
+
+  // Moderate load interrupts it
+  EXPECT_FALSE(runSecond(&qc, 10, 10));
+  EXPECT_FALSE(runSecond(&qc, 60, 10));
+  EXPECT_FALSE(runSecond(&qc, 10, 10));
+  EXPECT_TRUE(runSecond(&qc, 10, 10));
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsampleNone);
+
+  runSecond(&qc, 10, 10);
+  EXPECT_TRUE(runSecond(&qc, 10, 10));
+  EXPECT_EQ(qc.getQuality(), 95);
+}
+
+TEST(QualityControl, expensiveDecoding)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  runSecond(&qc, 100, 90);
+  runSecond(&qc, 100, 90);
+  ASSERT_EQ(qc.getSubsampling(), rfb::subsample4X);
+
+  // Idle, but only because the updates are small
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 10; i++)
+      qc.updateDone(10000, 1000, 1000);
+    EXPECT_FALSE(qc.adjust(1000));
+  }
+  EXPECT_EQ(qc.getDecodeCost(), 1000);
+  EXPECT_EQ(qc.getSubsampling(), rfb::subsample4X);
+  EXPECT_EQ(qc.getQuality(), 92);
+}
+
+TEST(QualityControl, lan)
+{
+  rfb::QualityControl qc;
+
+  qc.reset(100000000);
+  qc.gotRTT(1);
+  runSecond(&qc, 10, 10);
+  EXPECT_TRUE(runSecond(&qc, 10, 10));
+  EXPECT_EQ(qc.getCompressLevel(), 1);
+}
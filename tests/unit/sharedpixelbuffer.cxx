@@ -0,0 +1,127 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtest/gtest.h>
+
+#include <rdr/MemOutStream.h>
+
+#include <rfb/ServerParams.h>
+#include <rfb/SharedMemoryDecoder.h>
+#include <rfb/SharedPixelBuffer.h>
+
+static const rfb::PixelFormat fbPF(32, 24, false, true,
+                                   255, 255, 255, 0, 8, 16);
+static const rfb::PixelFormat otherPF(16, 16, false, true,
+                                      31, 63, 31, 11, 5, 0);
+
+static void fill(rfb::ModifiablePixelBuffer* pb, const core::Rect& r,
+                 uint32_t colour)
+{
+  pb->fillRect(r, &colour);
+}
+
+static uint32_t pixel(const rfb::PixelBuffer* pb, int x, int y)
+{
+  uint32_t pix = 0;
+  pb->getImage(&pix, {x, y, x+1, y+1});
+  return pix;
+}
+
+class SharedPixelBuffer : public testing::Test {
+protected:
+  void SetUp() override {
+    if (!rfb::SharedPixelBuffer::isSupported())
+      GTEST_SKIP() << "Shared framebuffers not supported here";
+  }
+
+  // Runs a rect through the decoder like DecodeManager would
+  void decode(rfb::SharedMemoryDecoder* decoder, const core::Rect& r,
+              uint32_t serial, rfb::ModifiablePixelBuffer* pb) {
+    rdr::MemOutStream buf;
+    rfb::ServerParams server;
+
+    buf.writeU32(serial);
+    decoder->decodeRect(r, buf.data(), buf.length(), server, pb);
+  }
+};
+
+TEST_F(SharedPixelBuffer, attach)
+{
+  rfb::SharedPixelBuffer fb(fbPF, 64, 32);
+
+  fill(&fb, fb.getRect(), 0x123456);
+  fill(&fb, {10, 10, 20, 20}, 0xabcdef);
+
+  rfb::SharedPixelBuffer view(fbPF, 64, 32, fb.getPid(), fb.getFd());
+
+  EXPECT_EQ(pixel(&view, 0, 0), 0x123456U);
+  EXPECT_EQ(pixel(&view, 15, 15), 0xabcdefU);
+
+  // Same memory, not a copy
+  fill(&fb, {0, 0, 1, 1}, 0x654321);
+  EXPECT_EQ(pixel(&view, 0, 0), 0x654321U);
+}
+
+TEST_F(SharedPixelBuffer, tooBig)
+{
+  rfb::SharedPixelBuffer fb(fbPF, 64, 32);
+
+  EXPECT_THROW(rfb::SharedPixelBuffer(fbPF, 64, 64,
+                                      fb.getPid(), fb.getFd()),
+               std::exception);
+}
+
+TEST_F(SharedPixelBuffer, decode)
+{
+  rfb::SharedPixelBuffer* fb;
+  rfb::SharedMemoryDecoder decoder;
+  rfb::ManagedPixelBuffer pb(otherPF, 64, 32);
+
+  fb = new rfb::SharedPixelBuffer(fbPF, 64, 32);
+  fill(fb, fb->getRect(), 0x0000ff);
+  fill(fb, {8, 8, 16, 16}, 0xff0000);
+
+  fill(&pb, pb.getRect(), 0);
+
+  // Nothing attached yet, so nothing should happen
+  decode(&decoder, {8, 8, 16, 16}, 1, &pb);
+  EXPECT_EQ(pixel(&pb, 8, 8), 0U);
+
+  decoder.setBuffer(new rfb::SharedPixelBuffer(fbPF, 64, 32,
+                                               fb->getPid(),
+                                               fb->getFd()), 1);
+
+  decode(&decoder, {8, 8, 16, 16}, 1, &pb);
+  EXPECT_EQ(pixel(&pb, 7, 7), 0U);
+  EXPECT_EQ(pixel(&pb, 8, 8), 0x001fU);
+  EXPECT_EQ(pixel(&pb, 15, 15), 0x001fU);
+  EXPECT_EQ(pixel(&pb, 16, 16), 0U);
+
+  // Meant for some other buffer
+  decode(&decoder, {0, 0, 8, 8}, 2, &pb);
+  EXPECT_EQ(pixel(&pb, 0, 0), 0U);
+
+  EXPECT_THROW(decode(&decoder, {60, 0, 70, 8}, 1, &pb),
+               std::exception);
+
+  delete fb;
+}
@@ -0,0 +1,175 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <core/Rect.h>
+
+#include "TileDamage.h"
+
+static const int tileSize = 1 << TileDamage::tileShift;
+
+// What take() should give for this exact bounding box
+static core::Rect roundToTiles(const core::Rect& r, int width, int height)
+{
+  core::Rect tiles;
+
+  if (r.is_empty())
+    return r;
+
+  tiles.tl.x = r.tl.x / tileSize * tileSize;
+  tiles.tl.y = r.tl.y / tileSize * tileSize;
+  tiles.br.x = (r.br.x + tileSize - 1) / tileSize * tileSize;
+  tiles.br.y = (r.br.y + tileSize - 1) / tileSize * tileSize;
+
+  return tiles.intersect({0, 0, width, height});
+}
+
+static core::Rect randomRect(int width, int height)
+{
+  int x, y, w, h;
+
+  x = rand() % width;
+  y = rand() % height;
+  w = rand() % (width - x) + 1;
+  h = rand() % (height - y) + 1;
+
+  // Mostly small, like glyphs and tiles from the decoders
+  if (rand() % 4) {
+    w = std::min(w, 1 + rand() % 40);
+    h = std::min(h, 1 + rand() % 40);
+  }
+
+  return {x, y, x + w, y + h};
+}
+
+TEST(TileDamage, empty)
+{
+  TileDamage damage(100, 100);
+
+  EXPECT_TRUE(damage.take().is_empty());
+
+  damage.add({10, 10, 10, 20});
+  EXPECT_TRUE(damage.take().is_empty());
+}
+
+TEST(TileDamage, roundsToTiles)
+{
+  TileDamage damage(100, 100);
+
+  damage.add({5, 5, 6, 6});
+  EXPECT_EQ(damage.take(), core::Rect(0, 0, 16, 16));
+
+  damage.add({16, 16, 33, 32});
+  EXPECT_EQ(damage.take(), core::Rect(16, 16, 48, 32));
+}
+
+TEST(TileDamage, clipsToSize)
+{
+  TileDamage damage(100, 50);
+
+  damage.add({90, 40, 100, 50});
+  EXPECT_EQ(damage.take(), core::Rect(80, 32, 100, 50));
+}
+
+TEST(TileDamage, clearsOnTake)
+{
+  TileDamage damage(100, 100);
+
+  damage.add({0, 0, 100, 100});
+  EXPECT_EQ(damage.take(), core::Rect(0, 0, 100, 100));
+  EXPECT_TRUE(damage.take().is_empty());
+}
+
+TEST(TileDamage, wordBoundaries)
+{
+  // Three words of tiles per row
+  TileDamage damage(64 * tileSize * 2 + 50, 20);
+
+  // Last tile of the first word and first tile of the second
+  damage.add({63 * tileSize + 1, 0, 64 * tileSize + 1, 1});
+  EXPECT_EQ(damage.take(),
+            core::Rect(63 * tileSize, 0, 65 * tileSize, 16));
+
+  // All of the middle word
+  damage.add({64 * tileSize, 17, 128 * tileSize, 18});
+  EXPECT_EQ(damage.take(),
+            core::Rect(64 * tileSize, 16, 128 * tileSize, 20));
+
+  // Across all three
+  damage.add({10, 5, 64 * tileSize * 2 + 50, 6});
+  EXPECT_EQ(damage.take(),
+            core::Rect(0, 0, 64 * tileSize * 2 + 50, 16));
+}
+
+TEST(TileDamage, random)
+{
+  srand(1);
+
+  for (int i = 0; i < 1000; i++) {
+    int width, height, count;
+    core::Rect bounds;
+
+    width = 1 + rand() % 3000;
+    height = 1 + rand() % 1200;
+
+    TileDamage damage(width, height);
+
+    count = rand() % 20;
+    for (int j = 0; j < count; j++) {
+      core::Rect r;
+
+      r = randomRect(width, height);
+      damage.add(r);
+      bounds = bounds.union_boundary(r);
+    }
+
+    ASSERT_EQ(damage.take(), roundToTiles(bounds, width, height))
+      << "Iteration " << i << ", " << width << "x" << height;
+    ASSERT_TRUE(damage.take().is_empty());
+  }
+}
+
+TEST(TileDamage, threads)
+{
+  TileDamage damage(1920, 1080);
+  std::vector<std::thread> threads;
+
+  // Each thread fills in its own column, all sharing words
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&damage, i]() {
+      for (int y = 0; y < 1080; y += 8)
+        damage.add({i * tileSize, y, i * tileSize + 1, y + 1});
+    });
+  }
+
+  for (std::thread& thread : threads)
+    thread.join();
+
+  EXPECT_EQ(damage.take(), core::Rect(0, 0, 4 * tileSize, 1080));
+}
@@ -220,6 +220,31 @@ TEST(Unicode, utf8ToLatin1)
     EXPECT_EQ(core::utf8ToLatin1(latin1utf8[i].utf8), latin1utf8[i].latin1);
 }
 
+TEST(Unicode, utf8ToLatin1Buffer)
+{
+  std::string in, expected, out;
+
+  // Long enough to go through the fast paths
+  for (int i = 0; i < 50; i++) {
+    in += "r\xc3\xa4ksm\xc3\xb6rg\xc3\xa5s\n";
+    expected += "r\xe4ksm\xf6rg\xe5s\n";
+  }
+
+  EXPECT_TRUE(core::utf8ToLatin1(in.c_str(), (size_t)-1, &out));
+  EXPECT_EQ(out, expected);
+
+  // Valid, but not representable
+  EXPECT_TRUE(core::utf8ToLatin1("\xe6\x97\xa5", 3, &out));
+  EXPECT_EQ(out, "?");
+
+  EXPECT_FALSE(core::utf8ToLatin1("\xe5\xe4\xf6", 3, &out));
+  EXPECT_EQ(out, "??");
+
+  // Whatever cut the sequence short still needs converting
+  EXPECT_FALSE(core::utf8ToLatin1("\xe5\n", 2, &out));
+  EXPECT_EQ(out, "?\n");
+}
+
 TEST(Unicode, utf8ToAscii)
 {
   size_t i;
@@ -0,0 +1,229 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+#include <rdr/ZlibInStream.h>
+#include <rdr/ZlibOutStream.h>
+
+// Something that compresses well, so that later data refers back to
+// earlier data
+static std::string makeData(char seed)
+{
+  std::string data;
+
+  for (int i = 0; i < 4096; i++)
+    data += (char)(seed + (i % 7) + (i / 512));
+
+  return data;
+}
+
+// Writes and flushes a block like an encoder would
+static void compress(rdr::ZlibOutStream* zos, rdr::MemOutStream* out,
+                     const std::string& data)
+{
+  zos->setUnderlying(out);
+  zos->writeBytes((const uint8_t*)data.data(), data.size());
+  zos->flush();
+  zos->setUnderlying(nullptr);
+}
+
+static std::string decompress(rdr::MemOutStream& out, size_t len)
+{
+  rdr::MemInStream mis(out.data(), out.length());
+  rdr::ZlibInStream zis;
+  std::vector<uint8_t> buf(len);
+
+  zis.setUnderlying(&mis, out.length());
+  for (size_t i = 0; i < len; i += 256) {
+    size_t chunk = std::min(len - i, (size_t)256);
+    if (!zis.hasData(chunk))
+      break;
+    zis.readBytes(buf.data() + i, chunk);
+  }
+  zis.flushUnderlying();
+
+  EXPECT_EQ(mis.avail(), 0U);
+
+  return std::string((const char*)buf.data(), len);
+}
+
+TEST(ZlibOutStream, rollback)
+{
+  rdr::ZlibOutStream zos;
+  rdr::MemOutStream sent, thrown;
+  std::string a, b, c;
+
+  a = makeData('a');
+  b = makeData('b');
+  c = makeData('c');
+
+  compress(&zos, &sent, a);
+
+  zos.checkpoint();
+  compress(&zos, &thrown, b);
+  EXPECT_GT(thrown.length(), 0U);
+  zos.rollback();
+
+  compress(&zos, &sent, c);
+
+  EXPECT_EQ(decompress(sent, a.size() + c.size()), a + c);
+}
+
+TEST(ZlibOutStream, commit)
+{
+  rdr::ZlibOutStream zos;
+  rdr::MemOutStream sent;
+  std::string a, b, c;
+
+  a = makeData('a');
+  b = makeData('b');
+  c = makeData('c');
+
+  compress(&zos, &sent, a);
+
+  zos.checkpoint();
+  compress(&zos, &sent, b);
+  zos.commit();
+
+  compress(&zos, &sent, c);
+
+  EXPECT_EQ(decompress(sent, a.size() + b.size() + c.size()), a + b + c);
+}
+
+TEST(ZlibOutStream, rollbackUnused)
+{
+  rdr::ZlibOutStream zos;
+  rdr::MemOutStream sent;
+  std::string a, c;
+
+  a = makeData('a');
+  c = makeData('c');
+
+  compress(&zos, &sent, a);
+
+  zos.checkpoint();
+  zos.rollback();
+
+  compress(&zos, &sent, c);
+
+  EXPECT_EQ(decompress(sent, a.size() + c.size()), a + c);
+}
+
+TEST(ZlibOutStream, rollbackLevel)
+{
+  rdr::ZlibOutStream zos(nullptr, 1);
+  rdr::MemOutStream sent, thrown;
+  std::string a, b, c;
+
+  a = makeData('a');
+  b = makeData('b');
+  c = makeData('c');
+
+  compress(&zos, &sent, a);
+
+  zos.checkpoint();
+  zos.setCompressionLevel(9);
+  compress(&zos, &thrown, b);
+  zos.rollback();
+
+  // The level change has to be redone on the restored state
+  compress(&zos, &sent, c);
+
+  zos.setCompressionLevel(1);
+  compress(&zos, &sent, a);
+
+  EXPECT_EQ(decompress(sent, a.size() * 2 + c.size()), a + c + a);
+}
+
+// Inflates everything like ZRLEDecoder does, without knowing the size
+// of the output beforehand
+static std::string inflateAll(rdr::ZlibInStream* zis)
+{
+  std::string data;
+
+  while (zis->hasData(1)) {
+    size_t chunk = zis->avail();
+    data.append((const char*)zis->getptr(chunk), chunk);
+    zis->setptr(chunk);
+  }
+
+  return data;
+}
+
+TEST(ZlibInStream, endOfInput)
+{
+  rdr::ZlibOutStream zos;
+  rdr::MemOutStream out;
+  rdr::ZlibInStream zis;
+  std::string a;
+  size_t len;
+
+  a = makeData('a');
+
+  compress(&zos, &out, a);
+  len = out.length();
+
+  // The next message, which must be left alone
+  out.writeBytes((const uint8_t*)"next", 4);
+
+  rdr::MemInStream mis(out.data(), out.length());
+
+  zis.setUnderlying(&mis, len);
+  EXPECT_EQ(inflateAll(&zis), a);
+  EXPECT_FALSE(zis.hasData(1));
+  zis.flushUnderlying();
+  zis.setUnderlying(nullptr, 0);
+
+  EXPECT_EQ(mis.avail(), 4U);
+}
+
+TEST(ZlibInStream, pendingOutput)
+{
+  rdr::ZlibOutStream zos;
+  rdr::MemOutStream out;
+  rdr::ZlibInStream zis;
+  std::string a;
+
+  // Compresses to much less than the stream's buffer, so all input is
+  // consumed long before all output has been produced
+  a = std::string(1024 * 1024, 'a');
+
+  compress(&zos, &out, a);
+
+  rdr::MemInStream mis(out.data(), out.length());
+
+  zis.setUnderlying(&mis, out.length());
+  EXPECT_EQ(inflateAll(&zis), a);
+  zis.flushUnderlying();
+  zis.setUnderlying(nullptr, 0);
+
+  EXPECT_EQ(mis.avail(), 0U);
+}
@@ -0,0 +1,197 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <rdr/MemInStream.h>
+#include <rdr/MemOutStream.h>
+#include <rdr/ZlibInStream.h>
+
+#include <rfb/Palette.h>
+#include <rfb/PixelBuffer.h>
+#include <rfb/SConnection.h>
+#include <rfb/ServerParams.h>
+#include <rfb/ZRLEDecoder.h>
+#include <rfb/ZRLEEncoder.h>
+
+static const rfb::PixelFormat rgb888(32, 24, false, true,
+                                     255, 255, 255, 16, 8, 0);
+
+class DummySConnection : public rfb::SConnection {
+public:
+  DummySConnection(rdr::OutStream* out)
+    : SConnection(rfb::AccessDefault) { setStreams(nullptr, out); }
+
+  void setAccessRights(rfb::AccessRights) override {}
+  void setDesktopSize(int, int, const rfb::ScreenSet&) override {}
+  void keyEvent(uint32_t, uint32_t, bool) override {}
+  void pointerEvent(const core::Point&, uint16_t) override {}
+};
+
+enum Pattern { Solid, Checkers, Halves, ManyRuns, Noise };
+
+class ZRLE : public testing::Test {
+protected:
+  void fill(rfb::ManagedPixelBuffer* pb, Pattern pattern) {
+    uint32_t* data;
+    int stride;
+
+    data = (uint32_t*)pb->getBufferRW(pb->getRect(), &stride);
+
+    srand(pattern);
+    for (int y = 0; y < pb->height(); y++) {
+      for (int x = 0; x < pb->width(); x++) {
+        uint32_t pixel;
+
+        switch (pattern) {
+        case Solid:
+          pixel = 0x0000aa;
+          break;
+        case Checkers:
+          pixel = ((x + y) % 2) ? 0xffffff : 0x000000;
+          break;
+        case Halves:
+          pixel = ((x % 64) < 32) ? 0xffffff : 0x000000;
+          break;
+        case ManyRuns:
+          // More colours than a palette can hold, but in long runs
+          pixel = ((y % 64) * 2 + (x % 64) / 32) * 0x010101;
+          break;
+        default:
+          pixel = rand() & 0xffffff;
+        }
+
+        data[y * stride + x] = pixel;
+      }
+    }
+
+    pb->commitBufferRW(pb->getRect());
+  }
+
+  // Encodes the pattern and checks that it decodes to the same thing,
+  // returning the subencoding of the first tile
+  int roundTrip(Pattern pattern, int width, int height) {
+    rdr::MemOutStream os;
+    DummySConnection conn(&os);
+    rfb::ZRLEEncoder encoder(&conn);
+    rfb::Palette palette;
+
+    rfb::ManagedPixelBuffer src(rgb888, width, height);
+    rfb::ManagedPixelBuffer dst(rgb888, width, height);
+
+    fill(&src, pattern);
+
+    encoder.writeRect(&src, palette);
+
+    decode(os, &dst);
+    compare(&src, &dst);
+
+    return subencoding(os);
+  }
+
+  void decode(rdr::MemOutStream& encoded,
+              rfb::ModifiablePixelBuffer* pb) {
+    rfb::ZRLEDecoder decoder;
+    rfb::ServerParams server;
+    rdr::MemInStream is(encoded.data(), encoded.length());
+    rdr::MemOutStream buf;
+
+    server.setPF(pb->getPF());
+
+    ASSERT_TRUE(decoder.readRect(pb->getRect(), &is, server, &buf));
+    EXPECT_EQ(is.avail(), 0U);
+    decoder.decodeRect(pb->getRect(), buf.data(), buf.length(),
+                       server, pb);
+  }
+
+  int subencoding(rdr::MemOutStream& encoded) {
+    rdr::MemInStream is(encoded.data(), encoded.length());
+    rdr::ZlibInStream zis;
+    size_t length;
+    int type;
+
+    if (!is.hasData(4))
+      return -1;
+    length = is.readU32();
+
+    zis.setUnderlying(&is, length);
+    if (!zis.hasData(1))
+      return -1;
+    type = zis.readU8();
+    zis.flushUnderlying();
+
+    return type;
+  }
+
+  void compare(const rfb::PixelBuffer* a, const rfb::PixelBuffer* b) {
+    const uint8_t *dataA, *dataB;
+    int strideA, strideB;
+
+    dataA = a->getBuffer(a->getRect(), &strideA);
+    dataB = b->getBuffer(b->getRect(), &strideB);
+
+    for (int y = 0; y < a->height(); y++) {
+      ASSERT_EQ(memcmp(dataA + y * strideA * 4,
+                       dataB + y * strideB * 4,
+                       a->width() * 4), 0) << "Row " << y;
+    }
+  }
+};
+
+TEST_F(ZRLE, solid)
+{
+  EXPECT_EQ(roundTrip(Solid, 64, 64), 1);
+}
+
+TEST_F(ZRLE, packedPalette)
+{
+  // Runs of one pixel are cheaper as packed indexes
+  EXPECT_EQ(roundTrip(Checkers, 64, 64), 2);
+}
+
+TEST_F(ZRLE, paletteRLE)
+{
+  EXPECT_EQ(roundTrip(Halves, 64, 64), 128 | 2);
+}
+
+TEST_F(ZRLE, plainRLE)
+{
+  EXPECT_EQ(roundTrip(ManyRuns, 64, 64), 128);
+}
+
+TEST_F(ZRLE, raw)
+{
+  EXPECT_EQ(roundTrip(Noise, 64, 64), 0);
+}
+
+TEST_F(ZRLE, manyTiles)
+{
+  // Big enough to be split between threads, if there are any
+  roundTrip(Halves, 300, 200);
+  roundTrip(ManyRuns, 300, 200);
+  roundTrip(Noise, 300, 200);
+}
@@ -93,9 +93,9 @@ bool XSelection::selectionRequest(Window requestor, Atom selection, Atom target,
     return false;
 
   if (target == XA_STRING) {
-    std::string latin1 = core::utf8ToLatin1(clientData.data(), clientData.length());
+    core::utf8ToLatin1(clientData.data(), clientData.length(), &latin1Data);
     XChangeProperty(dpy, requestor, property, XA_STRING, 8, PropModeReplace,
-                    (unsigned char*)latin1.data(), latin1.length());
+                    (unsigned char*)latin1Data.data(), latin1Data.length());
     return true;
   }
 
@@ -191,8 +191,8 @@ void XSelection::selectionNotify(XSelectionEvent* ev, Atom type, int format,
       std::string result = core::convertLF((char*)data, nitems);
       handler->handleXSelectionData(result.c_str());
     } else if (type == XA_STRING) {
-      std::string result = core::convertLF((char*)data, nitems);
-      result = core::latin1ToUTF8(result.data(), result.length());
+      std::string result;
+      core::latin1ToUTF8LF((char*)data, nitems, &result);
       handler->handleXSelectionData(result.c_str());
     }
   }
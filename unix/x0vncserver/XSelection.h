@@ -45,6 +45,7 @@ private:
   Atom timestampProperty;
   Atom announcedSelection;
   std::string clientData; // Always in UTF-8
+  std::string latin1Data; // Scratch space for STRING requests
 
   Time getXServerTime();
   void announceSelection(Atom selection);
@@ -24,6 +24,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <map>
+#include <string>
+
 #include <core/Configuration.h>
 #include <core/Logger_stdio.h>
 #include <core/Logger_syslog.h>
@@ -32,6 +35,7 @@
 
 #include <network/TcpSocket.h>
 
+#include <rfb/FramebufferMemory.h>
 #include <rfb/UnixPasswordValidator.h>
 
 #include "RFBGlue.h"
@@ -40,6 +44,12 @@
 static core::LogWriter inputLog("Input");
 static core::LogWriter selectionLog("Selection");
 
+static std::map<void*, rfb::FramebufferMemory*> framebuffers;
+
+// Scratch space for clipboard conversions, kept around so that its
+// memory can be reused
+static std::string convertBuffer;
+
 void vncInitRFB(void)
 {
   core::initStdIOLoggers();
@@ -210,10 +220,11 @@ char* vncConvertLF(const char* src, size_t bytes)
   }
 }
 
-char* vncLatin1ToUTF8(const char* src, size_t bytes)
+char* vncLatin1ToUTF8LF(const char* src, size_t bytes)
 {
   try {
-    return strdup(core::latin1ToUTF8(src, bytes).c_str());
+    core::latin1ToUTF8LF(src, bytes, &convertBuffer);
+    return strdup(convertBuffer.c_str());
   } catch (...) {
     return nullptr;
   }
@@ -222,7 +233,8 @@ char* vncLatin1ToUTF8(const char* src, size_t bytes)
 char* vncUTF8ToLatin1(const char* src, size_t bytes)
 {
   try {
-    return strdup(core::utf8ToLatin1(src, bytes).c_str());
+    core::utf8ToLatin1(src, bytes, &convertBuffer);
+    return strdup(convertBuffer.c_str());
   } catch (...) {
     return nullptr;
   }
@@ -243,3 +255,37 @@ void vncSetDisplayName(const char *displayNumStr)
   displayName += displayNumStr;
   rfb::UnixPasswordValidator::setDisplayName(displayName);
 }
+
+void* vncAllocFramebuffer(size_t size)
+{
+  rfb::FramebufferMemory* memory;
+
+  memory = new rfb::FramebufferMemory();
+  try {
+    memory->allocate(size);
+  } catch (...) {
+    delete memory;
+    return nullptr;
+  }
+
+  framebuffers[memory->data()] = memory;
+
+  return memory->data();
+}
+
+void vncFreeFramebuffer(void* data)
+{
+  std::map<void*, rfb::FramebufferMemory*>::iterator iter;
+
+  iter = framebuffers.find(data);
+  if (iter == framebuffers.end())
+    return;
+
+  delete iter->second;
+  framebuffers.erase(iter);
+}
+
+int vncFramebufferStride(int width, int bpp)
+{
+  return rfb::FramebufferMemory::getStride(width, bpp);
+}
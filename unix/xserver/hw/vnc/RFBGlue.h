@@ -50,13 +50,17 @@ int vncIsTCPPortUsed(int port);
 
 char* vncConvertLF(const char* src, size_t bytes);
 
-char* vncLatin1ToUTF8(const char* src, size_t bytes);
+char* vncLatin1ToUTF8LF(const char* src, size_t bytes);
 char* vncUTF8ToLatin1(const char* src, size_t bytes);
 
 int vncIsValidUTF8(const char* str, size_t bytes);
 
 void vncSetDisplayName(const char *displayNumStr);
 
+void* vncAllocFramebuffer(size_t size);
+void vncFreeFramebuffer(void* data);
+int vncFramebufferStride(int width, int bpp);
+
 #ifdef __cplusplus
 }
 #endif
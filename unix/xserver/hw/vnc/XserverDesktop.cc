@@ -35,6 +35,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/time.h>
 #include <sys/utsname.h>
 
 #include <core/Configuration.h>
@@ -63,6 +64,11 @@ void vncPresentMscEvent(uint64_t id, uint64_t msc);
 
 static core::LogWriter vlog("XserverDesktop");
 
+// Reading back the screen has a fixed cost per call, so damaged rects
+// are merged in to bands as long as that doesn't read more than this
+// many times the damaged area
+static const int MaxBandOverhead = 2;
+
 core::BoolParameter
   rawKeyboard("RawKeyboard",
               "Send keyboard events straight through and avoid mapping "
@@ -95,6 +101,9 @@ XserverDesktop::XserverDesktop(int screenIndex_,
 
 XserverDesktop::~XserverDesktop()
 {
+  for (const auto& entry : sockets)
+    entry.second->outStream().setCallback(nullptr);
+
   while (!listeners.empty()) {
     vncRemoveNotifyFd(listeners.back()->getFd());
     delete listeners.back();
@@ -132,6 +141,10 @@ void XserverDesktop::setFramebuffer(int w, int h, void* fbptr, int stride_)
 
   setBuffer(w, h, (uint8_t*)fbptr, stride_);
 
+  // Nothing has been read back yet
+  shadowStale = getRect();
+  shadowCopied.clear();
+
   vncSetGlueContext(screenIndex);
   layout = ::computeScreenLayout(&outputIdMap);
 
@@ -286,6 +299,11 @@ void XserverDesktop::setCursorPos(int x, int y, bool warped)
 
 void XserverDesktop::add_changed(const core::Region& region)
 {
+  if (shadowFramebuffer) {
+    shadowStale.assign_union(region);
+    shadowCopied.assign_subtract(region);
+  }
+
   try {
     server->add_changed(region);
   } catch (std::exception& e) {
@@ -296,6 +314,27 @@ void XserverDesktop::add_changed(const core::Region& region)
 void XserverDesktop::add_copied(const core::Region& dest,
                                 const core::Point& delta)
 {
+  if (shadowFramebuffer) {
+    // Redo the copy in the shadow framebuffer so it doesn't have to be
+    // read back, except where the source hasn't been read back either
+    core::Region invalid;
+    std::vector<core::Rect> rects;
+
+    invalid = dest;
+    invalid.translate(delta.negate());
+    invalid = invalid.intersect(shadowStale);
+    invalid.translate(delta);
+
+    dest.get_rects(&rects, delta.x <= 0, delta.y <= 0);
+    for (const core::Rect& rect : rects)
+      copyRect(rect, delta);
+
+    shadowStale.assign_subtract(dest);
+    shadowStale.assign_union(invalid);
+    shadowCopied.assign_union(dest);
+    shadowCopied.assign_subtract(invalid);
+  }
+
   try {
     server->add_copied(dest, delta);
   } catch (std::exception& e) {
@@ -338,34 +377,53 @@ bool XserverDesktop::handleListenerEvent(int fd)
     delete sock;
     return true;
   }
-  vncSetNotifyFd(sock->getFd(), screenIndex, true, false);
+  watchSocket(sock);
 
   return true;
 }
 
 bool XserverDesktop::handleSocketReadWrite(int fd, bool read, bool write)
 {
-  std::list<network::Socket*> sockets;
-  std::list<network::Socket*>::iterator i;
-
-  server->getSockets(&sockets);
-  for (i = sockets.begin(); i != sockets.end(); i++) {
-    if ((*i)->getFd() == fd)
-      break;
-  }
+  std::map<int, network::Socket*>::iterator i;
+  network::Socket* sock;
 
+  i = sockets.find(fd);
   if (i == sockets.end())
     return false;
 
+  sock = i->second;
+
   if (read)
-    server->processSocketReadEvent(*i);
+    server->processSocketReadEvent(sock);
 
   if (write)
-    server->processSocketWriteEvent(*i);
+    server->processSocketWriteEvent(sock);
+
+  // A closed socket is always readable, so this also catches sockets
+  // that were shut down by a timer
+  if (sock->isShutdownRead())
+    closedSockets.insert(sock);
 
   return true;
 }
 
+void XserverDesktop::watchSocket(network::Socket* sock)
+{
+  int fd = sock->getFd();
+
+  sockets[fd] = sock;
+  sock->outStream().setCallback(this);
+  vncSetNotifyFd(fd, screenIndex, true,
+                 sock->outStream().hasBufferedData());
+}
+
+void XserverDesktop::bufferedDataChanged(rdr::BufferedOutStream* stream)
+{
+  // We can get here from inside the X server's fd notification, so
+  // the actual update is left for the block handler
+  pendingNotify.insert(static_cast<rdr::FdOutStream*>(stream)->getFd());
+}
+
 void XserverDesktop::blockHandler(int* timeout)
 {
   // We don't have a good callback for when we can init input devices[1],
@@ -375,23 +433,18 @@ void XserverDesktop::blockHandler(int* timeout)
   vncInitInputDevice();
 
   try {
-    std::list<network::Socket*> sockets;
-    std::list<network::Socket*>::iterator i;
-    server->getSockets(&sockets);
-    for (i = sockets.begin(); i != sockets.end(); i++) {
-      int fd = (*i)->getFd();
-
-      if ((*i)->isShutdownRead()) {
-        vlog.debug("Client gone, sock %d",fd);
-        vncRemoveNotifyFd(fd);
-        server->removeSocket(*i);
-        vncClientGone(fd);
-        delete (*i);
-      }
-
-      /* Update existing NotifyFD to listen for write (or not) */
-      vncSetNotifyFd(fd, screenIndex, true, (*i)->outStream().hasBufferedData());
+    for (network::Socket* sock : closedSockets) {
+      int fd = sock->getFd();
+
+      vlog.debug("Client gone, sock %d",fd);
+      vncRemoveNotifyFd(fd);
+      server->removeSocket(sock);
+      vncClientGone(fd);
+      sockets.erase(fd);
+      pendingNotify.erase(fd);
+      delete sock;
     }
+    closedSockets.clear();
 
     // We are responsible for propagating mouse movement between clients
     int cursorX, cursorY;
@@ -408,6 +461,20 @@ void XserverDesktop::blockHandler(int* timeout)
     int nextTimeout = core::Timer::checkTimeouts();
     if (nextTimeout >= 0 && (*timeout == -1 || nextTimeout < *timeout))
       *timeout = nextTimeout;
+
+    // Update existing NotifyFD to listen for write (or not), now that
+    // all output for this round has been produced
+    for (int fd : pendingNotify) {
+      std::map<int, network::Socket*>::iterator i;
+
+      i = sockets.find(fd);
+      if (i == sockets.end())
+        continue;
+
+      vncSetNotifyFd(fd, screenIndex, true,
+                     i->second->outStream().hasBufferedData());
+    }
+    pendingNotify.clear();
   } catch (std::exception& e) {
     vlog.error("XserverDesktop::blockHandler: %s", e.what());
   }
@@ -424,7 +491,7 @@ bool XserverDesktop::addClient(network::Socket* sock,
   if (!server->addSocket(sock, reverse, rights))
     return false;
 
-  vncSetNotifyFd(sock->getFd(), screenIndex, true, false);
+  watchSocket(sock);
 
   return true;
 }
@@ -533,18 +600,59 @@ void XserverDesktop::grabRegion(const core::Region& region)
   if (shadowFramebuffer == nullptr)
     return;
 
-  std::vector<core::Rect> rects;
-  std::vector<core::Rect>::iterator i;
-  region.get_rects(&rects);
-  for (i = rects.begin(); i != rects.end(); i++) {
+  struct timeval start, end;
+  std::vector<core::Rect> rects, bands;
+  core::Rect band;
+  int bandArea, pixels;
+
+  gettimeofday(&start, nullptr);
+
+  region.subtract(shadowCopied).get_rects(&rects);
+
+  bandArea = 0;
+  for (const core::Rect& rect : rects) {
+    core::Rect merged;
+
+    merged = band.union_boundary(rect);
+    if ((bandArea != 0) &&
+        (merged.area() <= (bandArea + rect.area()) * MaxBandOverhead)) {
+      band = merged;
+      bandArea += rect.area();
+      continue;
+    }
+
+    if (bandArea != 0)
+      bands.push_back(band);
+
+    band = rect;
+    bandArea = rect.area();
+  }
+  if (bandArea != 0)
+    bands.push_back(band);
+
+  pixels = 0;
+  for (const core::Rect& rect : bands) {
     uint8_t *buffer;
     int bufStride;
 
-    buffer = getBufferRW(*i, &bufStride);
-    vncGetScreenImage(screenIndex, i->tl.x, i->tl.y, i->width(), i->height(),
+    buffer = getBufferRW(rect, &bufStride);
+    vncGetScreenImage(screenIndex, rect.tl.x, rect.tl.y,
+                      rect.width(), rect.height(),
                       (char*)buffer, bufStride * format.bpp/8);
-    commitBufferRW(*i);
+    commitBufferRW(rect);
+
+    pixels += rect.area();
   }
+
+  shadowStale.assign_subtract(region);
+  shadowCopied.clear();
+
+  gettimeofday(&end, nullptr);
+
+  vlog.debug("Captured %d pixels in %d reads (%d rects) in %ld us",
+             pixels, (int)bands.size(), (int)rects.size(),
+             (end.tv_sec - start.tv_sec) * 1000000L +
+             (end.tv_usec - start.tv_usec));
 }
 
 void XserverDesktop::keyEvent(uint32_t keysym, uint32_t keycode, bool down)
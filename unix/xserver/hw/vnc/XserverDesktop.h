@@ -28,11 +28,15 @@
 #endif
 
 #include <map>
+#include <set>
 
 #include <stdint.h>
 
+#include <core/Region.h>
 #include <core/Timer.h>
 
+#include <rdr/BufferedOutStream.h>
+
 #include <rfb/SDesktop.h>
 #include <rfb/PixelBuffer.h>
 
@@ -47,7 +51,8 @@ namespace rfb {
 namespace network { class SocketListener; class Socket; }
 
 class XserverDesktop : public rfb::SDesktop, public rfb::FullFramePixelBuffer,
-                       public core::Timer::Callback {
+                       public core::Timer::Callback,
+                       public rdr::BufferedOutStream::Callback {
 public:
 
   XserverDesktop(int screenIndex,
@@ -113,15 +118,29 @@ public:
 protected:
   bool handleListenerEvent(int fd);
   bool handleSocketReadWrite(int fd, bool read, bool write);
+  void watchSocket(network::Socket* sock);
 
   void handleTimeout(core::Timer* t) override;
 
+  // rdr::BufferedOutStream callbacks
+  void bufferedDataChanged(rdr::BufferedOutStream* stream) override;
+
 private:
 
   int screenIndex;
   rfb::VNCServer* server;
   std::list<network::SocketListener*> listeners;
+  std::map<int, network::Socket*> sockets;
+  // Sockets that need to be removed in the next block handler
+  std::set<network::Socket*> closedSockets;
+  // Sockets whose write interest needs to be updated
+  std::set<int> pendingNotify;
   uint8_t* shadowFramebuffer;
+  // Parts of the shadow framebuffer that are out of date
+  core::Region shadowStale;
+  // Parts of the shadow framebuffer that have been updated by
+  // repeating a copy, and therefore don't need to be read back
+  core::Region shadowCopied;
 
   uint32_t queryConnectId;
   network::Socket* queryConnectSocket;
@@ -28,6 +28,7 @@
 #include <pwd.h>
 
 #include <string>
+#include <vector>
 
 #include <core/Configuration.h>
 #include <core/Logger_stdio.h>
@@ -291,8 +292,10 @@ void vncHandleSocketEvent(int fd, int scrIdx, int read, int write)
 
 void vncCallBlockHandlers(int* timeout)
 {
-  for (int scr = 0; scr < vncGetScreenCount(); scr++)
+  for (int scr = 0; scr < vncGetScreenCount(); scr++) {
+    vncHooksFlushChanged(scr);
     desktop[scr]->blockHandler(timeout);
+  }
 }
 
 int vncGetAvoidShiftNumLock(void)
@@ -410,10 +413,15 @@ void vncSetLEDState(unsigned long leds)
 void vncAddChanged(int scrIdx, int nRects,
                    const struct UpdateRect *rects)
 {
-  for (int i = 0;i < nRects;i++) {
-    desktop[scrIdx]->add_changed({{rects[i].x1, rects[i].y1,
-                                   rects[i].x2, rects[i].y2}});
-  }
+  std::vector<core::Rect> list;
+
+  list.reserve(nRects);
+  for (int i = 0;i < nRects;i++)
+    list.push_back({rects[i].x1, rects[i].y1, rects[i].x2, rects[i].y2});
+
+  // Merging in to the (big) tracked region is the expensive part, so
+  // build one region from everything and only do that once
+  desktop[scrIdx]->add_changed(core::Region(list));
 }
 
 void vncAddCopied(int scrIdx, int nRects,
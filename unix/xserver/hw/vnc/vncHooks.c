@@ -22,6 +22,8 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "vncHooks.h"
 #include "vncExtInit.h"
@@ -39,6 +41,7 @@
 #include "mipointrst.h"
 #include "picturestr.h"
 #include "randrstr.h"
+#include "servermd.h"
 
 #define DBGPRINT(x) //(fprintf x)
 
@@ -57,6 +60,15 @@
 typedef struct _vncHooksScreenRec {
   int                          ignoreHooks;
 
+  // Damage that hasn't been passed on yet
+  BoxPtr                       pendingBoxes;
+  int                          numPendingBoxes;
+  int                          maxPendingBoxes;
+
+  // Staging area for vncGetScreenImage()
+  char*                        imageBuffer;
+  size_t                       imageBufferSize;
+
   CloseScreenProcPtr           CloseScreen;
   CreateGCProcPtr              CreateGC;
   CopyWindowProcPtr            CopyWindow;
@@ -286,6 +298,13 @@ int vncHooksInit(int scrIdx)
 
   vncHooksScreen->ignoreHooks = 0;
 
+  vncHooksScreen->pendingBoxes = NULL;
+  vncHooksScreen->numPendingBoxes = 0;
+  vncHooksScreen->maxPendingBoxes = 0;
+
+  vncHooksScreen->imageBuffer = NULL;
+  vncHooksScreen->imageBufferSize = 0;
+
   wrap(vncHooksScreen, pScreen, CloseScreen, vncHooksCloseScreen);
   wrap(vncHooksScreen, pScreen, CreateGC, vncHooksCreateGC);
   wrap(vncHooksScreen, pScreen, CopyWindow, vncHooksCopyWindow);
@@ -334,19 +353,51 @@ void vncGetScreenImage(int scrIdx, int x, int y, int width, int height,
   ScreenPtr pScreen = screenInfo.screens[scrIdx];
   vncHooksScreenPtr vncHooksScreen = vncHooksScreenPrivate(pScreen);
 
+  DrawablePtr pDrawable;
+  int lineBytes, pixelBytes;
+  size_t needed;
   int i;
 
-  vncHooksScreen->ignoreHooks++;
+  pDrawable = (DrawablePtr) pScreen->root;
+
+  lineBytes = PixmapBytePad(width, pDrawable->depth);
+  pixelBytes = width * (pDrawable->bitsPerPixel / 8);
+  needed = (size_t)lineBytes * height;
 
-  // We do one line at a time since GetImage() cannot handle stride
-  for (i = y; i < y + height; i++) {
-    DrawablePtr pDrawable;
-    pDrawable = (DrawablePtr) pScreen->root;
+  vncHooksScreen->ignoreHooks++;
 
-    (*pScreen->GetImage) (pDrawable, x, i, width, 1,
+  // GetImage() cannot handle stride, and every call can be expensive
+  // with some drivers as it might have to wait for the GPU. So fetch
+  // the whole area at once and spread it out afterwards if needed.
+  if (lineBytes == strideBytes) {
+    (*pScreen->GetImage) (pDrawable, x, y, width, height,
                           ZPixmap, (unsigned long)~0L, buffer);
+  } else {
+    if (needed > vncHooksScreen->imageBufferSize) {
+      free(vncHooksScreen->imageBuffer);
+      vncHooksScreen->imageBuffer = malloc(needed);
+      vncHooksScreen->imageBufferSize =
+        vncHooksScreen->imageBuffer ? needed : 0;
+    }
+
+    if (vncHooksScreen->imageBuffer != NULL) {
+      (*pScreen->GetImage) (pDrawable, x, y, width, height,
+                            ZPixmap, (unsigned long)~0L,
+                            vncHooksScreen->imageBuffer);
 
-    buffer += strideBytes;
+      for (i = 0; i < height; i++) {
+        memcpy(buffer, vncHooksScreen->imageBuffer + i * lineBytes,
+               pixelBytes);
+        buffer += strideBytes;
+      }
+    } else {
+      // Out of memory, so fall back to one line at a time
+      for (i = y; i < y + height; i++) {
+        (*pScreen->GetImage) (pDrawable, x, i, width, 1,
+                              ZPixmap, (unsigned long)~0L, buffer);
+        buffer += strideBytes;
+      }
+    }
   }
 
   vncHooksScreen->ignoreHooks--;
@@ -357,16 +408,112 @@ void vncGetScreenImage(int scrIdx, int x, int y, int width, int height,
 // Helper functions
 //
 
+// Drawing operations often only touch a few pixels each, so rather
+// than merging every one of them in to the update tracker, the boxes
+// are collected here and handed over as a single region when the
+// server is about to go idle.
+
+#define MAX_PENDING_BOXES 4096
+
+static void flush_changed(ScreenPtr pScreen)
+{
+  vncHooksScreenPtr vncHooksScreen = vncHooksScreenPrivate(pScreen);
+  RegionRec reg;
+
+  if (vncHooksScreen->numPendingBoxes == 0)
+    return;
+
+  if (!RegionInitBoxes(&reg, vncHooksScreen->pendingBoxes,
+                       vncHooksScreen->numPendingBoxes)) {
+    // Out of memory, so just send the boxes as they are
+    vncAddChanged(pScreen->myNum, vncHooksScreen->numPendingBoxes,
+                  (const struct UpdateRect*)vncHooksScreen->pendingBoxes);
+  } else {
+    vncAddChanged(pScreen->myNum, RegionNumRects(&reg),
+                  (const struct UpdateRect*)RegionRects(&reg));
+  }
+
+  RegionUninit(&reg);
+
+  vncHooksScreen->numPendingBoxes = 0;
+}
+
+// Merges the pending boxes in place, returning FALSE if that didn't
+// free up enough room
+
+static Bool compact_changed(ScreenPtr pScreen)
+{
+  vncHooksScreenPtr vncHooksScreen = vncHooksScreenPrivate(pScreen);
+  RegionRec reg;
+  Bool ret;
+
+  if (!RegionInitBoxes(&reg, vncHooksScreen->pendingBoxes,
+                       vncHooksScreen->numPendingBoxes)) {
+    RegionUninit(&reg);
+    return FALSE;
+  }
+
+  ret = RegionNumRects(&reg) < vncHooksScreen->maxPendingBoxes / 2;
+  if (ret) {
+    memcpy(vncHooksScreen->pendingBoxes, RegionRects(&reg),
+           RegionNumRects(&reg) * sizeof(BoxRec));
+    vncHooksScreen->numPendingBoxes = RegionNumRects(&reg);
+  }
+
+  RegionUninit(&reg);
+
+  return ret;
+}
+
 static inline void add_changed(ScreenPtr pScreen, RegionPtr reg)
 {
   vncHooksScreenPtr vncHooksScreen = vncHooksScreenPrivate(pScreen);
+  int needed;
+
   if (vncHooksScreen->ignoreHooks)
     return;
   if (RegionNil(reg))
     return;
-  vncAddChanged(pScreen->myNum,
-                RegionNumRects(reg),
-                (const struct UpdateRect*)RegionRects(reg));
+
+  needed = vncHooksScreen->numPendingBoxes + RegionNumRects(reg);
+  if (needed > vncHooksScreen->maxPendingBoxes) {
+    if (needed <= MAX_PENDING_BOXES) {
+      BoxPtr boxes;
+      int size;
+
+      size = vncHooksScreen->maxPendingBoxes * 2;
+      if (size < 64)
+        size = 64;
+      while (size < needed)
+        size *= 2;
+      if (size > MAX_PENDING_BOXES)
+        size = MAX_PENDING_BOXES;
+
+      boxes = realloc(vncHooksScreen->pendingBoxes,
+                      size * sizeof(BoxRec));
+      if (boxes != NULL) {
+        vncHooksScreen->pendingBoxes = boxes;
+        vncHooksScreen->maxPendingBoxes = size;
+      }
+    }
+
+    if ((needed > vncHooksScreen->maxPendingBoxes) &&
+        !compact_changed(pScreen))
+      flush_changed(pScreen);
+
+    // Very complex region, or no memory
+    if (RegionNumRects(reg) > vncHooksScreen->maxPendingBoxes -
+                              vncHooksScreen->numPendingBoxes) {
+      vncAddChanged(pScreen->myNum,
+                    RegionNumRects(reg),
+                    (const struct UpdateRect*)RegionRects(reg));
+      return;
+    }
+  }
+
+  memcpy(vncHooksScreen->pendingBoxes + vncHooksScreen->numPendingBoxes,
+         RegionRects(reg), RegionNumRects(reg) * sizeof(BoxRec));
+  vncHooksScreen->numPendingBoxes += RegionNumRects(reg);
 }
 
 static inline void add_copied(ScreenPtr pScreen, RegionPtr dst,
@@ -377,6 +524,8 @@ static inline void add_copied(ScreenPtr pScreen, RegionPtr dst,
     return;
   if (RegionNil(dst))
     return;
+  // The copy has to be applied after anything drawn before it
+  flush_changed(pScreen);
   vncAddCopied(pScreen->myNum,
                RegionNumRects(dst),
                (const struct UpdateRect*)RegionRects(dst), dx, dy);
@@ -410,6 +559,16 @@ static inline Bool is_visible(DrawablePtr drawable)
   return TRUE;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// vncHooksFlushChanged() passes on any damage collected so far
+//
+
+void vncHooksFlushChanged(int scrIdx)
+{
+  flush_changed(screenInfo.screens[scrIdx]);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // screen functions
@@ -438,6 +597,15 @@ static Bool vncHooksCloseScreen(ScreenPtr pScreen_)
 
   SCREEN_PROLOGUE(pScreen_, CloseScreen);
 
+  free(vncHooksScreen->pendingBoxes);
+  vncHooksScreen->pendingBoxes = NULL;
+  vncHooksScreen->numPendingBoxes = 0;
+  vncHooksScreen->maxPendingBoxes = 0;
+
+  free(vncHooksScreen->imageBuffer);
+  vncHooksScreen->imageBuffer = NULL;
+  vncHooksScreen->imageBufferSize = 0;
+
   unwrap(vncHooksScreen, pScreen, CreateGC);
   unwrap(vncHooksScreen, pScreen, CopyWindow);
   unwrap(vncHooksScreen, pScreen, ClearToBackground);
@@ -1060,6 +1228,7 @@ static Bool vncHooksRandRSetConfig(ScreenPtr pScreen, Rotation rotation,
 
   RANDR_PROLOGUE(SetConfig);
 
+  flush_changed(pScreen);
   vncPreScreenResize(pScreen->myNum);
   ret = (*rp->rrSetConfig)(pScreen, rotation, rate, pSize);
   vncPostScreenResize(pScreen->myNum, ret, pScreen->width, pScreen->height);
@@ -1080,6 +1249,7 @@ static Bool vncHooksRandRScreenSetSize(ScreenPtr pScreen,
 
   RANDR_PROLOGUE(ScreenSetSize);
 
+  flush_changed(pScreen);
   vncPreScreenResize(pScreen->myNum);
   ret = (*rp->rrScreenSetSize)(pScreen, width, height, mmWidth, mmHeight);
   vncPostScreenResize(pScreen->myNum, ret, pScreen->width, pScreen->height);
@@ -28,6 +28,8 @@ int vncHooksInit(int scrIdx);
 void vncGetScreenImage(int scrIdx, int x, int y, int width, int height,
                        char *buffer, int strideBytes);
 
+void vncHooksFlushChanged(int scrIdx);
+
 #ifdef __cplusplus
 }
 #endif
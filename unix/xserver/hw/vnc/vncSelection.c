@@ -580,7 +580,6 @@ static void vncHandleSelection(Atom selection, Atom target,
         vncSelectionRequest(selection, xaSTRING);
     }
   } else if (target == xaSTRING) {
-    char* filtered;
     char* utf8;
 
     if (prop->format != 8)
@@ -588,12 +587,7 @@ static void vncHandleSelection(Atom selection, Atom target,
     if (prop->type != xaSTRING)
       return;
 
-    filtered = vncConvertLF(prop->data, prop->size);
-    if (filtered == NULL)
-      return;
-
-    utf8 = vncLatin1ToUTF8(filtered, (size_t)-1);
-    free(filtered);
+    utf8 = vncLatin1ToUTF8LF(prop->data, prop->size);
     if (utf8 == NULL)
       return;
 
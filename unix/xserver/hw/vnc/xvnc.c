@@ -41,6 +41,7 @@ from the X Consortium.
 #include "xorg-version.h"
 
 #include <stdio.h>
+#include <string.h>
 #ifdef HAVE_LIBXCVT
 #include <libxcvt/libxcvt.h>
 #endif
@@ -452,9 +453,14 @@ vncAllocateFramebufferMemory(VncFramebufferInfoPtr pfb)
     pfb->bitsPerPixel = vncBitsPerPixel(pfb->depth);
     pfb->paddedWidth = pfb->paddedBytesWidth * 8 / pfb->bitsPerPixel;
 
+    /* Rows might need further padding to suit the encoders */
+    pfb->paddedWidth = vncFramebufferStride(pfb->paddedWidth,
+                                            pfb->bitsPerPixel);
+    pfb->paddedBytesWidth = pfb->paddedWidth * pfb->bitsPerPixel / 8;
+
     /* And allocate buffer */
     sizeInBytes = pfb->paddedBytesWidth * pfb->height;
-    pfb->pfbMemory = malloc(sizeInBytes);
+    pfb->pfbMemory = vncAllocFramebuffer(sizeInBytes);
 
     /* This will be NULL if the above failed */
     return pfb->pfbMemory;
@@ -466,7 +472,7 @@ vncFreeFramebufferMemory(VncFramebufferInfoPtr pfb)
     if ((pfb == NULL) || (pfb->pfbMemory == NULL))
         return;
 
-    free(pfb->pfbMemory);
+    vncFreeFramebuffer(pfb->pfbMemory);
     pfb->pfbMemory = NULL;
 }
 
@@ -607,6 +613,27 @@ vncRandRScreenSetSize(ScreenPtr pScreen,
         return FALSE;
     }
 
+    /*
+     * Keep whatever still fits so that unchanged areas don't have to be
+     * repainted, or resent to VNC clients
+     */
+    if (vncScreenInfo.fb.pfbMemory != NULL) {
+        int y, rows, rowBytes;
+
+        rows = fb.height;
+        if (vncScreenInfo.fb.height < rows)
+            rows = vncScreenInfo.fb.height;
+        rowBytes = fb.paddedBytesWidth;
+        if (vncScreenInfo.fb.paddedBytesWidth < rowBytes)
+            rowBytes = vncScreenInfo.fb.paddedBytesWidth;
+
+        for (y = 0; y < rows; y++) {
+            memcpy((char *) pbits + y * fb.paddedBytesWidth,
+                   (char *) vncScreenInfo.fb.pfbMemory +
+                   y * vncScreenInfo.fb.paddedBytesWidth, rowBytes);
+        }
+    }
+
     /* Free the old framebuffer and keep the info about the new one */
     vncFreeFramebufferMemory(&vncScreenInfo.fb);
     vncScreenInfo.fb = fb;
@@ -23,10 +23,16 @@
 #endif
 
 #include <assert.h>
+#include <string.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/resource.h>
+#else
+#include <windows.h>
 #endif
 
+#include <algorithm>
+
 #include <core/LogWriter.h>
 #include <core/Timer.h>
 #include <core/string.h>
@@ -37,6 +43,7 @@
 
 #include <rfb/CMsgWriter.h>
 #include <rfb/CSecurity.h>
+#include <rfb/ClientParams.h>
 #include <rfb/Exception.h>
 #include <rfb/Security.h>
 #include <rfb/fenceTypes.h>
@@ -77,10 +84,38 @@ static const rfb::PixelFormat mediumColourPF(8, 8, false, true,
 // Time new bandwidth estimates are weighted against (in ms)
 static const unsigned bpsEstimateWindow = 1000;
 
+// Throughput where we switch to and from FastLossless (in bits/s). The
+// switch back is lower to avoid flipping back and forth.
+static const unsigned long long fastLosslessEnableBps = 200000000;
+static const unsigned long long fastLosslessDisableBps = 100000000;
+
+// How often automatic quality selection is reconsidered (in ms)
+static const unsigned qualityAdjustInterval = 1000;
+
+// Fence payload used to measure the round trip time
+static const uint8_t rttFenceData[] = { 'R', 'T', 'T' };
+
+// Fence payload used to find the update caused by an input event,
+// followed by a serial number, and how long (in ms) to wait for such
+// an update
+static const uint8_t latencyFenceData[] = { 'L', 'A', 'T' };
+static const unsigned latencyTimeout = 1000;
+
+// Number of latency samples kept for the histogram and summary
+static const size_t maxLatencySamples = 1000;
+
+// How often presentation statistics are logged (in ms)
+static const unsigned frameStatsInterval = 10000;
+
 CConn::CConn()
   : serverPort(0), sock(nullptr), desktop(nullptr),
     updateCount(0), pixelCount(0),
-    lastServerEncoding((unsigned int)-1), bpsEstimate(20000000)
+    lastServerEncoding((unsigned int)-1), bpsEstimate(20000000),
+    rttPending(false), latencyState(LatencyIdle),
+    latencyUnsupported(false), latencySerial(0), latencyNext(0),
+    latencyTimeouts(0),
+    presentPending(false), pendingUpdates(0), frameStatsCpu(0),
+    presentedFrames(0), mergedUpdates(0)
 {
   setShared(::shared);
 
@@ -94,15 +129,24 @@ CConn::CConn()
 
   setQualityLevel(::qualityLevel);
 
+  qualityControl.reset(bpsEstimate);
+  gettimeofday(&lastQualityAdjust, nullptr);
+
+  lastPresent.tv_sec = lastPresent.tv_usec = 0;
+  gettimeofday(&frameStatsStart, nullptr);
+
   OptionsDialog::addCallback(handleOptions, this);
 }
 
 CConn::~CConn()
 {
+  logLatency();
+
   close();
 
   OptionsDialog::removeCallback(handleOptions);
   Fl::remove_timeout(handleUpdateTimeout, this);
+  Fl::remove_timeout(handlePresentTimeout, this);
 
   if (desktop)
     delete desktop;
@@ -175,6 +219,12 @@ void CConn::connect(const char* vncServerName, network::Socket* socket)
 
   Fl::add_fd(sock->getFd(), FL_READ | FL_EXCEPT, socketEvent, this);
 
+#ifndef WIN32
+  // The server can only share memory with us if it is on this host
+  if (dynamic_cast<network::UnixSocket*>(sock) != nullptr)
+    supportsSharedMemory = true;
+#endif
+
   setServerName(serverHost.c_str());
   setStreams(&sock->inStream(), &sock->outStream());
 
@@ -242,6 +292,112 @@ unsigned CConn::getPosition()
   return sock->inStream().pos();
 }
 
+std::string CConn::autoSelectInfo()
+{
+  static const char* subsamplingNames[] = {
+    "4:4:4", "gray", "4:2:2", "4:2:0", "8X", "16X"
+  };
+  std::string info;
+
+  if (!autoSelect)
+    return "";
+
+  info = core::format("Q%d %s Z%d", qualityControl.getQuality(),
+                      subsamplingNames[qualityControl.getSubsampling()],
+                      qualityControl.getCompressLevel());
+  if (qualityControl.getRTT() != -1)
+    info += core::format(" %d ms", qualityControl.getRTT());
+
+  return info;
+}
+
+void CConn::inputSent()
+{
+  uint8_t data[sizeof(latencyFenceData) + 4];
+
+  if (!measureLatency || !server.supportsFence || latencyUnsupported)
+    return;
+
+  checkLatencyTimeout();
+  if (latencyState != LatencyIdle)
+    return;
+
+  // The serial number lets us ignore the responses for measurements
+  // we have already given up on
+  latencySerial++;
+  memcpy(data, latencyFenceData, sizeof(latencyFenceData));
+  memcpy(data + sizeof(latencyFenceData), &latencySerial, 4);
+
+  // The server will respond right after the update with the first
+  // changes that the input could have caused
+  writer()->writeFence(rfb::fenceFlagRequest | rfb::fenceFlagSyncDamage,
+                       sizeof(data), data);
+  gettimeofday(&latencyStart, nullptr);
+  latencyState = LatencyWaitFence;
+}
+
+void CConn::framePresented()
+{
+  unsigned sample;
+
+  checkLatencyTimeout();
+  if (latencyState != LatencyWaitDraw)
+    return;
+
+  sample = core::msSince(&latencyStart);
+  if (latencySamples.size() < maxLatencySamples)
+    latencySamples.push_back(sample);
+  else
+    latencySamples[latencyNext] = sample;
+  latencyNext = (latencyNext + 1) % maxLatencySamples;
+
+  latencyState = LatencyIdle;
+}
+
+void CConn::checkLatencyTimeout()
+{
+  if (latencyState == LatencyIdle)
+    return;
+
+  // Inputs that don't change anything will leave us waiting, so give
+  // up on those eventually rather than counting some later update
+  if (core::msSince(&latencyStart) < latencyTimeout)
+    return;
+
+  latencyState = LatencyIdle;
+  latencyTimeouts++;
+}
+
+const std::vector<unsigned>& CConn::getLatencySamples()
+{
+  return latencySamples;
+}
+
+void CConn::logLatency()
+{
+  std::vector<unsigned> sorted;
+  size_t count;
+
+  if (latencySamples.empty() && (latencyTimeouts == 0))
+    return;
+
+  if (latencyTimeouts != 0)
+    vlog.info(_("Input latency: %u inputs without any change"),
+              latencyTimeouts);
+
+  if (latencySamples.empty())
+    return;
+
+  sorted = latencySamples;
+  std::sort(sorted.begin(), sorted.end());
+  count = sorted.size();
+
+  vlog.info(_("Input latency: %d samples, min %u ms, median %u ms, "
+              "95th percentile %u ms, max %u ms"),
+            (int)count, sorted[0], sorted[count / 2],
+            sorted[count * 95 / 100], sorted[count - 1]);
+}
+
 void CConn::socketEvent(FL_SOCKET fd, void *data)
 {
   CConn *cc;
@@ -343,6 +499,8 @@ void CConn::initDone()
 
   // Force a switch to the format and encoding we'd like
   updateEncoding();
+  updateCompressLevel();
+  updateQualityLevel();
   updatePixelFormat();
 }
 
@@ -375,6 +533,10 @@ void CConn::framebufferUpdateStart()
   gettimeofday(&updateStartTime, nullptr);
   updateStartPos = sock->inStream().pos();
 
+  // For quality selection
+  updateStartPixels = pixelCount;
+  updateStartDecodeTime = getDecodeTime();
+
   // Update the screen prematurely for very slow updates
   Fl::add_timeout(1.0, handleUpdateTimeout, this);
 }
@@ -410,11 +572,17 @@ void CConn::framebufferUpdateEnd()
                  (bps * weight)) / 1000000;
 
   Fl::remove_timeout(handleUpdateTimeout, this);
-  desktop->updateWindow();
+
+  qualityControl.updateDone(elapsed, pixelCount - updateStartPixels,
+                            getDecodeTime() - updateStartDecodeTime);
+
+  presentUpdate();
 
   // Compute new settings based on updated bandwidth values
   if (autoSelect) {
+    adjustQuality();
     updateEncoding();
+    updateCompressLevel();
     updateQualityLevel();
     updatePixelFormat();
   }
@@ -477,6 +645,45 @@ void CConn::handleClipboardData(const char* data)
   desktop->handleClipboardData(data);
 }
 
+void CConn::fence(uint32_t flags, unsigned len, const uint8_t data[])
+{
+  CConnection::fence(flags, len, data);
+
+  if (flags & rfb::fenceFlagRequest)
+    return;
+
+  if ((len == sizeof(latencyFenceData) + 4) &&
+      (memcmp(data, latencyFenceData, sizeof(latencyFenceData)) == 0)) {
+    uint32_t serial;
+
+    memcpy(&serial, data + sizeof(latencyFenceData), 4);
+    if ((latencyState != LatencyWaitFence) || (serial != latencySerial))
+      return;
+
+    if (!(flags & rfb::fenceFlagSyncDamage)) {
+      vlog.error(_("The server cannot mark updates caused by input, so "
+                   "input latency cannot be measured"));
+      latencyUnsupported = true;
+      latencyState = LatencyIdle;
+      return;
+    }
+
+    // The update is already done, but might still be waiting to be
+    // shown
+    if (presentPending)
+      latencyState = LatencyWaitPresent;
+    else
+      latencyState = LatencyWaitDraw;
+    return;
+  }
+
+  if ((len == sizeof(rttFenceData)) &&
+      (memcmp(data, rttFenceData, len) == 0) && rttPending) {
+    qualityControl.gotRTT(core::msSince(&rttStart));
+    rttPending = false;
+  }
+}
+
 
 ////////////////////// Internal methods //////////////////////
 
@@ -489,9 +696,21 @@ void CConn::updateEncoding()
 {
   int encNum;
 
-  if (autoSelect)
-    encNum = rfb::encodingTight;
-  else
+  if (autoSelect) {
+    // On a fast enough network, CPU time is the bottleneck rather
+    // than bandwidth, so prefer the fast lossless encoding
+    encNum = getPreferredEncoding();
+    if (bpsEstimate > fastLosslessEnableBps)
+      encNum = rfb::encodingFastLossless;
+    else if ((encNum != rfb::encodingFastLossless) ||
+             (bpsEstimate < fastLosslessDisableBps))
+      encNum = rfb::encodingTight;
+
+    if (encNum != getPreferredEncoding()) {
+      vlog.info(_("Throughput %d kbit/s - changing to %s encoding"),
+                (int)(bpsEstimate/1000), rfb::encodingName(encNum));
+    }
+  } else
     encNum = rfb::encodingNum(::preferredEncoding.getValueStr().c_str());
 
   if (encNum != -1)
@@ -502,33 +721,54 @@ void CConn::updateCompressLevel()
 {
   if (customCompressLevel)
     setCompressLevel(::compressLevel);
+  else if (autoSelect)
+    setCompressLevel(qualityControl.getCompressLevel());
   else
     setCompressLevel(-1);
 }
 
 void CConn::updateQualityLevel()
 {
-  int newQualityLevel;
+  if (!autoSelect) {
+    setQualityLevel(::qualityLevel);
+    setFineQualityLevel(-1, rfb::subsampleUndefined);
+    return;
+  }
 
-  if (!autoSelect)
-    newQualityLevel = ::qualityLevel;
-  else {
-    // Above 16Mbps (i.e. LAN), we choose the second highest JPEG
-    // quality, which should be perceptually lossless. If the bandwidth
-    // is below that, we choose a more lossy JPEG quality.
-
-    if (bpsEstimate > 16000000)
-      newQualityLevel = 8;
-    else
-      newQualityLevel = 6;
+  // The coarse level is for servers that don't understand the fine
+  // quality settings
+  setQualityLevel(qualityControl.getQualityLevel());
+  setFineQualityLevel(qualityControl.getQuality(),
+                      qualityControl.getSubsampling());
+}
 
-    if (newQualityLevel != getQualityLevel()) {
-      vlog.info(_("Throughput %d kbit/s - changing to quality %d"),
-                (int)(bpsEstimate/1000), newQualityLevel);
-    }
+void CConn::adjustQuality()
+{
+  unsigned elapsed;
+
+  // Keep a round trip measurement going in the background
+  if (server.supportsFence && !rttPending) {
+    writer()->writeFence(rfb::fenceFlagRequest,
+                         sizeof(rttFenceData), rttFenceData);
+    gettimeofday(&rttStart, nullptr);
+    rttPending = true;
   }
 
-  setQualityLevel(newQualityLevel);
+  elapsed = core::msSince(&lastQualityAdjust);
+  if (elapsed < qualityAdjustInterval)
+    return;
+
+  gettimeofday(&lastQualityAdjust, nullptr);
+
+  if (!qualityControl.adjust(elapsed))
+    return;
+
+  vlog.info(_("Load %u%%, %u%% decoding (%u ns/pixel), %u updates/s - "
+              "%s"),
+            qualityControl.getLoad(), qualityControl.getDecodeShare(),
+            qualityControl.getDecodeCost(),
+            qualityControl.getFrameRate(), qualityControl.getReason());
+  vlog.info(_("Changing to %s"), autoSelectInfo().c_str());
 }
 
 void CConn::updatePixelFormat()
@@ -591,6 +831,113 @@ void CConn::handleOptions(void *data)
   self->updatePixelFormat();
 }
 
+// presentUpdate() shows a finished update on screen, but never more
+// often than the frame rate limit. Updates that arrive faster than
+// that are merged in to the next frame.
+void CConn::presentUpdate()
+{
+  unsigned long long interval, elapsed;
+  struct timeval now;
+
+  pendingUpdates++;
+
+  if (presentPending)
+    return;
+
+  if (maxFrameRate == 0) {
+    presentFrame();
+    return;
+  }
+
+  interval = 1000000 / maxFrameRate;
+
+  gettimeofday(&now, nullptr);
+  elapsed = (now.tv_sec - lastPresent.tv_sec) * 1000000ULL;
+  elapsed += now.tv_usec - lastPresent.tv_usec;
+
+  if (elapsed >= interval) {
+    presentFrame();
+    return;
+  }
+
+  presentPending = true;
+  Fl::add_timeout((double)(interval - elapsed) / 1000000.0,
+                  handlePresentTimeout, this);
+}
+
+static unsigned long long getCpuTime()
+{
+#ifdef _WIN32
+  FILETIME dummy1, dummy2, kernelTime, userTime;
+  ULARGE_INTEGER kernel, user;
+
+  GetProcessTimes(GetCurrentProcess(), &dummy1, &dummy2,
+                  &kernelTime, &userTime);
+
+  kernel.LowPart = kernelTime.dwLowDateTime;
+  kernel.HighPart = kernelTime.dwHighDateTime;
+  user.LowPart = userTime.dwLowDateTime;
+  user.HighPart = userTime.dwHighDateTime;
+
+  // 100 ns units
+  return (kernel.QuadPart + user.QuadPart) / 10;
+#else
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+void CConn::presentFrame()
+{
+  bool changed;
+  unsigned elapsed;
+  unsigned long long cpu;
+
+  Fl::remove_timeout(handlePresentTimeout, this);
+  presentPending = false;
+
+  changed = desktop->updateWindow();
+  gettimeofday(&lastPresent, nullptr);
+
+  checkLatencyTimeout();
+  if ((latencyState == LatencyWaitPresent) && changed)
+    latencyState = LatencyWaitDraw;
+
+  presentedFrames++;
+  mergedUpdates += pendingUpdates - 1;
+  pendingUpdates = 0;
+
+  elapsed = core::msSince(&frameStatsStart);
+  if (elapsed < frameStatsInterval)
+    return;
+
+  cpu = getCpuTime();
+  if (frameStatsCpu != 0) {
+    vlog.debug("%u frames in %u ms (%u updates merged), "
+               "%llu us CPU per frame", presentedFrames, elapsed,
+               mergedUpdates,
+               (cpu - frameStatsCpu) / presentedFrames);
+  }
+
+  gettimeofday(&frameStatsStart, nullptr);
+  frameStatsCpu = cpu;
+  presentedFrames = 0;
+  mergedUpdates = 0;
+}
+
+void CConn::handlePresentTimeout(void *data)
+{
+  CConn *self = (CConn *)data;
+
+  assert(self);
+
+  self->presentFrame();
+}
+
 void CConn::handleUpdateTimeout(void *data)
 {
   CConn *self = (CConn *)data;
@@ -20,9 +20,12 @@
 #ifndef __CCONN_H__
 #define __CCONN_H__
 
+#include <vector>
+
 #include <FL/Fl.H>
 
 #include <rfb/CConnection.h>
+#include <rfb/QualityControl.h>
 
 #include "UserDialog.h"
 
@@ -44,6 +47,18 @@ public:
   unsigned getPixelCount();
   unsigned getPosition();
 
+  // Short description of the automatically selected settings, or an
+  // empty string if they are not automatically selected
+  std::string autoSelectInfo();
+
+  // Latency measurement (if enabled). inputSent() should be called
+  // after a key or button press has been sent, and framePresented()
+  // once the window has been redrawn. The samples are in milliseconds,
+  // and only the most recent ones are kept.
+  void inputSent();
+  void framePresented();
+  const std::vector<unsigned>& getLatencySamples();
+
 protected:
 
   // Callback when socket is ready (or broken)
@@ -83,6 +98,8 @@ protected:
   void handleClipboardAnnounce(bool available) override;
   void handleClipboardData(const char* data) override;
 
+  void fence(uint32_t flags, unsigned len, const uint8_t data[]) override;
+
 private:
 
   void resizeFramebuffer() override;
@@ -92,6 +109,15 @@ private:
   void updateQualityLevel();
   void updatePixelFormat();
 
+  void adjustQuality();
+
+  void checkLatencyTimeout();
+  void logLatency();
+
+  void presentUpdate();
+  void presentFrame();
+  static void handlePresentTimeout(void *data);
+
   static void handleOptions(void *data);
 
   static void handleUpdateTimeout(void *data);
@@ -112,8 +138,32 @@ private:
 
   struct timeval updateStartTime;
   size_t updateStartPos;
+  unsigned updateStartPixels;
+  unsigned long long updateStartDecodeTime;
   unsigned long long bpsEstimate;
 
+  rfb::QualityControl qualityControl;
+  struct timeval lastQualityAdjust;
+  bool rttPending;
+  struct timeval rttStart;
+
+  enum { LatencyIdle, LatencyWaitFence, LatencyWaitPresent,
+         LatencyWaitDraw } latencyState;
+  bool latencyUnsupported;
+  uint32_t latencySerial;
+  struct timeval latencyStart;
+  std::vector<unsigned> latencySamples;
+  size_t latencyNext;
+  unsigned latencyTimeouts;
+
+  struct timeval lastPresent;
+  bool presentPending;
+  unsigned pendingUpdates;
+  struct timeval frameStatsStart;
+  unsigned long long frameStatsCpu;
+  unsigned presentedFrames;
+  unsigned mergedUpdates;
+
   UserDialog dlg;
 };
 
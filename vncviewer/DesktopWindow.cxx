@@ -228,7 +228,8 @@ DesktopWindow::DesktopWindow(int w, int h, CConn* cc_)
   repositionWidgets();
 
   // Throughput graph for debugging
-  if (vlog.getLevel() >= core::LogWriter::LEVEL_DEBUG) {
+  if ((vlog.getLevel() >= core::LogWriter::LEVEL_DEBUG) ||
+      measureLatency) {
     memset(&stats, 0, sizeof(stats));
     Fl::add_timeout(0, handleStatsTimeout, this);
   }
@@ -348,14 +349,14 @@ void DesktopWindow::updateCaption()
 // Copy the areas of the framebuffer that have been changed (damaged)
 // to the displayed window.
 
-void DesktopWindow::updateWindow()
+bool DesktopWindow::updateWindow()
 {
   if (firstUpdate) {
     firstUpdate = false;
     remoteResize();
   }
 
-  viewport->updateWindow();
+  return viewport->updateWindow();
 }
 
 
@@ -511,6 +512,29 @@ void DesktopWindow::draw()
     X = Y = 0;
   else
     fl_clip_box(0, 0, W, H, X, Y, W, H);
+
+  // If it is only the framebuffer that has changed, and nothing needs
+  // to be composited on top of it, then we can skip the offscreen
+  // surface and copy it straight to the window
+  if (!redraw && overlays.empty()) {
+    core::Rect damaged, graph;
+
+    damaged.setXYWH(X, Y, W, H);
+    if (statsGraph)
+      graph.setXYWH(w() - statsGraph->width() - 30,
+                    h() - statsGraph->height() - 30,
+                    statsGraph->width(), statsGraph->height());
+
+    if (!damaged.overlaps(graph)) {
+      update_child(*viewport);
+      update_child(*hscroll);
+      update_child(*vscroll);
+
+      cc->framePresented();
+      return;
+    }
+  }
+
   fl_push_no_clip();
   fl_push_clip(X, Y, W, H);
 
@@ -630,6 +654,8 @@ void DesktopWindow::draw()
     update_child(*hscroll);
     update_child(*vscroll);
   }
+
+  cc->framePresented();
 }
 
 
@@ -1734,10 +1760,14 @@ void DesktopWindow::handleStatsTimeout(void *data)
   unsigned updates, pixels, pos;
   unsigned elapsed;
 
+  static const unsigned latencyLimits[] = { 10, 20, 50, 100, 200, 500 };
+  const size_t latencyBuckets = sizeof(latencyLimits)/sizeof(latencyLimits[0]) + 1;
+
   const unsigned statsWidth = 200;
-  const unsigned statsHeight = 100;
+  const unsigned latencyHeight = measureLatency ? 40 : 0;
+  const unsigned statsHeight = 100 + latencyHeight;
   const unsigned graphWidth = statsWidth - 10;
-  const unsigned graphHeight = statsHeight - 25;
+  const unsigned graphHeight = statsHeight - latencyHeight - 25;
 
   Fl_Image_Surface *surface;
   Fl_RGB_Image *image;
@@ -1822,15 +1852,56 @@ void DesktopWindow::handleStatsTimeout(void *data)
 
   fl_color(FL_GREEN);
   snprintf(buffer, sizeof(buffer), "%u upd/s", self->stats[statsCount-1].ups);
-  fl_draw(buffer, 5, statsHeight - 5);
+  fl_draw(buffer, 5, statsHeight - latencyHeight - 5);
 
   fl_color(FL_YELLOW);
   fl_draw(core::siPrefix(self->stats[statsCount-1].pps, "pix/s").c_str(),
-          5 + (statsWidth-10)/3, statsHeight - 5);
+          5 + (statsWidth-10)/3, statsHeight - latencyHeight - 5);
 
   fl_color(FL_RED);
   fl_draw(core::siPrefix(self->stats[statsCount-1].bps * 8, "bps").c_str(),
-          5 + (statsWidth-10)*2/3, statsHeight - 5);
+          5 + (statsWidth-10)*2/3, statsHeight - latencyHeight - 5);
+
+  // Input latency histogram, in ms
+  if (measureLatency) {
+    unsigned buckets[latencyBuckets];
+    unsigned maxBucket;
+
+    const unsigned barTop = statsHeight - latencyHeight;
+    const unsigned barWidth = graphWidth / latencyBuckets;
+    const unsigned barHeight = latencyHeight - 15;
+
+    memset(buckets, 0, sizeof(buckets));
+    for (unsigned sample : self->cc->getLatencySamples()) {
+      for (i = 0;i < latencyBuckets-1;i++) {
+        if (sample < latencyLimits[i])
+          break;
+      }
+      buckets[i]++;
+    }
+
+    maxBucket = *std::max_element(buckets, buckets + latencyBuckets);
+
+    for (i = 0;i < latencyBuckets;i++) {
+      unsigned height;
+
+      height = maxBucket ? barHeight * buckets[i] / maxBucket : 0;
+
+      fl_color(FL_CYAN);
+      fl_rectf(5 + i * barWidth + 1, barTop + barHeight - height,
+               barWidth - 2, height);
+
+      if (i < latencyBuckets-1)
+        snprintf(buffer, sizeof(buffer), "<%u", latencyLimits[i]);
+      else
+        snprintf(buffer, sizeof(buffer), "%u+", latencyLimits[i-1]);
+      fl_color(FL_WHITE);
+      fl_draw(buffer, 5 + i * barWidth + 1, statsHeight - 3);
+    }
+  }
+
+  fl_color(FL_WHITE);
+  fl_draw(self->cc->autoSelectInfo().c_str(), 8, 16);
 
   image = surface->image();
   delete surface;
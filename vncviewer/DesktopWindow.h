@@ -45,8 +45,8 @@ public:
   // Most efficient format (from DesktopWindow's point of view)
   const rfb::PixelFormat &getPreferredPF();
 
-  // Flush updates to screen
-  void updateWindow();
+  // Flush updates to screen, returns false if nothing had changed
+  bool updateWindow();
 
   // Updated session title
   void updateCaption();
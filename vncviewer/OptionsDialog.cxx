@@ -176,6 +176,8 @@ void OptionsDialog::loadOptions(void)
     jpegButton->setonly();
   else if (preferredEncoding == "ZRLE")
     zrleButton->setonly();
+  else if (preferredEncoding == "FastLossless")
+    fastLosslessButton->setonly();
   else if (preferredEncoding == "Hextile")
     hextileButton->setonly();
 #ifdef HAVE_H264
@@ -379,6 +381,8 @@ void OptionsDialog::storeOptions(void)
     preferredEncoding.setParam(rfb::encodingName(rfb::encodingJPEG));
   else if (zrleButton->value())
     preferredEncoding.setParam(rfb::encodingName(rfb::encodingZRLE));
+  else if (fastLosslessButton->value())
+    preferredEncoding.setParam(rfb::encodingName(rfb::encodingFastLossless));
   else if (hextileButton->value())
     preferredEncoding.setParam(rfb::encodingName(rfb::encodingHextile));
 #ifdef HAVE_H264
@@ -593,6 +597,13 @@ void OptionsDialog::createCompressionPage(int tx, int ty, int tw, int th)
     zrleButton->type(FL_RADIO_BUTTON);
     ty += RADIO_HEIGHT + TIGHT_MARGIN;
 
+    fastLosslessButton = new Fl_Round_Button(LBLRIGHT(tx, ty,
+                                                      RADIO_MIN_WIDTH,
+                                                      RADIO_HEIGHT,
+                                                      "FastLossless"));
+    fastLosslessButton->type(FL_RADIO_BUTTON);
+    ty += RADIO_HEIGHT + TIGHT_MARGIN;
+
     hextileButton = new Fl_Round_Button(LBLRIGHT(tx, ty,
                                                  RADIO_MIN_WIDTH,
                                                  RADIO_HEIGHT,
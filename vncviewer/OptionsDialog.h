@@ -89,6 +89,7 @@ protected:
   Fl_Round_Button *tightButton;
   Fl_Round_Button *jpegButton;
   Fl_Round_Button *zrleButton;
+  Fl_Round_Button *fastLosslessButton;
   Fl_Round_Button *hextileButton;
 #ifdef HAVE_H264
   Fl_Round_Button *h264Button;
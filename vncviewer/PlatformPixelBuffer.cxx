@@ -43,7 +43,7 @@ PlatformPixelBuffer::PlatformPixelBuffer(int width, int height) :
   FullFramePixelBuffer(rfb::PixelFormat(32, 24, false, true,
                                         255, 255, 255, 16, 8, 0),
                        0, 0, nullptr, 0),
-  Surface(width, height)
+  Surface(width, height), damage(width, height)
 #if !defined(WIN32) && !defined(__APPLE__)
   , shminfo(nullptr), xim(nullptr)
 #endif
@@ -94,19 +94,14 @@ PlatformPixelBuffer::~PlatformPixelBuffer()
 void PlatformPixelBuffer::commitBufferRW(const core::Rect& r)
 {
   FullFramePixelBuffer::commitBufferRW(r);
-  mutex.lock();
-  damage.assign_union(r);
-  mutex.unlock();
+  damage.add(r);
 }
 
 core::Rect PlatformPixelBuffer::getDamage(void)
 {
   core::Rect r;
 
-  mutex.lock();
-  r = damage.get_bounding_rect();
-  damage.clear();
-  mutex.unlock();
+  r = damage.take();
 
 #if !defined(WIN32) && !defined(__APPLE__)
   if (r.width() == 0 || r.height() == 0)
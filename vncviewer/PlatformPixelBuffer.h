@@ -26,14 +26,12 @@
 #include <X11/extensions/XShm.h>
 #endif
 
-#include <list>
-#include <mutex>
-
-#include <core/Region.h>
+#include <core/Rect.h>
 
 #include <rfb/PixelBuffer.h>
 
 #include "Surface.h"
+#include "TileDamage.h"
 
 class PlatformPixelBuffer: public rfb::FullFramePixelBuffer, public Surface {
 public:
@@ -48,8 +46,7 @@ public:
   using rfb::FullFramePixelBuffer::height;
 
 protected:
-  std::mutex mutex;
-  core::Region damage;
+  TileDamage damage;
 
 #if !defined(WIN32) && !defined(__APPLE__)
 protected:
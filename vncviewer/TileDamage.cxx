@@ -0,0 +1,127 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <limits.h>
+
+#include "TileDamage.h"
+
+TileDamage::TileDamage(int width_, int height_)
+  : width(width_), height(height_)
+{
+  int tilesWide;
+
+  tilesWide = (width + (1 << tileShift) - 1) >> tileShift;
+  stride = (tilesWide + 63) / 64;
+  rows = (height + (1 << tileShift) - 1) >> tileShift;
+  tiles = new std::atomic<uint64_t>[stride * rows];
+  for (int i = 0; i < stride * rows; i++)
+    tiles[i].store(0, std::memory_order_relaxed);
+}
+
+TileDamage::~TileDamage()
+{
+  delete [] tiles;
+}
+
+void TileDamage::add(const core::Rect& r)
+{
+  int x1, y1, x2, y2;
+
+  if (r.is_empty())
+    return;
+
+  // Inclusive tile coordinates
+  x1 = r.tl.x >> tileShift;
+  y1 = r.tl.y >> tileShift;
+  x2 = (r.br.x - 1) >> tileShift;
+  y2 = (r.br.y - 1) >> tileShift;
+
+  for (int y = y1; y <= y2; y++) {
+    std::atomic<uint64_t>* row;
+
+    row = tiles + y * stride;
+
+    for (int word = x1 / 64; word <= x2 / 64; word++) {
+      uint64_t mask;
+
+      mask = ~(uint64_t)0;
+      if (word == x1 / 64)
+        mask &= ~(uint64_t)0 << (x1 % 64);
+      if (word == x2 / 64)
+        mask &= ~(uint64_t)0 >> (63 - x2 % 64);
+
+      // Release so that whoever picks up the damage also sees the
+      // pixels
+      row[word].fetch_or(mask, std::memory_order_release);
+    }
+  }
+}
+
+core::Rect TileDamage::take()
+{
+  core::Rect r;
+  int x1, y1, x2, y2;
+
+  x1 = y1 = INT_MAX;
+  x2 = y2 = -1;
+
+  for (int y = 0; y < rows; y++) {
+    std::atomic<uint64_t>* row;
+
+    row = tiles + y * stride;
+
+    for (int word = 0; word < stride; word++) {
+      uint64_t bits;
+      int first, last;
+
+      if (row[word].load(std::memory_order_relaxed) == 0)
+        continue;
+
+      bits = row[word].exchange(0, std::memory_order_acquire);
+      if (bits == 0)
+        continue;
+
+      first = 0;
+      while (!(bits & ((uint64_t)1 << first)))
+        first++;
+      last = 63;
+      while (!(bits & ((uint64_t)1 << last)))
+        last--;
+
+      if (word * 64 + first < x1)
+        x1 = word * 64 + first;
+      if (word * 64 + last > x2)
+        x2 = word * 64 + last;
+      if (y < y1)
+        y1 = y;
+      y2 = y;
+    }
+  }
+
+  if (x2 >= 0) {
+    r.setXYWH(x1 << tileShift, y1 << tileShift,
+              (x2 - x1 + 1) << tileShift, (y2 - y1 + 1) << tileShift);
+    r = r.intersect({0, 0, width, height});
+  }
+
+  return r;
+}
@@ -0,0 +1,53 @@
+/* Copyright (C) 2026 TigerVNC Team
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef __TILEDAMAGE_H__
+#define __TILEDAMAGE_H__
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <core/Rect.h>
+
+// TileDamage keeps track of changed areas as one bit per tile, so that
+// several decoder threads can mark them without having to lock
+// anything
+
+class TileDamage {
+public:
+  TileDamage(int width, int height);
+  ~TileDamage();
+
+  // add() marks every tile that the rectangle touches as changed. It
+  // may be called from any number of threads at once.
+  void add(const core::Rect& r);
+
+  // take() returns the bounding box of all changed tiles, clipped to
+  // the size, and marks them as unchanged again.
+  core::Rect take();
+
+  static const int tileShift = 4;
+
+private:
+  int width, height;
+  int stride, rows;
+  std::atomic<uint64_t>* tiles;
+};
+
+#endif
@@ -183,12 +183,17 @@ const rfb::PixelFormat &Viewport::getPreferredPF()
 // Copy the areas of the framebuffer that have been changed (damaged)
 // to the displayed window.
 
-void Viewport::updateWindow()
+bool Viewport::updateWindow()
 {
   core::Rect r;
 
   r = frameBuffer->getDamage();
+  if (r.is_empty())
+    return false;
+
   damage(FL_DAMAGE_USER1, r.tl.x + x(), r.tl.y + y(), r.width(), r.height());
+
+  return true;
 }
 
 static const char * dotcursor_xpm[] = {
@@ -431,7 +436,7 @@ int Viewport::handle(int event)
 
   switch (event) {
   case FL_PASTE:
-    if (!core::isValidUTF8(Fl::event_text(), Fl::event_length())) {
+    if (!core::utf8ToLF(Fl::event_text(), Fl::event_length(), &filtered)) {
       vlog.error("Invalid UTF-8 sequence in system clipboard");
       // Reset the state as if we don't have any clipboard data at all
       this->pendingClientClipboard = false;
@@ -444,8 +449,6 @@ int Viewport::handle(int event)
       return 1;
     }
 
-    filtered = core::convertLF(Fl::event_text(), Fl::event_length());
-
     vlog.debug("Sending clipboard data (%d bytes)", (int)filtered.size());
 
     try {
@@ -554,6 +557,8 @@ void Viewport::sendPointerEvent(const core::Point& pos,
   if ((pointerEventInterval == 0) || (buttonMask != lastButtonMask)) {
     try {
       cc->writer()->writePointerEvent(pos, buttonMask);
+      if (buttonMask & ~lastButtonMask)
+        cc->inputSent();
     } catch (std::exception& e) {
       vlog.error("%s", e.what());
       abort_connection_with_unexpected_error(e);
@@ -823,6 +828,7 @@ void Viewport::sendKeyPress(int systemKeyCode,
 
   try {
     cc->sendKeyPress(systemKeyCode, keyCode, keySym);
+    cc->inputSent();
   } catch (std::exception& e) {
     vlog.error("%s", e.what());
     abort_connection_with_unexpected_error(e);
@@ -46,8 +46,8 @@ public:
   // Most efficient format (from Viewport's point of view)
   const rfb::PixelFormat &getPreferredPF();
 
-  // Flush updates to screen
-  void updateWindow();
+  // Flush updates to screen, returns false if nothing had changed
+  bool updateWindow();
 
   // New image for the locally rendered cursor
   void setCursor();
@@ -57,6 +57,11 @@ core::IntParameter
                        "Time in milliseconds to rate-limit successive "
                        "pointer events",
                        17, 0, INT_MAX);
+core::IntParameter
+  maxFrameRate("MaxFrameRate",
+               "Maximum number of times per second the screen is "
+               "redrawn with new updates, or 0 for no limit",
+               60, 0, 1000);
 core::BoolParameter
   emulateMiddleButton("EmulateMiddleButton",
                       "Emulate middle mouse button by pressing left "
@@ -90,6 +95,12 @@ core::BoolParameter
                    "exiting immediately and ask for a reconnect.",
                    true);
 
+core::BoolParameter
+  measureLatency("MeasureLatency",
+                 "Measure the time from a key or button press until "
+                 "the resulting screen update is shown",
+                 false);
+
 core::StringParameter
   passwordFile("PasswordFile",
                "Password file for VNC authentication",
@@ -117,12 +128,12 @@ core::AliasParameter
 core::EnumParameter
   preferredEncoding("PreferredEncoding",
                     "Preferred encoding to use (Tight, JPEG, ZRLE, "
-                    "Hextile, "
+                    "FastLossless, Hextile, "
 #ifdef HAVE_H264
                     "H.264, "
 #endif
                     "or Raw)",
-                    {"Tight", "JPEG", "ZRLE", "Hextile",
+                    {"Tight", "JPEG", "ZRLE", "FastLossless", "Hextile",
 #ifdef HAVE_H264
                      "H.264",
 #endif
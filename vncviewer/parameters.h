@@ -33,6 +33,7 @@
 
 
 extern core::IntParameter pointerEventInterval;
+extern core::IntParameter maxFrameRate;
 extern core::BoolParameter emulateMiddleButton;
 extern core::BoolParameter dotWhenNoCursor; // deprecated
 extern core::BoolParameter alwaysCursor;
@@ -77,6 +78,7 @@ extern core::EnumListParameter shortcutModifiers;
 extern core::BoolParameter fullscreenSystemKeys;
 extern core::BoolParameter alertOnFatalError;
 extern core::BoolParameter reconnectOnError;
+extern core::BoolParameter measureLatency;
 
 #ifndef WIN32
 extern core::StringParameter via;